@@ -6,15 +6,30 @@ from the C code.
 
 """
 
-# cython: c_string_type=str, c_string_encoding=ascii
+# cython: c_string_type=str, c_string_encoding=ascii, freethreading_compatible=True
 
 from libcpp cimport bool
+from libc.stdint cimport int8_t, int32_t, int64_t, uint16_t, uint32_t, uintptr_t
+from libc.stdlib cimport malloc, free
+from libc.string cimport memcpy
 from cython.operator cimport dereference
+from cpython.buffer cimport PyBuffer_FillInfo
+from cpython.ref cimport PyObject, Py_INCREF
+cimport cython
 from ctypes import c_int, c_long, c_float, c_double
 
+import os
+import asyncio
+import collections
+import gzip
+import socket
+import struct
+import threading
+
 import numpy as np
 cimport numpy as np
 np.import_array()
+np.import_ufunc()
 import pandas as pd
 
 cimport codonwlib
@@ -25,7 +40,10 @@ def convert_char(arr):
 ref_codons = convert_char(codonwlib.amino_acids.cod)
 ref_aa1 = convert_char(codonwlib.amino_acids.aa1)
 ref_aa3 = convert_char(codonwlib.amino_acids.aa3)
+ref_metrics = [codonwlib.metric_names[i].decode('UTF-8') for i in range(codonwlib.NUM_METRICS)]
 
+# For users only: nothing in this module reads these, so a copy changed by
+# one thread cannot affect indices computed in another
 aa1_aa3 = pd.Series(index=ref_aa1, data=ref_aa3)
 aa3_aa1 = pd.Series(index=ref_aa3, data=ref_aa1)
 
@@ -40,6 +58,118 @@ def get_reference_code(idx):
     cseq = CodonSeq("ATG", idx)
     return cseq.genetic_code
 
+
+cdef class _GeneticCode:
+    """A custom genetic code, parsed once and kept in `_code_cache`
+    """
+    cdef codonwlib.GENETIC_CODE_STRUCT code
+
+
+_code_cache = {}
+ncbi_codons = [x + y + z for x in "TCAG" for y in "TCAG" for z in "TCAG"]
+
+
+cdef codonwlib.GENETIC_CODE_STRUCT _ncbi_code(str aas) except *:
+    """Genetic code from 64 amino acids in NCBI codon order
+    """
+    cdef _GeneticCode gc = _code_cache.get(aas)
+    if gc is None:
+        gc = _GeneticCode()
+        if codonwlib.code_from_ncbi(aas.encode(), &gc.code):
+            raise ValueError("Not a genetic code: {!r}".format(aas))
+        gc = _code_cache.setdefault(aas, gc)
+    return gc.code
+
+
+def _dict_code(code):
+    """64 amino acids in NCBI order from a dict of codon (DNA or RNA) to
+    amino acid letter
+    """
+    code = {k.upper().replace("U", "T"): v for k, v in code.items()}
+    try:
+        return "".join(code[c] for c in ncbi_codons)
+    except KeyError as e:
+        raise ValueError("No amino acid for codon {}".format(e.args[0]))
+
+
+cdef codonwlib.GENETIC_CODE_STRUCT _series_code(ser) except *:
+    """Genetic code from a pd.Series of amino acids indexed by codon
+    """
+    cdef codonwlib.GENETIC_CODE_STRUCT code
+    if ref_codons[0] not in ser.index:  # untranslatable codons
+        ser = pd.concat([pd.Series({ref_codons[0]: 'X'}), ser])
+
+    # place in required order and map amino acids letter to code
+    ser = ser[ref_codons]
+    aa_to_idx = pd.Series(np.arange(len(ref_aa1)), index=ref_aa1)
+
+    code.des = <char *>"Custom genetic code"
+    code.typ = <char *>""
+    code.ca = aa_to_idx[ser].values
+    return code
+
+
+cdef codonwlib.GENETIC_CODE_STRUCT _code_struct(genetic_code) except *:
+    """Genetic code given as for `CodonSeq`
+    """
+    if isinstance(genetic_code, (int, np.integer)):
+        if not 0 <= genetic_code < codonwlib.NUM_GENETIC_CODES:
+            raise ValueError("No genetic code {}".format(genetic_code))
+        return codonwlib.cu_ref[genetic_code]
+    if isinstance(genetic_code, str):
+        return _ncbi_code(genetic_code)
+    if isinstance(genetic_code, dict):
+        return _ncbi_code(_dict_code(genetic_code))
+    return _series_code(genetic_code)
+
+
+cdef codonwlib.CAI_STRUCT _cai_struct(cai_ref) except *:
+    """CAI weights given as for `CodonSeq.cai` (an integer, a pd.Series
+    indexed by codon or an array of 64 values)
+    """
+    cdef codonwlib.CAI_STRUCT ref_cai
+    cdef int x
+    if isinstance(cai_ref, (int, np.integer)):
+        if not 0 <= cai_ref < codonwlib.NUM_CAI_SPECIES:
+            raise ValueError("No CAI reference {}".format(cai_ref))
+        return codonwlib.cai_ref[cai_ref]
+
+    if isinstance(cai_ref, pd.Series):
+        w = cai_ref.reindex(ref_codons[1:]).fillna(0).values
+    else:
+        w = np.asarray(cai_ref, dtype=float)
+    if w.shape != (64,):
+        raise ValueError("CAI weights must be given for 64 codons")
+    ref_cai.des = NULL
+    ref_cai.ref = NULL
+    ref_cai.cai_val[0] = 0
+    for x in range(64):
+        ref_cai.cai_val[x + 1] = w[x]
+    return ref_cai
+
+
+def _cai_values(cai_ref):
+    """The 65 CAI weights of `cai_ref`, as `_cai_struct` takes it
+    """
+    cdef codonwlib.CAI_STRUCT cai = _cai_struct(cai_ref)
+    return np.array([cai.cai_val[x] for x in range(65)], dtype=float)
+
+
+def _count_matrix(counts):
+    """Codon counts as a C contiguous n x 65 matrix of C longs
+
+    A 64 column matrix (codons only, as from `CodonSeq.codon_usage`) is
+    given the leading column of untranslatable codons used internally.
+    """
+    counts = np.asarray(counts)
+    if counts.ndim == 1:
+        counts = counts[np.newaxis, :]
+    if counts.ndim != 2 or counts.shape[1] not in (64, 65):
+        raise ValueError("Codon counts must have 64 or 65 columns")
+    if counts.shape[1] == 64:
+        counts = np.hstack([np.zeros([counts.shape[0], 1], dtype=counts.dtype), counts])
+    return np.ascontiguousarray(counts, dtype=c_long)
+
 cdef class CodonSeq:
     # Use memory view to arrays
     # https://suzyahyah.github.io/cython/programming/2018/12/01/Gotchas-in-Cython.html
@@ -67,15 +197,17 @@ cdef class CodonSeq:
             5. Nuclear code of Cilitia
             6. Nuclear code of Euplotes
             7. Mitochondrial code of Echinoderms
+            or a custom code: a string of 64 amino acids (* for stop) in
+            the codon order of the NCBI tables (`codonw.ncbi_codons`,
+            TTT TTC TTA TTG TCT ...), a dict of codon to amino acid, or a
+            pd.Series of amino acids indexed by codon. Strings are parsed
+            once and kept.
 
         """
         self.dds = np.zeros([65], dtype=c_int)
         self.dda = np.zeros([23], dtype=c_int)
 
-        if isinstance(genetic_code, int):
-            self.ref_code = codonwlib.cu_ref[genetic_code]
-        else:
-            self.genetic_code = genetic_code
+        self.ref_code = _code_struct(genetic_code)
 
         codonwlib.how_synon(&self.dds[0], &self.ref_code)
         codonwlib.how_synon_aa(&self.dda[0], &self.ref_code)
@@ -99,29 +231,23 @@ cdef class CodonSeq:
                          name=self.ref_code.des.decode('UTF-8'))
 
     @genetic_code.setter
-    def genetic_code(self, ser):
-        if 'UNK' not in ser:
-            ser['UNK'] = 'X'
-        
-        # place in required order and map amino acids letter to code
-        ser = ser[ref_codons]
-        aa_to_idx = pd.Series(np.arange(len(ref_aa1)), index=ref_aa1)
-
-        self.ref_code = codonwlib.GENETIC_CODE_STRUCT(b"", b"")
-        self.ref_code.ca = aa_to_idx[ser].values
-        return
+    def genetic_code(self, code):
+        self.ref_code = _code_struct(code)
+        # tables derived from the code
+        codonwlib.how_synon(&self.dds[0], &self.ref_code)
+        codonwlib.how_synon_aa(&self.dda[0], &self.ref_code)
+        codonwlib.count_amino_acids(&self.ncod[0], &self.naa[0], &self.ref_code)
 
 
-    cpdef double cai(self, int cai_ref=0):
+    cpdef double cai(self, cai_ref=0):
         """Calculates Codon Adaptation Index
 
         `cai_ref`: The relative adaptiveness of codon
             0. Escherichia coli - No reference [default]
             1. Bacillus subtilis - No reference
             2. Saccharomyces cerevisiae - Sharp and Cowe (1991) Yeast 7:657-678
-
-        If you'd like to have user-provided reference values, please implement this
-        functionality and make a pull-request.
+            or user-provided values, a pd.Series indexed by codon (e.g. from
+            `fit_cai_weights`) or an array of 64 values in `codon_usage` order
 
 
         CAI is a measurement of the relative adaptiveness of the codon usage of a
@@ -148,7 +274,7 @@ cdef class CodonSeq:
 
         [Sharp and Li 1987](https://doi.org/10.1093/nar/15.3.1281)
         """
-        cdef codonwlib.CAI_STRUCT ref_cai = codonwlib.cai_ref[cai_ref]
+        cdef codonwlib.CAI_STRUCT ref_cai = _cai_struct(cai_ref)
         cdef double cai_val = 0
         cdef int ret = codonwlib.cai(&self.ncod[0], &cai_val, &self.dds[0], &ref_cai, &self.ref_code)
         return cai_val
@@ -313,12 +439,12 @@ cdef class CodonSeq:
     def codon_usage(self):
         """Codon tabulation
         """
-        return pd.Series(self.ncod[1:65], index=ref_codons[1:65])
+        return pd.Series(np.asarray(self.ncod[1:65]), index=ref_codons[1:65])
         
     def aa_usage(self):
         """Amino acid tabulation
         """
-        return pd.Series(self.naa, index=ref_aa1)
+        return pd.Series(np.asarray(self.naa), index=ref_aa1)
 
 
     cpdef np.ndarray[dtype=float, ndim=1, mode="c"] _rscu(self):
@@ -404,13 +530,18 @@ cdef class CodonSeq:
         return v
 
 
-    cpdef np.ndarray[dtype=double, ndim=2, mode="c"] _dinuc(self, bool pct):
+    cpdef np.ndarray[dtype=double, ndim=2, mode="c"] _dinuc(self, bool pct, bool soft_mask=False):
         cdef np.ndarray[dtype=long, ndim=2, mode="c"] dinuc_frames = np.zeros([4, 16], dtype=c_long)
         cdef np.ndarray[dtype=long, ndim=1, mode="c"] dinuc_tot = np.zeros([4], dtype=c_long)
         cdef int fram = 0
+        cdef int ret
 
-        cdef int ret = codonwlib.dinuc_count(<char *>self.seq,
-            <long (*)[16]>&dinuc_frames[0, 0], &dinuc_tot[0], &fram)
+        if soft_mask:
+            ret = codonwlib.dinuc_count_mask(<char *>self.seq, len(self.seq),
+                <long (*)[16]>&dinuc_frames[0, 0], &dinuc_tot[0], &fram)
+        else:
+            ret = codonwlib.dinuc_count(<char *>self.seq,
+                <long (*)[16]>&dinuc_frames[0, 0], &dinuc_tot[0], &fram)
 
         dinuc_frames[3, :] = np.sum(dinuc_frames, axis=0)
             
@@ -419,22 +550,25 @@ cdef class CodonSeq:
         
         return dinuc_frames.astype(np.double)
 
-    def dinuc(self, pct=True):
+    def dinuc(self, pct=True, soft_mask=False):
         """Calculate Dinucleotide Usage
         
         `pct`:
             If True, report percentages
+        `soft_mask`:
+            If True, lowercase (soft-masked) bases are left out, as are
+            the dinucleotides they are part of
 
         The frequency of all 16 dinucleotides, in total, and across
         all three possible reading frames, i.e. `1:2`, `2:3`, `3:1`.
         """
         
-        cdef np.ndarray[dtype=double, ndim=2, mode="c"] frames = self._dinuc(pct)
+        cdef np.ndarray[dtype=double, ndim=2, mode="c"] frames = self._dinuc(pct, soft_mask)
 
         if pct:
             def convert(x): return x
         else:
-            def convert(x): return x.astype(long)
+            def convert(x): return x.astype(np.int_)
 
         v = pd.DataFrame(convert(frames),
             columns=['TT', 'TC', 'TA', 'TG',
@@ -444,3 +578,3008 @@ cdef class CodonSeq:
             index=['1:2', '2:3', '3:1', 'all'])
         
         return v
+
+
+cdef class RSCUIndex:
+    """Approximate nearest neighbour index over RSCU profiles
+
+    Profiles are the RSCU values (see `CodonSeq.rscu`) of synonymous,
+    non-stop codons, i.e. 59 dimensions for the universal code. They are
+    grouped into `nlist` cells by k-means and a query only scans the
+    profiles of the `nprobe` cells whose centroids are closest to it
+    (an "IVF-flat" index). Distances are squared euclidean.
+
+    Build an index from codon counts with `RSCUIndex.build`, write it with
+    `save` and map it back read-only with `RSCUIndex.load`.
+
+        index = codonw.RSCUIndex.build(genome_counts, ids=taxids, nlist=1024)
+        index.save("genomes.idx")
+        index = codonw.RSCUIndex.load("genomes.idx")
+        ids, dist = index.query(gene_counts, k=10, nprobe=16)
+    """
+    cdef codonwlib.NN_INDEX_STRUCT idx
+
+    def __dealloc__(self):
+        codonwlib.nn_free(&self.idx)
+
+    @staticmethod
+    def build(counts, ids=None, int nlist=256, int niter=20, genetic_code=0, int nthreads=0):
+        """Builds an index
+
+        `counts`: codon counts, one row per profile (64 or 65 columns)
+        `ids`: integer id of each row, defaults to the row number
+        `nlist`: number of k-means cells, ~sqrt(number of rows) is a good start
+        `niter`: number of k-means iterations
+        `genetic_code`: as for `CodonSeq`
+        `nthreads`: threads to use, 0 for all processors
+        """
+        cdef RSCUIndex self = RSCUIndex.__new__(RSCUIndex)
+        cdef long[:, ::1] ncod = _count_matrix(counts)
+        cdef codonwlib.GENETIC_CODE_STRUCT code = _code_struct(genetic_code)
+        cdef int64_t[::1] id_view
+        cdef int64_t *id_ptr = NULL
+        cdef long n = ncod.shape[0]
+        cdef int ret
+
+        if n == 0:
+            raise ValueError("Cannot build an index from no profiles")
+        if ids is not None:
+            id_view = np.ascontiguousarray(ids, dtype=np.int64)
+            if id_view.shape[0] != n:
+                raise ValueError("Need one id per row of counts")
+            id_ptr = &id_view[0]
+
+        with nogil:
+            ret = codonwlib.nn_build(&self.idx, &ncod[0, 0], id_ptr, n, nlist, niter,
+                                     &code, nthreads)
+        if ret:
+            raise MemoryError("Could not build RSCU index")
+        return self
+
+    @staticmethod
+    def load(path):
+        """Maps a saved index read-only into memory
+        """
+        cdef RSCUIndex self = RSCUIndex.__new__(RSCUIndex)
+        cdef bytes fn = os.fsencode(path)
+        if codonwlib.nn_load(&self.idx, fn):
+            raise IOError("Could not load RSCU index from {}".format(path))
+        return self
+
+    def save(self, path):
+        """Writes the index to `path`
+        """
+        cdef bytes fn = os.fsencode(path)
+        if codonwlib.nn_save(&self.idx, fn):
+            raise IOError("Could not save RSCU index to {}".format(path))
+
+    def query(self, counts, int k=10, int nprobe=8, int nthreads=0):
+        """Finds the `k` indexed profiles closest to each row of `counts`
+
+        Scanning more cells (`nprobe`) is slower but more accurate. Returns
+        arrays of ids and squared distances, each of shape (rows, k), sorted
+        by distance. Slots that could not be filled have id -1.
+        """
+        cdef long[:, ::1] ncod = _count_matrix(counts)
+        cdef long nq = ncod.shape[0]
+        cdef np.ndarray[dtype=np.int64_t, ndim=2, mode="c"] ids = np.empty([nq, k], dtype=np.int64)
+        cdef np.ndarray[dtype=float, ndim=2, mode="c"] dist = np.empty([nq, k], dtype=c_float)
+
+        if k < 1:
+            raise ValueError("k must be at least 1")
+        if nq > 0:
+            with nogil:
+                codonwlib.nn_search(&self.idx, &ncod[0, 0], nq, k, nprobe,
+                                    <int64_t *>&ids[0, 0], &dist[0, 0], nthreads)
+        return ids, dist
+
+    def __len__(self):
+        return self.idx.n
+
+    @property
+    def dim(self):
+        return self.idx.dim
+
+    @property
+    def nlist(self):
+        return self.idx.nlist
+
+    @property
+    def mapped(self):
+        return self.idx.mapped
+
+
+cdef class SeqBatch:
+    """Nucleotide sequences stored end to end in one buffer
+
+    Sequence `i` is `data[offsets[i]:offsets[i + 1]]`. This is the layout
+    taken by the functions that work on many sequences at once (e.g.
+    `count_codons`) and is made from a list or pd.Series of sequences, or
+    read from a FASTA file by `read_fasta`. `names` may be None.
+    """
+    cdef public bytes data
+    cdef public np.ndarray offsets
+    cdef public object names
+
+    def __init__(self, seqs, names=None):
+        if isinstance(seqs, pd.Series) and names is None:
+            names = list(seqs.index)
+        encoded = [s.encode() if isinstance(s, str) else bytes(s) for s in seqs]
+        self.data = b"".join(encoded)
+        self.offsets = np.zeros([len(encoded) + 1], dtype=np.int64)
+        np.cumsum([len(s) for s in encoded], out=self.offsets[1:])
+        self.names = names
+
+    @staticmethod
+    def from_buffer(bytes data, offsets, names=None):
+        cdef SeqBatch self = SeqBatch.__new__(SeqBatch)
+        self.data = data
+        self.offsets = np.ascontiguousarray(offsets, dtype=np.int64)
+        self.names = names
+        return self
+
+    def __len__(self):
+        return self.offsets.shape[0] - 1
+
+    def __getitem__(self, long i):
+        if i < 0:
+            i += len(self)
+        if not 0 <= i < len(self):
+            raise IndexError("SeqBatch index out of range")
+        return self.data[self.offsets[i]:self.offsets[i + 1]].decode()
+
+    def __iter__(self):
+        for i in range(len(self)):
+            yield self[i]
+
+    def to_series(self):
+        return pd.Series(list(self), index=self.names, name="seq")
+
+
+def _as_batch(seqs):
+    if isinstance(seqs, SeqBatch):
+        return seqs
+    if isinstance(seqs, (str, bytes)):
+        seqs = [seqs]
+    return SeqBatch(seqs)
+
+
+cdef SeqBatch _parse_fasta(bytes buf):
+    cdef long n_max = buf.count(b">")
+    cdef np.ndarray[dtype=np.uint8_t, ndim=1, mode="c"] seq = np.empty([len(buf) + 1], dtype=np.uint8)
+    cdef np.ndarray[dtype=np.int64_t, ndim=1, mode="c"] seq_off = np.empty([n_max + 1], dtype=np.int64)
+    cdef np.ndarray[dtype=np.int64_t, ndim=1, mode="c"] name_off = np.empty([2 * n_max + 1], dtype=np.int64)
+    cdef long n = codonwlib.fasta_parse(buf, len(buf), <char *>&seq[0],
+        <int64_t *>&seq_off[0], <int64_t *>&name_off[0], n_max)
+    names = [buf[name_off[2 * i]:name_off[2 * i + 1]].decode() for i in range(n)]
+    return SeqBatch.from_buffer(seq[:seq_off[n]].tobytes(), seq_off[:n + 1].copy(), names)
+
+
+def read_fasta(source, long batch_bytes=1 << 24):
+    """Reads FASTA records as `SeqBatch`es of about `batch_bytes` each
+
+    `source`: file name or file object
+    """
+    close = isinstance(source, (str, bytes, os.PathLike))
+    fh = open(source, "rb") if close else source
+    rest = b""
+    try:
+        block = fh.read(batch_bytes)
+        while block:
+            # read ahead so that the last batch takes the end of the file
+            after = fh.read(batch_bytes)
+            if isinstance(block, str):
+                block = block.encode()
+            buf = rest + block
+            rest = b""
+            if after:
+                # only whole records are parsed, the rest waits for more
+                cut = buf.rfind(b"\n>")
+                if cut < 0:
+                    rest = buf
+                    block = after
+                    continue
+                rest = buf[cut + 1:]
+                buf = buf[:cut + 1]
+            batch = _parse_fasta(buf)
+            if len(batch):
+                yield batch
+            block = after
+    finally:
+        if close:
+            fh.close()
+
+
+def _batches(source, long batch_bytes=1 << 24):
+    """Batches of sequences from a FASTA file, a sequence collection or
+    an iterable of `SeqBatch`es
+    """
+    if isinstance(source, (str, os.PathLike)):
+        return read_fasta(source, batch_bytes)
+    if isinstance(source, (SeqBatch, list, tuple, pd.Series)):
+        return [_as_batch(source)]
+    if hasattr(source, "read"):
+        return read_fasta(source, batch_bytes)
+    return source
+
+
+cdef class Arena:
+    """Memory for the arrays of a batch of genes, released all at once
+
+    A region of `size` bytes of address space is reserved (backed by huge
+    pages where available, and only committed as it is used). Functions
+    given `arena=` carve their counts, temporaries and results from it as
+    NumPy views, so that a batch allocates nothing else. `reset` makes all
+    of it free again for the next batch once no view is left.
+
+        arena = codonw.Arena()
+        for batch in codonw.read_fasta(fn, batch_size=10000):
+            arena.reset()
+            res = codonw.compute_metrics(batch, arena=arena)
+            ...
+            del res
+    """
+    cdef codonwlib.ARENA_STRUCT *arena
+    cdef long views
+
+    def __init__(self, size_t size=1 << 30):
+        self.arena = codonwlib.arena_open(size)
+        if self.arena == NULL:
+            raise MemoryError("Could not reserve {} bytes".format(size))
+
+    def __dealloc__(self):
+        if self.arena != NULL:
+            codonwlib.arena_close(self.arena)
+
+    def __getbuffer__(self, Py_buffer *buf, int flags):
+        PyBuffer_FillInfo(buf, self, codonwlib.arena_base(self.arena),
+                          codonwlib.arena_size(self.arena), 0, flags)
+        with cython.critical_section(self):
+            self.views += 1
+
+    def __releasebuffer__(self, Py_buffer *buf):
+        with cython.critical_section(self):
+            self.views -= 1
+
+    def array(self, shape, dtype=np.float64, zero=True):
+        """A new array of `shape` and `dtype` in the arena, 64-byte aligned
+        and zeroed unless `zero` is False
+        """
+        dtype = np.dtype(dtype)
+        count = int(np.prod(shape))
+        cdef char *p = <char *>codonwlib.arena_alloc(
+            self.arena, max(count * dtype.itemsize, 1), codonwlib.ARENA_ALIGN)
+        if p == NULL:
+            raise MemoryError("Arena is full")
+        a = np.frombuffer(self, dtype=dtype, count=count,
+                          offset=p - codonwlib.arena_base(self.arena)).reshape(shape)
+        if zero:
+            a[...] = 0
+        return a
+
+    def reset(self):
+        """Frees everything allocated, which must no longer be in use
+        """
+        cdef long views
+        with cython.critical_section(self):
+            views = self.views
+            if not views:
+                codonwlib.arena_reset(self.arena)
+        if views:
+            raise BufferError("{} arrays of the arena are still in use".format(views))
+
+    @property
+    def used(self):
+        return codonwlib.arena_used(self.arena)
+
+    @property
+    def size(self):
+        return codonwlib.arena_size(self.arena)
+
+
+def _batch_array(arena, shape, dtype, zero=True):
+    """np.zeros, or an array from `arena` if given
+    """
+    if arena is None:
+        return np.zeros(shape, dtype=dtype)
+    return arena.array(shape, dtype, zero)
+
+
+def count_codons(seqs, int nthreads=0, arena=None, bint ambiguous=False, bint soft_mask=False):
+    """Codon usage of many sequences at once
+
+    `seqs`: a `SeqBatch`, or list or pd.Series of sequences
+    `nthreads`: threads to use, 0 for all processors
+    `arena`: an `Arena` to take the result from
+    `ambiguous`: share codons with IUPAC ambiguity codes (N, R, Y ...)
+        equally between the codons they may stand for, e.g. 1/4 of ACN to
+        each of ACA, ACC, ACG and ACU, rather than counting them as
+        untranslatable. Counts are then float64.
+    `soft_mask`: leave out codons with a lowercase (soft-masked) letter,
+        e.g. repeats of a soft-masked genome, counting them per sequence
+        instead
+
+    Returns a (sequences, 65) array of counts, each row equal to
+    `CodonSeq.ncod` of that sequence, i.e. codons in the order of
+    `codonw.ref_codons` with untranslatable codons in the first column.
+    With `soft_mask` returns the counts and an array of the number of
+    masked codons of each sequence.
+    """
+    cdef SeqBatch batch = _as_batch(seqs)
+    cdef long n = len(batch)
+    cdef const char *data = batch.data
+    cdef np.int64_t[::1] offsets = batch.offsets
+    cdef np.ndarray[dtype=long, ndim=2, mode="c"] ncod
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] fcod
+    cdef np.ndarray[dtype=long, ndim=1, mode="c"] masked
+
+    if ambiguous and soft_mask:
+        raise ValueError("ambiguous and soft_mask cannot be combined")
+    if soft_mask:
+        ncod = _batch_array(arena, [n, 65], c_long, False)
+        masked = _batch_array(arena, [max(n, 1)], c_long, False)[:n]
+        if n > 0:
+            with nogil:
+                codonwlib.codon_usage_batch_mask(data, <int64_t *>&offsets[0], n, &ncod[0, 0],
+                                                 &masked[0], nthreads)
+        return ncod, masked
+    if ambiguous:
+        fcod = _batch_array(arena, [n, 65], c_double, False)
+        if n > 0:
+            with nogil:
+                codonwlib.codon_usage_batch_frac(data, <int64_t *>&offsets[0], n, &fcod[0, 0], nthreads)
+        return fcod
+
+    ncod = _batch_array(arena, [n, 65], c_long, False)
+    if n > 0:
+        with nogil:
+            codonwlib.codon_usage_batch(data, <int64_t *>&offsets[0], n, &ncod[0, 0], nthreads)
+    return ncod
+
+
+class SparseCounts:
+    """Codon (or codon pair) counts of many sequences as a CSR matrix
+
+    The non-zero counts of row `i` are `data[indptr[i]:indptr[i + 1]]`
+    (uint32) in the columns `indices[indptr[i]:indptr[i + 1]]` (uint16,
+    increasing). Columns are those of `count_codons` (65) or, for codon
+    pairs, the 4096 pairs of adjacent translatable codons x, y (1 to 64
+    in `ref_codons` order) numbered (x - 1) * 64 + (y - 1).
+    """
+
+    def __init__(self, indptr, indices, data, int ncols=65, names=None):
+        self.indptr = np.ascontiguousarray(indptr, dtype=np.int64)
+        self.indices = np.ascontiguousarray(indices, dtype=np.uint16)
+        self.data = np.ascontiguousarray(data, dtype=np.uint32)
+        self.ncols = ncols
+        self.names = names
+        if (self.indptr.ndim != 1 or self.indptr.shape[0] < 1 or self.indptr[0] != 0 or
+                np.any(np.diff(self.indptr) < 0) or
+                self.indices.shape[0] != self.indptr[-1] or self.data.shape[0] != self.indptr[-1]):
+            raise ValueError("Inconsistent CSR arrays")
+        if self.indices.shape[0] and self.indices.max() >= ncols:
+            raise ValueError("Column out of range")
+
+    def __len__(self):
+        return self.indptr.shape[0] - 1
+
+    @property
+    def shape(self):
+        return (len(self), self.ncols)
+
+    @property
+    def nnz(self):
+        return self.data.shape[0]
+
+    def toarray(self):
+        """Dense (sequences, ncols) int64 counts
+        """
+        out = np.zeros(self.shape, dtype=np.int64)
+        rows = np.repeat(np.arange(len(self)), np.diff(self.indptr))
+        out[rows, self.indices] = self.data
+        return out
+
+    def to_scipy(self):
+        """As a scipy.sparse.csr_matrix (scipy is needed for this only)
+        """
+        import scipy.sparse
+        return scipy.sparse.csr_matrix((self.data, self.indices, self.indptr), shape=self.shape)
+
+    def _check_codons(self):
+        if self.ncols != 65:
+            raise ValueError("Indices need codon counts, not codon pairs")
+
+    def metrics(self, metrics=None, genetic_code=0, cai_ref=0, fop_ref=0, int nthreads=0):
+        """Indices of every row, as `compute_metrics` would give them for
+        the sequences counted. CAI and Fop are summed over the stored
+        counts only.
+        """
+        self._check_codons()
+        cdef _MetricRef ref = _MetricRef(genetic_code, cai_ref, fop_ref)
+        cdef int[::1] which = _metric_index(metrics)
+        cdef long n = len(self)
+        cdef np.ndarray[dtype=double, ndim=2, mode="c"] out = np.zeros([max(n, 1), which.shape[0]], dtype=c_double)
+        cdef const np.int64_t[::1] indptr = self.indptr
+        cdef const np.uint16_t[::1] indices = np.concatenate([self.indices, np.zeros(1, np.uint16)])
+        cdef const np.uint32_t[::1] data = np.concatenate([self.data, np.zeros(1, np.uint32)])
+        cdef int ret = 0
+
+        if n and which.shape[0]:
+            with nogil:
+                ret = codonwlib.metric_csr(<int64_t *>&indptr[0], <uint16_t *>&indices[0],
+                                           <uint32_t *>&data[0], n, &ref.ref, &which[0],
+                                           which.shape[0], &out[0, 0], nthreads)
+        if ret:
+            raise ValueError("Could not compute indices")
+        return pd.DataFrame(out[:n], columns=[ref_metrics[i] for i in which], index=self.names)
+
+    def rscu(self, genetic_code=0, int nthreads=0):
+        """RSCU of the stored codons: a float32 array aligned with `data`,
+        so that `SparseCounts(indptr, indices, rscu)` has the layout of the
+        RSCU matrix (codons not stored have an RSCU of 0)
+        """
+        self._check_codons()
+        cdef _MetricRef ref = _MetricRef(genetic_code)
+        cdef long n = len(self)
+        cdef np.ndarray[dtype=float, ndim=1, mode="c"] out = np.zeros([self.nnz + 1], dtype=c_float)
+        cdef const np.int64_t[::1] indptr = self.indptr
+        cdef const np.uint16_t[::1] indices = np.concatenate([self.indices, np.zeros(1, np.uint16)])
+        cdef const np.uint32_t[::1] data = np.concatenate([self.data, np.zeros(1, np.uint32)])
+
+        if n:
+            with nogil:
+                codonwlib.rscu_csr(<int64_t *>&indptr[0], <uint16_t *>&indices[0],
+                                   <uint32_t *>&data[0], n, &ref.ref, &out[0], nthreads)
+        return out[:self.nnz]
+
+
+def count_codons_sparse(seqs, pairs=False, int nthreads=0):
+    """Codon usage of many sequences at once as a `SparseCounts` matrix
+
+    `seqs`: a `SeqBatch`, or list or pd.Series of sequences
+    `pairs`: count pairs of adjacent codons (4096 columns) instead
+    `nthreads`: threads to use, 0 for all processors
+
+    Rows equal those of `count_codons`, with only non-zero counts stored,
+    which suits short genes and codon pairs.
+    """
+    cdef SeqBatch batch = _as_batch(seqs)
+    cdef long n = len(batch)
+    cdef bool cpairs = pairs
+    cdef const char *cdata = batch.data
+    cdef np.int64_t[::1] offsets = batch.offsets
+    cdef np.ndarray[dtype=np.int64_t, ndim=1, mode="c"] indptr = np.zeros([n + 1], dtype=np.int64)
+    cdef np.ndarray[dtype=np.uint16_t, ndim=1, mode="c"] indices
+    cdef np.ndarray[dtype=np.uint32_t, ndim=1, mode="c"] data
+    cdef int ret = 0
+
+    if n > 0:
+        with nogil:
+            ret = codonwlib.codon_csr_count(cdata, <int64_t *>&offsets[0], n, cpairs,
+                                            <int64_t *>&indptr[0], nthreads)
+    if ret:
+        raise MemoryError()
+    indices = np.zeros([indptr[n] + 1], dtype=np.uint16)
+    data = np.zeros([indptr[n] + 1], dtype=np.uint32)
+    if n > 0:
+        with nogil:
+            ret = codonwlib.codon_csr_fill(cdata, <int64_t *>&offsets[0], n, cpairs,
+                                           <int64_t *>&indptr[0], &indices[0], &data[0], nthreads)
+    if ret:
+        raise MemoryError()
+    return SparseCounts(indptr, indices[:indptr[n]], data[:indptr[n]],
+                        codonwlib.CSR_PAIR_BINS if pairs else 65, batch.names)
+
+
+cdef class _MetricRef:
+    """References needed by `compute_metrics`, read only once made
+    """
+    cdef codonwlib.METRIC_REF_STRUCT ref
+
+    def __init__(self, genetic_code=0, cai_ref=0, fop_ref=0):
+        cdef codonwlib.GENETIC_CODE_STRUCT code = _code_struct(genetic_code)
+        cdef codonwlib.CAI_STRUCT cai = _cai_struct(cai_ref)
+        cdef codonwlib.FOP_STRUCT fop = _fop_struct(fop_ref)
+        codonwlib.metric_init(&self.ref, &code, &cai, &fop)
+
+
+def _metric_index(metrics):
+    """Positions in `ref_metrics` of the names in `metrics`
+    """
+    if metrics is None:
+        metrics = ref_metrics
+    if isinstance(metrics, str):
+        metrics = [metrics]
+    for m in metrics:
+        if m not in ref_metrics:
+            raise ValueError("No index {}, choose from {}".format(m, ref_metrics))
+    return np.array([ref_metrics.index(m) for m in metrics], dtype=np.intc)
+
+
+cdef class _MetricRefs:
+    """`_MetricRef` for every built-in genetic code, side by side
+    """
+    cdef codonwlib.METRIC_REF_STRUCT refs[codonwlib.NUM_GENETIC_CODES]
+
+    def __init__(self, cai_ref=0, fop_ref=0):
+        cdef _MetricRef ref
+        cdef int i
+        for i in range(codonwlib.NUM_GENETIC_CODES):
+            ref = _MetricRef(i, cai_ref, fop_ref)
+            self.refs[i] = ref.ref
+
+
+def _seq_codes(genetic_code, long n):
+    """Built-in genetic code of each of `n` sequences, or None if
+    `genetic_code` is one code for all (an integer or a pd.Series of
+    amino acids)
+    """
+    if isinstance(genetic_code, (int, np.integer)):
+        return None
+    if isinstance(genetic_code, pd.Series) and not pd.api.types.is_integer_dtype(genetic_code):
+        return None
+    codes = np.asarray(genetic_code)
+    if codes.ndim != 1 or not np.issubdtype(codes.dtype, np.integer):
+        return None
+    if codes.shape[0] != n:
+        raise ValueError("{} genetic codes for {} sequences".format(codes.shape[0], n))
+    if n and (codes.min() < 0 or codes.max() >= codonwlib.NUM_GENETIC_CODES):
+        raise ValueError("Genetic codes must be between 0 and {}".format(codonwlib.NUM_GENETIC_CODES - 1))
+    return np.ascontiguousarray(codes, dtype=np.int8)
+
+
+def compute_metrics(seqs, metrics=None, genetic_code=0, cai_ref=0, fop_ref=0,
+                    int nthreads=0, arena=None, bint ambiguous=False, bint soft_mask=False,
+                    RefBundle bundle=None, aa_properties=0):
+    """Indices of many sequences at once
+
+    `seqs`: a `SeqBatch`, or list or pd.Series of sequences
+    `metrics`: names from `codonw.ref_metrics`, all by default
+    `genetic_code`, `cai_ref`, `fop_ref`: as for `CodonSeq` and its methods.
+        `genetic_code` may also be an integer array with the built-in code
+        of each sequence, for batches that mix codes
+    `arena`: an `Arena` to take the counts and results from, the
+        DataFrame then being a view of the arena
+    `ambiguous`: count codons with IUPAC ambiguity codes fractionally, as
+        `count_codons(..., ambiguous=True)`, and compute the indices from
+        those counts. Needs a single genetic code.
+    `soft_mask`: compute the indices without the codons that have a
+        lowercase (soft-masked) letter, and add their number as a
+        "Masked" column. Needs a single genetic code.
+    `bundle`: a `RefBundle` to take the references from, `genetic_code`,
+        `cai_ref`, `fop_ref` and `aa_properties` (the Gravy and Aromo
+        scales) then being names or positions of its records. Needs a
+        single genetic code.
+
+    Returns a pd.DataFrame with one row per sequence, values equal to those
+    of the `CodonSeq` methods.
+    """
+    cdef SeqBatch batch = _as_batch(seqs)
+    cdef long n = len(batch)
+    per_seq = _seq_codes(genetic_code, n)
+    cdef bint mixed = per_seq is not None
+    if mixed and ambiguous:
+        raise ValueError("ambiguous counting needs a single genetic code")
+    if mixed and soft_mask:
+        raise ValueError("soft_mask needs a single genetic code")
+    if ambiguous and soft_mask:
+        raise ValueError("ambiguous and soft_mask cannot be combined")
+    if mixed and bundle is not None:
+        raise ValueError("A reference bundle needs a single genetic code")
+    if bundle is None and not (isinstance(aa_properties, (int, np.integer)) and aa_properties == 0):
+        raise ValueError("aa_properties are taken from a reference bundle")
+    cdef _MetricRef ref = (bundle._metric_ref(genetic_code, cai_ref, fop_ref, aa_properties)
+                           if bundle is not None else
+                           _MetricRef(0 if mixed else genetic_code, cai_ref, fop_ref))
+    cdef _MetricRefs refs = _MetricRefs(cai_ref, fop_ref) if mixed else None
+    cdef const np.int8_t[::1] codes = per_seq if mixed else np.zeros(1, np.int8)
+    cdef int[::1] which = _metric_index(metrics)
+    cdef np.ndarray[dtype=long, ndim=2, mode="c"] ncod = _batch_array(
+        arena, [1 if ambiguous else max(n, 1), 65], c_long, False)
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] fcod = _batch_array(
+        arena, [max(n, 1) if ambiguous else 1, 65], c_double, False)
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] out = _batch_array(arena, [n, which.shape[0]], c_double)
+    cdef np.ndarray[dtype=long, ndim=1, mode="c"] masked = _batch_array(
+        arena, [max(n, 1) if soft_mask else 1], c_long)
+    cdef const char *data = batch.data
+    cdef np.int64_t[::1] offsets = batch.offsets
+    cdef int ret = 0
+
+    if n > 0 and which.shape[0] > 0:
+        with nogil:
+            if soft_mask:
+                ret = codonwlib.metric_seqs_mask(data, <int64_t *>&offsets[0], n, &ncod[0, 0], &masked[0],
+                                                 &ref.ref, &which[0], which.shape[0], &out[0, 0], nthreads)
+            elif ambiguous:
+                ret = codonwlib.metric_seqs_frac(data, <int64_t *>&offsets[0], n, &fcod[0, 0], &ref.ref,
+                                                 &which[0], which.shape[0], &out[0, 0], nthreads)
+            elif mixed:
+                ret = codonwlib.metric_seqs_codes(data, <int64_t *>&offsets[0], n, <int8_t *>&codes[0],
+                                                  &ncod[0, 0], &refs.refs[0], codonwlib.NUM_GENETIC_CODES,
+                                                  &which[0], which.shape[0], &out[0, 0], nthreads)
+            else:
+                ret = codonwlib.metric_seqs(data, <int64_t *>&offsets[0], n, &ncod[0, 0], &ref.ref,
+                                            &which[0], which.shape[0], &out[0, 0], nthreads)
+    if ret:
+        raise ValueError("Could not compute indices")
+    df = pd.DataFrame(out, columns=[ref_metrics[i] for i in which], index=batch.names,
+                      copy=False)
+    if soft_mask:
+        if which.shape[0] == 0 and n > 0:
+            masked = count_codons(batch, nthreads, soft_mask=True)[1]
+        df = df.assign(Masked=masked[:n])
+    return df
+
+
+def _aligned_array(nbytes, arena=None):
+    """Uninitialised uint8 array of `nbytes` starting on a 64 byte boundary
+    """
+    if arena is not None:
+        return arena.array(nbytes, np.uint8, False)
+    buf = np.empty(nbytes + 64, dtype=np.uint8)
+    first = -buf.ctypes.data % 64
+    return buf[first:first + nbytes]
+
+
+class ResultTable:
+    """Indices of many genes stored column by column
+
+    Each index (and, if requested, the count of each codon) is one
+    contiguous array over all genes, 64-byte aligned in a single buffer,
+    so that reading one index of every gene is a sequential scan. Columns
+    are NumPy arrays, `table["CAI"]`, and export to pandas or Arrow
+    without going through rows.
+    """
+
+    def __init__(self, columns, names=None):
+        self._columns = dict(columns)
+        self.names = names
+
+    def __len__(self):
+        return len(next(iter(self._columns.values()))) if self._columns else 0
+
+    def __getitem__(self, name):
+        return self._columns[name]
+
+    def __contains__(self, name):
+        return name in self._columns
+
+    @property
+    def columns(self):
+        return list(self._columns)
+
+    def to_pandas(self):
+        return pd.DataFrame(self._columns, index=self.names)
+
+    def to_arrow(self):
+        """A pyarrow Table sharing the column buffers, with gene names (if
+        any) as a first column "name"
+        """
+        import pyarrow as pa
+        cols = {"name": pa.array(list(self.names), pa.string())} if self.names is not None else {}
+        cols.update((k, pa.array(v)) for k, v in self._columns.items())
+        return pa.table(cols)
+
+
+def metric_table(seqs, metrics=None, genetic_code=0, cai_ref=0, fop_ref=0,
+                 counts=False, int nthreads=0, arena=None):
+    """Indices of many sequences at once as a `ResultTable`
+
+    `seqs`, `metrics`, `genetic_code`, `cai_ref`, `fop_ref`: as for
+        `compute_metrics`
+    `counts`: also keep the count of every codon, as int64 columns named
+        by codon
+    `arena`: an `Arena` to take the column buffer from
+
+    Genes are processed in blocks and every column written a block at a
+    time, values are those of `compute_metrics`.
+    """
+    cdef SeqBatch batch = _as_batch(seqs)
+    cdef _MetricRef ref = _MetricRef(genetic_code, cai_ref, fop_ref)
+    cdef int[::1] which = _metric_index(metrics)
+    cdef long n = len(batch)
+    cdef int nwhich = which.shape[0]
+    cdef double *cols[codonwlib.NUM_METRICS]
+    cdef int64_t *cnt[64]
+    cdef int64_t **pcnt = cnt if counts else NULL
+    cdef const char *data = batch.data
+    cdef np.int64_t[::1] offsets = batch.offsets
+    cdef np.uint8_t[::1] buf
+    cdef long stride = (n * 8 + 63) // 64 * 64
+    cdef int k, ret = 0
+
+    if nwhich > codonwlib.NUM_METRICS:
+        raise ValueError("At most {} indices".format(codonwlib.NUM_METRICS))
+    names = [ref_metrics[i] for i in which]
+    if counts:
+        names += ref_codons[1:]
+    buffer = _aligned_array(max(stride * len(names), 1), arena)
+    buf = buffer
+    for k in range(len(names)):
+        if k < nwhich:
+            cols[k] = <double *>&buf[k * stride] if stride else NULL
+        else:
+            cnt[k - nwhich] = <int64_t *>&buf[k * stride] if stride else NULL
+
+    if n > 0:
+        with nogil:
+            ret = codonwlib.metric_columns(data, <int64_t *>&offsets[0], n, &ref.ref,
+                                           &which[0] if nwhich else NULL, nwhich, cols,
+                                           pcnt, nthreads)
+    if ret:
+        raise ValueError("Could not compute indices")
+    return ResultTable(
+        {m: buffer[k * stride:k * stride + n * 8].view(np.float64 if k < nwhich else np.int64)
+         for k, m in enumerate(names)}, batch.names)
+
+
+cdef class GenomeBackground:
+    """Genome-wide codon usage to compare genes against
+
+    Add the codon counts of all genes of a genome, in as many batches as
+    convenient, with `add` and then `score` genes against the genome.
+    Only the pooled counts and the mean and covariance of per-gene codon
+    frequencies are kept, see `alien_scores` for the whole process.
+    """
+    cdef codonwlib.BACKGROUND_STRUCT bg
+    cdef object lock  # adds and scores from several threads
+
+    def __init__(self, genetic_code=0):
+        cdef codonwlib.GENETIC_CODE_STRUCT code = _code_struct(genetic_code)
+        codonwlib.bg_init(&self.bg, &code)
+        self.lock = threading.Lock()
+
+    def add(self, counts):
+        """Adds genes (rows of codon counts) to the background
+        """
+        cdef long[:, ::1] ncod = _count_matrix(counts)
+        if ncod.shape[0] > 0:
+            with self.lock:
+                codonwlib.bg_add(&self.bg, &ncod[0, 0], ncod.shape[0])
+
+    def score(self, counts, bool leave_one_out=False, double pseudocount=0.5,
+              double ridge=1e-3, int nthreads=0):
+        """Scores genes (rows of codon counts) against the background
+
+        `leave_one_out`: compare each gene with the background without it,
+            only valid for genes that were added to the background
+        `pseudocount`: added to each background codon count for KL divergence
+        `ridge`: added to the diagonal of the codon frequency covariance,
+            relative to the mean variance of all genes added, for the
+            Mahalanobis distance
+
+        Returns a pd.DataFrame with columns
+
+            B: Karlin's codon bias of the gene relative to the genome, B(g|G),
+               the amino acid frequency weighted sum of absolute differences
+               in codon frequencies within each amino acid
+               [Karlin, Mrazek & Campbell 1998](https://doi.org/10.1128/JB.180.14.3659-3669.1998)
+            KL: Kullback-Leibler divergence of sense codon frequencies of the
+               gene from those of the genome (in nats)
+            Mahalanobis: Mahalanobis distance of the gene's sense codon
+               frequencies from the mean of all genes
+
+        Scores of genes without sense codons are NaN.
+        """
+        cdef long[:, ::1] ncod = _count_matrix(counts)
+        cdef long n = ncod.shape[0]
+        cdef np.ndarray[dtype=double, ndim=2, mode="c"] out = np.empty([n, 3], dtype=c_double)
+        if n > 0:
+            with self.lock:
+                with nogil:
+                    codonwlib.bg_score(&self.bg, &ncod[0, 0], n, leave_one_out,
+                                       pseudocount, ridge, &out[0, 0], nthreads)
+        return pd.DataFrame(out, columns=['B', 'KL', 'Mahalanobis'])
+
+    @property
+    def n_genes(self):
+        """Number of genes with sense codons added"""
+        return self.bg.ngenes
+
+    def codon_usage(self):
+        """Pooled codon counts of all genes added"""
+        with self.lock:
+            ncod = np.array(self.bg.ncod)
+        return pd.Series(ncod[1:65], index=ref_codons[1:65])
+
+
+def alien_scores(source, genetic_code=0, bool leave_one_out=True,
+                 double pseudocount=0.5, double ridge=1e-3, int nthreads=0):
+    """Scores every gene of `source` against the codon usage of them all
+
+    `source`: FASTA file name or file object, a `SeqBatch`, a list or
+        pd.Series of sequences, or an iterable of `SeqBatch`es
+
+    Sequences are read once: the codon counts of each batch are added to a
+    `GenomeBackground` and kept to be scored once all have been read. See
+    `GenomeBackground.score` for the other arguments and the scores.
+    """
+    bg = GenomeBackground(genetic_code)
+    counts = []
+    names = []
+    for batch in _batches(source):
+        c = count_codons(batch, nthreads)
+        bg.add(c)
+        counts.append(c)
+        names.extend(batch.names if batch.names is not None
+                     else range(len(names), len(names) + len(batch)))
+
+    counts = np.vstack(counts) if counts else np.zeros([0, 65], dtype=c_long)
+    scores = bg.score(counts, leave_one_out, pseudocount, ridge, nthreads)
+    scores.index = names
+    return scores
+
+
+cdef class CodonCOA:
+    """Streaming correspondence analysis of codon usage
+
+    `method`:
+        "ca": correspondence analysis of codon counts [default]
+        "pca": principal component analysis of RSCU values
+    `genetic_code`: as for `CodonSeq`
+
+    Only synonymous, non-stop codons are analysed (59 for the universal
+    code). Genes are added a batch of codon counts at a time with
+    `partial_fit`, keeping no more than a 59 x 59 matrix of moments however
+    many genes there are, and a second pass with `transform` gives each
+    gene's coordinates on the axes.
+
+        coa = codonw.CodonCOA()
+        for batch in codonw.read_fasta("genome.fna"):
+            coa.partial_fit(codonw.count_codons(batch))
+        for batch in codonw.read_fasta("genome.fna"):
+            coords = coa.transform(codonw.count_codons(batch), naxes=4)
+
+    For CA the coordinates are row principal coordinates and `inertia` the
+    principal inertias; for PCA they are scores and the variance of each
+    axis. Genes without synonymous codons are ignored and have NaN
+    coordinates.
+    """
+    cdef codonwlib.COA_STRUCT coa
+    cdef object lock  # batches added and axes fitted from several threads
+
+    def __init__(self, method="ca", genetic_code=0):
+        cdef codonwlib.GENETIC_CODE_STRUCT code = _code_struct(genetic_code)
+        if method not in ("ca", "pca"):
+            raise ValueError("method must be 'ca' or 'pca'")
+        codonwlib.coa_init(&self.coa, method == "pca", &code)
+        self.lock = threading.RLock()
+
+    def partial_fit(self, counts, int nthreads=0):
+        """Adds genes (rows of codon counts)
+        """
+        cdef long[:, ::1] ncod = _count_matrix(counts)
+        cdef int ret = 0
+        if ncod.shape[0] > 0:
+            with self.lock:
+                with nogil:
+                    ret = codonwlib.coa_add(&self.coa, &ncod[0, 0], ncod.shape[0], nthreads)
+        if ret:
+            raise MemoryError("Could not add genes")
+        return self
+
+    cdef _fit(self):
+        with self.lock:
+            if not self.coa.fitted and codonwlib.coa_fit(&self.coa):
+                raise ValueError("Could not fit axes to {} genes".format(self.coa.nrows))
+
+    def transform(self, counts, int naxes=4, int nthreads=0):
+        """Coordinates of genes (rows of codon counts) on the first `naxes` axes
+        """
+        cdef long[:, ::1] ncod = _count_matrix(counts)
+        cdef long n = ncod.shape[0]
+        cdef np.ndarray[dtype=double, ndim=2, mode="c"] out
+        with self.lock:
+            self._fit()
+            naxes = min(max(naxes, 1), self.coa.dim)
+            out = np.empty([n, naxes], dtype=c_double)
+            if n > 0:
+                with nogil:
+                    codonwlib.coa_transform(&self.coa, &ncod[0, 0], n, naxes, &out[0, 0], nthreads)
+        return out
+
+    @property
+    def n_genes(self):
+        return self.coa.nrows
+
+    @property
+    def codons(self):
+        """Codons analysed, in the order of the axes' coefficients"""
+        return [ref_codons[self.coa.cod[j]] for j in range(self.coa.dim)]
+
+    @property
+    def inertia(self):
+        """Eigenvalue of each axis, decreasing"""
+        with self.lock:
+            self._fit()
+            return np.array([self.coa.eigval[j] for j in range(self.coa.dim)])
+
+    @property
+    def explained(self):
+        """Fraction of the total inertia (or variance) on each axis"""
+        inertia = self.inertia
+        return inertia / inertia.sum()
+
+    def axes(self, int naxes=4):
+        """Unit eigenvectors of the first `naxes` axes, one column per axis"""
+        with self.lock:
+            self._fit()
+            naxes = min(max(naxes, 1), self.coa.dim)
+            v = np.array(<double[:64 * 64]>self.coa.axes).reshape([64, 64])
+        return pd.DataFrame(v[:self.coa.dim, :naxes], index=self.codons,
+                            columns=["Axis{}".format(k + 1) for k in range(naxes)])
+
+    def codon_coordinates(self, int naxes=4):
+        """Principal coordinates of the codons (CA) or loadings (PCA)"""
+        v = self.axes(naxes)
+        scale = np.sqrt(self.inertia[:v.shape[1]])
+        if not self.coa.rscu:
+            mass = np.array([self.coa.mean[j] for j in range(self.coa.dim)])
+            with np.errstate(divide='ignore', invalid='ignore'):
+                return v.mul(scale, axis=1).div(np.sqrt(mass), axis=0)
+        return v.mul(scale, axis=1)
+
+
+class CodonMixture:
+    """Mixture of multinomial codon usage classes fitted by EM
+
+    `n_classes`: number of classes
+    `init`: starting codon usage of the first classes, a list of
+        ("cai", `cai_ref`): relative adaptiveness of a `CodonSeq.cai` reference
+        ("fop", `fop_ref`): optimal codons of a `CodonSeq.fop` reference, given
+            twice the weight of common codons and ten times that of rare ones
+        or a pd.Series (indexed by codon) or array of 64 relative usages.
+        Other classes start from the pooled usage of all genes, perturbed.
+    `synonymous`: if True [default], classes describe codon choice within
+        each amino acid (synonymous, non-stop codons only), else frequencies
+        of all sense codons
+    `pseudocount`: added to each expected codon count when updating classes
+    `genetic_code`: as for `CodonSeq`
+
+    E.g. to separate highly expressed genes starting from E. coli's optimal
+    codons and the genome average
+
+        mix = codonw.CodonMixture(2, init=[("fop", 0)]).fit(counts)
+        mix.posterior[:, 0]    # P(gene in the optimal codon class)
+    """
+
+    def __init__(self, n_classes=2, init=None, synonymous=True, max_iter=500,
+                 tol=1e-9, pseudocount=0.01, genetic_code=0, seed=0):
+        cdef codonwlib.GENETIC_CODE_STRUCT code = _code_struct(genetic_code)
+        cdef int cod[64]
+        cdef int dim
+
+        self.n_classes = n_classes
+        self.init = list(init) if init is not None else []
+        if len(self.init) > n_classes:
+            raise ValueError("More starting classes than classes")
+        self.synonymous = synonymous
+        self.max_iter = max_iter
+        self.tol = tol
+        self.pseudocount = pseudocount
+        self.seed = seed
+
+        self._ca = np.array(code.ca, dtype=np.intc)
+        if synonymous:
+            dim = codonwlib.syn_codons(cod, &code)
+            self._cod = np.array([cod[j] for j in range(dim)], dtype=np.intc)
+            self._group = self._ca[self._cod]
+        else:
+            self._cod = np.array([x for x in range(1, 65) if code.ca[x] != 11], dtype=np.intc)
+            self._group = np.zeros(len(self._cod), dtype=np.intc)
+
+    @property
+    def codons(self):
+        return [ref_codons[x] for x in self._cod]
+
+    def _by_aa(self, v):
+        """v scaled to sum to one within each amino acid"""
+        aa = self._ca[self._cod]
+        sums = np.zeros(22)
+        np.add.at(sums, aa, v)
+        return v / sums[aa]
+
+    def _start(self, counts):
+        pooled = counts[:, self._cod].sum(axis=0) + 1.0
+        # amino acid composition, which classes share unless synonymous
+        share = np.ones(len(self._cod))
+        if not self.synonymous:
+            share = (pooled / self._by_aa(pooled)) / pooled.sum()
+
+        rng = np.random.default_rng(self.seed)
+        theta = []
+        for start in self.init:
+            if isinstance(start, tuple) and start[0] == "cai":
+                w = _cai_values(start[1])[self._cod]
+                w[w < 0.0001] = 0.01
+            elif isinstance(start, tuple) and start[0] == "fop":
+                opt = _fop_classes(start[1])
+                w = np.choose(np.clip(opt[self._cod], 1, 3) - 1, [0.1, 0.5, 1.0])
+            elif isinstance(start, pd.Series):
+                w = start.reindex(ref_codons).fillna(0).values[self._cod] + 1e-6
+            else:
+                w = np.concatenate([[0], np.asarray(start, dtype=float)])[self._cod] + 1e-6
+            theta.append(self._by_aa(w) * share)
+        while len(theta) < self.n_classes:
+            theta.append(self._by_aa(pooled * rng.gamma(50, 1 / 50, len(pooled))) * share)
+
+        return np.log(np.vstack(theta))
+
+    def fit(self, counts, int nthreads=0):
+        """Fits the mixture to genes (rows of codon counts)
+
+        Sets `weights` (class proportions), `profiles` (class codon
+        probabilities), `posterior` (genes x classes probabilities),
+        `loglik`, `n_iter` and `converged`.
+        """
+        cdef long[:, ::1] ncod = _count_matrix(counts)
+        cdef long n = ncod.shape[0]
+        cdef int k = self.n_classes
+        cdef int[::1] cod = self._cod
+        cdef int[::1] group = self._group
+        cdef int dim = cod.shape[0]
+        cdef double[::1] logpi = np.full([k], -np.log(k))
+        cdef double[:, ::1] logtheta = np.ascontiguousarray(self._start(np.asarray(ncod)))
+        cdef np.ndarray[dtype=double, ndim=2, mode="c"] resp = np.zeros([n, k], dtype=c_double)
+        cdef double loglik = 0
+        cdef int niter = 0
+        cdef int max_iter = self.max_iter
+        cdef double tol = self.tol
+        cdef double pseudo = self.pseudocount
+        cdef int ret
+
+        if n == 0:
+            raise ValueError("Cannot fit a mixture to no genes")
+        with nogil:
+            ret = codonwlib.em_mixture(&ncod[0, 0], n, k, &cod[0], dim, &group[0],
+                                       &logpi[0], &logtheta[0, 0], &resp[0, 0], max_iter,
+                                       tol, pseudo, &loglik, &niter, nthreads)
+        if ret == 1:
+            raise ValueError("Could not fit a mixture of {} classes".format(k))
+
+        self._logpi = np.asarray(logpi)
+        self._logtheta = np.asarray(logtheta)
+        self.weights = np.exp(self._logpi)
+        self.profiles = pd.DataFrame(np.exp(self._logtheta), columns=self.codons)
+        self.posterior = resp
+        self.loglik = loglik
+        self.n_iter = niter
+        self.converged = ret == 0
+        return self
+
+    def predict_proba(self, counts, int nthreads=0):
+        """Posterior class probabilities of genes (rows of codon counts)
+        """
+        cdef long[:, ::1] ncod = _count_matrix(counts)
+        cdef long n = ncod.shape[0]
+        cdef int k = self.n_classes
+        cdef int[::1] cod = self._cod
+        cdef double[::1] logpi = self._logpi
+        cdef double[:, ::1] logtheta = self._logtheta
+        cdef np.ndarray[dtype=double, ndim=2, mode="c"] resp = np.zeros([n, k], dtype=c_double)
+        cdef double loglik = 0
+        if n > 0:
+            with nogil:
+                codonwlib.em_posterior(&ncod[0, 0], n, k, &cod[0], cod.shape[0], &logpi[0],
+                                       &logtheta[0, 0], &resp[0, 0], &loglik, nthreads)
+        return resp
+
+
+def fit_cai_weights(counts, double top=0.01, int max_iter=50, genetic_code=0,
+                    int nthreads=0):
+    """Fits CAI weights to a genome without a reference set of genes
+
+    `counts`: codon counts of the genes of one genome (rows)
+    `top`: fraction of genes used as the reference set (at least one gene)
+    `max_iter`: maximum number of rounds
+
+    Weights are first taken from the codon usage of all genes, then, each
+    round, from the `top` genes of highest CAI under the previous weights,
+    until this reference set no longer changes (after O'Neill et al. 2013,
+    scnRCA).
+
+    Returns the weights as a pd.Series indexed by codon, usable as the
+    `cai_ref` of `CodonSeq.cai`. Its `attrs` hold the final reference set
+    ("reference", gene rows), the CAI of every gene ("cai"), the number of
+    rounds ("n_iter") and whether the set stopped changing ("converged").
+    """
+    cdef long[:, ::1] ncod = _count_matrix(counts)
+    cdef long n = ncod.shape[0]
+    cdef long nref = max(1, <long>(top * n))
+    cdef codonwlib.GENETIC_CODE_STRUCT code = _code_struct(genetic_code)
+    cdef codonwlib.CAI_STRUCT fitted
+    cdef int[::1] dds = np.zeros([65], dtype=np.intc)
+    cdef np.ndarray[dtype=long, ndim=1, mode="c"] ref = np.zeros([nref], dtype=c_long)
+    cdef np.ndarray[dtype=double, ndim=1, mode="c"] out = np.zeros([n], dtype=c_double)
+    cdef int niter = 0
+    cdef int ret
+
+    if n == 0:
+        raise ValueError("Cannot fit CAI weights to no genes")
+    codonwlib.how_synon(&dds[0], &code)
+    with nogil:
+        ret = codonwlib.cai_fit(&ncod[0, 0], n, nref, max_iter, &dds[0], &code,
+                                &fitted, &ref[0], &out[0], &niter, nthreads)
+    if ret == 1:
+        raise ValueError("Could not fit CAI weights")
+
+    w = pd.Series([fitted.cai_val[x] for x in range(1, 65)], index=ref_codons[1:], name="w")
+    w.attrs = {"reference": ref, "cai": out, "n_iter": niter, "converged": ret == 0}
+    return w
+
+
+usage_formats = ["gcg", "kazusa", "cutg", "codonw", "cutab"]
+
+
+def _usage_format(format):
+    """Position of `format` in `usage_formats`
+    """
+    if format not in usage_formats:
+        raise ValueError("No codon usage table format {}, choose from {}".format(format, usage_formats))
+    return usage_formats.index(format)
+
+
+def _usage_matrix(counts):
+    """Codon usage tables as a C contiguous n x 65 matrix of doubles, as
+    `_count_matrix`
+    """
+    counts = np.asarray(counts, dtype=c_double)
+    if counts.ndim == 1:
+        counts = counts[np.newaxis, :]
+    if counts.ndim != 2 or counts.shape[1] not in (64, 65):
+        raise ValueError("Codon usage tables must have 64 or 65 columns")
+    if counts.shape[1] == 64:
+        counts = np.hstack([np.zeros([counts.shape[0], 1]), counts])
+    return np.ascontiguousarray(counts)
+
+
+def read_usage_tables(source, format="kazusa"):
+    """Reads codon usage tables in a standard text format
+
+    `source`: file name, file object or bytes
+    `format`: one of `codonw.usage_formats`
+        gcg     GCG CodonFrequency (.cod) tables
+        kazusa  the Kazusa / CoCoPUTs layout, "UUU 17.6(714298)  UCU ..."
+        cutg    CUTG .spsum files, a species line and 64 counts per table
+        codonw  the machine readable codon usage output of codonW
+        cutab   the codon usage tables of codonW
+
+    A file may hold any number of tables (e.g. a whole CUTG release), all
+    parsed in one pass without the GIL.
+
+    Returns a pd.DataFrame of counts (float64), one row per table indexed
+    by its title, with the 64 codons of `codonw.ref_codons` as columns.
+    Rows can be used as codon counts by the functions of this module, or
+    turned into CAI weights by `usage_weights`.
+    """
+    cdef int fmt = _usage_format(format)
+    if isinstance(source, (str, os.PathLike)):
+        with open(source, "rb") as fh:
+            buf = fh.read()
+    elif hasattr(source, "read"):
+        buf = source.read()
+    else:
+        buf = source
+    if isinstance(buf, str):
+        buf = buf.encode()
+    buf = bytes(buf)
+
+    # tables take at least this many lines
+    cdef long max_rec = buf.count(b"\n") // (2 if fmt == 2 else 4 if fmt == 3 else 1) + 1
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] ncod = np.zeros([max_rec, 65], dtype=c_double)
+    cdef np.ndarray[dtype=np.int64_t, ndim=1, mode="c"] name_off = np.zeros([2 * max_rec], dtype=np.int64)
+    cdef const char *data = buf
+    cdef long length = len(buf)
+    cdef long n
+
+    with nogil:
+        n = codonwlib.cut_parse(data, length, fmt, &ncod[0, 0], <int64_t *>&name_off[0], max_rec)
+    if n < 0:
+        raise ValueError("Could not parse {} codon usage tables".format(format))
+    names = [buf[name_off[2 * i]:name_off[2 * i + 1]].decode(errors="replace") for i in range(n)]
+    return pd.DataFrame(ncod[:n, 1:], index=names, columns=ref_codons[1:], copy=False)
+
+
+def write_usage_tables(dest, counts, format="kazusa", names=None, genetic_code=0):
+    """Writes codon usage tables in a format read by `read_usage_tables`
+
+    `dest`: file name
+    `counts`: tables as rows of 64 (or 65, untranslatable codons first)
+        codon counts, e.g. from `read_usage_tables` or `count_codons`
+    `names`: title of each table, by default the index of a pd.DataFrame
+    `genetic_code`: groups codons by amino acid (gcg and cutab formats)
+
+    The codonw and cutab layouts hold whole counts, and titles of at most
+    20 and 16 characters.
+    """
+    cdef int fmt = _usage_format(format)
+    if names is None and isinstance(counts, pd.DataFrame):
+        names = [str(x) for x in counts.index]
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] ncod = _usage_matrix(counts)
+    cdef long n = ncod.shape[0]
+    cdef codonwlib.GENETIC_CODE_STRUCT code = _code_struct(genetic_code)
+    cdef const char **cnames = NULL
+    cdef bytes path = os.fsencode(dest)
+    cdef long i
+    cdef int ret
+
+    if names is not None:
+        names = [str(x).replace("\n", " ").encode() for x in names]
+        if len(names) != n:
+            raise ValueError("{} names for {} tables".format(len(names), n))
+        cnames = <const char **>malloc(sizeof(char *) * max(n, 1))
+        if cnames == NULL:
+            raise MemoryError()
+        for i in range(n):
+            cnames[i] = names[i]
+    try:
+        # no tables give an empty file
+        ret = codonwlib.cut_save(path, fmt, &ncod[0, 0] if n > 0 else NULL, n, cnames, &code)
+    finally:
+        free(cnames)
+    if ret:
+        raise OSError("Could not write {}".format(dest))
+
+
+def usage_weights(counts, genetic_code=0):
+    """CAI weights (relative adaptiveness) of codon usage tables
+
+    `counts`: tables as for `write_usage_tables`, or one table
+
+    The weight of a codon is its count over that of the most used codon of
+    the same amino acid. Returns a pd.Series indexed by codon for a single
+    table (usable as the `cai_ref` of `CodonSeq.cai` and `compute_metrics`),
+    otherwise a pd.DataFrame (or array) with a row of weights per table.
+    """
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] ncod = _usage_matrix(counts)
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] w = np.zeros_like(ncod)
+    cdef codonwlib.GENETIC_CODE_STRUCT code = _code_struct(genetic_code)
+
+    if ncod.shape[0] > 0:
+        with nogil:
+            codonwlib.cut_weights(&ncod[0, 0], ncod.shape[0], &code, &w[0, 0])
+    if isinstance(counts, pd.Series) or np.ndim(counts) == 1:
+        return pd.Series(w[0, 1:], index=ref_codons[1:], name="w")
+    if isinstance(counts, pd.DataFrame):
+        return pd.DataFrame(w[:, 1:], index=counts.index, columns=ref_codons[1:], copy=False)
+    return w[:, 1:]
+
+
+def _taxon_frame(taxa):
+    """Taxon ids by sequence name as a pd.DataFrame with a column per rank
+    """
+    if isinstance(taxa, dict):
+        taxa = pd.Series(taxa)
+    if isinstance(taxa, pd.Series):
+        taxa = taxa.to_frame("taxon" if taxa.name is None else taxa.name)
+    if not isinstance(taxa, pd.DataFrame):
+        raise TypeError("taxa must be a dict, pd.Series or pd.DataFrame of taxon ids")
+    return taxa
+
+
+def _batch_taxa(SeqBatch batch, taxa, int nrank):
+    """nseq x nrank taxon ids of a batch, -1 where a sequence has none
+
+    A pd.DataFrame is matched by the first word of each sequence name,
+    anything else is taken as the ids of each sequence in order.
+    """
+    if isinstance(taxa, pd.DataFrame):
+        if batch.names is None:
+            raise ValueError("Sequences need names to be matched to taxa")
+        keys = [str(x).split(None, 1)[0] if str(x).strip() else "" for x in batch.names]
+        ids = taxa.reindex(keys).fillna(-1).to_numpy(dtype=np.int64)
+    else:
+        ids = np.asarray(taxa, dtype=np.int64).reshape(len(batch), -1)
+    if ids.shape[1] != nrank:
+        raise ValueError("Need {} taxon ids per sequence, got {}".format(nrank, ids.shape[1]))
+    return np.ascontiguousarray(ids)
+
+
+cdef class TaxonDBBuilder:
+    """Pools codon (and codon pair) counts per taxon into a `TaxonDB`
+
+    `ranks`: names of the taxon ids given for each sequence, e.g.
+        ("species", "genus", "family"); a sequence adds to all its taxa
+    `pairs`: also pool counts of adjacent codon pairs (CSR_PAIR_BINS columns)
+
+    Add sequences with `add` and write the store with `save`, or see
+    `TaxonDB.build` for the whole process.
+    """
+    cdef codonwlib.TDB_BUILDER_STRUCT *tb
+    cdef readonly tuple ranks
+    cdef object lock  # batches added from several threads
+
+    def __init__(self, ranks=("taxon",), bint pairs=False):
+        cdef const char *cnames[codonwlib.TDB_MAX_RANKS]
+        if isinstance(ranks, str):
+            ranks = (ranks,)
+        self.ranks = tuple(str(r) for r in ranks)
+        if not 0 < len(self.ranks) <= codonwlib.TDB_MAX_RANKS:
+            raise ValueError("A taxon database takes 1 to {} ranks".format(codonwlib.TDB_MAX_RANKS))
+        encoded = [r.encode()[:codonwlib.TDB_RANK_LEN - 1] for r in self.ranks]
+        for i, r in enumerate(encoded):
+            cnames[i] = r
+        self.tb = codonwlib.tdb_open(len(encoded), cnames, pairs)
+        if self.tb == NULL:
+            raise MemoryError()
+        self.lock = threading.Lock()
+
+    def __dealloc__(self):
+        if self.tb != NULL:
+            codonwlib.tdb_close(self.tb)
+
+    def add(self, seqs, taxa, int nthreads=0):
+        """Adds sequences to the tables of their taxa
+
+        `seqs`: a `SeqBatch`, or list or pd.Series of sequences
+        `taxa`: a pd.DataFrame of taxon ids indexed by sequence name (the
+            first word of a FASTA title) with a column per rank, or a dict
+            or pd.Series for a single rank; or else an array of the ids of
+            each sequence in order. Negative or missing ids are skipped.
+        `nthreads`: threads to use, 0 for all processors
+        """
+        cdef SeqBatch batch = _as_batch(seqs)
+        cdef long n = len(batch)
+        cdef int nrank = len(self.ranks)
+        if not isinstance(taxa, (pd.DataFrame, np.ndarray, list, tuple)):
+            taxa = _taxon_frame(taxa)
+        cdef np.ndarray[dtype=np.int64_t, ndim=2, mode="c"] ids = _batch_taxa(batch, taxa, nrank)
+        cdef const char *data = batch.data
+        cdef np.int64_t[::1] offsets = batch.offsets
+        cdef int ret = 0
+        if n > 0:
+            with self.lock:
+                with nogil:
+                    ret = codonwlib.tdb_add(self.tb, data, <int64_t *>&offsets[0], n,
+                                            <int64_t *>&ids[0, 0], nthreads)
+        if ret:
+            raise MemoryError("Could not add to taxon database")
+
+    def save(self, path):
+        """Writes the store to `path`, to be mapped by `TaxonDB.load`
+        """
+        cdef bytes fn = os.fsencode(path)
+        with self.lock:
+            if codonwlib.tdb_save(self.tb, fn):
+                raise IOError("Could not save taxon database to {}".format(path))
+
+    def __len__(self):
+        with self.lock:
+            return codonwlib.tdb_size(self.tb)
+
+
+cdef class TaxonDB:
+    """Codon usage tables pooled per taxon, mapped read-only from a file
+
+    The store holds, for every taxon, the number of sequences pooled and
+    their codon counts (65 columns as `count_codons`), and codon pair
+    counts if built with them. Taxa are kept sorted by id so any taxon is
+    found by binary search.
+
+        db = codonw.TaxonDB.build("refseq_cds.fna", lineage, "cu.tdb")
+        db = codonw.TaxonDB.load("cu.tdb")
+        w = codonw.usage_weights(db.codon_usage(562))
+    """
+    cdef codonwlib.TAXON_DB_STRUCT db
+
+    def __dealloc__(self):
+        codonwlib.tdb_free(&self.db)
+
+    @staticmethod
+    def build(source, taxa, path, bint pairs=False, long batch_bytes=1 << 24, int nthreads=0):
+        """Builds a store from sequences and their taxa and loads it
+
+        `source`: FASTA file name or file object, a `SeqBatch`, a list or
+            pd.Series of sequences, or an iterable of `SeqBatch`es
+        `taxa`: taxon ids by sequence name, see `TaxonDBBuilder.add`; the
+            columns of a pd.DataFrame name the ranks
+        `path`: file to write
+        `pairs`: also pool codon pair counts
+        """
+        taxa = _taxon_frame(taxa)
+        builder = TaxonDBBuilder([str(c) for c in taxa.columns], pairs)
+        for batch in _batches(source, batch_bytes):
+            builder.add(batch, taxa, nthreads)
+        builder.save(path)
+        return TaxonDB.load(path)
+
+    @staticmethod
+    def load(path):
+        """Maps a saved store read-only into memory
+        """
+        cdef TaxonDB self = TaxonDB.__new__(TaxonDB)
+        cdef bytes fn = os.fsencode(path)
+        if codonwlib.tdb_load(&self.db, fn):
+            raise IOError("Could not load taxon database from {}".format(path))
+        return self
+
+    def __len__(self):
+        return self.db.n
+
+    def __contains__(self, taxid):
+        return codonwlib.tdb_find(&self.db, taxid) >= 0
+
+    @property
+    def ids(self):
+        """Taxon ids held, increasing"""
+        return np.array(<int64_t[:self.db.n]>self.db.ids) if self.db.n else np.zeros([0], dtype=np.int64)
+
+    @property
+    def ranks(self):
+        """Names of the ranks given when the store was built"""
+        return tuple([self.db.rank_names[r].decode() for r in range(self.db.nrank)])
+
+    @property
+    def pairs(self):
+        return self.db.pairs
+
+    cdef np.ndarray _rows(self, ids):
+        cdef np.ndarray[dtype=np.int64_t, ndim=1, mode="c"] cids = np.ascontiguousarray(np.ravel(ids), dtype=np.int64)
+        cdef np.ndarray[dtype=np.int64_t, ndim=1, mode="c"] rows = np.empty_like(cids)
+        cdef long n = cids.shape[0], found = 0
+        if n > 0:
+            with nogil:
+                found = codonwlib.tdb_lookup(&self.db, <int64_t *>&cids[0], n, <int64_t *>&rows[0])
+        if found < n:
+            raise KeyError(cids[rows < 0][0])
+        return rows
+
+    cdef np.ndarray _gather(self, ids, int64_t *table, long width):
+        cdef np.ndarray[dtype=np.int64_t, ndim=1, mode="c"] rows = self._rows(ids)
+        cdef long n = rows.shape[0], i
+        cdef np.ndarray[dtype=np.int64_t, ndim=2, mode="c"] out = np.empty([n, width], dtype=np.int64)
+        with nogil:
+            for i in range(n):
+                memcpy(&out[i, 0], table + rows[i] * width, sizeof(int64_t) * width)
+        return out[0] if np.ndim(ids) == 0 else out
+
+    def codon_usage(self, taxids):
+        """Pooled codon counts of one taxon (65 values, untranslatable
+        codons first) or of each of a list of taxa (one row each)
+
+        Raises KeyError for a taxon that is not held.
+        """
+        return self._gather(taxids, self.db.ncod, 65)
+
+    def pair_usage(self, taxids):
+        """Pooled codon pair counts, columns as `count_codons_sparse(pairs=True)`
+        """
+        if not self.db.pairs:
+            raise ValueError("The taxon database was built without codon pairs")
+        return self._gather(taxids, self.db.npair, codonwlib.CSR_PAIR_BINS)
+
+    def n_genes(self, taxids):
+        """Number of sequences pooled in each taxon"""
+        genes = self._gather(taxids, self.db.genes, 1)
+        return genes[0] if np.ndim(taxids) == 0 else genes[:, 0]
+
+    def rank(self, taxid):
+        """Name of the rank a taxon was first given at"""
+        cdef long row = codonwlib.tdb_find(&self.db, taxid)
+        if row < 0:
+            raise KeyError(taxid)
+        return self.ranks[self.db.ranks[row]]
+
+
+bundle_tables = ["genetic_code", "cai", "fop", "aa_properties"]
+
+
+def _fop_classes(fop):
+    """The 65 codon classes of `fop`, as `_fop_struct` takes it
+    """
+    cdef codonwlib.FOP_STRUCT ref_fop = _fop_struct(fop)
+    return np.array([ref_fop.fop_cod[x] for x in range(65)], dtype=np.int8)
+
+
+cdef codonwlib.FOP_STRUCT _fop_struct(fop) except *:
+    """Optimal codons given as an integer (built-in `fop_ref`), a
+    collection of optimal codons, or the class of each of the 64 codons
+    (3 optimal, 2 common, 1 rare) as a pd.Series indexed by codon or array
+    """
+    cdef codonwlib.FOP_STRUCT ref_fop
+    cdef int x
+    if isinstance(fop, (int, np.integer)):
+        if not 0 <= fop < codonwlib.NUM_FOP_SPECIES:
+            raise ValueError("No Fop reference {}".format(fop))
+        return codonwlib.fop_ref[fop]
+
+    if isinstance(fop, pd.Series):
+        cls = fop.reindex(ref_codons[1:]).fillna(2).values
+    elif all(isinstance(c, str) for c in fop):
+        opt = {c.upper().replace("T", "U") for c in fop}
+        cls = [3 if c in opt else 2 for c in ref_codons[1:]]
+    else:
+        cls = fop
+    cls = np.asarray(cls, dtype=np.int64)
+    if cls.shape != (64,) or cls.min() < 1 or cls.max() > 3:
+        raise ValueError("Codon classes (1 to 3) must be given for 64 codons")
+    ref_fop.des = NULL
+    ref_fop.ref = NULL
+    ref_fop.fop_cod[0] = 0
+    for x in range(64):
+        ref_fop.fop_cod[x + 1] = cls[x]
+    return ref_fop
+
+
+cdef codonwlib.AMINO_PROP_STRUCT _prop_struct(prop) except *:
+    """Gravy and Aromo scales, 0 for the built-in ones or a dict with
+    "hydro" and/or "aromo" as pd.Series indexed by amino acid (one or three
+    letter codes, others keep their built-in values)
+    """
+    cdef codonwlib.AMINO_PROP_STRUCT ap = codonwlib.amino_prop
+    cdef int x
+    if isinstance(prop, (int, np.integer)):
+        if prop != 0:
+            raise ValueError("No built-in amino acid properties {}".format(prop))
+        return ap
+    for key in prop:
+        if key not in ("hydro", "aromo"):
+            raise ValueError("Amino acid properties are hydro and aromo, not {}".format(key))
+        scale = prop[key]
+        if not isinstance(scale, pd.Series):
+            scale = pd.Series(np.asarray(scale)[-21:], index=ref_aa3[1:])
+        for x in range(1, 22):
+            v = scale.get(ref_aa3[x], scale.get(ref_aa1[x]))
+            if v is None:
+                continue
+            if key == "hydro":
+                ap.hydro[x] = v
+            else:
+                ap.aromo[x] = v
+    return ap
+
+
+def write_ref_bundle(path, genetic_codes=None, cai_refs=None, fop_refs=None,
+                     aa_properties=None, long version=0, bint builtins=True):
+    """Writes reference tables to a bundle file for `RefBundle`
+
+    Each table is a dict of name to
+        `genetic_codes`: genetic code, as for `CodonSeq`
+        `cai_refs`: CAI weights, as the `cai_ref` of `CodonSeq.cai`
+        `fop_refs`: optimal codons, an integer (a built-in `fop_ref`), a
+            collection of optimal codons or the class of each codon
+            (3 optimal, 2 common, 1 rare)
+        `aa_properties`: Gravy and Aromo scales, a dict with "hydro" and
+            "aromo" pd.Series indexed by amino acid
+    `version`: recorded in the bundle, e.g. a release number
+    `builtins`: put the built-in tables of each kind first, named by
+        their descriptions (the amino acid properties as "codonW")
+
+    Names are at most BUNDLE_NAME_LEN - 1 bytes.
+    """
+    cdef list codes = [], cais = [], fops = [], props = [], names = []
+    cdef int ncode, ncai, nfop, nprop, i, k = 0
+    cdef codonwlib.GENETIC_CODE_STRUCT *pcu = NULL
+    cdef codonwlib.CAI_STRUCT *pcai = NULL
+    cdef codonwlib.FOP_STRUCT *pfop = NULL
+    cdef codonwlib.AMINO_PROP_STRUCT *pap = NULL
+    cdef const char **cnames = NULL
+    cdef bytes fn = os.fsencode(path)
+    cdef int ret = 1
+
+    if builtins:
+        codes = [(codonwlib.cu_ref[i].des.decode(), i) for i in range(codonwlib.NUM_GENETIC_CODES)]
+        cais = [(codonwlib.cai_ref[i].des.decode(), i) for i in range(codonwlib.NUM_CAI_SPECIES)]
+        fops = [(codonwlib.fop_ref[i].des.decode(), i) for i in range(codonwlib.NUM_FOP_SPECIES)]
+        props = [("codonW", 0)]
+    codes += list((genetic_codes or {}).items())
+    cais += list((cai_refs or {}).items())
+    fops += list((fop_refs or {}).items())
+    props += list((aa_properties or {}).items())
+    for table in (codes, cais, fops, props):
+        seen = [str(name) for name, _ in table]
+        if len(set(seen)) != len(seen):
+            raise ValueError("Names in a bundle table must be unique")
+        names += [x.encode()[:codonwlib.BUNDLE_NAME_LEN - 1] for x in seen]
+    ncode, ncai, nfop, nprop = len(codes), len(cais), len(fops), len(props)
+
+    try:
+        pcu = <codonwlib.GENETIC_CODE_STRUCT *>malloc(sizeof(codonwlib.GENETIC_CODE_STRUCT) * max(ncode, 1))
+        pcai = <codonwlib.CAI_STRUCT *>malloc(sizeof(codonwlib.CAI_STRUCT) * max(ncai, 1))
+        pfop = <codonwlib.FOP_STRUCT *>malloc(sizeof(codonwlib.FOP_STRUCT) * max(nfop, 1))
+        pap = <codonwlib.AMINO_PROP_STRUCT *>malloc(sizeof(codonwlib.AMINO_PROP_STRUCT) * max(nprop, 1))
+        cnames = <const char **>malloc(sizeof(char *) * max(len(names), 1))
+        if not (pcu and pcai and pfop and pap and cnames):
+            raise MemoryError()
+        for i in range(ncode):
+            pcu[i] = _code_struct(codes[i][1])
+        for i in range(ncai):
+            pcai[i] = _cai_struct(cais[i][1])
+        for i in range(nfop):
+            pfop[i] = _fop_struct(fops[i][1])
+        for i in range(nprop):
+            pap[i] = _prop_struct(props[i][1])
+        for i in range(len(names)):
+            cnames[i] = names[i]
+        ret = codonwlib.bundle_save(fn, version, pcu, ncode, pcai, ncai, pfop, nfop,
+                                    pap, nprop, cnames)
+    finally:
+        free(pcu)
+        free(pcai)
+        free(pfop)
+        free(pap)
+        free(cnames)
+    if ret:
+        raise OSError("Could not write reference bundle {}".format(path))
+
+
+cdef class RefBundle:
+    """Reference tables mapped read-only from a file written by
+    `write_ref_bundle`
+
+    Genetic codes, CAI weights, optimal codons and amino acid property
+    scales are held with the arrays derived from them, so processes start
+    without building any tables. Pass a bundle to `compute_metrics` to take
+    the references from it, by name or position:
+
+        bundle = codonw.RefBundle("refs.bundle")
+        df = codonw.compute_metrics(seqs, bundle=bundle, cai_ref="my genome")
+
+    `reload` points the bundle at a new file (e.g. one written elsewhere
+    and renamed over the old one) without a restart; calls already running
+    keep the tables they started with.
+    """
+    cdef codonwlib.REF_SLOT_STRUCT *slot
+    cdef readonly object path
+
+    def __init__(self, path):
+        cdef bytes fn = os.fsencode(path)
+        cdef codonwlib.REF_BUNDLE_STRUCT *b = codonwlib.bundle_load(fn)
+        if b == NULL:
+            raise IOError("Could not load reference bundle from {}".format(path))
+        self.slot = codonwlib.refslot_open(b)
+        codonwlib.bundle_unref(b)
+        if self.slot == NULL:
+            raise MemoryError()
+        self.path = path
+
+    def __dealloc__(self):
+        if self.slot != NULL:
+            codonwlib.refslot_close(self.slot)
+
+    def reload(self, path=None):
+        """Swaps in the bundle at `path` (by default the same file again)
+        """
+        path = self.path if path is None else path
+        cdef bytes fn = os.fsencode(path)
+        cdef codonwlib.REF_BUNDLE_STRUCT *b = codonwlib.bundle_load(fn)
+        if b == NULL:
+            raise IOError("Could not load reference bundle from {}".format(path))
+        codonwlib.refslot_swap(self.slot, b)
+        codonwlib.bundle_unref(b)
+        self.path = path
+
+    @property
+    def version(self):
+        cdef codonwlib.REF_BUNDLE_STRUCT *b = codonwlib.refslot_get(self.slot)
+        v = codonwlib.bundle_version(b)
+        codonwlib.bundle_unref(b)
+        return v
+
+    def names(self, table):
+        """Names of the records of one of `codonw.bundle_tables`
+        """
+        cdef int t = self._table(table)
+        cdef codonwlib.REF_BUNDLE_STRUCT *b = codonwlib.refslot_get(self.slot)
+        try:
+            return [codonwlib.bundle_name(b, t, i).decode()
+                    for i in range(codonwlib.bundle_count(b, t))]
+        finally:
+            codonwlib.bundle_unref(b)
+
+    cdef int _table(self, table) except -1:
+        if table not in bundle_tables:
+            raise ValueError("No bundle table {}, choose from {}".format(table, bundle_tables))
+        return bundle_tables.index(table)
+
+    cdef long _record(self, codonwlib.REF_BUNDLE_STRUCT *b, int t, key) except -1:
+        """Position of a record given by name or position"""
+        cdef long i
+        if isinstance(key, (int, np.integer)):
+            i = key
+            if not 0 <= i < codonwlib.bundle_count(b, t):
+                raise KeyError(key)
+            return i
+        i = codonwlib.bundle_find(b, t, str(key).encode())
+        if i < 0:
+            raise KeyError(key)
+        return i
+
+    cdef _MetricRef _metric_ref(self, genetic_code, cai_ref, fop_ref, aa_properties):
+        cdef _MetricRef ref = _MetricRef.__new__(_MetricRef)
+        cdef codonwlib.REF_BUNDLE_STRUCT *b = codonwlib.refslot_get(self.slot)
+        cdef long c, a, f, p
+        try:
+            c = self._record(b, 0, genetic_code)
+            a = self._record(b, 1, cai_ref)
+            f = self._record(b, 2, fop_ref)
+            p = self._record(b, 3, aa_properties)
+            codonwlib.bundle_metric_ref(b, c, a, f, p, &ref.ref)
+        finally:
+            codonwlib.bundle_unref(b)
+        return ref
+
+    def genetic_code(self, key):
+        """A genetic code as a pd.Series of amino acids by codon, usable
+        as the `genetic_code` of `CodonSeq`
+        """
+        cdef codonwlib.GENETIC_CODE_STRUCT code
+        cdef codonwlib.REF_BUNDLE_STRUCT *b = codonwlib.refslot_get(self.slot)
+        try:
+            codonwlib.bundle_code(b, self._record(b, 0, key), &code)
+        finally:
+            codonwlib.bundle_unref(b)
+        return pd.Series([ref_aa1[code.ca[x]] for x in range(65)], index=ref_codons)
+
+    def cai_weights(self, key):
+        """CAI weights as a pd.Series by codon"""
+        cdef codonwlib.CAI_STRUCT cai
+        cdef codonwlib.REF_BUNDLE_STRUCT *b = codonwlib.refslot_get(self.slot)
+        try:
+            codonwlib.bundle_cai(b, self._record(b, 1, key), &cai)
+        finally:
+            codonwlib.bundle_unref(b)
+        return pd.Series([cai.cai_val[x] for x in range(1, 65)], index=ref_codons[1:], name="w")
+
+    def codon_classes(self, key):
+        """Fop classes (3 optimal, 2 common, 1 rare) as a pd.Series by codon"""
+        cdef codonwlib.FOP_STRUCT fop
+        cdef codonwlib.REF_BUNDLE_STRUCT *b = codonwlib.refslot_get(self.slot)
+        try:
+            codonwlib.bundle_fop(b, self._record(b, 2, key), &fop)
+        finally:
+            codonwlib.bundle_unref(b)
+        return pd.Series([fop.fop_cod[x] for x in range(1, 65)], index=ref_codons[1:])
+
+    def aa_properties(self, key):
+        """Gravy and Aromo scales as a pd.DataFrame by amino acid"""
+        cdef codonwlib.AMINO_PROP_STRUCT ap
+        cdef codonwlib.REF_BUNDLE_STRUCT *b = codonwlib.refslot_get(self.slot)
+        try:
+            codonwlib.bundle_prop(b, self._record(b, 3, key), &ap)
+        finally:
+            codonwlib.bundle_unref(b)
+        return pd.DataFrame({"hydro": [ap.hydro[x] for x in range(1, 22)],
+                             "aromo": [ap.aromo[x] for x in range(1, 22)]},
+                            index=ref_aa3[1:])
+
+
+_iupac_complement = str.maketrans("ACGTURYSWKMBDHVN", "TGCAAYRSWMKVHDBN")
+
+
+def optimise_codons(proteins, cai_ref=0, genetic_code=0, int beam=16, int gc_window=0,
+                    gc_range=(0.0, 1.0), forbidden=(), bint both_strands=True,
+                    metrics=("CAI", "GC", "Nc"), int nthreads=0):
+    """Back-translates proteins into coding sequences of the highest CAI
+
+    `proteins`: one letter amino acid sequences ('*' for stop), a
+        `SeqBatch` or a list or pd.Series of them
+    `cai_ref`: codon weights to maximise, as for `CodonSeq.cai` (any table
+        of weights, e.g. tAI, may be given as a pd.Series by codon)
+    `genetic_code`: as for `CodonSeq`
+    `beam`: partial sequences kept at each position (1 is greedy)
+    `gc_window`, `gc_range`: every window of `gc_window` bases (at most
+        252) must have a fraction of G+C within `gc_range`
+    `forbidden`: motifs that may not occur, e.g. restriction sites, with
+        IUPAC letters allowed; `both_strands` adds their reverse complements
+    `metrics`: indices of the results, from `codonw.ref_metrics`
+    `nthreads`: threads to use, 0 for all processors
+
+    Constraints are not absolute: the sequence with the fewest windows and
+    motifs violated (the "Violations" column) is chosen first and then the
+    one with the highest CAI among those. Returns a pd.DataFrame with the
+    coding sequence ("seq"), `metrics` computed with the same references
+    and the violations (-1, and no sequence, for proteins with letters the
+    genetic code cannot encode).
+    """
+    cdef SeqBatch batch = _as_batch(proteins)
+    cdef long n = len(batch)
+    cdef codonwlib.GENETIC_CODE_STRUCT code = _code_struct(genetic_code)
+    cdef codonwlib.CAI_STRUCT cai = _cai_struct(cai_ref)
+    cdef codonwlib.OPT_PARAMS_STRUCT par
+    cdef const char *prot = batch.data
+    cdef np.int64_t[::1] offsets = batch.offsets
+    cdef np.ndarray[dtype=np.uint8_t, ndim=1, mode="c"] out = np.empty([3 * len(batch.data) + 1], dtype=np.uint8)
+    cdef np.ndarray[dtype=long, ndim=1, mode="c"] viol = np.zeros([max(n, 1)], dtype=c_long)
+    cdef const char **cmotifs = NULL
+    cdef int ret = 0, i
+
+    motifs = [m.upper().replace("U", "T") for m in ([forbidden] if isinstance(forbidden, str) else forbidden)]
+    if both_strands:
+        motifs += [m.translate(_iupac_complement)[::-1] for m in motifs]
+    motifs = [m.encode() for m in dict.fromkeys(motifs)]
+    if not 0.0 <= gc_range[0] <= gc_range[1] <= 1.0:
+        raise ValueError("gc_range must be two fractions, low then high")
+
+    par.beam = beam
+    par.window = gc_window
+    par.gc_min = gc_range[0]
+    par.gc_max = gc_range[1]
+    par.nmotif = len(motifs)
+    cmotifs = <const char **>malloc(sizeof(char *) * max(len(motifs), 1))
+    if cmotifs == NULL:
+        raise MemoryError()
+    for i in range(len(motifs)):
+        cmotifs[i] = motifs[i]
+    par.motifs = cmotifs
+    try:
+        if n > 0:
+            with nogil:
+                ret = codonwlib.opt_batch(prot, <int64_t *>&offsets[0], n, &code, &cai, &par,
+                                          <char *>&out[0], &viol[0], nthreads)
+    finally:
+        free(cmotifs)
+    if ret:
+        raise ValueError("Could not optimise codons")
+
+    result = SeqBatch.from_buffer(out[:3 * len(batch.data)].tobytes(), 3 * batch.offsets, batch.names)
+    viol = viol[:n]
+    scores = compute_metrics(result, metrics, genetic_code, cai_ref, nthreads=nthreads)
+    vals = scores.to_numpy(dtype=c_double, copy=True)
+    vals[viol < 0] = np.nan
+    data = {"seq": [s if v >= 0 else "" for s, v in zip(result, viol)]}
+    data.update({m: vals[:, k] for k, m in enumerate(scores.columns)})
+    data["Violations"] = viol
+    return pd.DataFrame(data, index=batch.names)
+
+
+cdef class CodonHarmoniser:
+    """Codon harmonisation of genes from a source organism for a host
+
+    `source`, `host`: codon usage tables of the two organisms, 64 (or 65,
+        untranslatable codons first) counts or frequencies as for
+        `usage_weights`, e.g. from `read_usage_tables` or `count_codons`
+        of a reference set
+    `genetic_code`: as for `CodonSeq`
+
+    The synonymous codons of each amino acid are ranked by RSCU in each
+    table and the codon of each rank in the source replaced by the codon
+    of the same rank in the host, so that rare codons stay rare (e.g. to
+    keep translational pausing) and common codons stay common. The mapping
+    is worked out once, `harmonise` applies it to any number of genes.
+    """
+    cdef codonwlib.HARM_STRUCT harm
+
+    def __init__(self, source, host, genetic_code=0):
+        cdef np.ndarray[dtype=double, ndim=2, mode="c"] src = _usage_matrix(source)
+        cdef np.ndarray[dtype=double, ndim=2, mode="c"] dst = _usage_matrix(host)
+        cdef codonwlib.GENETIC_CODE_STRUCT code = _code_struct(genetic_code)
+        if src.shape[0] != 1 or dst.shape[0] != 1:
+            raise ValueError("Give one codon usage table each for the source and host")
+        codonwlib.harm_init(&self.harm, &src[0, 0], &dst[0, 0], &code)
+
+    @property
+    def mapping(self):
+        """Host codon replacing each source codon, as a pd.Series"""
+        return pd.Series([ref_codons[self.harm.map[x]] for x in range(1, 65)],
+                         index=ref_codons[1:65], name="host")
+
+    def harmonise(self, seqs, int nthreads=0):
+        """Harmonises coding sequences
+
+        `seqs`: sequences of the source organism, a `SeqBatch` or a list or
+            pd.Series of them
+        `nthreads`: threads to use, 0 for all processors
+
+        Codons with letters other than bases are kept, as is the case of
+        each letter. Returns a pd.DataFrame with the harmonised sequence
+        ("seq"), "Similarity", the Pearson correlation of the frequency of
+        each codon among its synonyms in the source with that of the codon
+        replacing it in the host (over codons of amino acids with synonyms,
+        NaN for fewer than two or no variation), "Native", the same for the
+        gene left as it is, and the number of codons "Changed".
+        """
+        cdef SeqBatch batch = _as_batch(seqs)
+        cdef long n = len(batch)
+        cdef const char *data = batch.data
+        cdef np.int64_t[::1] offsets = batch.offsets
+        cdef np.ndarray[dtype=np.uint8_t, ndim=1, mode="c"] out = np.empty([len(batch.data) + 1], dtype=np.uint8)
+        cdef np.ndarray[dtype=double, ndim=2, mode="c"] sim = np.empty([max(n, 1), 2], dtype=c_double)
+        cdef np.ndarray[dtype=long, ndim=1, mode="c"] changed = np.zeros([max(n, 1)], dtype=c_long)
+
+        if n > 0:
+            with nogil:
+                codonwlib.harm_batch(data, <int64_t *>&offsets[0], n, &self.harm,
+                                     <char *>&out[0], &sim[0, 0], &changed[0], nthreads)
+        result = SeqBatch.from_buffer(out[:len(batch.data)].tobytes(), batch.offsets, batch.names)
+        return pd.DataFrame({"seq": list(result), "Similarity": sim[:n, 0],
+                             "Native": sim[:n, 1], "Changed": changed[:n]},
+                            index=batch.names)
+
+
+def scan_synonymous(seqs, genetic_code=0, cai_ref=0, fop_ref=0, int nthreads=0):
+    """Changes in CAI, Fop, Nc and GC3s of every single synonymous codon
+    substitution of each gene, e.g. for the design of mutational scanning
+    libraries
+
+    `seqs`: coding sequences, a `SeqBatch` or a list or pd.Series of them
+    `genetic_code`, `cai_ref`, `fop_ref`: as for `compute_metrics` (a
+        `fop_ref` may also be optimal codons, as for `write_ref_bundle`)
+    `nthreads`: threads to use, 0 for all processors
+
+    Each sense codon is replaced in turn by each of its synonyms. The
+    indices of a gene are computed once and each variant only moves one
+    count between two codons, so a variant costs a few operations rather
+    than a recount. Returns a pd.DataFrame with a row per variant: the
+    gene (its name, or position in `seqs`), "pos", the offset in bases of
+    the codon changed, "ref" and "alt", the codons before and after, and
+    the changes "dCAI", "dFop", "dNc" and "dGC3s" (NaN where the index is
+    undefined for the gene or variant).
+    """
+    cdef SeqBatch batch = _as_batch(seqs)
+    cdef long n = len(batch)
+    cdef codonwlib.GENETIC_CODE_STRUCT code = _code_struct(genetic_code)
+    cdef codonwlib.CAI_STRUCT cai = _cai_struct(cai_ref)
+    cdef codonwlib.FOP_STRUCT fop = _fop_struct(fop_ref)
+    cdef codonwlib.METRIC_REF_STRUCT ref
+    cdef const char *data = batch.data
+    cdef np.int64_t[::1] offsets = batch.offsets
+    cdef np.ndarray[dtype=np.int64_t, ndim=1, mode="c"] var_off = np.zeros([n + 1], dtype=np.int64)
+    cdef np.ndarray[dtype=np.int64_t, ndim=1, mode="c"] pos
+    cdef np.ndarray[dtype=np.uint8_t, ndim=1, mode="c"] frm
+    cdef np.ndarray[dtype=np.uint8_t, ndim=1, mode="c"] to
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] out
+    cdef int64_t nvar = 0
+
+    codonwlib.metric_init(&ref, &code, &cai, &fop)
+    if n > 0:
+        with nogil:
+            nvar = codonwlib.scan_count(data, <int64_t *>&offsets[0], n, &ref,
+                                        <int64_t *>&var_off[0], nthreads)
+    pos = np.empty([max(nvar, 1)], dtype=np.int64)
+    frm = np.empty([max(nvar, 1)], dtype=np.uint8)
+    to = np.empty([max(nvar, 1)], dtype=np.uint8)
+    out = np.empty([max(nvar, 1), codonwlib.SCAN_NMETRIC], dtype=c_double)
+    if nvar > 0:
+        with nogil:
+            codonwlib.scan_batch(data, <int64_t *>&offsets[0], n, &ref, <int64_t *>&var_off[0],
+                                 <int64_t *>&pos[0], &frm[0], &to[0], &out[0, 0], nthreads)
+
+    names = np.asarray(batch.names if batch.names is not None else np.arange(n), dtype=object)
+    codons = np.array([c.replace("U", "T") for c in ref_codons], dtype=object)
+    cols = {"gene": np.repeat(names, np.diff(var_off)), "pos": pos[:nvar],
+            "ref": codons[frm[:nvar]], "alt": codons[to[:nvar]]}
+    cols.update({m: out[:nvar, k] for k, m in enumerate(["dCAI", "dFop", "dNc", "dGC3s"])})
+    return pd.DataFrame(cols)
+
+
+def _genome_seqs(genome):
+    """Chromosome sequences by name from a dict, pd.Series, `SeqBatch`es or
+    a FASTA file (named by the first word of each title)
+    """
+    if isinstance(genome, (str, bytes, os.PathLike)):
+        genome = read_fasta(genome)
+    if isinstance(genome, dict):
+        return genome
+    if isinstance(genome, pd.Series):
+        return genome.to_dict()
+    if isinstance(genome, SeqBatch):
+        genome = [genome]
+    seqs = {}
+    for batch in genome:
+        for name, seq in zip(batch.names, batch):
+            seqs[name.split()[0] if name.split() else name] = seq
+    return seqs
+
+
+def _cds_model(cds, genome):
+    """Gene names, CDS sequences and the exon table of `annotate_vcf`
+    """
+    cds = pd.DataFrame(cds)
+    missing = {"gene", "chrom", "start", "end", "strand"} - set(cds.columns)
+    if missing:
+        raise ValueError("CDS coordinates lack columns {}".format(sorted(missing)))
+    seqs = _genome_seqs(genome)
+    strand = np.where(cds["strand"].isin(["-", -1, "-1"]), -1, 1).astype(np.int8)
+    start = cds["start"].to_numpy(dtype=np.int64) - 1
+    end = cds["end"].to_numpy(dtype=np.int64)
+    chrom = cds["chrom"].astype(str).to_numpy()
+    genes = list(dict.fromkeys(cds["gene"]))
+    gene = pd.Index(genes).get_indexer(cds["gene"]).astype(np.int32)
+    if (end <= start).any():
+        raise ValueError("CDS exons must end at or after their start")
+
+    mixed = pd.DataFrame({"gene": gene, "chrom": chrom, "strand": strand}).groupby("gene").nunique()
+    mixed = mixed.index[(mixed["chrom"] > 1) | (mixed["strand"] > 1)]
+    if len(mixed):
+        raise ValueError("Exons of gene {} are on different chromosomes or strands".format(genes[mixed[0]]))
+
+    # exons of a gene in the direction of transcription give its CDS
+    exon_cds = np.zeros(len(cds), dtype=np.int64)
+    gene_len = np.zeros(len(genes), dtype=np.int64)
+    parts = [[] for _ in genes]
+    for i in np.lexsort((start * strand, gene)):
+        g = gene[i]
+        if chrom[i] not in seqs:
+            raise ValueError("No sequence for chromosome {}".format(chrom[i]))
+        piece = seqs[chrom[i]][start[i]:end[i]].upper()
+        if strand[i] < 0:
+            piece = piece.translate(_iupac_complement)[::-1]
+        exon_cds[i] = gene_len[g]
+        gene_len[g] += len(piece)
+        parts[g].append(piece)
+
+    names = sorted(set(chrom))
+    chrom_idx = pd.Index(names).get_indexer(chrom).astype(np.int32)
+    order = np.lexsort((start, chrom_idx))
+    exons = {"chrom": chrom_idx[order], "start": start[order], "end": end[order],
+             "gene": gene[order], "cds": exon_cds[order], "strand": strand[order]}
+    return genes, names, SeqBatch(["".join(p) for p in parts]), exons
+
+
+def _vcf_blocks(vcf, long block_bytes):
+    """Whole lines of a VCF file name or file object (gzip compressed or
+    not) in blocks of about `block_bytes`, decompressed as they are read
+    """
+    close = isinstance(vcf, (str, bytes, os.PathLike))
+    if not close and not hasattr(vcf, "read"):
+        raise TypeError("A VCF must be given as a file name or file object")
+    fh = open(vcf, "rb") if close else vcf
+    try:
+        if hasattr(fh, "peek"):
+            magic = fh.peek(2)[:2]
+        elif fh.seekable():
+            at = fh.tell()
+            magic = fh.read(2)
+            fh.seek(at)
+        else:
+            magic = b""
+        if magic == b"\x1f\x8b":
+            fh = gzip.GzipFile(fileobj=fh)
+        rest = b""
+        while True:
+            block = fh.read(block_bytes)
+            if isinstance(block, str):
+                block = block.encode()
+            if not block:
+                break
+            buf = rest + block
+            cut = buf.rfind(b"\n")
+            if cut < 0:
+                rest = buf
+                continue
+            rest = buf[cut + 1:]
+            yield buf[:cut + 1]
+        if rest:
+            yield rest
+    finally:
+        if close:
+            fh.close()
+
+
+cdef np.ndarray _c_array(const void *p, long n, dtype):
+    """Copy of the `n` items of `dtype` at `p`
+    """
+    cdef np.ndarray arr = np.empty([n], dtype=dtype)
+    if n > 0:
+        memcpy(np.PyArray_DATA(arr), p, n * arr.itemsize)
+    return arr
+
+
+def annotate_vcf(vcf, cds, genome, genetic_code=0, cai_ref=0, fop_ref=0,
+                 bint haplotypes=False, int nthreads=0, long block_bytes=1 << 24):
+    """Changes in CAI, Fop, Nc and GC3s of genes from the single nucleotide
+    variants of a VCF
+
+    `vcf`: VCF file name or file object (binary or text), gzip compressed
+        or not, read in blocks of `block_bytes` so that it is never held
+        in memory whole
+    `cds`: coding sequence coordinates, a pd.DataFrame (or anything it is
+        made from) with one row per exon: "gene", "chrom", "start" and
+        "end" (1-based, inclusive as in GFF) and "strand" ('+' or '-');
+        the exons of a gene are joined in order along its strand
+    `genome`: chromosome sequences, a dict or pd.Series by name,
+        `SeqBatch`es or a FASTA file
+    `genetic_code`, `cai_ref`, `fop_ref`: as for `scan_synonymous`
+    `haplotypes`: also the changes of each haplotype of each sample (the
+        GT field, taken in the order written; meaningful for phased calls)
+    `nthreads`: threads to use, 0 for all processors
+
+    Each ALT allele of one base of a record with a REF of one base is a
+    variant (multi-allelic records give one per allele), placed on every
+    CDS that holds it. The codon counts of each gene are taken once and a
+    variant only moves a count from one codon to another, so no variant
+    sequence is made. Returns a pd.DataFrame with a row per variant and
+    gene: "chrom", "pos" (POS), "record" (data line of the VCF, from 0),
+    "allele" (from 1), "gene", "cds_pos" (offset in the CDS), the codons
+    "ref" and "alt" with their amino acids "ref_aa" and "alt_aa",
+    "status" ("ok", "ref_mismatch" when REF is not the genome base or
+    "no_codon" outside a whole codon of bases, with NaN changes) and
+    "dCAI", "dFop", "dNc" and "dGC3s".
+
+    With `haplotypes`, also returns a pd.DataFrame of the haplotypes that
+    carry variants in a gene: "sample", "haplotype" (from 0), "gene",
+    "variants" and the changes of all of those variants together (those
+    in one codon combined), as a tuple (variants, haplotypes).
+    """
+    genes, chrom_names, seqs, exons = _cds_model(cds, genome)
+    cdef codonwlib.GENETIC_CODE_STRUCT code = _code_struct(genetic_code)
+    cdef codonwlib.CAI_STRUCT cai = _cai_struct(cai_ref)
+    cdef codonwlib.FOP_STRUCT fop = _fop_struct(fop_ref)
+    cdef codonwlib.METRIC_REF_STRUCT ref
+    cdef codonwlib.VCF_MODEL_STRUCT model
+    cdef codonwlib.VCF_RESULT_STRUCT res
+    cdef codonwlib.VCF_PARSE_STRUCT *ps = NULL
+    cdef bytes chroms = b"".join(c.encode() for c in chrom_names)
+    cdef np.ndarray[dtype=np.int64_t, ndim=1, mode="c"] chrom_off = np.zeros([len(chrom_names) + 1], dtype=np.int64)
+    cdef np.int32_t[::1] exon_chrom = exons["chrom"]
+    cdef np.int64_t[::1] exon_start = exons["start"]
+    cdef np.int64_t[::1] exon_end = exons["end"]
+    cdef np.int32_t[::1] exon_gene = exons["gene"]
+    cdef np.int64_t[::1] exon_cds = exons["cds"]
+    cdef np.int8_t[::1] exon_strand = exons["strand"]
+    cdef np.int64_t[::1] cds_off = seqs.offsets
+    cdef const char *cbuf
+    cdef long length
+    cdef int ret = 0
+
+    np.cumsum([len(c.encode()) for c in chrom_names], out=chrom_off[1:])
+    codonwlib.metric_init(&ref, &code, &cai, &fop)
+    model.chroms = chroms
+    model.chrom_off = <int64_t *>&chrom_off[0]
+    model.nchrom = len(chrom_names)
+    model.nexon = exon_chrom.shape[0]
+    if model.nexon:
+        model.exon_chrom = &exon_chrom[0]
+        model.exon_start = <int64_t *>&exon_start[0]
+        model.exon_end = <int64_t *>&exon_end[0]
+        model.exon_gene = &exon_gene[0]
+        model.exon_cds = <int64_t *>&exon_cds[0]
+        model.exon_strand = &exon_strand[0]
+    model.cds = seqs.data
+    model.cds_off = <int64_t *>&cds_off[0]
+    model.ngene = len(genes)
+    model.samples = haplotypes
+
+    header = []
+    ps = codonwlib.vcf_open(&model, &res)
+    try:
+        if ps == NULL:
+            raise MemoryError()
+        for buf in _vcf_blocks(vcf, block_bytes):
+            if not header and (buf.startswith(b"#CHROM") or b"\n#CHROM" in buf):
+                start = buf.find(b"#CHROM")
+                stop = buf.find(b"\n", start)
+                header = buf[start:stop if stop >= 0 else len(buf)].decode().rstrip("\r").split("\t")
+            cbuf = buf
+            length = len(buf)
+            with nogil:
+                ret = codonwlib.vcf_feed(ps, cbuf, length)
+            if ret:
+                raise MemoryError()
+        with nogil:
+            ret = codonwlib.vcf_finish(ps, &ref, nthreads)
+        if ret:
+            raise MemoryError()
+        codons = np.array([""] + [c.replace("U", "T") for c in ref_codons[1:]], dtype=object)
+        aas = np.array([""] + [ref_aa1[code.ca[x]] for x in range(1, 65)], dtype=object)
+        gene_names = np.asarray(genes + [None], dtype=object)[:len(genes)]
+        status = np.array(["ok", "ref_mismatch", "no_codon"], dtype=object)
+        nhit = res.nhit
+        frm = _c_array(res.from_, nhit, np.uint8)
+        to = _c_array(res.to, nhit, np.uint8)
+        cols = {"chrom": np.asarray(chrom_names, dtype=object)[_c_array(res.chrom, nhit, np.int32)],
+                "pos": _c_array(res.vcf_pos, nhit, np.int64),
+                "record": _c_array(res.rec, nhit, np.int64),
+                "allele": _c_array(res.allele, nhit, np.int32),
+                "gene": gene_names[_c_array(res.gene, nhit, np.int32)],
+                "cds_pos": _c_array(res.pos, nhit, np.int64),
+                "ref": codons[frm], "alt": codons[to], "ref_aa": aas[frm], "alt_aa": aas[to],
+                "status": status[_c_array(res.status, nhit, np.int8)]}
+        delta = _c_array(res.delta, nhit * codonwlib.SCAN_NMETRIC, c_double).reshape(nhit, codonwlib.SCAN_NMETRIC)
+        cols.update({m: delta[:, k] for k, m in enumerate(["dCAI", "dFop", "dNc", "dGC3s"])})
+        variants = pd.DataFrame(cols)
+        if not haplotypes:
+            return variants
+
+        samples = np.asarray(header[9:] + [""] * max(res.nsample - len(header[9:]), 0) + [None], dtype=object)
+        nhap = res.nhap
+        hcols = {"sample": samples[_c_array(res.hap_sample, nhap, np.int32)],
+                 "haplotype": _c_array(res.hap, nhap, np.int8),
+                 "gene": gene_names[_c_array(res.hap_gene, nhap, np.int32)],
+                 "variants": _c_array(res.hap_nvar, nhap, np.int32)}
+        delta = _c_array(res.hap_delta, nhap * codonwlib.SCAN_NMETRIC, c_double).reshape(nhap, codonwlib.SCAN_NMETRIC)
+        hcols.update({m: delta[:, k] for k, m in enumerate(["dCAI", "dFop", "dNc", "dGC3s"])})
+        return variants, pd.DataFrame(hcols)
+    finally:
+        codonwlib.vcf_close(ps)
+        codonwlib.vcf_free(&res)
+
+
+def weighted_usage(counts, weights, metrics=("Nc", "GC3s"), genetic_code=0, cai_ref=0,
+                   fop_ref=0, int nthreads=0):
+    """Codon usage of whole transcriptomes: gene codon counts weighted by
+    expression in each sample
+
+    `counts`: codon counts of n genes, 64 or 65 columns as from
+        `count_codons` or `CodonSeq.codon_usage`
+    `weights`: n x s expression of each gene in each sample (e.g. TPM or
+        ribosome densities), a pd.DataFrame with a column per sample or an
+        array; one sample if 1-D. Rows of a pd.DataFrame or pd.Series are
+        taken by the index of `counts` when that is a pd.DataFrame too
+    `metrics`: names from `codonw.ref_metrics` computed from each sample's
+        table
+    `genetic_code`, `cai_ref`, `fop_ref`: references, as for
+        `compute_metrics`
+    `nthreads`: threads to use, 0 for all processors
+
+    The s tables are the product of the weights and counts, taken in one
+    blocked pass with float64 sums. Returns a tuple of pd.DataFrames with a
+    row per sample: the weighted codon usage (64 codons, usable as counts
+    elsewhere in this module), amino acid usage (as `CodonSeq.aa_usage`),
+    RSCU (as `CodonSeq.rscu`) and the indices in `metrics`.
+    """
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] ncod = _usage_matrix(counts)
+    cdef long n = ncod.shape[0]
+    if isinstance(counts, pd.DataFrame) and isinstance(weights, (pd.DataFrame, pd.Series)):
+        weights = weights.loc[counts.index]
+    if isinstance(weights, pd.Series):
+        weights = weights.to_frame()
+    samples = weights.columns if isinstance(weights, pd.DataFrame) else None
+    weights = np.asarray(weights, dtype=c_double)
+    if weights.ndim == 1:
+        weights = weights[:, np.newaxis]
+    if weights.ndim != 2 or weights.shape[0] != n:
+        raise ValueError("Weights must have a row for each of {} genes".format(n))
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] w = np.ascontiguousarray(weights)
+
+    cdef _MetricRef ref = _MetricRef(genetic_code, cai_ref, fop_ref)
+    cdef int[::1] which = _metric_index(metrics)
+    cdef long s = w.shape[1]
+    cdef int nwhich = which.shape[0]
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] usage = np.zeros([max(s, 1), 65], dtype=c_double)
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] naa = np.zeros([max(s, 1), 22], dtype=c_double)
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] rscu = np.zeros([max(s, 1), 65], dtype=c_double)
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] out = np.zeros([max(s, 1), max(nwhich, 1)], dtype=c_double)
+    cdef const int *cwhich = &which[0] if nwhich else NULL
+    cdef const double *cncod = &ncod[0, 0] if n else NULL
+    cdef const double *cw = &w[0, 0] if n and s else NULL
+    cdef int ret
+
+    with nogil:
+        ret = codonwlib.wusage_batch(cncod, n, cw, s, &ref.ref, cwhich, nwhich, &usage[0, 0],
+                                     &naa[0, 0], &rscu[0, 0], &out[0, 0], nthreads)
+    if ret:
+        raise ValueError("Illegal Fop or CBI reference values")
+
+    index = samples if samples is not None else pd.RangeIndex(s)
+    names = [ref_metrics[i] for i in which]
+    return (pd.DataFrame(usage[:s, 1:], index=index, columns=ref_codons[1:], copy=False),
+            pd.DataFrame(naa[:s], index=index, columns=ref_aa1, copy=False),
+            pd.DataFrame(rscu[:s, 1:], index=index, columns=ref_codons[1:], copy=False),
+            pd.DataFrame(out[:s, :nwhich], index=index, columns=names, copy=False))
+
+
+cdef class Server:
+    """Resident server computing indices for sequences sent over a Unix
+    domain socket, see `ServeClient` and codon_serve.c for the protocol
+
+    `path`: socket to listen on (a stale socket there is replaced)
+    `nthreads`: threads used for each request, 0 for all CPUs
+
+    E.g. in its own process
+
+        codonw.Server("/tmp/codonw.sock").serve_forever()
+    """
+    cdef codonwlib.SERVE_STRUCT *srv
+    cdef readonly object path
+    cdef object lock  # serving and closing flags, set from several threads
+    cdef bint serving, closing
+
+    def __init__(self, path, int nthreads=0):
+        self.path = os.fsencode(path)
+        self.lock = threading.Lock()
+        self.srv = codonwlib.serve_open(self.path, nthreads)
+        if self.srv == NULL:
+            raise OSError("Could not listen on {}".format(path))
+
+    def serve_forever(self, double poll_interval=0.1):
+        """Answers requests until a client asks the server to shut down or
+        the server is closed
+
+        Signals (e.g. KeyboardInterrupt) are handled every `poll_interval`
+        seconds.
+        """
+        cdef int ret = 0
+        cdef int ms = <int>(poll_interval * 1000)
+        with self.lock:
+            if self.serving:
+                raise RuntimeError("Server is already serving")
+            self.serving = True
+        try:
+            while True:
+                with self.lock:
+                    if self.closing or self.srv == NULL or not codonwlib.serve_running(self.srv):
+                        break
+                with nogil:
+                    ret = codonwlib.serve_poll(self.srv, ms)
+                if ret:
+                    raise OSError("Server failed")
+        finally:
+            with self.lock:
+                self.serving = False
+                if self.closing:
+                    self._free()
+
+    def close(self):
+        """Closes the socket, after the current poll if another thread is in
+        `serve_forever`
+        """
+        with self.lock:
+            self.closing = True
+            if not self.serving:
+                self._free()
+
+    cdef _free(self):
+        if self.srv != NULL:
+            codonwlib.serve_close(self.srv)
+            self.srv = NULL
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __dealloc__(self):
+        # nothing else can be serving once the object is unreachable
+        self._free()
+
+
+class ServeClient:
+    """Client of a `Server`
+
+    Requests can be pipelined, `submit` sends a batch of sequences and
+    returns at once with a request id, `result` waits for its indices.
+
+        with codonw.ServeClient("/tmp/codonw.sock") as client:
+            ids = [client.submit(batch, metrics=["CAI", "Nc"]) for batch in batches]
+            results = [client.result(i) for i in ids]
+    """
+    _header = struct.Struct("=IIBBBBI")
+    _reply = struct.Struct("=IIBBHI")
+
+    def __init__(self, path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(os.fsdecode(path))
+        self._next_id = 0
+        self._waiting = {}
+        self._done = {}
+
+    def _send(self, kind, payload=b"", genetic_code=0, cai_ref=0, fop_ref=0, mask=0):
+        rid = self._next_id
+        self._next_id = (self._next_id + 1) % (1 << 32)
+        self.sock.sendall(self._header.pack(len(payload), rid, kind, genetic_code,
+                                            cai_ref, fop_ref, mask) + payload)
+        return rid
+
+    def _recv(self, n):
+        buf = bytearray(n)
+        view = memoryview(buf)
+        got = 0
+        while got < n:
+            k = self.sock.recv_into(view[got:], n - got)
+            if k == 0:
+                raise ConnectionError("Server closed the connection")
+            got += k
+        return bytes(buf)
+
+    def _wait(self, rid):
+        while rid not in self._done:
+            length, got_id, status, nind, _, nseq = self._reply.unpack(self._recv(self._reply.size))
+            self._done[got_id] = (status, nind, nseq, self._recv(length))
+        status, nind, nseq, payload = self._done.pop(rid)
+        if status:
+            raise ValueError(payload.decode('UTF-8', 'replace'))
+        return np.frombuffer(payload, dtype=np.float64).reshape(nseq, nind)
+
+    def submit(self, seqs, metrics=None, int genetic_code=0, int cai_ref=0, int fop_ref=0,
+               fasta=False):
+        """Sends sequences for indices, returns the request id
+
+        `seqs`: sequences (str or bytes, a pd.Series keeps its index) or,
+            if `fasta`, FASTA text
+        `metrics`: names from `ref_metrics`, all by default
+        `genetic_code`, `cai_ref`, `fop_ref`: built-in tables, as for
+            `CodonSeq`
+        """
+        metrics = list(ref_metrics if metrics is None else metrics)
+        mask = 0
+        for m in metrics:
+            mask |= 1 << ref_metrics.index(m)
+        names = None
+        if fasta:
+            payload = seqs.encode() if isinstance(seqs, str) else bytes(seqs)
+            kind = 1
+        else:
+            if isinstance(seqs, pd.Series):
+                names = seqs.index
+            seqs = [s.encode() if isinstance(s, str) else bytes(s) for s in seqs]
+            payload = b"".join([struct.pack("=I{}I".format(len(seqs)), len(seqs),
+                                            *[len(s) for s in seqs])] + seqs)
+            kind = 2
+        rid = self._send(kind, payload, genetic_code, cai_ref, fop_ref, mask)
+        self._waiting[rid] = ([m for m in ref_metrics if m in metrics], names)
+        return rid
+
+    def result(self, rid):
+        """Indices of request `rid` as a pd.DataFrame, one row per sequence
+        """
+        columns, names = self._waiting.pop(rid)
+        return pd.DataFrame(self._wait(rid), columns=columns, index=names)
+
+    def query(self, seqs, **kwargs):
+        """`submit` and wait for the `result`
+        """
+        return self.result(self.submit(seqs, **kwargs))
+
+    def stats(self):
+        """Requests and sequences answered by the server and the p50, p99,
+        max and mean latency (us) of recent requests
+        """
+        v = self._wait(self._send(3))[0]
+        return pd.Series(v, index=["requests", "sequences", "p50_us", "p99_us",
+                                   "max_us", "mean_us"])
+
+    def shutdown(self):
+        """Asks the server to stop after this request
+        """
+        self._wait(self._send(4))
+
+    def close(self):
+        self.sock.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+
+cdef class _MetricTask:
+    """`compute_metrics` of one batch, run by the background pool
+    """
+    cdef codonwlib.METRIC_TASK_STRUCT task
+    cdef SeqBatch batch
+    cdef _MetricRef ref
+    cdef int[::1] which
+    cdef const np.int64_t[::1] offsets
+    cdef long[:, ::1] ncod
+    cdef double[:, ::1] out
+
+    def __init__(self, SeqBatch batch, _MetricRef ref, which):
+        cdef long n = len(batch)
+        self.batch = batch
+        self.ref = ref
+        self.which = which
+        self.offsets = batch.offsets
+        self.ncod = np.zeros([max(n, 1), 65], dtype=c_long)
+        self.out = np.zeros([max(n, 1), max(len(which), 1)], dtype=c_double)
+        self.task.data = batch.data
+        self.task.offsets = <int64_t *>&self.offsets[0]
+        self.task.n = n
+        self.task.ncod = &self.ncod[0, 0]
+        self.task.ref = &ref.ref
+        self.task.which = &self.which[0] if len(which) else NULL
+        self.task.nwhich = len(which)
+        self.task.out = &self.out[0, 0]
+        self.task.status = 0
+
+    def result(self):
+        if self.task.status:
+            raise ValueError("Could not compute indices")
+        return pd.DataFrame(np.asarray(self.out)[:self.task.n, :self.task.nwhich],
+                            columns=[ref_metrics[i] for i in self.which],
+                            index=self.batch.names)
+
+
+cdef class _Pool:
+    """Background worker threads, finished tasks wake the asyncio event
+    loop that is waiting for them through the pool's file descriptor
+    """
+    cdef codonwlib.POOL_STRUCT *pool
+    cdef int64_t next_id
+    cdef dict pending
+    cdef dict loops
+    cdef object lock  # event loops in several threads share the pool
+
+    def __init__(self, int nthreads=0):
+        self.pool = codonwlib.pool_open(nthreads)
+        if self.pool == NULL:
+            raise OSError("Could not start worker threads")
+        self.next_id = 0
+        self.pending = {}
+        self.loops = {}
+        self.lock = threading.Lock()
+
+    def submit(self, _MetricTask task):
+        """Runs `task` in the background, returns an asyncio future
+        """
+        loop = asyncio.get_running_loop()
+        fut = loop.create_future()
+        with self.lock:
+            # ids are only collected under the lock, so the task is
+            # registered after it is accepted and nothing is left behind
+            if codonwlib.pool_submit(self.pool, codonwlib.metric_task, &task.task, self.next_id):
+                raise MemoryError()
+            if not self.loops.get(loop):
+                loop.add_reader(codonwlib.pool_fd(self.pool), self._collect)
+            self.loops[loop] = self.loops.get(loop, 0) + 1
+            self.pending[self.next_id] = (fut, task)
+            self.next_id += 1
+        return fut
+
+    def _collect(self):
+        cdef int64_t ids[256]
+        cdef long n, i
+        done = []
+        with self.lock:
+            n = codonwlib.pool_done(self.pool, ids, 256)
+            for i in range(n):
+                fut, task = self.pending.pop(ids[i])
+                loop = fut.get_loop()
+                self.loops[loop] -= 1
+                if not self.loops[loop]:
+                    del self.loops[loop]
+                    loop.remove_reader(codonwlib.pool_fd(self.pool))
+                done.append((fut, task, loop))
+        for fut, task, loop in done:
+            if loop.is_closed():
+                # an abandoned astream, nothing waits for the result
+                continue
+            if loop is asyncio.get_running_loop():
+                if not fut.cancelled():
+                    fut.set_result(task)
+            else:
+                try:
+                    loop.call_soon_threadsafe(_set_result, fut, task)
+                except RuntimeError:
+                    pass  # the loop closed after the check
+
+    def __dealloc__(self):
+        if self.pool != NULL:
+            codonwlib.pool_close(self.pool)
+
+
+def _set_result(fut, result):
+    if not fut.cancelled():
+        fut.set_result(result)
+
+
+_pool = None
+_pool_lock = threading.Lock()
+
+def _background_pool():
+    global _pool
+    with _pool_lock:
+        if _pool is None:
+            _pool = _Pool()
+    return _pool
+
+
+async def _aitems(source):
+    """Items of an iterable or asynchronous iterable
+    """
+    if hasattr(source, "__aiter__"):
+        async for item in source:
+            yield item
+    else:
+        for item in source:
+            yield item
+
+
+async def _abatches(source, long batch_size):
+    """`SeqBatch`es of at most `batch_size` sequences (unless given as
+    `SeqBatch`es) from a FASTA file, or an (asynchronous) iterable of
+    sequences, (name, sequence) pairs or `SeqBatch`es
+    """
+    if isinstance(source, (str, os.PathLike)) or hasattr(source, "read"):
+        # file reads are done off the event loop
+        loop = asyncio.get_running_loop()
+        batches = iter(read_fasta(source))
+        while True:
+            batch = await loop.run_in_executor(None, next, batches, None)
+            if batch is None:
+                return
+            yield batch
+
+    if isinstance(source, pd.Series):
+        source = source.items()
+    seqs, names = [], []
+    async for item in _aitems(source):
+        if isinstance(item, SeqBatch):
+            if seqs:
+                yield SeqBatch(seqs, names if len(names) == len(seqs) else None)
+                seqs, names = [], []
+            yield item
+            continue
+        if isinstance(item, tuple):
+            names.append(item[0])
+            item = item[1]
+        seqs.append(item)
+        if len(seqs) == batch_size:
+            yield SeqBatch(seqs, names if len(names) == len(seqs) else None)
+            seqs, names = [], []
+    if seqs:
+        yield SeqBatch(seqs, names if len(names) == len(seqs) else None)
+
+
+async def astream(source, metrics=None, genetic_code=0, cai_ref=0, fop_ref=0,
+                  long batch_size=1024, int max_pending=4):
+    """Indices of a stream of sequences, for use with asyncio
+
+    `source`: FASTA file (name or file object), or an iterable or
+        asynchronous iterable of sequences, (name, sequence) pairs or
+        `SeqBatch`es
+    `metrics`, `genetic_code`, `cai_ref`, `fop_ref`: as for `compute_metrics`
+    `batch_size`: sequences per batch
+    `max_pending`: batches computed ahead of the consumer, no more of the
+        source is read while this many are waiting
+
+    Batches are computed by the library's worker threads without the GIL,
+    the event loop is woken when each finishes. Yields a pd.DataFrame per
+    batch, in order.
+
+        async for df in codonw.astream(seqs, metrics=["CAI", "Nc"]):
+            ...
+    """
+    cdef _MetricRef ref = _MetricRef(genetic_code, cai_ref, fop_ref)
+    which = _metric_index(metrics)
+    pool = _background_pool()
+    pending = collections.deque()
+
+    if max_pending < 1:
+        raise ValueError("max_pending must be at least 1")
+    try:
+        async for batch in _abatches(source, batch_size):
+            pending.append(pool.submit(_MetricTask(batch, ref, which)))
+            if len(pending) >= max_pending:
+                yield (await pending.popleft()).result()
+        while pending:
+            yield (await pending.popleft()).result()
+    finally:
+        # batches of a stream closed early are still run (the pool holds
+        # their buffers until then), their results are dropped
+        for fut in pending:
+            fut.cancel()
+
+
+ctypedef struct _UFUNC_DATA:
+    codonwlib.METRIC_REF_STRUCT *ref
+    int which       # METRIC_* of the scalar indices
+    bint wide       # int64 rather than int32 counts
+
+
+cdef inline void _ufunc_counts(char *p, np.npy_intp step, bint wide, int n, long *out) noexcept nogil:
+    cdef int j
+    for j in range(n):
+        if wide:
+            out[j] = (<np.int64_t *>(p + j * step))[0]
+        else:
+            out[j] = (<np.int32_t *>(p + j * step))[0]
+
+
+cdef void _scalar_loop(char **args, const np.npy_intp *dims, const np.npy_intp *steps, void *data) noexcept nogil:
+    # (65)->()
+    cdef _UFUNC_DATA *d = <_UFUNC_DATA *>data
+    cdef long ncod[65]
+    cdef double v
+    cdef np.npy_intp i
+    for i in range(dims[0]):
+        _ufunc_counts(args[0] + i * steps[0], steps[2], d.wide, 65, ncod)
+        codonwlib.metric_row(ncod, d.ref, &d.which, 1, &v)
+        (<double *>(args[1] + i * steps[1]))[0] = v
+
+
+cdef void _aa_loop(char **args, const np.npy_intp *dims, const np.npy_intp *steps, void *data) noexcept nogil:
+    # (65)->(22)
+    cdef _UFUNC_DATA *d = <_UFUNC_DATA *>data
+    cdef long ncod[65]
+    cdef long naa[22]
+    cdef np.npy_intp i
+    cdef int j
+    for i in range(dims[0]):
+        _ufunc_counts(args[0] + i * steps[0], steps[2], d.wide, 65, ncod)
+        codonwlib.count_amino_acids(ncod, naa, &d.ref.code)
+        for j in range(22):
+            (<np.int64_t *>(args[1] + i * steps[1] + j * steps[3]))[0] = naa[j]
+
+
+cdef void _rscu_loop(char **args, const np.npy_intp *dims, const np.npy_intp *steps, void *data) noexcept nogil:
+    # (65),(22)->(64)
+    cdef _UFUNC_DATA *d = <_UFUNC_DATA *>data
+    cdef long ncod[65]
+    cdef long naa[22]
+    cdef float rscu[65]
+    cdef np.npy_intp i
+    cdef int j
+    for i in range(dims[0]):
+        _ufunc_counts(args[0] + i * steps[0], steps[3], d.wide, 65, ncod)
+        _ufunc_counts(args[1] + i * steps[1], steps[4], d.wide, 22, naa)
+        codonwlib.rscu_usage(ncod, naa, rscu, d.ref.ds, &d.ref.code)
+        for j in range(64):
+            (<double *>(args[2] + i * steps[2] + j * steps[5]))[0] = rscu[j + 1]
+
+
+cdef void _gc_loop(char **args, const np.npy_intp *dims, const np.npy_intp *steps, void *data) noexcept nogil:
+    # (65)->(20), as CodonSeq.bases2
+    cdef _UFUNC_DATA *d = <_UFUNC_DATA *>data
+    cdef long ncod[65]
+    cdef long bases[5][5]
+    cdef long tot_s, totalaa
+    cdef double metrics[20]
+    cdef np.npy_intp i
+    cdef int j
+    for i in range(dims[0]):
+        _ufunc_counts(args[0] + i * steps[0], steps[2], d.wide, 65, ncod)
+        codonwlib.gc(d.ref.ds, ncod, bases[4], bases[3], bases[0], bases[1], bases[2],
+                     &tot_s, &totalaa, &metrics[2], &d.ref.code)
+        metrics[0] = <double>totalaa
+        metrics[1] = <double>tot_s
+        for j in range(20):
+            (<double *>(args[1] + i * steps[1] + j * steps[3]))[0] = metrics[j]
+
+
+# float64 (fractional) counts, e.g. from count_codons(..., ambiguous=True)
+
+cdef inline void _ufunc_fcounts(char *p, np.npy_intp step, int n, double *out) noexcept nogil:
+    cdef int j
+    for j in range(n):
+        out[j] = (<double *>(p + j * step))[0]
+
+
+cdef void _scalar_frac_loop(char **args, const np.npy_intp *dims, const np.npy_intp *steps, void *data) noexcept nogil:
+    # (65)->()
+    cdef _UFUNC_DATA *d = <_UFUNC_DATA *>data
+    cdef double ncod[65]
+    cdef double v
+    cdef np.npy_intp i
+    for i in range(dims[0]):
+        _ufunc_fcounts(args[0] + i * steps[0], steps[2], 65, ncod)
+        codonwlib.metric_row_frac(ncod, d.ref, &d.which, 1, &v)
+        (<double *>(args[1] + i * steps[1]))[0] = v
+
+
+cdef void _aa_frac_loop(char **args, const np.npy_intp *dims, const np.npy_intp *steps, void *data) noexcept nogil:
+    # (65)->(22)
+    cdef _UFUNC_DATA *d = <_UFUNC_DATA *>data
+    cdef double ncod[65]
+    cdef double naa[22]
+    cdef np.npy_intp i
+    cdef int j
+    for i in range(dims[0]):
+        _ufunc_fcounts(args[0] + i * steps[0], steps[2], 65, ncod)
+        codonwlib.count_amino_acids_frac(ncod, naa, &d.ref.code)
+        for j in range(22):
+            (<double *>(args[1] + i * steps[1] + j * steps[3]))[0] = naa[j]
+
+
+cdef void _rscu_frac_loop(char **args, const np.npy_intp *dims, const np.npy_intp *steps, void *data) noexcept nogil:
+    # (65),(22)->(64), as rscu_usage
+    cdef _UFUNC_DATA *d = <_UFUNC_DATA *>data
+    cdef double ncod[65]
+    cdef double naa[22]
+    cdef double v
+    cdef np.npy_intp i
+    cdef int x
+    for i in range(dims[0]):
+        _ufunc_fcounts(args[0] + i * steps[0], steps[3], 65, ncod)
+        _ufunc_fcounts(args[1] + i * steps[1], steps[4], 22, naa)
+        for x in range(1, 65):
+            v = naa[d.ref.code.ca[x]]
+            (<double *>(args[2] + i * steps[2] + (x - 1) * steps[5]))[0] = \
+                ncod[x] / v * d.ref.ds[x] if v != 0 else 0
+
+
+cdef void _gc_frac_loop(char **args, const np.npy_intp *dims, const np.npy_intp *steps, void *data) noexcept nogil:
+    # (65)->(20)
+    cdef _UFUNC_DATA *d = <_UFUNC_DATA *>data
+    cdef double ncod[65]
+    cdef double metrics[20]
+    cdef np.npy_intp i
+    cdef int j
+    for i in range(dims[0]):
+        _ufunc_fcounts(args[0] + i * steps[0], steps[2], 65, ncod)
+        codonwlib.gc_frac(ncod, d.ref, &metrics[1], &metrics[0], &metrics[2])
+        for j in range(20):
+            (<double *>(args[1] + i * steps[1] + j * steps[3]))[0] = metrics[j]
+
+
+# loops take const dims and steps as NumPy 2 declares them, the cast only
+# satisfies the older declaration in numpy's pxd
+cdef np.PyUFuncGenericFunction _scalar_funcs[3]
+cdef np.PyUFuncGenericFunction _aa_funcs[3]
+cdef np.PyUFuncGenericFunction _rscu_funcs[3]
+cdef np.PyUFuncGenericFunction _gc_funcs[3]
+_scalar_funcs[0] = _scalar_funcs[1] = <np.PyUFuncGenericFunction>_scalar_loop
+_aa_funcs[0] = _aa_funcs[1] = <np.PyUFuncGenericFunction>_aa_loop
+_rscu_funcs[0] = _rscu_funcs[1] = <np.PyUFuncGenericFunction>_rscu_loop
+_gc_funcs[0] = _gc_funcs[1] = <np.PyUFuncGenericFunction>_gc_loop
+_scalar_funcs[2] = <np.PyUFuncGenericFunction>_scalar_frac_loop
+_aa_funcs[2] = <np.PyUFuncGenericFunction>_aa_frac_loop
+_rscu_funcs[2] = <np.PyUFuncGenericFunction>_rscu_frac_loop
+_gc_funcs[2] = <np.PyUFuncGenericFunction>_gc_frac_loop
+
+cdef char _to_double[6]
+cdef char _aa_types[6]
+cdef char _pair_to_double[9]
+_to_double[:] = [np.NPY_INT32, np.NPY_DOUBLE, np.NPY_INT64, np.NPY_DOUBLE, np.NPY_DOUBLE, np.NPY_DOUBLE]
+_aa_types[:] = [np.NPY_INT32, np.NPY_INT64, np.NPY_INT64, np.NPY_INT64, np.NPY_DOUBLE, np.NPY_DOUBLE]
+_pair_to_double[:] = [np.NPY_INT32, np.NPY_INT32, np.NPY_DOUBLE,
+                      np.NPY_INT64, np.NPY_INT64, np.NPY_DOUBLE,
+                      np.NPY_DOUBLE, np.NPY_DOUBLE, np.NPY_DOUBLE]
+
+
+cdef class IndexUfuncs:
+    """Indices as NumPy generalized ufuncs over codon count arrays
+
+    Counts have 65 columns in the order of `codonw.ref_codons`
+    (untranslatable codons first, as from `count_codons` or
+    `CodonSeq.ncod`) and may have any leading dimensions. int32 and
+    int64 counts are accepted, as are float64 (fractional) counts such as
+    those of `count_codons(..., ambiguous=True)`, and loops run without
+    the GIL.
+
+        cai, cbi, fop, enc   (65)->()
+        aa_usage             (65)->(22)     amino acid counts, float64 for
+                                            float64 counts
+        rscu_usage           (65),(22)->(64)
+        gc                   (65)->(20)     as `CodonSeq.bases2`
+
+    Made by `index_ufuncs`, use e.g. `codonw.ufuncs.cai(counts)`.
+    """
+    cdef _MetricRef ref
+    cdef _UFUNC_DATA cdata[21]
+    cdef void *data[21]
+    cdef readonly object cai, cbi, fop, enc, aa_usage, rscu_usage, gc
+
+    def __init__(self, int genetic_code=0, int cai_ref=0, int fop_ref=0):
+        cdef int i
+        self.ref = _MetricRef(genetic_code, cai_ref, fop_ref)
+        for i in range(21):
+            self.cdata[i].ref = &self.ref.ref
+            self.cdata[i].which = 0
+            self.cdata[i].wide = i % 3 == 1
+            self.data[i] = &self.cdata[i]
+
+        self.cai = self._scalar(0, codonwlib.METRIC_CAI, b"cai", b"Codon Adaptation Index")
+        self.cbi = self._scalar(3, codonwlib.METRIC_CBI, b"cbi", b"Codon bias index")
+        self.fop = self._scalar(6, codonwlib.METRIC_FOP, b"fop", b"Fraction of optimal codons")
+        self.enc = self._scalar(9, codonwlib.METRIC_ENC, b"enc", b"Effective number of codons")
+        self.aa_usage = self._owned(np.PyUFunc_FromFuncAndDataAndSignature(
+            _aa_funcs, &self.data[12], _aa_types, 3, 1, 1, np.PyUFunc_None,
+            b"aa_usage", b"Amino acid counts", 0, b"(65)->(22)"))
+        self.rscu_usage = self._owned(np.PyUFunc_FromFuncAndDataAndSignature(
+            _rscu_funcs, &self.data[15], _pair_to_double, 3, 2, 1, np.PyUFunc_None,
+            b"rscu_usage", b"Relative synonymous codon usage", 0, b"(65),(22)->(64)"))
+        self.gc = self._owned(np.PyUFunc_FromFuncAndDataAndSignature(
+            _gc_funcs, &self.data[18], _to_double, 3, 1, 1, np.PyUFunc_None,
+            b"gc", b"Base composition metrics, as CodonSeq.bases2", 0, b"(65)->(20)"))
+
+    cdef _owned(self, np.ufunc f):
+        # the loops read self.cdata, so the ufunc keeps self alive (its
+        # obj reference is released, and traversed, by NumPy)
+        Py_INCREF(self)
+        f.obj = <PyObject *>self
+        return f
+
+    cdef _scalar(self, int first, int which, char *name, char *doc):
+        self.cdata[first].which = self.cdata[first + 1].which = self.cdata[first + 2].which = which
+        return self._owned(np.PyUFunc_FromFuncAndDataAndSignature(
+            _scalar_funcs, &self.data[first], _to_double, 3, 1, 1, np.PyUFunc_None,
+            name, doc, 0, b"(65)->()"))
+
+
+_index_ufuncs = {}
+_index_ufuncs_lock = threading.Lock()
+
+def index_ufuncs(int genetic_code=0, int cai_ref=0, int fop_ref=0):
+    """`IndexUfuncs` for a built-in genetic code and CAI and Fop (also used
+    for CBI) references, made once and kept for the life of the module
+    """
+    key = (genetic_code, cai_ref, fop_ref)
+    with _index_ufuncs_lock:
+        if key not in _index_ufuncs:
+            _index_ufuncs[key] = IndexUfuncs(genetic_code, cai_ref, fop_ref)
+        return _index_ufuncs[key]
+
+
+ufuncs = index_ufuncs()
+
+
+cdef np.ndarray _arrow_chunk(arr, _MetricRef ref, int[::1] which, int nthreads):
+    """Indices of the sequences of one Arrow string or binary array, read
+    in place from its buffers
+    """
+    import pyarrow as pa
+
+    cdef long n = len(arr)
+    cdef np.ndarray[dtype=long, ndim=2, mode="c"] ncod = np.zeros([max(n, 1), 65], dtype=c_long)
+    cdef np.ndarray[dtype=double, ndim=2, mode="c"] out = np.zeros([n, which.shape[0]], dtype=c_double)
+    cdef const np.int64_t[::1] offsets
+    cdef const char *data = b""
+    cdef int ret = 0
+
+    if n == 0 or which.shape[0] == 0:
+        return out
+    if not (pa.types.is_large_string(arr.type) or pa.types.is_large_binary(arr.type) or
+            pa.types.is_string(arr.type) or pa.types.is_binary(arr.type)):
+        arr = arr.cast(pa.large_string())
+    wide = pa.types.is_large_string(arr.type) or pa.types.is_large_binary(arr.type)
+
+    buffers = arr.buffers()
+    offsets = np.ascontiguousarray(
+        np.frombuffer(buffers[1], dtype=np.int64 if wide else np.int32)[arr.offset:arr.offset + n + 1],
+        dtype=np.int64)
+    if buffers[2] is not None and buffers[2].size > 0:
+        data = <const char *><uintptr_t>buffers[2].address
+
+    with nogil:
+        ret = codonwlib.metric_seqs(data, <int64_t *>&offsets[0], n, &ncod[0, 0], &ref.ref,
+                                    &which[0], which.shape[0], &out[0, 0], nthreads)
+    if ret:
+        raise ValueError("Could not compute indices")
+    if arr.null_count:
+        out[np.asarray(arr.is_null(), dtype=np.bool_)] = np.nan
+    return out
+
+
+def arrow_metrics(data, column="seq", metrics=None, genetic_code=0, cai_ref=0,
+                  fop_ref=0, int nthreads=0):
+    """Indices of a whole partition of sequences, Arrow in and Arrow out
+
+    `data`: a pyarrow Array or ChunkedArray of sequences (string or
+        binary), or a Table or RecordBatch holding them in `column`
+    `metrics`, `genetic_code`, `cai_ref`, `fop_ref`: as for `compute_metrics`
+
+    Sequences are read directly from the Arrow buffers, no Python object
+    is made per row. Returns a pyarrow Table with one float64 column per
+    index, row i for sequence i, and nulls for null sequences.
+    """
+    import pyarrow as pa
+
+    cdef _MetricRef ref = _MetricRef(genetic_code, cai_ref, fop_ref)
+    which = _metric_index(metrics)
+
+    if isinstance(data, (pa.Table, pa.RecordBatch)):
+        data = data.column(column)
+    chunks = data.chunks if isinstance(data, pa.ChunkedArray) else [data]
+    out = [_arrow_chunk(c, ref, which, nthreads) for c in chunks]
+    out = np.vstack(out) if out else np.zeros([0, len(which)])
+    return pa.table({ref_metrics[w]: pa.array(out[:, j], from_pandas=True)
+                     for j, w in enumerate(which)})
+
+
+def partition_metrics(df, column="seq", **kwargs):
+    """`arrow_metrics` of a pandas partition, e.g. for Dask
+
+        ddf.map_partitions(codonw.partition_metrics, meta=...)
+
+    Arrow backed columns (`string[pyarrow]`) are read without copying.
+    Returns a pd.DataFrame with the partition's index.
+    """
+    import pyarrow as pa
+    res = arrow_metrics(pa.array(df[column]), **kwargs).to_pandas()
+    res.index = df.index
+    return res
+
+
+def polars_metrics(column="seq", metrics=None, **kwargs):
+    """Polars expression giving a struct of indices of the sequences in
+    `column` (see `arrow_metrics` for the other arguments)
+
+        df.with_columns(codonw.polars_metrics("seq", ["CAI", "Nc"]).alias("idx")).unnest("idx")
+
+    Each batch of the column is handed to the native engine as Arrow.
+    """
+    import polars as pl
+
+    which = _metric_index(metrics)
+    names = [ref_metrics[w] for w in which]
+
+    def kernel(s):
+        table = arrow_metrics(s.to_arrow(), metrics=names, **kwargs)
+        return pl.Series(s.name, table.to_struct_array())
+
+    return pl.col(column).map_batches(
+        kernel, return_dtype=pl.Struct({m: pl.Float64 for m in names}))
@@ -5,8 +5,30 @@ Exports to be used in the Python interface
 """
 
 from libcpp cimport bool
+from libc.stdint cimport int8_t, int32_t, int64_t, uint8_t, uint16_t, uint32_t
 
 cdef extern from "include/codonW.h":
+    enum: NUM_GENETIC_CODES
+    enum: NUM_FOP_SPECIES
+    enum: NUM_CAI_SPECIES
+    enum: NUM_METRICS
+    enum: METRIC_CAI
+    enum: METRIC_FOP
+    enum: METRIC_ENC
+    enum: METRIC_CBI
+    enum: SERVE_NSTATS
+    enum: CSR_PAIR_BINS
+    enum: ARENA_ALIGN
+    enum: NUM_CUT_FORMATS
+    enum: TDB_MAX_RANKS
+    enum: TDB_RANK_LEN
+    enum: NUM_BUNDLE_TABLES
+    enum: BUNDLE_NAME_LEN
+    enum: SCAN_NMETRIC
+    enum: VCF_OK
+    enum: VCF_REF_MISMATCH
+    enum: VCF_NO_CODON
+
     ctypedef struct GENETIC_CODE_STRUCT:
         char *des
         char *typ
@@ -28,8 +50,8 @@ cdef extern from "include/codonW.h":
         char *cod[65]
 
     ctypedef struct AMINO_PROP_STRUCT:
-        float *hydro[22]
-        int *aromo[22]
+        float hydro[22]
+        int aromo[22]
 
     GENETIC_CODE_STRUCT *cu_ref
     FOP_STRUCT *fop_ref
@@ -40,16 +62,265 @@ cdef extern from "include/codonW.h":
     int ident_codon(char *codon)
     int how_synon(int dds[], GENETIC_CODE_STRUCT *pcu)
     int how_synon_aa(int dda[], GENETIC_CODE_STRUCT *pcu)
+    int code_from_ncbi(const char *aas, GENETIC_CODE_STRUCT *pcu)
 
     int codon_usage_tot(char *seq, long *codon_tot, int *valid_stops, long ncod[], long naa[], GENETIC_CODE_STRUCT *pcu)
-    int rscu_usage(long *nncod, long *nnaa, float rscu[], int *ds, GENETIC_CODE_STRUCT *pcu)
+    int rscu_usage(long *nncod, long *nnaa, float rscu[], int *ds, GENETIC_CODE_STRUCT *pcu) nogil
     int raau_usage(long nnaa[], double raau[])
     int base_sil_us(long *nncod, long *nnaa, double base_sil[], int *ds, int *da, GENETIC_CODE_STRUCT *pcu)
     int cai(long *nncod, double *sigma, int *ds, CAI_STRUCT *pcai, GENETIC_CODE_STRUCT *pcu)
     int cbi(long *nncod, long *nnaa, float *fcbi, int *ds, int *da, GENETIC_CODE_STRUCT *pcu, FOP_STRUCT *pcbi)
     int fop(long *nncod, float *ffop, int *ds, bool factor_in_rare, GENETIC_CODE_STRUCT *pcu, FOP_STRUCT *pfop)
     int enc(long *nncod, long *nnaa, float *enc_tot, int *da, GENETIC_CODE_STRUCT *pcu)
-    int gc(int *ds, long *ncod, long bases[5], long base_tot[5], long base_1[5], long base_2[5], long base_3[5], long *tot_s, long *totalaa, double gc_metrics[], GENETIC_CODE_STRUCT *pcu)
+    int gc(int *ds, long *ncod, long bases[5], long base_tot[5], long base_1[5], long base_2[5], long base_3[5], long *tot_s, long *totalaa, double gc_metrics[], GENETIC_CODE_STRUCT *pcu) nogil
     int dinuc_count(char *seq, long din[3][16], long dinuc_tot[4], int *fram)
     int hydro(long *nnaa, float *hydro, float hydro_ref[22])
     int aromo(long *nnaa, float *aromo, int aromo_ref[22])
+
+    ctypedef struct NN_INDEX_STRUCT:
+        int dim
+        int nlist
+        long n
+        int cod[64]
+        GENETIC_CODE_STRUCT code
+        bool mapped
+
+    ctypedef struct TDB_BUILDER_STRUCT:
+        pass
+
+    ctypedef struct TAXON_DB_STRUCT:
+        long n
+        bool pairs
+        int nrank
+        char rank_names[TDB_MAX_RANKS][TDB_RANK_LEN]
+        int64_t *ids
+        int32_t *ranks
+        int64_t *genes
+        int64_t *ncod
+        int64_t *npair
+
+    ctypedef struct BACKGROUND_STRUCT:
+        int dim
+        double ncod[65]
+        long ngenes
+
+    ctypedef struct COA_STRUCT:
+        bool rscu
+        int dim
+        int cod[64]
+        long nrows
+        double weight
+        double mean[64]
+        bool fitted
+        double eigval[64]
+        double axes[64 * 64]
+
+    ctypedef struct METRIC_REF_STRUCT:
+        GENETIC_CODE_STRUCT code
+        int ds[65]
+        AMINO_PROP_STRUCT prop
+
+    ctypedef struct OPT_PARAMS_STRUCT:
+        int beam
+        int window
+        double gc_min
+        double gc_max
+        const char **motifs
+        int nmotif
+
+    ctypedef struct VCF_MODEL_STRUCT:
+        const char *chroms
+        const int64_t *chrom_off
+        long nchrom
+        const int32_t *exon_chrom
+        const int64_t *exon_start
+        const int64_t *exon_end
+        const int32_t *exon_gene
+        const int64_t *exon_cds
+        const int8_t *exon_strand
+        long nexon
+        int64_t max_exon
+        const char *cds
+        const int64_t *cds_off
+        long ngene
+        bool samples
+
+    ctypedef struct VCF_RESULT_STRUCT:
+        long nrec
+        long nsample
+        long nhit
+        int64_t *rec
+        int64_t *vcf_pos
+        int32_t *chrom
+        int32_t *allele
+        int32_t *gene
+        int64_t *pos
+        uint8_t *from_ "from"
+        uint8_t *to
+        int8_t *status
+        double *delta
+        long nhap
+        int32_t *hap_sample
+        int8_t *hap
+        int32_t *hap_gene
+        int32_t *hap_nvar
+        double *hap_delta
+
+    ctypedef struct VCF_PARSE_STRUCT:
+        pass
+
+    ctypedef struct HARM_STRUCT:
+        int map[65]
+        double fsrc[65]
+        double fhost[65]
+        int ds[65]
+
+    ctypedef struct REF_BUNDLE_STRUCT:
+        pass
+
+    ctypedef struct REF_SLOT_STRUCT:
+        pass
+
+    ctypedef struct METRIC_TASK_STRUCT:
+        const char *data
+        const int64_t *offsets
+        long n
+        long *ncod
+        METRIC_REF_STRUCT *ref
+        const int *which
+        int nwhich
+        double *out
+        int status
+
+    ctypedef struct SERVE_STRUCT:
+        pass
+
+    ctypedef void (*POOL_FUNC)(void *arg)
+    ctypedef struct POOL_STRUCT:
+        pass
+
+    ctypedef struct ARENA_STRUCT:
+        pass
+
+    const char *metric_names[NUM_METRICS]
+
+    int count_amino_acids(long *ncod, long naa[], GENETIC_CODE_STRUCT *pcu) nogil
+    int syn_codons(int cod[64], GENETIC_CODE_STRUCT *pcu)
+
+cdef extern from "include/codonW.h" nogil:
+    int par_threads(int nthreads)
+
+    POOL_STRUCT *pool_open(int nthreads)
+    int pool_fd(POOL_STRUCT *pool)
+    int pool_submit(POOL_STRUCT *pool, POOL_FUNC fn, void *arg, int64_t id)
+    long pool_done(POOL_STRUCT *pool, int64_t *ids, long max)
+    void pool_close(POOL_STRUCT *pool)
+
+    ARENA_STRUCT *arena_open(size_t size)
+    void *arena_alloc(ARENA_STRUCT *arena, size_t size, size_t align)
+    char *arena_base(ARENA_STRUCT *arena)
+    size_t arena_used(ARENA_STRUCT *arena)
+    size_t arena_size(ARENA_STRUCT *arena)
+    void arena_reset(ARENA_STRUCT *arena)
+    void arena_close(ARENA_STRUCT *arena)
+
+    int nn_build(NN_INDEX_STRUCT *idx, long *ncod, int64_t *ids, long n, int nlist, int niter, GENETIC_CODE_STRUCT *pcu, int nthreads)
+    int nn_save(NN_INDEX_STRUCT *idx, char *filename)
+    int nn_load(NN_INDEX_STRUCT *idx, char *filename)
+    void nn_free(NN_INDEX_STRUCT *idx)
+    int nn_search(NN_INDEX_STRUCT *idx, long *ncod, long nq, int k, int nprobe, int64_t *out_ids, float *out_dist, int nthreads)
+
+    int codon_usage_batch(const char *data, const int64_t *offsets, long nseq, long *ncod, int nthreads)
+    int codon_usage_batch_mask(const char *data, const int64_t *offsets, long nseq, long *ncod, long *masked, int nthreads)
+    int dinuc_count_mask(const char *seq, long len, long din[3][16], long dinuc_tot[4], int *fram)
+    int codon_usage_batch_frac(const char *data, const int64_t *offsets, long nseq, double *ncod, int nthreads)
+    int codon_csr_count(const char *data, const int64_t *offsets, long nseq, bool pairs, int64_t *indptr, int nthreads)
+    int codon_csr_fill(const char *data, const int64_t *offsets, long nseq, bool pairs, const int64_t *indptr, uint16_t *indices, uint32_t *values, int nthreads)
+    int metric_csr(const int64_t *indptr, const uint16_t *indices, const uint32_t *values, long n, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out, int nthreads)
+    int rscu_csr(const int64_t *indptr, const uint16_t *indices, const uint32_t *values, long n, METRIC_REF_STRUCT *ref, float *rscu, int nthreads)
+    long fasta_parse(const char *buf, long len, char *seq, int64_t *seq_off, int64_t *name_off, long max_rec)
+
+    int bg_init(BACKGROUND_STRUCT *bg, GENETIC_CODE_STRUCT *pcu)
+    int bg_add(BACKGROUND_STRUCT *bg, long *ncod, long n)
+    int bg_score(BACKGROUND_STRUCT *bg, long *ncod, long n, bool leave_one_out, double pseudo, double ridge, double *out, int nthreads)
+
+    int coa_init(COA_STRUCT *coa, bool rscu, GENETIC_CODE_STRUCT *pcu)
+    int coa_add(COA_STRUCT *coa, long *ncod, long n, int nthreads)
+    int coa_fit(COA_STRUCT *coa)
+    int coa_transform(COA_STRUCT *coa, long *ncod, long n, int naxes, double *out, int nthreads)
+
+    int em_mixture(long *ncod, long n, int k, int *cod, int dim, int *group, double *logpi, double *logtheta, double *resp, int max_iter, double tol, double pseudo, double *loglik, int *niter, int nthreads)
+    int em_posterior(long *ncod, long n, int k, int *cod, int dim, double *logpi, double *logtheta, double *resp, double *loglik, int nthreads)
+
+    int cai_batch(long *ncod, long n, int *ds, CAI_STRUCT *pcai, GENETIC_CODE_STRUCT *pcu, double *out, int nthreads)
+    void cai_weights(const double pool[65], CAI_STRUCT *pcai, GENETIC_CODE_STRUCT *pcu)
+    int cai_fit(long *ncod, long n, long nref, int max_iter, int *ds, GENETIC_CODE_STRUCT *pcu, CAI_STRUCT *pcai, long *ref, double *out, int *niter, int nthreads)
+
+    long cut_parse(const char *buf, long len, int format, double *ncod, int64_t *name_off, long max_rec)
+    int cut_save(const char *filename, int format, const double *ncod, long n, const char **names, GENETIC_CODE_STRUCT *pcu)
+    int cut_weights(const double *ncod, long n, GENETIC_CODE_STRUCT *pcu, double *w)
+
+    TDB_BUILDER_STRUCT *tdb_open(int nrank, const char **rank_names, bool pairs)
+    int tdb_add(TDB_BUILDER_STRUCT *tb, const char *data, const int64_t *offsets, long nseq, const int64_t *taxa, int nthreads)
+    long tdb_size(TDB_BUILDER_STRUCT *tb)
+    int tdb_save(TDB_BUILDER_STRUCT *tb, const char *filename)
+    void tdb_close(TDB_BUILDER_STRUCT *tb)
+    int tdb_load(TAXON_DB_STRUCT *db, const char *filename)
+    void tdb_free(TAXON_DB_STRUCT *db)
+    long tdb_find(TAXON_DB_STRUCT *db, int64_t id)
+    long tdb_lookup(TAXON_DB_STRUCT *db, const int64_t *ids, long n, int64_t *rows)
+
+    int bundle_save(const char *filename, int64_t version, GENETIC_CODE_STRUCT *codes, int ncode, CAI_STRUCT *cais, int ncai, FOP_STRUCT *fops, int nfop, AMINO_PROP_STRUCT *props, int nprop, const char **names)
+    REF_BUNDLE_STRUCT *bundle_load(const char *filename)
+    void bundle_ref(REF_BUNDLE_STRUCT *b)
+    void bundle_unref(REF_BUNDLE_STRUCT *b)
+    int64_t bundle_version(REF_BUNDLE_STRUCT *b)
+    long bundle_count(REF_BUNDLE_STRUCT *b, int table)
+    const char *bundle_name(REF_BUNDLE_STRUCT *b, int table, long i)
+    long bundle_find(REF_BUNDLE_STRUCT *b, int table, const char *name)
+    int bundle_code(REF_BUNDLE_STRUCT *b, long i, GENETIC_CODE_STRUCT *pcu)
+    int bundle_cai(REF_BUNDLE_STRUCT *b, long i, CAI_STRUCT *pcai)
+    int bundle_fop(REF_BUNDLE_STRUCT *b, long i, FOP_STRUCT *pfop)
+    int bundle_prop(REF_BUNDLE_STRUCT *b, long i, AMINO_PROP_STRUCT *pap)
+    int bundle_metric_ref(REF_BUNDLE_STRUCT *b, long code, long cai, long fop, long prop, METRIC_REF_STRUCT *ref)
+    REF_SLOT_STRUCT *refslot_open(REF_BUNDLE_STRUCT *b)
+    REF_BUNDLE_STRUCT *refslot_get(REF_SLOT_STRUCT *slot)
+    void refslot_swap(REF_SLOT_STRUCT *slot, REF_BUNDLE_STRUCT *b)
+    void refslot_close(REF_SLOT_STRUCT *slot)
+
+    int opt_batch(const char *prot, const int64_t *offsets, long n, GENETIC_CODE_STRUCT *pcu, CAI_STRUCT *pcai, OPT_PARAMS_STRUCT *par, char *out, long *violations, int nthreads)
+
+    int harm_init(HARM_STRUCT *ph, const double src[65], const double host[65], GENETIC_CODE_STRUCT *pcu)
+    int harm_batch(const char *seqs, const int64_t *offsets, long n, HARM_STRUCT *ph, char *out, double *sim, long *changed, int nthreads)
+
+    int64_t scan_count(const char *data, const int64_t *offsets, long n, METRIC_REF_STRUCT *ref, int64_t *var_off, int nthreads)
+    int scan_batch(const char *data, const int64_t *offsets, long n, METRIC_REF_STRUCT *ref, const int64_t *var_off, int64_t *pos, uint8_t *from_, uint8_t *to, double *out, int nthreads)
+
+    VCF_PARSE_STRUCT *vcf_open(VCF_MODEL_STRUCT *model, VCF_RESULT_STRUCT *res)
+    int vcf_feed(VCF_PARSE_STRUCT *ps, const char *buf, long len)
+    int vcf_finish(VCF_PARSE_STRUCT *ps, METRIC_REF_STRUCT *ref, int nthreads)
+    void vcf_close(VCF_PARSE_STRUCT *ps)
+    int vcf_annotate(const char *buf, long len, VCF_MODEL_STRUCT *model, METRIC_REF_STRUCT *ref, VCF_RESULT_STRUCT *res, int nthreads)
+    void vcf_free(VCF_RESULT_STRUCT *res)
+
+    int wusage_batch(const double *ncod, long n, const double *w, long nsample, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *usage, double *naa, double *rscu, double *out, int nthreads)
+
+    int metric_init(METRIC_REF_STRUCT *ref, GENETIC_CODE_STRUCT *pcu, CAI_STRUCT *pcai, FOP_STRUCT *pfop)
+    int metric_row(long *ncod, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out)
+    int metric_batch(long *ncod, long n, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out, int nthreads)
+    int metric_seqs(const char *data, const int64_t *offsets, long n, long *ncod, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out, int nthreads)
+    int metric_seqs_mask(const char *data, const int64_t *offsets, long n, long *ncod, long *masked, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out, int nthreads)
+    int metric_seqs_codes(const char *data, const int64_t *offsets, long n, const int8_t *codes, long *ncod, METRIC_REF_STRUCT *refs, int nrefs, const int *which, int nwhich, double *out, int nthreads)
+    void metric_task(void *arg)
+    int metric_columns(const char *data, const int64_t *offsets, long n, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double **cols, int64_t **counts, int nthreads)
+    int count_amino_acids_frac(const double *ncod, double naa[], GENETIC_CODE_STRUCT *pcu)
+    int gc_frac(const double *ncod, METRIC_REF_STRUCT *ref, double *tot_s, double *totalaa, double gc_metrics[])
+    int metric_row_frac(const double *ncod, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out)
+    int metric_batch_frac(double *ncod, long n, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out, int nthreads)
+    int metric_seqs_frac(const char *data, const int64_t *offsets, long n, double *ncod, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out, int nthreads)
+
+    SERVE_STRUCT *serve_open(const char *path, int nthreads)
+    int serve_poll(SERVE_STRUCT *srv, int timeout_ms)
+    bool serve_running(SERVE_STRUCT *srv)
+    int serve_stats(SERVE_STRUCT *srv, double stats[SERVE_NSTATS])
+    void serve_close(SERVE_STRUCT *srv)
@@ -27,6 +27,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <errno.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define GARG_EXACT 0x800             /* used in function gargs  */
 #define GARG_NEXT 0x1000             /* used in function gargs  */
@@ -118,6 +119,13 @@ typedef struct
   AMINO_PROP_STRUCT *pap;
   int *da;
   int *ds;
+
+  int dds[65];       /* storage for ds and da    */
+  int dda[23];
+  char raau_header;  /* header lines written     */
+  char aa_header;
+  char gc_header;
+  char dinuc_header;
 } MENU_STRUCT;
 
 typedef struct {
@@ -129,13 +137,272 @@ typedef struct {
   AMINO_PROP_STRUCT *amino_prop;
 } REF_STRUCT;
 
+/* approximate nearest neighbour index over RSCU profiles (codon_nn.c)   */
+typedef struct
+{
+  int dim;                  /* RSCU dimensions used             */
+  int nlist;                /* number of inverted lists         */
+  long n;                   /* number of indexed profiles       */
+  int cod[64];              /* codon (1-64) of each dimension   */
+  GENETIC_CODE_STRUCT code; /* genetic code used for RSCU       */
+
+  float *centroids;         /* nlist x dim cell centroids       */
+  int64_t *offsets;         /* nlist + 1 list starts            */
+  int64_t *ids;             /* n user ids grouped by list       */
+  float *vecs;              /* n x dim profiles grouped by list */
+
+  void *map;                /* block holding all of the above   */
+  size_t map_len;
+  bool mapped;              /* map is an mmapped file           */
+} NN_INDEX_STRUCT;
+
+/* genome background for gene vs genome comparisons (codon_diff.c)       */
+typedef struct
+{
+  int dim;                  /* sense codons used                */
+  int cod[64];              /* codon (1-64) of each dimension   */
+  GENETIC_CODE_STRUCT code;
+
+  double ncod[65];          /* pooled codon counts              */
+  long ngenes;              /* genes in mean and m2             */
+  double mean[64];          /* mean sense codon frequency       */
+  double m2[64 * 64];       /* co-moments, upper triangle       */
+} BACKGROUND_STRUCT;
+
+/* streaming correspondence analysis / PCA of RSCU (codon_coa.c)         */
+typedef struct
+{
+  bool rscu;                /* PCA of RSCU rather than CA       */
+  int dim;                  /* synonymous codons used           */
+  int cod[64];              /* codon (1-64) of each dimension   */
+  int ds[65];
+  GENETIC_CODE_STRUCT code;
+
+  long nrows;               /* genes accumulated                */
+  double weight;            /* total weight (codons for CA)     */
+  double mean[64];          /* weighted mean profile            */
+  double m2[64 * 64];       /* co-moments, upper triangle       */
+
+  bool fitted;
+  double eigval[64];        /* decreasing                       */
+  double axes[64 * 64];     /* axis k is column k               */
+} COA_STRUCT;
+
+/* indices computed from codon counts alone (codon_metrics.c)            */
+#define METRIC_CAI 0
+#define METRIC_FOP 1
+#define METRIC_ENC 2
+#define METRIC_GC3S 3
+#define METRIC_GC 4
+#define METRIC_LEN_SYM 5
+#define METRIC_LEN_AA 6
+#define METRIC_GRAVY 7
+#define METRIC_AROMO 8
+#define METRIC_CBI 9
+#define NUM_METRICS 10
+#define METRIC_BLOCK 256            /* genes per column block written */
+
+typedef struct
+{
+  GENETIC_CODE_STRUCT code;
+  int ds[65];               /* synonyms of each codon           */
+  int da[23];               /* synonyms of each amino acid      */
+  double cai_logw[65];      /* log CAI w values                 */
+  FOP_STRUCT fop;           /* optimal codons                   */
+  bool has_opt[22];         /* amino acids counted by Fop, CBI  */
+  bool opt_ok;              /* and their codon classes valid    */
+  AMINO_PROP_STRUCT prop;   /* Gravy and Aromo scales           */
+} METRIC_REF_STRUCT;
+
+/* indices of a batch of sequences as a pool task (codon_metrics.c)     */
+typedef struct
+{
+  const char *data;         /* sequences, see codon_batch.c     */
+  const int64_t *offsets;
+  long n;
+  long *ncod;               /* n x 65 codon counts              */
+  METRIC_REF_STRUCT *ref;
+  const int *which;         /* METRIC_* wanted                  */
+  int nwhich;
+  double *out;              /* n x nwhich                       */
+  int status;               /* return value of metric_seqs      */
+} METRIC_TASK_STRUCT;
+
+/* codon usage table formats (codon_table.c)                            */
+#define CUT_GCG 0                   /* GCG CodonFrequency .cod        */
+#define CUT_KAZUSA 1                /* Kazusa / CoCoPUTs text         */
+#define CUT_CUTG 2                  /* CUTG .spsum                    */
+#define CUT_CODONW 3                /* as written by codon_usage_out  */
+#define CUT_CUTAB 4                 /* as written by cutab_out        */
+#define NUM_CUT_FORMATS 5
+
+/* set in base_mask_code for lowercase (soft-masked) letters            */
+#define BASE_MASKED 0x8
+
+/* columns of codon pair counts in CSR form (codon_csr.c)              */
+#define CSR_PAIR_BINS 4096
+
+/* per-taxon codon usage database (codon_taxdb.c)                      */
+#define TDB_MAX_RANKS 16            /* taxon ids given per sequence   */
+#define TDB_RANK_LEN 32             /* longest rank name, with \0     */
+typedef struct tdb_builder_struct TDB_BUILDER_STRUCT;
+
+typedef struct
+{
+  long n;                   /* number of taxa                   */
+  bool pairs;               /* codon pair counts held           */
+  int nrank;
+  char rank_names[TDB_MAX_RANKS][TDB_RANK_LEN];
+
+  int64_t *ids;             /* n taxon ids, increasing          */
+  int32_t *ranks;           /* rank of each taxon               */
+  int64_t *genes;           /* sequences pooled in each taxon   */
+  int64_t *ncod;            /* n x 65 codon counts              */
+  int64_t *npair;           /* n x CSR_PAIR_BINS, or NULL       */
+
+  void *map;                /* the mapped file                  */
+  size_t map_len;
+} TAXON_DB_STRUCT;
+
+/* memory-mapped reference bundles (codon_bundle.c)                    */
+#define BUNDLE_CODES 0              /* tables of a bundle             */
+#define BUNDLE_CAI 1
+#define BUNDLE_FOP 2
+#define BUNDLE_PROPS 3
+#define NUM_BUNDLE_TABLES 4
+#define BUNDLE_NAME_LEN 64          /* longest record name, with \0   */
+typedef struct ref_bundle_struct REF_BUNDLE_STRUCT;
+typedef struct ref_slot_struct REF_SLOT_STRUCT;
+
+/* constraints of codon optimisation (codon_opt.c)                     */
+typedef struct
+{
+  int beam;                 /* candidates kept at each position */
+  int window;               /* GC window in bases, 0 for none   */
+  double gc_min;            /* G+C fraction allowed in a window */
+  double gc_max;
+  const char **motifs;      /* forbidden, IUPAC letters allowed */
+  int nmotif;
+} OPT_PARAMS_STRUCT;
+
+/* codon harmonisation between two usage tables (codon_harm.c)         */
+typedef struct
+{
+  int map[65];              /* host codon for each source codon */
+  double fsrc[65];          /* frequency among synonyms, source */
+  double fhost[65];         /* and host                         */
+  int ds[65];               /* synonyms of each codon           */
+} HARM_STRUCT;
+
+/* index deltas of each synonymous variant (codon_scan.c): CAI, Fop,   */
+/* Nc and GC3s                                                          */
+#define SCAN_NMETRIC 4
+
+/* what the index changes need besides the counts                      */
+typedef struct
+{
+  METRIC_REF_STRUCT *ref;
+  int gc3[65];              /* G or C third base                */
+  int fold[9];              /* amino acids of each degeneracy   */
+} SCAN_REF_STRUCT;
+
+/* codon counts of a gene with the running totals of each index        */
+typedef struct
+{
+  long ncod[65];
+  long naa[22];
+  long q[22];               /* sum of squared codon counts      */
+  double sigma;             /* log weights of the CAI codons    */
+  long tot;                 /* CAI (and GC3s) codons            */
+  long fop_opt, fop_tot;
+  long gc3;                 /* G+C synonymous third positions   */
+} SCAN_GENE_STRUCT;
+
+/* genes of a genome for VCF annotation (codon_vcf.c): the exons of     */
+/* each CDS, sorted by chromosome and start                             */
+typedef struct
+{
+  const char *chroms;       /* names end to end, sorted         */
+  const int64_t *chrom_off; /* nchrom + 1 offsets               */
+  long nchrom;
+  const int32_t *exon_chrom;
+  const int64_t *exon_start;/* 0-based, end exclusive           */
+  const int64_t *exon_end;
+  const int32_t *exon_gene;
+  const int64_t *exon_cds;  /* CDS offset of its first base in  */
+                            /* the direction of the gene        */
+  const int8_t *exon_strand;/* 1 or -1                          */
+  long nexon;
+  int64_t max_exon;         /* longest exon, set by vcf_annotate */
+  const char *cds;          /* CDS of each gene, batch layout   */
+  const int64_t *cds_off;
+  long ngene;
+  bool samples;             /* changes of each haplotype too    */
+} VCF_MODEL_STRUCT;
+
+#define VCF_OK 0
+#define VCF_REF_MISMATCH 1          /* REF is not the genome base     */
+#define VCF_NO_CODON 2              /* not in a whole codon of bases  */
+
+/* variants placed on genes, and haplotypes, with their index changes  */
+typedef struct
+{
+  long nrec;                /* data lines of the VCF            */
+  long nsample;
+  long nhit;                /* variant alleles placed on genes  */
+  int64_t *rec;             /* data line, from 0                */
+  int64_t *vcf_pos;         /* POS                              */
+  int32_t *chrom;
+  int32_t *allele;          /* of ALT, from 1                   */
+  int32_t *gene;
+  int64_t *pos;             /* offset in the CDS                */
+  uint8_t *from, *to;       /* codons before and after          */
+  int8_t *status;           /* VCF_OK ...                       */
+  double *delta;            /* nhit x SCAN_NMETRIC              */
+  long nhap;                /* haplotypes with variants in a gene */
+  int32_t *hap_sample;
+  int8_t *hap;              /* of the sample, from 0            */
+  int32_t *hap_gene;
+  int32_t *hap_nvar;
+  double *hap_delta;        /* nhap x SCAN_NMETRIC              */
+} VCF_RESULT_STRUCT;
+
+/* reading state of vcf_open ... vcf_close                              */
+typedef struct vcf_parse_struct VCF_PARSE_STRUCT;
+
+/* expression weighted usage (codon_wusage.c): genes and samples taken */
+/* together by each block of the product                                */
+#define WUSAGE_GENES 256
+#define WUSAGE_SAMPLES 8
+
+/* resident analysis server (codon_serve.c)                              */
+typedef struct serve_struct SERVE_STRUCT;
+#define SERVE_NSTATS 6              /* requests, sequences, latency   */
+                                    /* p50, p99, max, mean in us      */
+
+/* work function for par_for, called on items [start, end)               */
+typedef void (*PAR_FUNC)(long start, long end, void *arg);
+#define PAR_MAX_THREADS 256
+
+/* background worker threads (codon_pool.c)                              */
+typedef void (*POOL_FUNC)(void *arg);
+typedef struct pool_struct POOL_STRUCT;
+
+/* per-batch bump allocator (codon_arena.c)                              */
+typedef struct arena_struct ARENA_STRUCT;
+#define ARENA_ALIGN 64              /* least alignment, a cache line   */
+
 extern REF_STRUCT Z_ref;
-extern MENU_STRUCT Z_menu;
+extern const MENU_STRUCT Z_menu;
 extern GENETIC_CODE_STRUCT cu_ref[];
 extern FOP_STRUCT fop_ref[];
 extern CAI_STRUCT cai_ref[];
 extern AMINO_STRUCT amino_acids;
 extern AMINO_PROP_STRUCT amino_prop;
+extern const unsigned char base_code[256];
+extern const unsigned char iupac_code[256];
+extern const unsigned char base_mask_code[256];
+extern const char *metric_names[NUM_METRICS];
 
 /****************** Function type declarations *****************************/
 
@@ -153,8 +420,11 @@ int initialize_point(char code, char fop_type, char cai_type, MENU_STRUCT *pm, R
 int ident_codon(char *codon);
 int how_synon(int dds[], GENETIC_CODE_STRUCT *pcu);
 int how_synon_aa(int dda[], GENETIC_CODE_STRUCT *pcu);
+int code_from_ncbi(const char *aas, GENETIC_CODE_STRUCT *pcu);
 
 int count_codons(long* ncod, long *loc_cod_tot);
+int count_amino_acids(long *ncod, long naa[], GENETIC_CODE_STRUCT *pcu);
+int syn_codons(int cod[64], GENETIC_CODE_STRUCT *pcu);
 
 int codon_usage_tot(char *seq, long *codon_tot, int *valid_stops, long ncod[], long naa[], GENETIC_CODE_STRUCT *pcu);
 int codon_usage_out(FILE *fblkout, long *ncod, char *info, MENU_STRUCT *pm);
@@ -167,13 +437,14 @@ int fop_out(FILE *foutput, long *ncod, MENU_STRUCT *pm);
 int hydro_out(FILE *foutput, long *naa, char* title, MENU_STRUCT *pm);
 int aromo_out(FILE *foutput, long *naa, char* title, MENU_STRUCT *pm);
 int cutab_out(FILE *fblkout, long *nncod, long *nnaa, char* title, MENU_STRUCT *pm);
-int dinuc_out(char *seq, FILE *fblkout, char *ttitle, char sp);
+int dinuc_out(char *seq, FILE *fblkout, char *ttitle, MENU_STRUCT *pm);
 int enc_out(FILE *foutput, long *ncod, long *naa, MENU_STRUCT *pm);
 int gc_out(FILE *foutput, FILE *fblkout, long *ncod, int which, char* title, MENU_STRUCT *pm);
 int base_sil_us_out(FILE *foutput, long *ncod, long *naa, MENU_STRUCT *pm);
 
 
 int rscu_usage(long *nncod, long *nnaa, float rscu[], int *ds, GENETIC_CODE_STRUCT *pcu);
+int rscu_profile(long *nncod, float *vec, int *cod, int n, int *ds, GENETIC_CODE_STRUCT *pcu);
 int raau_usage(long nnaa[], double raau[]);
 int base_sil_us(long *nncod, long *nnaa, double base_sil[], int *ds, int *da, GENETIC_CODE_STRUCT *pcu);
 int cai(long *nncod, double *sigma, int *ds, CAI_STRUCT *pcai, GENETIC_CODE_STRUCT *pcu);
@@ -184,3 +455,154 @@ int gc(int *ds, long *ncod, long bases[5], long base_tot[5], long base_1[5], lon
 int dinuc_count(char *seq, long din[3][16], long dinuc_tot[4], int *fram);
 int hydro(long *nnaa, float *hydro, float hydro_ref[22]);
 int aromo(long *nnaa, float *aromo, int aromo_ref[22]);
+
+// defined in codon_par.c
+int par_threads(int nthreads);
+int par_for(long n, int nthreads, PAR_FUNC fn, void *arg);
+
+// defined in codon_pool.c
+POOL_STRUCT *pool_open(int nthreads);
+int pool_fd(POOL_STRUCT *pool);
+int pool_submit(POOL_STRUCT *pool, POOL_FUNC fn, void *arg, int64_t id);
+long pool_done(POOL_STRUCT *pool, int64_t *ids, long max);
+void pool_close(POOL_STRUCT *pool);
+
+// defined in codon_arena.c
+ARENA_STRUCT *arena_open(size_t size);
+void *arena_alloc(ARENA_STRUCT *arena, size_t size, size_t align);
+char *arena_base(ARENA_STRUCT *arena);
+size_t arena_used(ARENA_STRUCT *arena);
+size_t arena_size(ARENA_STRUCT *arena);
+void arena_reset(ARENA_STRUCT *arena);
+void arena_close(ARENA_STRUCT *arena);
+
+// defined in codon_nn.c
+int nn_build(NN_INDEX_STRUCT *idx, long *ncod, int64_t *ids, long n, int nlist, int niter, GENETIC_CODE_STRUCT *pcu, int nthreads);
+int nn_save(NN_INDEX_STRUCT *idx, char *filename);
+int nn_load(NN_INDEX_STRUCT *idx, char *filename);
+void nn_free(NN_INDEX_STRUCT *idx);
+int nn_search(NN_INDEX_STRUCT *idx, long *ncod, long nq, int k, int nprobe, int64_t *out_ids, float *out_dist, int nthreads);
+
+// defined in codon_batch.c
+int codon_usage_seq(const char *seq, long len, long ncod[]);
+int codon_usage_batch(const char *data, const int64_t *offsets, long nseq, long *ncod, int nthreads);
+int codon_usage_seq_mask(const char *seq, long len, long ncod[], long *masked);
+int codon_usage_batch_mask(const char *data, const int64_t *offsets, long nseq, long *ncod, long *masked, int nthreads);
+int dinuc_count_mask(const char *seq, long len, long din[3][16], long dinuc_tot[4], int *fram);
+int codon_usage_seq_frac(const char *seq, long len, double ncod[]);
+int codon_usage_batch_frac(const char *data, const int64_t *offsets, long nseq, double *ncod, int nthreads);
+
+// defined in codon_csr.c
+int codon_csr_count(const char *data, const int64_t *offsets, long nseq, bool pairs, int64_t *indptr, int nthreads);
+int codon_csr_fill(const char *data, const int64_t *offsets, long nseq, bool pairs, const int64_t *indptr, uint16_t *indices, uint32_t *values, int nthreads);
+int metric_csr(const int64_t *indptr, const uint16_t *indices, const uint32_t *values, long n, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out, int nthreads);
+int rscu_csr(const int64_t *indptr, const uint16_t *indices, const uint32_t *values, long n, METRIC_REF_STRUCT *ref, float *rscu, int nthreads);
+
+// defined in codon_fasta.c
+long fasta_parse(const char *buf, long len, char *seq, int64_t *seq_off, int64_t *name_off, long max_rec);
+
+// defined in codon_diff.c
+int bg_init(BACKGROUND_STRUCT *bg, GENETIC_CODE_STRUCT *pcu);
+int bg_add(BACKGROUND_STRUCT *bg, long *ncod, long n);
+int bg_score(BACKGROUND_STRUCT *bg, long *ncod, long n, bool leave_one_out, double pseudo, double ridge, double *out, int nthreads);
+
+// defined in codon_coa.c
+int coa_init(COA_STRUCT *coa, bool rscu, GENETIC_CODE_STRUCT *pcu);
+int coa_add(COA_STRUCT *coa, long *ncod, long n, int nthreads);
+int coa_fit(COA_STRUCT *coa);
+int coa_transform(COA_STRUCT *coa, long *ncod, long n, int naxes, double *out, int nthreads);
+
+// defined in codon_em.c
+int em_mixture(long *ncod, long n, int k, int *cod, int dim, int *group, double *logpi, double *logtheta, double *resp, int max_iter, double tol, double pseudo, double *loglik, int *niter, int nthreads);
+int em_posterior(long *ncod, long n, int k, int *cod, int dim, double *logpi, double *logtheta, double *resp, double *loglik, int nthreads);
+
+// defined in codon_cai.c
+int cai_batch(long *ncod, long n, int *ds, CAI_STRUCT *pcai, GENETIC_CODE_STRUCT *pcu, double *out, int nthreads);
+void cai_weights(const double pool[65], CAI_STRUCT *pcai, GENETIC_CODE_STRUCT *pcu);
+int cai_fit(long *ncod, long n, long nref, int max_iter, int *ds, GENETIC_CODE_STRUCT *pcu, CAI_STRUCT *pcai, long *ref, double *out, int *niter, int nthreads);
+
+// defined in codon_table.c
+long cut_parse(const char *buf, long len, int format, double *ncod, int64_t *name_off, long max_rec);
+int cut_save(const char *filename, int format, const double *ncod, long n, const char **names, GENETIC_CODE_STRUCT *pcu);
+int cut_weights(const double *ncod, long n, GENETIC_CODE_STRUCT *pcu, double *w);
+
+// defined in codon_taxdb.c
+TDB_BUILDER_STRUCT *tdb_open(int nrank, const char **rank_names, bool pairs);
+int tdb_add(TDB_BUILDER_STRUCT *tb, const char *data, const int64_t *offsets, long nseq, const int64_t *taxa, int nthreads);
+long tdb_size(TDB_BUILDER_STRUCT *tb);
+int tdb_save(TDB_BUILDER_STRUCT *tb, const char *filename);
+void tdb_close(TDB_BUILDER_STRUCT *tb);
+int tdb_load(TAXON_DB_STRUCT *db, const char *filename);
+void tdb_free(TAXON_DB_STRUCT *db);
+long tdb_find(TAXON_DB_STRUCT *db, int64_t id);
+long tdb_lookup(TAXON_DB_STRUCT *db, const int64_t *ids, long n, int64_t *rows);
+
+// defined in codon_bundle.c
+int bundle_save(const char *filename, int64_t version, GENETIC_CODE_STRUCT *codes, int ncode, CAI_STRUCT *cais, int ncai, FOP_STRUCT *fops, int nfop, AMINO_PROP_STRUCT *props, int nprop, const char **names);
+REF_BUNDLE_STRUCT *bundle_load(const char *filename);
+void bundle_ref(REF_BUNDLE_STRUCT *b);
+void bundle_unref(REF_BUNDLE_STRUCT *b);
+int64_t bundle_version(REF_BUNDLE_STRUCT *b);
+long bundle_count(REF_BUNDLE_STRUCT *b, int table);
+const char *bundle_name(REF_BUNDLE_STRUCT *b, int table, long i);
+long bundle_find(REF_BUNDLE_STRUCT *b, int table, const char *name);
+int bundle_code(REF_BUNDLE_STRUCT *b, long i, GENETIC_CODE_STRUCT *pcu);
+int bundle_cai(REF_BUNDLE_STRUCT *b, long i, CAI_STRUCT *pcai);
+int bundle_fop(REF_BUNDLE_STRUCT *b, long i, FOP_STRUCT *pfop);
+int bundle_prop(REF_BUNDLE_STRUCT *b, long i, AMINO_PROP_STRUCT *pap);
+int bundle_metric_ref(REF_BUNDLE_STRUCT *b, long code, long cai, long fop, long prop, METRIC_REF_STRUCT *ref);
+REF_SLOT_STRUCT *refslot_open(REF_BUNDLE_STRUCT *b);
+REF_BUNDLE_STRUCT *refslot_get(REF_SLOT_STRUCT *slot);
+void refslot_swap(REF_SLOT_STRUCT *slot, REF_BUNDLE_STRUCT *b);
+void refslot_close(REF_SLOT_STRUCT *slot);
+
+// defined in codon_opt.c
+int opt_batch(const char *prot, const int64_t *offsets, long n, GENETIC_CODE_STRUCT *pcu, CAI_STRUCT *pcai, OPT_PARAMS_STRUCT *par, char *out, long *violations, int nthreads);
+
+// defined in codon_harm.c
+int harm_init(HARM_STRUCT *ph, const double src[65], const double host[65], GENETIC_CODE_STRUCT *pcu);
+int harm_batch(const char *seqs, const int64_t *offsets, long n, HARM_STRUCT *ph, char *out, double *sim, long *changed, int nthreads);
+
+// defined in codon_scan.c
+int scan_codon(const char *seq);
+int scan_ref_init(SCAN_REF_STRUCT *sr, METRIC_REF_STRUCT *ref);
+int scan_gene_init(SCAN_GENE_STRUCT *g, const char *seq, long len, SCAN_REF_STRUCT *sr);
+void scan_move(SCAN_GENE_STRUCT *g, int x, int y, SCAN_REF_STRUCT *sr);
+void scan_values(const SCAN_GENE_STRUCT *g, SCAN_REF_STRUCT *sr, double out[SCAN_NMETRIC]);
+void scan_delta(SCAN_GENE_STRUCT *g, const double base[SCAN_NMETRIC], int x, int y, SCAN_REF_STRUCT *sr, double out[SCAN_NMETRIC]);
+int64_t scan_count(const char *data, const int64_t *offsets, long n, METRIC_REF_STRUCT *ref, int64_t *var_off, int nthreads);
+int scan_batch(const char *data, const int64_t *offsets, long n, METRIC_REF_STRUCT *ref, const int64_t *var_off, int64_t *pos, uint8_t *from, uint8_t *to, double *out, int nthreads);
+
+// defined in codon_vcf.c
+VCF_PARSE_STRUCT *vcf_open(VCF_MODEL_STRUCT *model, VCF_RESULT_STRUCT *res);
+int vcf_feed(VCF_PARSE_STRUCT *ps, const char *buf, long len);
+int vcf_finish(VCF_PARSE_STRUCT *ps, METRIC_REF_STRUCT *ref, int nthreads);
+void vcf_close(VCF_PARSE_STRUCT *ps);
+int vcf_annotate(const char *buf, long len, VCF_MODEL_STRUCT *model, METRIC_REF_STRUCT *ref, VCF_RESULT_STRUCT *res, int nthreads);
+void vcf_free(VCF_RESULT_STRUCT *res);
+
+// defined in codon_wusage.c
+int wusage_batch(const double *ncod, long n, const double *w, long nsample, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *usage, double *naa, double *rscu, double *out, int nthreads);
+
+// defined in codon_metrics.c
+int metric_init(METRIC_REF_STRUCT *ref, GENETIC_CODE_STRUCT *pcu, CAI_STRUCT *pcai, FOP_STRUCT *pfop);
+void metric_opt_info(METRIC_REF_STRUCT *ref);
+int metric_row(long *ncod, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out);
+int metric_batch(long *ncod, long n, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out, int nthreads);
+int metric_seqs(const char *data, const int64_t *offsets, long n, long *ncod, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out, int nthreads);
+int metric_seqs_mask(const char *data, const int64_t *offsets, long n, long *ncod, long *masked, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out, int nthreads);
+int metric_seqs_codes(const char *data, const int64_t *offsets, long n, const int8_t *codes, long *ncod, METRIC_REF_STRUCT *refs, int nrefs, const int *which, int nwhich, double *out, int nthreads);
+void metric_task(void *arg);
+int metric_columns(const char *data, const int64_t *offsets, long n, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double **cols, int64_t **counts, int nthreads);
+int count_amino_acids_frac(const double *ncod, double naa[], GENETIC_CODE_STRUCT *pcu);
+int gc_frac(const double *ncod, METRIC_REF_STRUCT *ref, double *tot_s, double *totalaa, double gc_metrics[]);
+int metric_row_frac(const double *ncod, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out);
+int metric_batch_frac(double *ncod, long n, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out, int nthreads);
+int metric_seqs_frac(const char *data, const int64_t *offsets, long n, double *ncod, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out, int nthreads);
+
+// defined in codon_serve.c
+SERVE_STRUCT *serve_open(const char *path, int nthreads);
+int serve_poll(SERVE_STRUCT *srv, int timeout_ms);
+bool serve_running(SERVE_STRUCT *srv);
+int serve_stats(SERVE_STRUCT *srv, double stats[SERVE_NSTATS]);
+void serve_close(SERVE_STRUCT *srv);
@@ -34,7 +34,7 @@ genetic code or across the calculation of various codon indicies.
 #include <limits.h>
 #include <stdbool.h>
 
-#include "codonw-slim/codonw/codonwlib/include/codonW.h"
+#include "../include/codonW.h"
 
 /********************* Initilize Pointers**********************************/
 /* Various pointers to structures are assigned here dependent on the      */
@@ -58,13 +58,11 @@ int initialize_point(char code, char fop_species, char cai_species, MENU_STRUCT
    pm->pcbi = &(ref->fop[fop_species]);
    pm->pcu = &(ref->cu[code]);
 
-   static int dds[65];
-   how_synon(dds, pm->pcu);
-   pm->ds = dds;
+   how_synon(pm->dds, pm->pcu);
+   pm->ds = pm->dds;
 
-   static int dda[22];
-   how_synon_aa(dda, pm->pcu);
-   pm->da = dda;
+   how_synon_aa(pm->dda, pm->pcu);
+   pm->da = pm->dda;
 
    fprintf(pm->my_err, "Genetic code set to %s %s\n", pm->pcu->des, pm->pcu->typ);
 
@@ -106,6 +104,47 @@ int how_synon_aa(int dda[], GENETIC_CODE_STRUCT *pcu)
    return 0;
 }
 
+/****************** Genetic code from NCBI    *****************************/
+/* Fills pcu->ca from 64 one letter amino acids (or * for stop) in the    */
+/* order of the NCBI translation tables, TTT TTC TTA TTG TCT ... GGG.     */
+/* NCBI codon p = (x-1)*16 + (y-1)*4 + (z-1) is codon (x-1)*16+y+(z-1)*4  */
+/* here. Returns 1 if aas is not 64 known letters.                        */
+/**************************************************************************/
+int code_from_ncbi(const char *aas, GENETIC_CODE_STRUCT *pcu)
+{
+   signed char aa_index[256];
+   int p, x, a;
+
+   memset(aa_index, -1, sizeof(aa_index));
+   for (a = 1; a < 22; a++)
+   {
+      aa_index[(unsigned char)amino_acids.aa1[a][0]] = (signed char)a;
+      aa_index[(unsigned char)tolower(amino_acids.aa1[a][0])] = (signed char)a;
+   }
+
+   if (strlen(aas) != 64)
+   {
+      fprintf(stderr, "A genetic code needs 64 amino acids, not %zu\n", strlen(aas));
+      return 1;
+   }
+   pcu->des = "Custom genetic code";
+   pcu->typ = "";
+   pcu->ca[0] = 0;
+   for (p = 0; p < 64; p++)
+   {
+      a = aa_index[(unsigned char)aas[p]];
+      if (a < 0)
+      {
+         fprintf(stderr, "Unknown amino acid '%c' in genetic code\n", aas[p]);
+         return 1;
+      }
+      x = (p / 16) * 16 + (p / 4) % 4 + 1 + (p % 4) * 4;
+      pcu->ca[x] = a;
+   }
+
+   return 0;
+}
+
 /****************** Codon Usage Counting      *****************************/
 /* Counts the frequency of usage of each codon and amino acid this data   */
 /* is used throughout CodonW                                              */
@@ -197,6 +236,42 @@ int count_codons(long* ncod, long *loc_cod_tot) {
    return 0;
 }
 
+/****************** Synonymous codons         *****************************/
+/* Lists the codons that carry information about synonymous usage, those  */
+/* that are neither stop codons nor the only codon for their amino acid   */
+/* (59 for the universal code), and returns how many there are            */
+/**************************************************************************/
+int syn_codons(int cod[64], GENETIC_CODE_STRUCT *pcu)
+{
+   int ds[65];
+   int x, n = 0;
+
+   how_synon(ds, pcu);
+   for (x = 1; x < 65; x++)
+   {
+      if (pcu->ca[x] == 11 || ds[x] == 1)
+         continue;
+      cod[n++] = x;
+   }
+   return n;
+}
+
+/****************** Count amino acids         *****************************/
+/* Tallies amino acid usage from codon usage, for counts that did not     */
+/* come from codon_usage_tot                                              */
+/**************************************************************************/
+int count_amino_acids(long *ncod, long naa[], GENETIC_CODE_STRUCT *pcu)
+{
+   int x;
+
+   for (x = 0; x < 22; x++)
+      naa[x] = 0;
+   for (x = 0; x < 65; x++)
+      naa[pcu->ca[x]] += ncod[x];
+
+   return 0;
+}
+
 
 /******************  Clean up               *******************************/
 /* Called after each sequence has been completely read from disk          */
@@ -0,0 +1,140 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains an arena (bump) allocator for the buffers of a batch
+of genes. One region of address space is reserved up front, backed by
+transparent huge pages where the system offers them, and allocations are
+carved from it in order. Nothing is freed on its own: the whole arena is
+reset once the batch is done, so that the next batch reuses the same,
+already faulted in, pages.
+
+Pages are only committed as they are first written, so the reservation
+can be generous.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "../include/codonW.h"
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+struct arena_struct
+{
+   pthread_mutex_t lock;
+   char *base;
+   size_t size;
+   size_t used;
+};
+
+/****************** Reserve an arena          *****************************/
+/* size bytes of address space, returns NULL on error                     */
+/**************************************************************************/
+ARENA_STRUCT *arena_open(size_t size)
+{
+   ARENA_STRUCT *arena;
+   void *base;
+
+   if (!(arena = (ARENA_STRUCT *)calloc(1, sizeof(ARENA_STRUCT))))
+      return NULL;
+   base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if (base == MAP_FAILED)
+   {
+      fprintf(stderr, "Could not reserve %zu bytes for arena: %s\n", size, strerror(errno));
+      free(arena);
+      return NULL;
+   }
+#ifdef MADV_HUGEPAGE
+   madvise(base, size, MADV_HUGEPAGE); /* only a hint, may fail            */
+#endif
+
+   pthread_mutex_init(&arena->lock, NULL);
+   arena->base = (char *)base;
+   arena->size = size;
+   return arena;
+}
+
+/****************** Allocate from an arena    *****************************/
+/* size bytes aligned to align (a power of two), or NULL if the arena is  */
+/* full. Safe to call from several threads.                               */
+/**************************************************************************/
+void *arena_alloc(ARENA_STRUCT *arena, size_t size, size_t align)
+{
+   size_t start;
+   void *p = NULL;
+
+   if (align < ARENA_ALIGN)
+      align = ARENA_ALIGN;
+
+   pthread_mutex_lock(&arena->lock);
+   start = (arena->used + align - 1) & ~(align - 1);
+   if (start <= arena->size && size <= arena->size - start)
+   {
+      p = arena->base + start;
+      arena->used = start + size;
+   }
+   pthread_mutex_unlock(&arena->lock);
+
+   return p;
+}
+
+/* start of the reserved region and bytes in use                         */
+char *arena_base(ARENA_STRUCT *arena)
+{
+   return arena->base;
+}
+
+size_t arena_used(ARENA_STRUCT *arena)
+{
+   return arena->used;
+}
+
+size_t arena_size(ARENA_STRUCT *arena)
+{
+   return arena->size;
+}
+
+/****************** Reset an arena            *****************************/
+/* Everything allocated is released at once, pages stay mapped            */
+/**************************************************************************/
+void arena_reset(ARENA_STRUCT *arena)
+{
+   pthread_mutex_lock(&arena->lock);
+   arena->used = 0;
+   pthread_mutex_unlock(&arena->lock);
+}
+
+void arena_close(ARENA_STRUCT *arena)
+{
+   munmap(arena->base, arena->size);
+   pthread_mutex_destroy(&arena->lock);
+   free(arena);
+}
@@ -0,0 +1,332 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains functions that work on many sequences at once. A batch
+of sequences is stored end to end in one buffer, sequence i occupying
+data[offsets[i]] to data[offsets[i + 1]] (the layout of an Arrow string
+array), and results are written to one row per sequence of a matrix.
+
+Counts can also be fractional: an ambiguous codon (IUPAC letters such as
+N, R or Y) is then shared equally between the codons it may stand for
+instead of being lost to the untranslatable count.
+
+For soft-masked sequences (repeats in lowercase) case can be made to
+matter: the _mask functions set the codons, and dinucleotides, that touch
+a lowercase letter aside, tallying the masked codons of each sequence.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../include/codonW.h"
+
+/* nucleotide recoding used by ident_codon, T/U=1 C=2 A=3 G=4 others 0   */
+const unsigned char base_code[256] = {
+    ['T'] = 1, ['t'] = 1, ['U'] = 1, ['u'] = 1,
+    ['C'] = 2, ['c'] = 2,
+    ['A'] = 3, ['a'] = 3,
+    ['G'] = 4, ['g'] = 4
+};
+
+/* base_code with case as a mask bit: BASE_MASKED is set for lowercase   */
+/* letters, whether bases or not                                          */
+const unsigned char base_mask_code[256] = {
+    ['T'] = 1, ['U'] = 1, ['C'] = 2, ['A'] = 3, ['G'] = 4,
+    ['t'] = 1 | BASE_MASKED, ['u'] = 1 | BASE_MASKED, ['c'] = 2 | BASE_MASKED,
+    ['a'] = 3 | BASE_MASKED, ['g'] = 4 | BASE_MASKED,
+    ['b'] = BASE_MASKED, ['d'] = BASE_MASKED, ['e'] = BASE_MASKED, ['f'] = BASE_MASKED,
+    ['h'] = BASE_MASKED, ['i'] = BASE_MASKED, ['j'] = BASE_MASKED, ['k'] = BASE_MASKED,
+    ['l'] = BASE_MASKED, ['m'] = BASE_MASKED, ['n'] = BASE_MASKED, ['o'] = BASE_MASKED,
+    ['p'] = BASE_MASKED, ['q'] = BASE_MASKED, ['r'] = BASE_MASKED, ['s'] = BASE_MASKED,
+    ['v'] = BASE_MASKED, ['w'] = BASE_MASKED, ['x'] = BASE_MASKED, ['y'] = BASE_MASKED,
+    ['z'] = BASE_MASKED
+};
+
+/* IUPAC nucleotide codes as sets of bases, bit b - 1 for base_code b    */
+const unsigned char iupac_code[256] = {
+    ['T'] = 1, ['t'] = 1, ['U'] = 1, ['u'] = 1,
+    ['C'] = 2, ['c'] = 2,
+    ['A'] = 4, ['a'] = 4,
+    ['G'] = 8, ['g'] = 8,
+    ['Y'] = 3, ['y'] = 3,    /* C or T    */
+    ['W'] = 5, ['w'] = 5,    /* A or T    */
+    ['M'] = 6, ['m'] = 6,    /* A or C    */
+    ['H'] = 7, ['h'] = 7,    /* not G     */
+    ['K'] = 9, ['k'] = 9,    /* G or T    */
+    ['S'] = 10, ['s'] = 10,  /* C or G    */
+    ['B'] = 11, ['b'] = 11,  /* not A     */
+    ['R'] = 12, ['r'] = 12,  /* A or G    */
+    ['D'] = 13, ['d'] = 13,  /* not C     */
+    ['V'] = 14, ['v'] = 14,  /* not T     */
+    ['N'] = 15, ['n'] = 15
+};
+
+/* expansion of each set: number of bases, then their base_code values   */
+static const unsigned char iupac_bases[16][5] = {
+    {0},          {1, 1},       {1, 2},       {2, 1, 2},
+    {1, 3},       {2, 1, 3},    {2, 2, 3},    {3, 1, 2, 3},
+    {1, 4},       {2, 1, 4},    {2, 2, 4},    {3, 1, 2, 4},
+    {2, 3, 4},    {3, 1, 3, 4}, {3, 2, 3, 4}, {4, 1, 2, 3, 4}
+};
+
+/****************** Codon usage of one sequence  **************************/
+/* Table-driven equivalent of the counting loop in codon_usage_tot, the   */
+/* length is given so that sequences need not be NUL terminated. Counts   */
+/* are added to ncod, a trailing partial codon is counted in ncod[0].     */
+/**************************************************************************/
+int codon_usage_seq(const char *seq, long len, long ncod[])
+{
+   const unsigned char *s = (const unsigned char *)seq;
+   int b1, b2, b3;
+   long i;
+
+   for (i = 0; i + 2 < len; i += 3)
+   {
+      b1 = base_code[s[i]];
+      b2 = base_code[s[i + 1]];
+      b3 = base_code[s[i + 2]];
+      if (b1 && b2 && b3)
+         ncod[(b1 - 1) * 16 + b2 + (b3 - 1) * 4]++;
+      else
+         ncod[0]++;
+   }
+
+   if (len % 3)
+      ncod[0]++;
+
+   return 0;
+}
+
+/****************** Codon usage, soft-masked  *****************************/
+/* As codon_usage_seq, but codons with a lowercase letter are not counted */
+/* in ncod, only added to *masked (a trailing partial codon too)          */
+/**************************************************************************/
+int codon_usage_seq_mask(const char *seq, long len, long ncod[], long *masked)
+{
+   const unsigned char *s = (const unsigned char *)seq;
+   int b1, b2, b3;
+   long i;
+
+   for (i = 0; i + 2 < len; i += 3)
+   {
+      b1 = base_mask_code[s[i]];
+      b2 = base_mask_code[s[i + 1]];
+      b3 = base_mask_code[s[i + 2]];
+      if ((b1 | b2 | b3) & BASE_MASKED)
+         (*masked)++;
+      else if (b1 && b2 && b3)
+         ncod[(b1 - 1) * 16 + b2 + (b3 - 1) * 4]++;
+      else
+         ncod[0]++;
+   }
+
+   if (len % 3)
+   {
+      for (b1 = 0; i < len; i++)
+         b1 |= base_mask_code[s[i]];
+      if (b1 & BASE_MASKED)
+         (*masked)++;
+      else
+         ncod[0]++;
+   }
+
+   return 0;
+}
+
+/****************** Dinucleotides, soft-masked ****************************/
+/* As dinuc_count (codon_blk.c) for len bases of seq, a lowercase letter  */
+/* breaking the run of bases as any character other than TUCAG does       */
+/**************************************************************************/
+int dinuc_count_mask(const char *seq, long len, long din[3][16], long dinuc_tot[4], int *fram)
+{
+   const unsigned char *s = (const unsigned char *)seq;
+   int last, cur = 0, x;
+   long i;
+
+   for (i = 0; i < len; i++)
+   {
+      last = cur;
+      cur = base_mask_code[s[i]];
+      if (cur & BASE_MASKED)
+         cur = 0;
+      if (!cur || !last)
+         continue;
+      din[*fram][(last - 1) * 4 + cur - 1]++;
+      if (++(*fram) == 3)
+         *fram = 0;
+   }
+
+   for (x = 0; x < 4; x++)
+      dinuc_tot[x] = 0;
+   for (x = 0; x < 3; x++)
+      for (i = 0; i < 16; i++)
+      {
+         dinuc_tot[x] += din[x][i];
+         dinuc_tot[3] += din[x][i];
+      }
+
+   return 0;
+}
+
+typedef struct
+{
+   const char *data;
+   const int64_t *offsets;
+   long *ncod;
+   long *masked;   /* NULL to ignore case                               */
+} CU_BATCH_JOB;
+
+static void codon_usage_range(long start, long end, void *varg)
+{
+   CU_BATCH_JOB *job = (CU_BATCH_JOB *)varg;
+   long i;
+
+   for (i = start; i < end; i++)
+   {
+      memset(job->ncod + i * 65, 0, sizeof(long) * 65);
+      if (job->masked)
+      {
+         job->masked[i] = 0;
+         codon_usage_seq_mask(job->data + job->offsets[i], (long)(job->offsets[i + 1] - job->offsets[i]),
+                              job->ncod + i * 65, job->masked + i);
+      }
+      else
+         codon_usage_seq(job->data + job->offsets[i],
+                         (long)(job->offsets[i + 1] - job->offsets[i]), job->ncod + i * 65);
+   }
+}
+
+/****************** Codon usage of a batch     ****************************/
+/* ncod is an nseq x 65 matrix, row i receives the counts of sequence i   */
+/**************************************************************************/
+int codon_usage_batch(const char *data, const int64_t *offsets, long nseq, long *ncod, int nthreads)
+{
+   CU_BATCH_JOB job;
+
+   job.data = data;
+   job.offsets = offsets;
+   job.ncod = ncod;
+   job.masked = NULL;
+
+   return par_for(nseq, nthreads, codon_usage_range, &job);
+}
+
+/****************** Soft-masked usage of a batch **************************/
+/* As codon_usage_batch with codon_usage_seq_mask counts, masked[i]       */
+/* receiving the number of masked codons of sequence i                    */
+/**************************************************************************/
+int codon_usage_batch_mask(const char *data, const int64_t *offsets, long nseq, long *ncod, long *masked,
+                           int nthreads)
+{
+   CU_BATCH_JOB job;
+
+   job.data = data;
+   job.offsets = offsets;
+   job.ncod = ncod;
+   job.masked = masked;
+
+   return par_for(nseq, nthreads, codon_usage_range, &job);
+}
+
+/****************** Fractional codon usage    *****************************/
+/* As codon_usage_seq, but a codon with IUPAC ambiguity codes adds an     */
+/* equal share of one to each codon it is compatible with, so that NNN    */
+/* adds 1/64 to every codon. Only codons with other characters (gaps,     */
+/* digits ...) and a trailing partial codon are counted in ncod[0].       */
+/**************************************************************************/
+int codon_usage_seq_frac(const char *seq, long len, double ncod[])
+{
+   const unsigned char *s = (const unsigned char *)seq;
+   const unsigned char *e1, *e2, *e3;
+   int b1, b2, b3, i1, i2, i3;
+   double share;
+   long i;
+
+   for (i = 0; i + 2 < len; i += 3)
+   {
+      b1 = base_code[s[i]];
+      b2 = base_code[s[i + 1]];
+      b3 = base_code[s[i + 2]];
+      if (b1 && b2 && b3)
+      {
+         ncod[(b1 - 1) * 16 + b2 + (b3 - 1) * 4] += 1;
+         continue;
+      }
+
+      e1 = iupac_bases[iupac_code[s[i]]];
+      e2 = iupac_bases[iupac_code[s[i + 1]]];
+      e3 = iupac_bases[iupac_code[s[i + 2]]];
+      if (!(e1[0] && e2[0] && e3[0]))
+      {
+         ncod[0] += 1;
+         continue;
+      }
+      share = 1.0 / (double)(e1[0] * e2[0] * e3[0]);
+      for (i1 = 1; i1 <= e1[0]; i1++)
+         for (i2 = 1; i2 <= e2[0]; i2++)
+            for (i3 = 1; i3 <= e3[0]; i3++)
+               ncod[(e1[i1] - 1) * 16 + e2[i2] + (e3[i3] - 1) * 4] += share;
+   }
+
+   if (len % 3)
+      ncod[0] += 1;
+
+   return 0;
+}
+
+typedef struct
+{
+   const char *data;
+   const int64_t *offsets;
+   double *ncod;
+} CU_FRAC_JOB;
+
+static void codon_usage_frac_range(long start, long end, void *varg)
+{
+   CU_FRAC_JOB *job = (CU_FRAC_JOB *)varg;
+   long i;
+
+   for (i = start; i < end; i++)
+   {
+      memset(job->ncod + i * 65, 0, sizeof(double) * 65);
+      codon_usage_seq_frac(job->data + job->offsets[i],
+                           (long)(job->offsets[i + 1] - job->offsets[i]), job->ncod + i * 65);
+   }
+}
+
+/****************** Fractional usage of a batch ***************************/
+/* As codon_usage_batch with codon_usage_seq_frac counts                  */
+/**************************************************************************/
+int codon_usage_batch_frac(const char *data, const int64_t *offsets, long nseq, double *ncod, int nthreads)
+{
+   CU_FRAC_JOB job;
+
+   job.data = data;
+   job.offsets = offsets;
+   job.ncod = ncod;
+
+   return par_for(nseq, nthreads, codon_usage_frac_range, &job);
+}
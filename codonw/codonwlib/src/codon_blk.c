@@ -99,6 +99,21 @@ int rscu_usage(long *nncod, long *nnaa, float rscu[], int *ds, GENETIC_CODE_STRU
    return 0;
 }
 
+/* RSCU of the n codons listed in cod (e.g. from syn_codons) as floats   */
+int rscu_profile(long *nncod, float *vec, int *cod, int n, int *ds, GENETIC_CODE_STRUCT *pcu)
+{
+   long naa[22];
+   float rscu[65];
+   int x;
+
+   count_amino_acids(nncod, naa, pcu);
+   rscu_usage(nncod, naa, rscu, ds, pcu);
+   for (x = 0; x < n; x++)
+      vec[x] = rscu[cod[x]];
+
+   return 0;
+}
+
 int rscu_usage_out(FILE *fblkout, long *nncod, long *nnaa, char* title, MENU_STRUCT *pm)
 {
    float rscu[65];
@@ -149,20 +164,19 @@ int raau_usage_out(FILE *fblkout, long *nnaa, char* title, MENU_STRUCT *pm)
 {
    AMINO_STRUCT *paa = pm->paa;
 
-   static char first_line = true;
    int i, x;
    char sp;
 
    sp = '\t';
 
-   if (first_line)
+   if (!pm->raau_header)
    { /* if true write a header*/
       fprintf(fblkout, "%s", "Gene_name");
 
       for (i = 0; i < 22; i++)
          fprintf(fblkout, "%c%s", sp, paa->aa3[i]); /* three letter AA names*/
       fprintf(fblkout, "\n");
-      first_line = false;
+      pm->raau_header = true;
    }
 
    fprintf(fblkout, "%.30s", title);
@@ -182,11 +196,10 @@ int aa_usage_out(FILE *fblkout, long *nnaa, char* title, MENU_STRUCT *pm)
 {
    AMINO_STRUCT *paa = pm->paa;
 
-   static char first_line = true;
    int i;
    char sp = pm->separator;
 
-   if (first_line)
+   if (!pm->aa_header)
    {
       fprintf(fblkout, "%s", "Gene_name");
 
@@ -194,7 +207,7 @@ int aa_usage_out(FILE *fblkout, long *nnaa, char* title, MENU_STRUCT *pm)
          fprintf(fblkout, "%c%s", sp, paa->aa3[i]); /* 3 letter AA code     */
 
       fprintf(fblkout, "\n");
-      first_line = false;
+      pm->aa_header = true;
    }
    fprintf(fblkout, "%.20s", title);
 
@@ -293,7 +306,6 @@ int gc_out(FILE *foutput, FILE *fblkout, long *nncod, int which, char* title, ME
 
    gc(pm->ds, nncod, bases, base_tot, base_1, base_2, base_3, &tot_s, &totalaa, &metrics, pm->pcu);
 
-   static char header = false;
    char sp = pm->separator;
    
    typedef double lf;
@@ -308,13 +320,13 @@ int gc_out(FILE *foutput, FILE *fblkout, long *nncod, int which, char* title, ME
    switch ((int)which)
    {
    case 1: /* exhaustive output for analysis     */
-      if (!header)
+      if (!pm->gc_header)
       { /* print a first line                 */
          fprintf(fblkout,
                   "Gene_description%cLen_aa%cLen_sym%cGC%cGC3s%cGCn3s%cGC1%cGC2"
                   "%cGC3%cT1%cT2%cT3%cC1%cC2%cC3%cA1%cA2%cA3%cG1%cG2%cG3\n",
                   sp, sp, sp, sp, sp, sp, sp, sp, sp, sp, sp, sp, sp, sp, sp, sp, sp, sp, sp, sp);
-         header = true;
+         pm->gc_header = true;
       }
       /* now print the information          */
       fprintf(fblkout, "%-.20s%c", title, sp);
@@ -445,8 +457,8 @@ int dinuc_count(char *seq, long din[3][16], long dinuc_tot[4], int *fram)
    return 0;
 }
 
-int dinuc_out(char *seq, FILE *fblkout, char *ttitle, char sp) {
-   static char called = false;
+int dinuc_out(char *seq, FILE *fblkout, char *ttitle, MENU_STRUCT *pm) {
+   char sp = pm->separator;
    char bases[5] = {'T', 'C', 'A', 'G'};
    int i, x, y;
 
@@ -463,9 +475,9 @@ int dinuc_out(char *seq, FILE *fblkout, char *ttitle, char sp) {
 
    dinuc_count(seq, din, dinuc_tot, &fram);
 
-   if (!called)
+   if (!pm->dinuc_header)
    { /* write out the first row as a header*/
-      called = true;
+      pm->dinuc_header = true;
 
       fprintf(fblkout, "%s", "title");
       for (y = 0; y < 4; y++)
@@ -477,7 +489,7 @@ int dinuc_out(char *seq, FILE *fblkout, char *ttitle, char sp) {
       }
 
       fprintf(fblkout, "\n");
-   } /* matches if (!called)               */
+   } /* matches if (!pm->dinuc_header)     */
 
    /*Sample output   truncated  **********************************************/
    /*title         frame TT    TC    TA    TG    CT    CC    CA    CG    AT  */
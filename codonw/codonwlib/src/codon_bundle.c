@@ -0,0 +1,487 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains reference bundles: genetic codes, CAI weights, optimal
+codon sets and amino acid property scales, any number of each, written
+once to a file that is then mapped read-only.
+
+Each table is an array of fixed size named records. Along with its codon
+assignments a genetic code carries the synonym counts of how_synon and
+how_synon_aa, and CAI weights their logarithms as used by metric_init, so
+that the METRIC_REF_STRUCT of any combination is filled by copying.
+
+A bundle is reference counted. A slot holds the current bundle of a long
+running process and may be pointed at a new one at any time: callers take
+a reference to the bundle in the slot while they read from it, and the
+old bundle is unmapped when its last reader lets it go.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../include/codonW.h"
+
+#define BUNDLE_MAGIC "CWREFBN"
+#define BUNDLE_FORMAT 1
+#define BUNDLE_HEADER_LEN 256
+#define BUNDLE_ALIGN 64
+
+typedef struct
+{
+   char magic[8];
+   int32_t format;           /* BUNDLE_FORMAT                     */
+   int32_t reserved;
+   int64_t version;          /* set by whoever wrote the bundle   */
+   int64_t count[NUM_BUNDLE_TABLES];
+} BUNDLE_HEADER;
+
+typedef struct
+{
+   char name[BUNDLE_NAME_LEN];
+   int ca[65];
+   int ds[65];               /* as how_synon                      */
+   int da[23];               /* as how_synon_aa                   */
+} BUNDLE_CODE_REC;
+
+typedef struct
+{
+   char name[BUNDLE_NAME_LEN];
+   float w[65];
+   double logw[65];          /* as metric_init                    */
+} BUNDLE_CAI_REC;
+
+typedef struct
+{
+   char name[BUNDLE_NAME_LEN];
+   char fop_cod[65];
+} BUNDLE_FOP_REC;
+
+typedef struct
+{
+   char name[BUNDLE_NAME_LEN];
+   AMINO_PROP_STRUCT prop;
+} BUNDLE_PROP_REC;
+
+static const size_t bundle_rec_len[NUM_BUNDLE_TABLES] = {
+    sizeof(BUNDLE_CODE_REC), sizeof(BUNDLE_CAI_REC), sizeof(BUNDLE_FOP_REC), sizeof(BUNDLE_PROP_REC)};
+
+struct ref_bundle_struct
+{
+   int refs;
+   char *map;
+   size_t map_len;
+   int64_t version;
+   long count[NUM_BUNDLE_TABLES];
+   char *table[NUM_BUNDLE_TABLES];
+};
+
+struct ref_slot_struct
+{
+   pthread_mutex_t lock;
+   REF_BUNDLE_STRUCT *bundle;
+};
+
+static char bundle_code_typ[] = "";
+
+static size_t bundle_align(size_t x)
+{
+   return (x + BUNDLE_ALIGN - 1) & ~((size_t)BUNDLE_ALIGN - 1);
+}
+
+/* byte offsets of the tables in the file, returns its length            */
+static size_t bundle_layout(const int64_t count[NUM_BUNDLE_TABLES], size_t off[NUM_BUNDLE_TABLES])
+{
+   size_t pos = BUNDLE_HEADER_LEN;
+   int t;
+
+   for (t = 0; t < NUM_BUNDLE_TABLES; t++)
+   {
+      off[t] = pos;
+      pos = bundle_align(pos + bundle_rec_len[t] * (size_t)count[t]);
+   }
+   return pos;
+}
+
+/****************** Write a bundle            *****************************/
+/* names holds ncode + ncai + nfop + nprop record names in that order     */
+/**************************************************************************/
+int bundle_save(const char *filename, int64_t version,
+                GENETIC_CODE_STRUCT *codes, int ncode, CAI_STRUCT *cais, int ncai,
+                FOP_STRUCT *fops, int nfop, AMINO_PROP_STRUCT *props, int nprop,
+                const char **names)
+{
+   BUNDLE_HEADER *head;
+   BUNDLE_CODE_REC *rc;
+   BUNDLE_CAI_REC *rw;
+   BUNDLE_FOP_REC *rf;
+   BUNDLE_PROP_REC *rp;
+   size_t off[NUM_BUNDLE_TABLES], total;
+   char *block;
+   FILE *fout;
+   double w;
+   int i, x, k = 0, status;
+
+   if (ncode < 0 || ncai < 0 || nfop < 0 || nprop < 0)
+      return 1;
+
+   if (!(head = (BUNDLE_HEADER *)calloc(1, sizeof(BUNDLE_HEADER))))
+      return 1;
+   head->count[BUNDLE_CODES] = ncode;
+   head->count[BUNDLE_CAI] = ncai;
+   head->count[BUNDLE_FOP] = nfop;
+   head->count[BUNDLE_PROPS] = nprop;
+   total = bundle_layout(head->count, off);
+   if (!(block = (char *)calloc(1, total)))
+   {
+      fprintf(stderr, "Out of memory writing reference bundle\n");
+      free(head);
+      return 1;
+   }
+   memcpy(head->magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+   head->format = BUNDLE_FORMAT;
+   head->version = version;
+   memcpy(block, head, sizeof(BUNDLE_HEADER));
+   free(head);
+
+   rc = (BUNDLE_CODE_REC *)(block + off[BUNDLE_CODES]);
+   for (i = 0; i < ncode; i++, k++)
+   {
+      strncpy(rc[i].name, names[k], BUNDLE_NAME_LEN - 1);
+      memcpy(rc[i].ca, codes[i].ca, sizeof(rc[i].ca));
+      how_synon(rc[i].ds, &codes[i]);
+      how_synon_aa(rc[i].da, &codes[i]);
+   }
+   rw = (BUNDLE_CAI_REC *)(block + off[BUNDLE_CAI]);
+   for (i = 0; i < ncai; i++, k++)
+   {
+      strncpy(rw[i].name, names[k], BUNDLE_NAME_LEN - 1);
+      for (x = 1; x < 65; x++)
+      {
+         rw[i].w[x] = cais[i].cai_val[x];
+         w = (double)cais[i].cai_val[x];
+         rw[i].logw[x] = log(w < 0.0001 ? (double)0.01F : w);
+      }
+   }
+   rf = (BUNDLE_FOP_REC *)(block + off[BUNDLE_FOP]);
+   for (i = 0; i < nfop; i++, k++)
+   {
+      strncpy(rf[i].name, names[k], BUNDLE_NAME_LEN - 1);
+      memcpy(rf[i].fop_cod, fops[i].fop_cod, sizeof(rf[i].fop_cod));
+   }
+   rp = (BUNDLE_PROP_REC *)(block + off[BUNDLE_PROPS]);
+   for (i = 0; i < nprop; i++, k++)
+   {
+      strncpy(rp[i].name, names[k], BUNDLE_NAME_LEN - 1);
+      rp[i].prop = props[i];
+   }
+
+   if ((fout = fopen(filename, "wb")) == NULL)
+   {
+      fprintf(stderr, "Could not open %s for writing\n", filename);
+      free(block);
+      return 1;
+   }
+   status = fwrite(block, 1, total, fout) != total;
+   if (fclose(fout) != 0 || status)
+   {
+      fprintf(stderr, "Could not write reference bundle to %s\n", filename);
+      status = 1;
+   }
+   free(block);
+   return status;
+}
+
+/* records a bundle written by bundle_save could hold: every name ends    */
+/* in a NUL within its field, and genetic codes assign amino acids 0..21  */
+/* with the synonym counts those give                                     */
+static int bundle_check(REF_BUNDLE_STRUCT *b)
+{
+   GENETIC_CODE_STRUCT code;
+   BUNDLE_CODE_REC *rc;
+   int ds[65], da[23], t, x;
+   long i;
+
+   for (t = 0; t < NUM_BUNDLE_TABLES; t++)
+      for (i = 0; i < b->count[t]; i++)
+         if (bundle_name(b, t, i)[BUNDLE_NAME_LEN - 1] != 0)
+            return 1;
+
+   memset(&code, 0, sizeof(code));
+   for (i = 0; i < b->count[BUNDLE_CODES]; i++)
+   {
+      rc = (BUNDLE_CODE_REC *)b->table[BUNDLE_CODES] + i;
+      for (x = 0; x < 65; x++)
+         if (rc->ca[x] < 0 || rc->ca[x] > 21)
+            return 1;
+      memcpy(code.ca, rc->ca, sizeof(code.ca));
+      how_synon(ds, &code);
+      how_synon_aa(da, &code);
+      if (memcmp(ds, rc->ds, sizeof(ds)) != 0 || memcmp(da, rc->da, sizeof(int) * 22) != 0)
+         return 1;
+   }
+   return 0;
+}
+
+/****************** Map a bundle              *****************************/
+/* returns a bundle holding one reference, or NULL                        */
+/**************************************************************************/
+REF_BUNDLE_STRUCT *bundle_load(const char *filename)
+{
+   REF_BUNDLE_STRUCT *b;
+   BUNDLE_HEADER *head;
+   struct stat st;
+   size_t off[NUM_BUNDLE_TABLES];
+   char *map;
+   int fd, t;
+
+   if ((fd = open(filename, O_RDONLY)) < 0)
+   {
+      fprintf(stderr, "Could not open %s\n", filename);
+      return NULL;
+   }
+   if (fstat(fd, &st) != 0 || (size_t)st.st_size < BUNDLE_HEADER_LEN)
+   {
+      fprintf(stderr, "%s is not a reference bundle\n", filename);
+      close(fd);
+      return NULL;
+   }
+   map = (char *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (map == MAP_FAILED)
+   {
+      fprintf(stderr, "Could not map %s\n", filename);
+      return NULL;
+   }
+
+   head = (BUNDLE_HEADER *)map;
+   for (t = 0; t < NUM_BUNDLE_TABLES; t++)
+      if (head->count[t] < 0 || head->count[t] > (int64_t)st.st_size)
+         break;
+   if (memcmp(head->magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0 ||
+       head->format != BUNDLE_FORMAT || t < NUM_BUNDLE_TABLES ||
+       bundle_layout(head->count, off) != (size_t)st.st_size)
+   {
+      fprintf(stderr, "%s is not a format %d reference bundle\n", filename, BUNDLE_FORMAT);
+      munmap(map, (size_t)st.st_size);
+      return NULL;
+   }
+
+   if (!(b = (REF_BUNDLE_STRUCT *)calloc(1, sizeof(REF_BUNDLE_STRUCT))))
+   {
+      munmap(map, (size_t)st.st_size);
+      return NULL;
+   }
+   b->refs = 1;
+   b->map = map;
+   b->map_len = (size_t)st.st_size;
+   b->version = head->version;
+   for (t = 0; t < NUM_BUNDLE_TABLES; t++)
+   {
+      b->count[t] = (long)head->count[t];
+      b->table[t] = map + off[t];
+   }
+   /* the map is read-only and shared, so bad records are refused       */
+   /* rather than mended                                                 */
+   if (bundle_check(b))
+   {
+      fprintf(stderr, "%s holds invalid reference records\n", filename);
+      munmap(map, b->map_len);
+      free(b);
+      return NULL;
+   }
+   return b;
+}
+
+void bundle_ref(REF_BUNDLE_STRUCT *b)
+{
+   __atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+}
+
+/* drops a reference, the last one unmaps the bundle                     */
+void bundle_unref(REF_BUNDLE_STRUCT *b)
+{
+   if (!b || __atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) > 0)
+      return;
+   munmap(b->map, b->map_len);
+   free(b);
+}
+
+int64_t bundle_version(REF_BUNDLE_STRUCT *b)
+{
+   return b->version;
+}
+
+long bundle_count(REF_BUNDLE_STRUCT *b, int table)
+{
+   return table >= 0 && table < NUM_BUNDLE_TABLES ? b->count[table] : 0;
+}
+
+/* name of record i of a table, every record starts with its name        */
+const char *bundle_name(REF_BUNDLE_STRUCT *b, int table, long i)
+{
+   if (table < 0 || table >= NUM_BUNDLE_TABLES || i < 0 || i >= b->count[table])
+      return NULL;
+   return b->table[table] + bundle_rec_len[table] * (size_t)i;
+}
+
+/* record of a table with the given name, -1 if there is none            */
+long bundle_find(REF_BUNDLE_STRUCT *b, int table, const char *name)
+{
+   long i;
+
+   for (i = 0; i < bundle_count(b, table); i++)
+      if (strncmp(bundle_name(b, table, i), name, BUNDLE_NAME_LEN) == 0)
+         return i;
+   return -1;
+}
+
+/****************** References from a bundle  *****************************/
+/* Copies records into the structures used elsewhere, the strings of     */
+/* which point into the bundle: they are valid while it is referenced     */
+/**************************************************************************/
+int bundle_code(REF_BUNDLE_STRUCT *b, long i, GENETIC_CODE_STRUCT *pcu)
+{
+   BUNDLE_CODE_REC *rc;
+
+   if (i < 0 || i >= b->count[BUNDLE_CODES])
+      return 1;
+   rc = (BUNDLE_CODE_REC *)b->table[BUNDLE_CODES] + i;
+   pcu->des = rc->name;
+   pcu->typ = bundle_code_typ;
+   memcpy(pcu->ca, rc->ca, sizeof(pcu->ca));
+   return 0;
+}
+
+int bundle_cai(REF_BUNDLE_STRUCT *b, long i, CAI_STRUCT *pcai)
+{
+   BUNDLE_CAI_REC *rw;
+
+   if (i < 0 || i >= b->count[BUNDLE_CAI])
+      return 1;
+   rw = (BUNDLE_CAI_REC *)b->table[BUNDLE_CAI] + i;
+   pcai->des = rw->name;
+   pcai->ref = NULL;
+   memcpy(pcai->cai_val, rw->w, sizeof(pcai->cai_val));
+   return 0;
+}
+
+int bundle_fop(REF_BUNDLE_STRUCT *b, long i, FOP_STRUCT *pfop)
+{
+   BUNDLE_FOP_REC *rf;
+
+   if (i < 0 || i >= b->count[BUNDLE_FOP])
+      return 1;
+   rf = (BUNDLE_FOP_REC *)b->table[BUNDLE_FOP] + i;
+   pfop->des = rf->name;
+   pfop->ref = NULL;
+   memcpy(pfop->fop_cod, rf->fop_cod, sizeof(pfop->fop_cod));
+   return 0;
+}
+
+int bundle_prop(REF_BUNDLE_STRUCT *b, long i, AMINO_PROP_STRUCT *pap)
+{
+   if (i < 0 || i >= b->count[BUNDLE_PROPS])
+      return 1;
+   *pap = ((BUNDLE_PROP_REC *)b->table[BUNDLE_PROPS] + i)->prop;
+   return 0;
+}
+
+/* as metric_init from records code, cai, fop and prop of a bundle       */
+int bundle_metric_ref(REF_BUNDLE_STRUCT *b, long code, long cai, long fop, long prop,
+                      METRIC_REF_STRUCT *ref)
+{
+   BUNDLE_CODE_REC *rc;
+   BUNDLE_CAI_REC *rw;
+
+   memset(ref, 0, sizeof(METRIC_REF_STRUCT));
+   if (bundle_code(b, code, &ref->code) || bundle_fop(b, fop, &ref->fop) ||
+       bundle_prop(b, prop, &ref->prop) || cai < 0 || cai >= b->count[BUNDLE_CAI])
+      return 1;
+
+   rc = (BUNDLE_CODE_REC *)b->table[BUNDLE_CODES] + code;
+   rw = (BUNDLE_CAI_REC *)b->table[BUNDLE_CAI] + cai;
+   memcpy(ref->ds, rc->ds, sizeof(ref->ds));
+   memcpy(ref->da, rc->da, sizeof(ref->da));
+   memcpy(ref->cai_logw, rw->logw, sizeof(ref->cai_logw));
+   /* the strings would outlive a swapped bundle                        */
+   ref->code.des = bundle_code_typ;
+   ref->fop.des = NULL;
+   metric_opt_info(ref);
+   return 0;
+}
+
+/****************** Hot swappable slot        *****************************/
+REF_SLOT_STRUCT *refslot_open(REF_BUNDLE_STRUCT *b)
+{
+   REF_SLOT_STRUCT *slot;
+
+   if (!(slot = (REF_SLOT_STRUCT *)calloc(1, sizeof(REF_SLOT_STRUCT))))
+      return NULL;
+   pthread_mutex_init(&slot->lock, NULL);
+   if (b)
+      bundle_ref(b);
+   slot->bundle = b;
+   return slot;
+}
+
+/* the bundle in the slot, with a reference for the caller to drop       */
+REF_BUNDLE_STRUCT *refslot_get(REF_SLOT_STRUCT *slot)
+{
+   REF_BUNDLE_STRUCT *b;
+
+   pthread_mutex_lock(&slot->lock);
+   if ((b = slot->bundle))
+      bundle_ref(b);
+   pthread_mutex_unlock(&slot->lock);
+   return b;
+}
+
+/* puts b in the slot, readers of the old bundle keep it until done      */
+void refslot_swap(REF_SLOT_STRUCT *slot, REF_BUNDLE_STRUCT *b)
+{
+   REF_BUNDLE_STRUCT *old;
+
+   if (b)
+      bundle_ref(b);
+   pthread_mutex_lock(&slot->lock);
+   old = slot->bundle;
+   slot->bundle = b;
+   pthread_mutex_unlock(&slot->lock);
+   bundle_unref(old);
+}
+
+void refslot_close(REF_SLOT_STRUCT *slot)
+{
+   bundle_unref(slot->bundle);
+   pthread_mutex_destroy(&slot->lock);
+   free(slot);
+}
@@ -0,0 +1,226 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains the Codon Adaptation Index of a batch of genes and a
+reference-free fit of CAI weights for genomes without a known set of
+highly expressed genes.
+
+The fit is self-consistent in the manner of scnRCA (O'Neill et al. 2013):
+weights are first taken from the codon usage of the whole genome, every
+gene is scored, the highest scoring genes become the reference set whose
+codon usage gives the next weights, and so on until the reference set no
+longer changes.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "../include/codonW.h"
+
+/* log relative adaptiveness, zero for codons that do not count          */
+static void cai_log_w(double logw[65], int *ds, CAI_STRUCT *pcai, GENETIC_CODE_STRUCT *pcu)
+{
+   double w;
+   int x;
+
+   logw[0] = 0;
+   for (x = 1; x < 65; x++)
+   {
+      if (pcu->ca[x] == 11 || ds[x] == 1)
+      {
+         logw[x] = 0;
+         continue;
+      }
+      w = (double)pcai->cai_val[x];
+      logw[x] = log(w < 0.0001 ? (double)0.01F : w); /* as in cai()       */
+   }
+}
+
+typedef struct
+{
+   long *ncod;
+   double *logw;
+   int *ds;
+   GENETIC_CODE_STRUCT *pcu;
+   double *out;
+} CAI_BATCH_JOB;
+
+static void cai_batch_range(long start, long end, void *varg)
+{
+   CAI_BATCH_JOB *job = (CAI_BATCH_JOB *)varg;
+   double sigma;
+   long i, totaa, *row;
+   int x;
+
+   for (i = start; i < end; i++)
+   {
+      row = job->ncod + i * 65;
+      for (x = 1, sigma = 0, totaa = 0; x < 65; x++)
+      {
+         if (job->pcu->ca[x] == 11 || job->ds[x] == 1)
+            continue;
+         sigma += (double)row[x] * job->logw[x];
+         totaa += row[x];
+      }
+      job->out[i] = totaa ? exp(sigma / (double)totaa) : 0;
+   }
+}
+
+/****************** CAI of a batch            *****************************/
+/* out[i] receives the CAI of row i of the n x 65 count matrix, exactly   */
+/* as cai() would but without changing pcai                               */
+/**************************************************************************/
+int cai_batch(long *ncod, long n, int *ds, CAI_STRUCT *pcai, GENETIC_CODE_STRUCT *pcu,
+              double *out, int nthreads)
+{
+   CAI_BATCH_JOB job;
+   double logw[65];
+
+   cai_log_w(logw, ds, pcai, pcu);
+   job.ncod = ncod;
+   job.logw = logw;
+   job.ds = ds;
+   job.pcu = pcu;
+   job.out = out;
+
+   return par_for(n, nthreads, cai_batch_range, &job);
+}
+
+/* relative adaptiveness from pooled codon counts                         */
+void cai_weights(const double pool[65], CAI_STRUCT *pcai, GENETIC_CODE_STRUCT *pcu)
+{
+   double most[22];
+   int x;
+
+   for (x = 0; x < 22; x++)
+      most[x] = 0;
+   for (x = 1; x < 65; x++)
+      if (pool[x] > most[pcu->ca[x]])
+         most[pcu->ca[x]] = pool[x];
+
+   pcai->cai_val[0] = 0;
+   for (x = 1; x < 65; x++)
+      pcai->cai_val[x] = most[pcu->ca[x]] > 0 ? (float)(pool[x] / most[pcu->ca[x]]) : 0.0F;
+}
+
+typedef struct
+{
+   double cai;
+   long gene;
+} CAI_RANK;
+
+/* highest CAI first, ties by gene so that the reference set is stable    */
+static int cai_rank_cmp(const void *a, const void *b)
+{
+   const CAI_RANK *ra = (const CAI_RANK *)a, *rb = (const CAI_RANK *)b;
+
+   if (ra->cai != rb->cai)
+      return ra->cai > rb->cai ? -1 : 1;
+   return ra->gene < rb->gene ? -1 : ra->gene > rb->gene;
+}
+
+static int cai_gene_cmp(const void *a, const void *b)
+{
+   long ga = *(const long *)a, gb = *(const long *)b;
+
+   return ga < gb ? -1 : ga > gb;
+}
+
+/****************** Reference-free CAI        *****************************/
+/* Fits the weights in pcai to the n x 65 count matrix ncod. Each round   */
+/* the nref genes of highest CAI are the reference set, ref (nref) holds  */
+/* the final set in gene order and out (n) the final CAI of every gene.   */
+/* Returns 0 once the reference set stops changing, 2 if it still changed */
+/* after max_iter rounds and 1 on error.                                  */
+/**************************************************************************/
+int cai_fit(long *ncod, long n, long nref, int max_iter, int *ds, GENETIC_CODE_STRUCT *pcu,
+            CAI_STRUCT *pcai, long *ref, double *out, int *niter, int nthreads)
+{
+   CAI_RANK *rank;
+   long *prev;
+   double pool[65];
+   long i;
+   int x, it, status = 2;
+
+   if (nref < 1 || nref > n)
+   {
+      fprintf(stderr, "The reference set must have between 1 and %ld genes\n", n);
+      return 1;
+   }
+   rank = (CAI_RANK *)malloc(sizeof(CAI_RANK) * n);
+   prev = (long *)malloc(sizeof(long) * nref);
+   if (!rank || !prev)
+   {
+      fprintf(stderr, "Out of memory fitting CAI weights\n");
+      free(rank);
+      free(prev);
+      return 1;
+   }
+
+   /* start from the codon usage of the whole genome                     */
+   for (x = 0; x < 65; x++)
+      pool[x] = 0;
+   for (i = 0; i < n * 65; i++)
+      pool[i % 65] += (double)ncod[i];
+   cai_weights(pool, pcai, pcu);
+
+   for (it = 0, *niter = 0; it < max_iter; it++)
+   {
+      cai_batch(ncod, n, ds, pcai, pcu, out, nthreads);
+      for (i = 0; i < n; i++)
+      {
+         rank[i].cai = out[i];
+         rank[i].gene = i;
+      }
+      qsort(rank, n, sizeof(CAI_RANK), cai_rank_cmp);
+      for (i = 0; i < nref; i++)
+         ref[i] = rank[i].gene;
+      qsort(ref, nref, sizeof(long), cai_gene_cmp);
+
+      if (it > 0 && memcmp(ref, prev, sizeof(long) * nref) == 0)
+      {
+         status = 0;
+         break;
+      }
+      memcpy(prev, ref, sizeof(long) * nref);
+      *niter = it + 1;
+
+      for (x = 0; x < 65; x++)
+         pool[x] = 0;
+      for (i = 0; i < nref; i++)
+         for (x = 1; x < 65; x++)
+            pool[x] += (double)ncod[ref[i] * 65 + x];
+      cai_weights(pool, pcai, pcu);
+   }
+
+   /* scores under the final weights                                     */
+   if (status)
+      cai_batch(ncod, n, ds, pcai, pcu, out, nthreads);
+
+   free(rank);
+   free(prev);
+   return status;
+}
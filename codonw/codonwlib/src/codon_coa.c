@@ -0,0 +1,379 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains a streaming correspondence analysis of codon counts,
+or principal component analysis of RSCU, over the synonymous codons of a
+genetic code. Genes are only seen one batch at a time and only a weighted
+mean and the co-moments around it (at most 64 x 64) are kept:
+
+  CA   each gene is its codon profile (counts / total) weighted by its
+       total, the weighted mean is then the column masses and the scaled
+       co-moments are the cross-product of the standardised residuals
+  PCA  each gene is its RSCU vector with weight one, the co-moments are
+       the covariance matrix
+
+Batches are split between threads, each accumulating its own moments by
+West's weighted update, which are then merged (Chan et al.).
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "../include/codonW.h"
+
+#define COA_JACOBI_SWEEPS 100
+
+typedef struct
+{
+   long nrows;
+   double weight;
+   double mean[64];
+   double m2[64 * 64];
+} COA_MOMENTS;
+
+/****************** Initialise                *****************************/
+int coa_init(COA_STRUCT *coa, bool rscu, GENETIC_CODE_STRUCT *pcu)
+{
+   memset(coa, 0, sizeof(COA_STRUCT));
+   coa->rscu = rscu;
+   coa->code = *pcu;
+   coa->dim = syn_codons(coa->cod, pcu);
+   how_synon(coa->ds, pcu);
+
+   return 0;
+}
+
+/* the vector and weight of one gene, false if it has no codons to use   */
+static bool coa_profile(COA_STRUCT *coa, long *nncod, double *x, double *w)
+{
+   float rscu[64];
+   double tot = 0;
+   int j;
+
+   for (j = 0; j < coa->dim; j++)
+      tot += (double)nncod[coa->cod[j]];
+   if (tot <= 0)
+      return false;
+
+   if (coa->rscu)
+   {
+      rscu_profile(nncod, rscu, coa->cod, coa->dim, coa->ds, &coa->code);
+      for (j = 0; j < coa->dim; j++)
+         x[j] = (double)rscu[j];
+      *w = 1.0;
+   }
+   else
+   {
+      for (j = 0; j < coa->dim; j++)
+         x[j] = (double)nncod[coa->cod[j]] / tot;
+      *w = tot;
+   }
+   return true;
+}
+
+/* merge moments b into a, only the upper triangle of m2 is kept         */
+static void coa_merge(COA_MOMENTS *a, COA_MOMENTS *b, int dim)
+{
+   double delta[64];
+   double w, f;
+   int j, k;
+
+   if (b->weight <= 0)
+      return;
+   w = a->weight + b->weight;
+   f = a->weight * b->weight / w;
+   for (j = 0; j < dim; j++)
+      delta[j] = b->mean[j] - a->mean[j];
+   for (j = 0; j < dim; j++)
+   {
+      for (k = j; k < dim; k++)
+         a->m2[j * 64 + k] += b->m2[j * 64 + k] + f * delta[j] * delta[k];
+      a->mean[j] += delta[j] * b->weight / w;
+   }
+   a->weight = w;
+   a->nrows += b->nrows;
+}
+
+typedef struct
+{
+   COA_STRUCT *coa;
+   long *ncod;
+   long n;
+   long nparts;
+   COA_MOMENTS *parts;
+} COA_ADD_JOB;
+
+static void coa_add_range(long start, long end, void *varg)
+{
+   COA_ADD_JOB *job = (COA_ADD_JOB *)varg;
+   COA_MOMENTS *mom;
+   double x[64], delta[64], w;
+   long p, i, first, last;
+   int j, k, dim = job->coa->dim;
+
+   for (p = start; p < end; p++)
+   {
+      mom = job->parts + p;
+      memset(mom, 0, sizeof(COA_MOMENTS));
+      first = job->n * p / job->nparts;
+      last = job->n * (p + 1) / job->nparts;
+
+      for (i = first; i < last; i++)
+      {
+         if (!coa_profile(job->coa, job->ncod + i * 65, x, &w))
+            continue;
+         mom->nrows++;
+         mom->weight += w;
+         for (j = 0; j < dim; j++)
+         {
+            delta[j] = x[j] - mom->mean[j];
+            mom->mean[j] += delta[j] * w / mom->weight;
+         }
+         for (j = 0; j < dim; j++)
+            for (k = j; k < dim; k++)
+               mom->m2[j * 64 + k] += w * delta[j] * (x[k] - mom->mean[k]);
+      }
+   }
+}
+
+/****************** Accumulate genes          *****************************/
+/* Adds the n genes of an n x 65 count matrix. Genes without synonymous   */
+/* codons are ignored.                                                    */
+/**************************************************************************/
+int coa_add(COA_STRUCT *coa, long *ncod, long n, int nthreads)
+{
+   COA_ADD_JOB job;
+   COA_MOMENTS total;
+   long p;
+
+   job.coa = coa;
+   job.ncod = ncod;
+   job.n = n;
+   job.nparts = par_threads(nthreads);
+   if (job.nparts > n)
+      job.nparts = n > 0 ? n : 1;
+   job.parts = (COA_MOMENTS *)malloc(sizeof(COA_MOMENTS) * job.nparts);
+   if (!job.parts)
+   {
+      fprintf(stderr, "Out of memory in correspondence analysis\n");
+      return 1;
+   }
+
+   par_for(job.nparts, nthreads, coa_add_range, &job);
+
+   total.nrows = coa->nrows;
+   total.weight = coa->weight;
+   memcpy(total.mean, coa->mean, sizeof(total.mean));
+   memcpy(total.m2, coa->m2, sizeof(total.m2));
+   for (p = 0; p < job.nparts; p++)
+      coa_merge(&total, job.parts + p, coa->dim);
+   coa->nrows = total.nrows;
+   coa->weight = total.weight;
+   memcpy(coa->mean, total.mean, sizeof(total.mean));
+   memcpy(coa->m2, total.m2, sizeof(total.m2));
+   coa->fitted = false;
+
+   free(job.parts);
+   return 0;
+}
+
+/****************** Symmetric eigenproblem    *****************************/
+/* Cyclic Jacobi rotations on the n x n (stride 64) matrix a, which is    */
+/* destroyed. Eigenvalues go to d, eigenvector k to column k of v.        */
+/**************************************************************************/
+static int coa_jacobi(double *a, double *d, double *v, int n)
+{
+   double off, theta, t, c, s, tau, h, g, scale;
+   int sweep, p, q, r;
+
+   for (p = 0; p < n; p++)
+   {
+      for (q = 0; q < n; q++)
+         v[p * 64 + q] = p == q ? 1.0 : 0.0;
+      d[p] = a[p * 64 + p];
+   }
+
+   for (sweep = 0; sweep < COA_JACOBI_SWEEPS; sweep++)
+   {
+      for (p = 0, off = 0, scale = 0; p < n; p++)
+      {
+         scale += fabs(d[p]);
+         for (q = p + 1; q < n; q++)
+            off += fabs(a[p * 64 + q]);
+      }
+      if (off <= 1e-15 * scale || off == 0)
+         return 0;
+
+      for (p = 0; p < n - 1; p++)
+         for (q = p + 1; q < n; q++)
+         {
+            if (fabs(a[p * 64 + q]) < 1e-300)
+               continue;
+            theta = (d[q] - d[p]) / (2.0 * a[p * 64 + q]);
+            t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+            c = 1.0 / sqrt(t * t + 1.0);
+            s = t * c;
+            tau = s / (1.0 + c);
+            h = t * a[p * 64 + q];
+            d[p] -= h;
+            d[q] += h;
+            a[p * 64 + q] = a[q * 64 + p] = 0.0;
+            for (r = 0; r < n; r++)
+            {
+               if (r != p && r != q)
+               { /* a is kept symmetric in full                         */
+                  g = a[r * 64 + p];
+                  h = a[r * 64 + q];
+                  a[r * 64 + p] = a[p * 64 + r] = g - s * (h + g * tau);
+                  a[r * 64 + q] = a[q * 64 + r] = h + s * (g - h * tau);
+               }
+               g = v[r * 64 + p];
+               h = v[r * 64 + q];
+               v[r * 64 + p] = g - s * (h + g * tau);
+               v[r * 64 + q] = h + s * (g - h * tau);
+            }
+         }
+   }
+
+   fprintf(stderr, "Correspondence analysis did not converge\n");
+   return 1;
+}
+
+/****************** Fit axes                  *****************************/
+/* Eigen decomposition of the accumulated moments, axes sorted by        */
+/* decreasing eigenvalue (inertia for CA, variance for PCA)              */
+/**************************************************************************/
+int coa_fit(COA_STRUCT *coa)
+{
+   double a[64 * 64], d[64], v[64 * 64], sj, sk, t;
+   int dim = coa->dim;
+   int j, k, best;
+
+   if (coa->nrows < 2)
+   {
+      fprintf(stderr, "Need at least two genes for correspondence analysis\n");
+      return 1;
+   }
+
+   for (j = 0; j < dim; j++)
+      for (k = j; k < dim; k++)
+      {
+         if (coa->rscu)
+            t = coa->m2[j * 64 + k] / (double)(coa->nrows - 1);
+         else
+         {
+            sj = sqrt(coa->mean[j]);
+            sk = sqrt(coa->mean[k]);
+            t = sj > 0 && sk > 0 ? coa->m2[j * 64 + k] / (coa->weight * sj * sk) : 0.0;
+         }
+         a[j * 64 + k] = a[k * 64 + j] = t;
+      }
+
+   if (coa_jacobi(a, d, v, dim))
+      return 1;
+
+   /* selection sort of eigenpairs, largest first                       */
+   for (j = 0; j < dim; j++)
+   {
+      for (k = j + 1, best = j; k < dim; k++)
+         if (d[k] > d[best])
+            best = k;
+      coa->eigval[j] = d[best] > 0 ? d[best] : 0.0;
+      d[best] = d[j];
+      for (k = 0; k < dim; k++)
+      {
+         coa->axes[k * 64 + j] = v[k * 64 + best];
+         v[k * 64 + best] = v[k * 64 + j];
+      }
+   }
+   coa->fitted = true;
+
+   return 0;
+}
+
+typedef struct
+{
+   COA_STRUCT *coa;
+   long *ncod;
+   int naxes;
+   double *out;
+} COA_TRANSFORM_JOB;
+
+static void coa_transform_range(long start, long end, void *varg)
+{
+   COA_TRANSFORM_JOB *job = (COA_TRANSFORM_JOB *)varg;
+   COA_STRUCT *coa = job->coa;
+   double x[64], w, f;
+   double *out;
+   long i;
+   int j, k;
+
+   for (i = start; i < end; i++)
+   {
+      out = job->out + i * job->naxes;
+      if (!coa_profile(coa, job->ncod + i * 65, x, &w))
+      {
+         for (k = 0; k < job->naxes; k++)
+            out[k] = NAN;
+         continue;
+      }
+
+      for (j = 0; j < coa->dim; j++)
+      {
+         x[j] -= coa->mean[j];
+         if (!coa->rscu)
+            x[j] = coa->mean[j] > 0 ? x[j] / sqrt(coa->mean[j]) : 0.0;
+      }
+      for (k = 0; k < job->naxes; k++)
+      {
+         for (j = 0, f = 0; j < coa->dim; j++)
+            f += x[j] * coa->axes[j * 64 + k];
+         out[k] = f;
+      }
+   }
+}
+
+/****************** Gene coordinates          *****************************/
+/* Principal coordinates of the n genes of an n x 65 count matrix on the  */
+/* first naxes axes, written to the n x naxes matrix out. Genes without   */
+/* synonymous codons are given NaN.                                       */
+/**************************************************************************/
+int coa_transform(COA_STRUCT *coa, long *ncod, long n, int naxes, double *out, int nthreads)
+{
+   COA_TRANSFORM_JOB job;
+
+   if (!coa->fitted && coa_fit(coa))
+      return 1;
+   if (naxes > coa->dim)
+      naxes = coa->dim;
+
+   job.coa = coa;
+   job.ncod = ncod;
+   job.naxes = naxes;
+   job.out = out;
+
+   return par_for(n, nthreads, coa_transform_range, &job);
+}
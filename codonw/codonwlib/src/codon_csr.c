@@ -0,0 +1,339 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains codon counts of a batch of sequences (see
+codon_batch.c) as a compressed sparse row (CSR) matrix, and indices
+computed from that form without expanding it.
+
+Row i holds the counts of sequence i: its non-zero columns are
+indices[indptr[i]] to indices[indptr[i + 1] - 1], in increasing order,
+with the counts at the same positions of values. Columns are the 65 of
+codon_usage_batch (0 for untranslatable codons) or, for codon pairs,
+the CSR_PAIR_BINS pairs of adjacent translatable codons x, y numbered
+(x - 1) * 64 + (y - 1).
+
+Building the matrix takes two passes, one to size each row and one to
+fill it once the caller has allocated indptr[n] entries.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "../include/codonW.h"
+
+typedef struct
+{
+   const char *data;
+   const int64_t *offsets;
+   bool pairs;
+   int64_t *indptr;
+   uint16_t *indices;   /* NULL while sizing rows                        */
+   uint32_t *values;
+   int status;
+} CSR_JOB;
+
+static int csr_cmp(const void *a, const void *b)
+{
+   return (int)*(const uint16_t *)a - (int)*(const uint16_t *)b;
+}
+
+/* pair bins of one sequence, sorted, in buf; returns how many           */
+static long csr_pairs(const unsigned char *s, long len, uint16_t *buf)
+{
+   long i, n = 0;
+   int b1, b2, b3, prev = 0, x;
+
+   for (i = 0; i + 2 < len; i += 3)
+   {
+      b1 = base_code[s[i]];
+      b2 = base_code[s[i + 1]];
+      b3 = base_code[s[i + 2]];
+      x = b1 && b2 && b3 ? (b1 - 1) * 16 + b2 + (b3 - 1) * 4 : 0;
+      if (prev && x)
+         buf[n++] = (uint16_t)((prev - 1) * 64 + (x - 1));
+      prev = x;
+   }
+   qsort(buf, n, sizeof(uint16_t), csr_cmp);
+
+   return n;
+}
+
+static void csr_range(long start, long end, void *varg)
+{
+   CSR_JOB *job = (CSR_JOB *)varg;
+   uint16_t *buf = NULL, *idx;
+   uint32_t *val;
+   long ncod[65], i, len, cap = 0, nb, j, nnz;
+   int x;
+
+   for (i = start; i < end; i++)
+   {
+      len = (long)(job->offsets[i + 1] - job->offsets[i]);
+      idx = job->indices ? job->indices + job->indptr[i] : NULL;
+      val = job->values ? job->values + job->indptr[i] : NULL;
+      nnz = 0;
+
+      if (!job->pairs)
+      {
+         memset(ncod, 0, sizeof(ncod));
+         codon_usage_seq(job->data + job->offsets[i], len, ncod);
+         for (x = 0; x < 65; x++)
+            if (ncod[x])
+            {
+               if (idx)
+               {
+                  idx[nnz] = (uint16_t)x;
+                  val[nnz] = (uint32_t)ncod[x];
+               }
+               nnz++;
+            }
+      }
+      else
+      {
+         if (len / 3 > cap)
+         {
+            free(buf);
+            cap = len / 3;
+            if (!(buf = (uint16_t *)malloc(sizeof(uint16_t) * cap)))
+            {
+               job->status = 1;
+               return;
+            }
+         }
+         nb = csr_pairs((const unsigned char *)job->data + job->offsets[i], len, buf);
+         for (j = 0; j < nb; j++)
+         {
+            if (j && buf[j] == buf[j - 1])
+            {
+               if (val)
+                  val[nnz - 1]++;
+               continue;
+            }
+            if (idx)
+            {
+               idx[nnz] = buf[j];
+               val[nnz] = 1;
+            }
+            nnz++;
+         }
+      }
+
+      if (!job->indices)
+         job->indptr[i + 1] = nnz;
+   }
+   free(buf);
+}
+
+/****************** Size a CSR batch          *****************************/
+/* indptr (nseq + 1) receives the row starts, indptr[nseq] is the number  */
+/* of non-zero counts to allocate for codon_csr_fill                      */
+/**************************************************************************/
+int codon_csr_count(const char *data, const int64_t *offsets, long nseq, bool pairs,
+                    int64_t *indptr, int nthreads)
+{
+   CSR_JOB job = {data, offsets, pairs, indptr, NULL, NULL, 0};
+   long i;
+
+   indptr[0] = 0;
+   par_for(nseq, nthreads, csr_range, &job);
+   if (job.status)
+   {
+      fprintf(stderr, "Out of memory counting codon pairs\n");
+      return 1;
+   }
+   for (i = 0; i < nseq; i++)
+      indptr[i + 1] += indptr[i];
+
+   return 0;
+}
+
+/****************** Fill a CSR batch          *****************************/
+/* indptr as from codon_csr_count, indices and values hold indptr[nseq]   */
+/**************************************************************************/
+int codon_csr_fill(const char *data, const int64_t *offsets, long nseq, bool pairs,
+                   const int64_t *indptr, uint16_t *indices, uint32_t *values, int nthreads)
+{
+   CSR_JOB job = {data, offsets, pairs, (int64_t *)indptr, indices, values, 0};
+
+   par_for(nseq, nthreads, csr_range, &job);
+   if (job.status)
+   {
+      fprintf(stderr, "Out of memory counting codon pairs\n");
+      return 1;
+   }
+   return 0;
+}
+
+typedef struct
+{
+   const int64_t *indptr;
+   const uint16_t *indices;
+   const uint32_t *values;
+   METRIC_REF_STRUCT *ref;
+   const int *which;
+   int nwhich;
+   char fop_class[65];  /* fop_cod of codons that count towards Fop, else 0 */
+   double *out;
+   float *rscu;
+} CSR_METRIC_JOB;
+
+/* the codons fop() counts, with factor_in_rare false                     */
+static int csr_fop_class(char cls[65], METRIC_REF_STRUCT *ref)
+{
+   int x;
+
+   if (!ref->opt_ok)
+   {
+      fprintf(stderr, "Illegal Fop reference values\n");
+      return 1;
+   }
+   cls[0] = 0;
+   for (x = 1; x < 65; x++)
+      cls[x] = ref->has_opt[ref->code.ca[x]] ? ref->fop.fop_cod[x] : 0;
+   return 0;
+}
+
+static void csr_metric_range(long start, long end, void *varg)
+{
+   CSR_METRIC_JOB *job = (CSR_METRIC_JOB *)varg;
+   METRIC_REF_STRUCT *ref = job->ref;
+   long ncod[65], tot, fop_n[4], i;
+   double sigma, *out;
+   bool dense;
+   int64_t j;
+   int k, x;
+
+   for (i = start; i < end; i++)
+   {
+      out = job->out + i * job->nwhich;
+      dense = false;
+      for (k = 0; k < job->nwhich; k++)
+      {
+         switch (job->which[k])
+         {
+         case METRIC_CAI:
+            for (j = job->indptr[i], sigma = 0, tot = 0; j < job->indptr[i + 1]; j++)
+            {
+               x = job->indices[j];
+               if (!x || ref->code.ca[x] == 11 || ref->ds[x] == 1)
+                  continue;
+               sigma += (double)job->values[j] * ref->cai_logw[x];
+               tot += job->values[j];
+            }
+            out[k] = tot ? exp(sigma / (double)tot) : 0;
+            break;
+         case METRIC_FOP:
+            fop_n[0] = fop_n[1] = fop_n[2] = fop_n[3] = 0;
+            for (j = job->indptr[i]; j < job->indptr[i + 1]; j++)
+               fop_n[(int)job->fop_class[job->indices[j]]] += job->values[j];
+            tot = fop_n[1] + fop_n[2] + fop_n[3];
+            out[k] = tot ? (float)fop_n[3] / (float)tot : 0.0F;
+            break;
+         default:
+            if (!dense)
+            {
+               memset(ncod, 0, sizeof(ncod));
+               for (j = job->indptr[i]; j < job->indptr[i + 1]; j++)
+                  ncod[job->indices[j]] = job->values[j];
+               dense = true;
+            }
+            metric_row(ncod, ref, job->which + k, 1, out + k);
+         }
+      }
+   }
+}
+
+/****************** Indices of a CSR batch    *****************************/
+/* As metric_batch for codon counts in CSR form. CAI and Fop are summed   */
+/* over the non-zero counts only, other indices expand the row first.     */
+/**************************************************************************/
+int metric_csr(const int64_t *indptr, const uint16_t *indices, const uint32_t *values, long n,
+               METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out, int nthreads)
+{
+   CSR_METRIC_JOB job;
+   int i;
+
+   for (i = 0; i < nwhich; i++)
+      if (which[i] < 0 || which[i] >= NUM_METRICS)
+      {
+         fprintf(stderr, "No index %d\n", which[i]);
+         return 1;
+      }
+   if (csr_fop_class(job.fop_class, ref))
+      return 1;
+
+   job.indptr = indptr;
+   job.indices = indices;
+   job.values = values;
+   job.ref = ref;
+   job.which = which;
+   job.nwhich = nwhich;
+   job.out = out;
+
+   return par_for(n, nthreads, csr_metric_range, &job);
+}
+
+static void csr_rscu_range(long start, long end, void *varg)
+{
+   CSR_METRIC_JOB *job = (CSR_METRIC_JOB *)varg;
+   GENETIC_CODE_STRUCT *pcu = &job->ref->code;
+   long naa[22], i;
+   int64_t j;
+   int x;
+
+   for (i = start; i < end; i++)
+   {
+      memset(naa, 0, sizeof(naa));
+      for (j = job->indptr[i]; j < job->indptr[i + 1]; j++)
+         if (job->indices[j])
+            naa[pcu->ca[job->indices[j]]] += job->values[j];
+      for (j = job->indptr[i]; j < job->indptr[i + 1]; j++)
+      {
+         x = job->indices[j];
+         job->rscu[j] = x ? ((float)job->values[j] / (float)naa[pcu->ca[x]]) * (float)job->ref->ds[x]
+                          : 0.0F;
+      }
+   }
+}
+
+/****************** RSCU of a CSR batch       *****************************/
+/* rscu[j] receives the RSCU of the codon at indices[j], as rscu_usage    */
+/* would give it. Codons not stored have an RSCU of 0.                    */
+/**************************************************************************/
+int rscu_csr(const int64_t *indptr, const uint16_t *indices, const uint32_t *values, long n,
+             METRIC_REF_STRUCT *ref, float *rscu, int nthreads)
+{
+   CSR_METRIC_JOB job;
+
+   job.indptr = indptr;
+   job.indices = indices;
+   job.values = values;
+   job.ref = ref;
+   job.rscu = rscu;
+
+   return par_for(n, nthreads, csr_rscu_range, &job);
+}
@@ -0,0 +1,249 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains measures of how different the codon usage of a gene is
+from that of its genome. The genome background is accumulated from codon
+counts one batch at a time (bg_add) and genes are then scored against it
+(bg_score), so neither step needs all genes in memory at once.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "../include/codonW.h"
+
+/****************** Initialise background     *****************************/
+int bg_init(BACKGROUND_STRUCT *bg, GENETIC_CODE_STRUCT *pcu)
+{
+   int x;
+
+   memset(bg, 0, sizeof(BACKGROUND_STRUCT));
+   bg->code = *pcu;
+   for (x = 1; x < 65; x++)
+      if (pcu->ca[x] != 11)
+         bg->cod[bg->dim++] = x;
+
+   return 0;
+}
+
+/****************** Accumulate background     *****************************/
+/* Adds n genes (an n x 65 count matrix) to the pooled codon counts and   */
+/* to the running mean and co-moments of per-gene sense codon frequencies */
+/* (Welford's update). Genes without sense codons only add to the pool.   */
+/**************************************************************************/
+int bg_add(BACKGROUND_STRUCT *bg, long *ncod, long n)
+{
+   double x[64], delta[64];
+   double tot;
+   long i;
+   int j, k, dim = bg->dim;
+   long *row;
+
+   for (i = 0; i < n; i++)
+   {
+      row = ncod + i * 65;
+      for (j = 0, tot = 0; j < 65; j++)
+         bg->ncod[j] += (double)row[j];
+      for (j = 0; j < dim; j++)
+         tot += (double)row[bg->cod[j]];
+      if (tot <= 0)
+         continue;
+
+      bg->ngenes++;
+      for (j = 0; j < dim; j++)
+      {
+         x[j] = (double)row[bg->cod[j]] / tot;
+         delta[j] = x[j] - bg->mean[j];
+         bg->mean[j] += delta[j] / (double)bg->ngenes;
+      }
+      for (j = 0; j < dim; j++)
+         for (k = j; k < dim; k++)
+            bg->m2[j * 64 + k] += delta[j] * (x[k] - bg->mean[k]);
+   }
+
+   return 0;
+}
+
+/* in place lower Cholesky factor of the dim x dim (stride 64) matrix a   */
+static int bg_cholesky(double *a, int dim)
+{
+   double s;
+   int i, j, k;
+
+   for (j = 0; j < dim; j++)
+   {
+      for (k = 0, s = a[j * 64 + j]; k < j; k++)
+         s -= a[j * 64 + k] * a[j * 64 + k];
+      if (s <= 0)
+         return 1;
+      a[j * 64 + j] = sqrt(s);
+      for (i = j + 1; i < dim; i++)
+      {
+         for (k = 0, s = a[i * 64 + j]; k < j; k++)
+            s -= a[i * 64 + k] * a[j * 64 + k];
+         a[i * 64 + j] = s / a[j * 64 + j];
+      }
+   }
+   return 0;
+}
+
+typedef struct
+{
+   BACKGROUND_STRUCT *bg;
+   long *ncod;
+   double *out;
+   double *chol; /* NULL when Mahalanobis distance is not available */
+   bool leave_one_out;
+   double pseudo;
+} BG_SCORE_JOB;
+
+static void bg_score_range(long start, long end, void *varg)
+{
+   BG_SCORE_JOB *job = (BG_SCORE_JOB *)varg;
+   BACKGROUND_STRUCT *bg = job->bg;
+   GENETIC_CODE_STRUCT *pcu = &bg->code;
+   int dim = bg->dim;
+   double gaa[22], baa[22], back[65], y[64];
+   double gtot, btot, f, fb, b, kl, q, s, t, g;
+   double *out;
+   long *row, i;
+   int j, k, a;
+
+   for (i = start; i < end; i++)
+   {
+      row = job->ncod + i * 65;
+      out = job->out + i * 3;
+
+      for (a = 0; a < 22; a++)
+         gaa[a] = baa[a] = 0;
+      for (j = 0, gtot = btot = 0; j < dim; j++)
+      {
+         k = bg->cod[j];
+         back[k] = bg->ncod[k] - (job->leave_one_out ? (double)row[k] : 0.0);
+         gaa[pcu->ca[k]] += (double)row[k];
+         baa[pcu->ca[k]] += back[k];
+         gtot += (double)row[k];
+         btot += back[k];
+      }
+
+      if (gtot <= 0)
+      {
+         out[0] = out[1] = out[2] = NAN;
+         continue;
+      }
+
+      /* Karlin's B(g|G) and the KL divergence of codon frequencies     */
+      for (j = 0, b = 0, kl = 0; j < dim; j++)
+      {
+         k = bg->cod[j];
+         a = pcu->ca[k];
+         if (a != 0 && gaa[a] > 0)
+         {
+            f = (double)row[k] / gaa[a];
+            fb = baa[a] > 0 ? back[k] / baa[a] : 0.0;
+            b += (gaa[a] / gtot) * fabs(f - fb);
+         }
+         if (row[k] > 0)
+         {
+            f = (double)row[k] / gtot;
+            fb = (back[k] + job->pseudo) / (btot + job->pseudo * dim);
+            kl += f * log(f / fb);
+         }
+      }
+      out[0] = b;
+      out[1] = kl;
+
+      /* Mahalanobis distance from the mean of per-gene frequencies       */
+      if (!job->chol)
+      {
+         out[2] = NAN;
+         continue;
+      }
+      for (j = 0; j < dim; j++)
+      { /* forward substitution, L y = x - mean                       */
+         s = (double)row[bg->cod[j]] / gtot - bg->mean[j];
+         for (k = 0; k < j; k++)
+            s -= job->chol[j * 64 + k] * y[k];
+         y[j] = s / job->chol[j * 64 + j];
+      }
+      for (j = 0, q = 0; j < dim; j++)
+         q += y[j] * y[j];
+
+      if (job->leave_one_out)
+      { /* remove the gene from mean and covariance (Sherman-Morrison) */
+         g = (double)bg->ngenes;
+         t = g / ((g - 1) * (g - 2));
+         if (1 - t * q <= 0)
+         {
+            out[2] = INFINITY;
+            continue;
+         }
+         q = (g / (g - 1)) * (g / (g - 1)) * (q + t * q * q / (1 - t * q));
+      }
+      out[2] = sqrt(q);
+   }
+}
+
+/****************** Score genes               *****************************/
+/* Writes B(g|G), KL divergence and Mahalanobis distance for each row of  */
+/* the n x 65 count matrix to the n x 3 matrix out.                       */
+/* leave_one_out removes each gene from the background it is compared to */
+/* and assumes that the gene was added to the background.                 */
+/* pseudo is added to every background codon count for KL divergence.    */
+/* ridge is added to the diagonal of the covariance, relative to the mean */
+/* variance, so that it can be inverted.                                  */
+/**************************************************************************/
+int bg_score(BACKGROUND_STRUCT *bg, long *ncod, long n, bool leave_one_out,
+             double pseudo, double ridge, double *out, int nthreads)
+{
+   BG_SCORE_JOB job;
+   double chol[64 * 64];
+   double denom, diag = 0;
+   int j, k, dim = bg->dim;
+
+   job.bg = bg;
+   job.ncod = ncod;
+   job.out = out;
+   job.leave_one_out = leave_one_out;
+   job.pseudo = pseudo;
+   job.chol = NULL;
+
+   denom = (double)bg->ngenes - (leave_one_out ? 2.0 : 1.0);
+   if (denom > 0)
+   {
+      for (j = 0; j < dim; j++)
+         for (k = j; k < dim; k++)
+            chol[k * 64 + j] = chol[j * 64 + k] = bg->m2[j * 64 + k] / denom;
+      for (j = 0; j < dim; j++)
+         diag += chol[j * 64 + j] / dim;
+      for (j = 0; j < dim; j++)
+         chol[j * 64 + j] += ridge * (diag > 0 ? diag : 1.0);
+      if (bg_cholesky(chol, dim) == 0)
+         job.chol = chol;
+   }
+
+   return par_for(n, nthreads, bg_score_range, &job);
+}
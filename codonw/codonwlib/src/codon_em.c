@@ -0,0 +1,236 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains an EM fit of a mixture of multinomial distributions to
+per-gene codon counts. Each class k has a weight pi[k] and codon
+probabilities theta[k][j], normalised within groups of codons: one group
+for all codons, or one per amino acid so that classes differ only in
+synonymous codon usage.
+
+Everything is kept in log space. Responsibilities of a gene are a dense
+k x dim product of its counts with log theta, and genes are split between
+threads, each summing its own expected counts for the M step.
+
+The log-likelihood reported omits the multinomial coefficients, which do
+not depend on the parameters.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "../include/codonW.h"
+
+#define EM_MAX_CLASSES 256
+
+typedef struct
+{
+   long *ncod;
+   long n;
+   int k;
+   int *cod;
+   int dim;
+   double *logpi;
+   double *logtheta;
+   double *resp; /* n x k, NULL if not wanted */
+   long nparts;
+   double *acc;  /* per part: k x dim expected counts, k class sums, loglik */
+} EM_JOB;
+
+static size_t em_part_len(EM_JOB *job)
+{
+   return (size_t)job->k * job->dim + job->k + 1;
+}
+
+static void em_estep_range(long start, long end, void *varg)
+{
+   EM_JOB *job = (EM_JOB *)varg;
+   int k = job->k, dim = job->dim;
+   double x[64], l[EM_MAX_CLASSES], *acc, *nk, *ll, m, s;
+   long p, i, first, last;
+   long *row;
+   int c, j;
+
+   for (p = start; p < end; p++)
+   {
+      acc = job->acc + p * em_part_len(job);
+      nk = acc + (size_t)k * dim;
+      ll = nk + k;
+      memset(acc, 0, sizeof(double) * em_part_len(job));
+      first = job->n * p / job->nparts;
+      last = job->n * (p + 1) / job->nparts;
+
+      for (i = first; i < last; i++)
+      {
+         row = job->ncod + i * 65;
+         for (j = 0; j < dim; j++)
+            x[j] = (double)row[job->cod[j]];
+
+         for (c = 0, m = -INFINITY; c < k; c++)
+         {
+            const double *lt = job->logtheta + (size_t)c * dim;
+            for (j = 0, s = 0; j < dim; j++)
+               s += x[j] * lt[j];
+            l[c] = job->logpi[c] + s;
+            if (l[c] > m)
+               m = l[c];
+         }
+         for (c = 0, s = 0; c < k; c++)
+         {
+            l[c] = exp(l[c] - m);
+            s += l[c];
+         }
+         *ll += m + log(s);
+
+         for (c = 0; c < k; c++)
+         {
+            l[c] /= s;
+            nk[c] += l[c];
+            for (j = 0; j < dim; j++)
+               acc[(size_t)c * dim + j] += l[c] * x[j];
+            if (job->resp)
+               job->resp[i * k + c] = l[c];
+         }
+      }
+   }
+}
+
+/* E step over all genes, the per part sums are added into part 0        */
+static int em_estep(EM_JOB *job, int nthreads)
+{
+   size_t len = em_part_len(job), t;
+   long p;
+
+   par_for(job->nparts, nthreads, em_estep_range, job);
+   for (p = 1; p < job->nparts; p++)
+      for (t = 0; t < len; t++)
+         job->acc[t] += job->acc[p * len + t];
+   return 0;
+}
+
+static int em_job_init(EM_JOB *job, long *ncod, long n, int k, int *cod, int dim,
+                       double *logpi, double *logtheta, double *resp, int nthreads)
+{
+   if (k < 1 || k > EM_MAX_CLASSES)
+   {
+      fprintf(stderr, "A mixture needs 1 to %d classes\n", EM_MAX_CLASSES);
+      return 1;
+   }
+   job->ncod = ncod;
+   job->n = n;
+   job->k = k;
+   job->cod = cod;
+   job->dim = dim;
+   job->logpi = logpi;
+   job->logtheta = logtheta;
+   job->resp = resp;
+   job->nparts = par_threads(nthreads);
+   if (job->nparts > n)
+      job->nparts = n > 0 ? n : 1;
+   job->acc = (double *)malloc(sizeof(double) * em_part_len(job) * job->nparts);
+   if (!job->acc)
+   {
+      fprintf(stderr, "Out of memory in mixture model\n");
+      return 1;
+   }
+   return 0;
+}
+
+/****************** Fit mixture               *****************************/
+/* ncod is an n x 65 count matrix, of which the dim codons in cod are     */
+/* used. group[j] gives the normalisation group of codon cod[j].          */
+/* logpi (k) and logtheta (k x dim) hold the starting point and receive   */
+/* the fit. pseudo is added to every expected count in the M step.        */
+/* Iterates until the log-likelihood improves by less than tol relative  */
+/* to its size, or max_iter times. resp (n x k) receives the posterior    */
+/* class probabilities if not NULL. Returns 0 on convergence, 2 if it    */
+/* did not converge and 1 on error.                                       */
+/**************************************************************************/
+int em_mixture(long *ncod, long n, int k, int *cod, int dim, int *group,
+               double *logpi, double *logtheta, double *resp, int max_iter,
+               double tol, double pseudo, double *loglik, int *niter, int nthreads)
+{
+   EM_JOB job;
+   double *nk, tot, gsum[65], prev = -INFINITY;
+   int c, j, it, status = 2;
+
+   if (em_job_init(&job, ncod, n, k, cod, dim, logpi, logtheta, NULL, nthreads))
+      return 1;
+   nk = job.acc + (size_t)k * dim;
+
+   for (it = 0; it < max_iter; it++)
+   {
+      em_estep(&job, nthreads);
+      *loglik = nk[k];
+      *niter = it + 1;
+      if (fabs(*loglik - prev) <= tol * fabs(*loglik))
+      {
+         status = 0;
+         break;
+      }
+      prev = *loglik;
+
+      /* M step                                                          */
+      for (c = 0, tot = 0; c < k; c++)
+         tot += nk[c];
+      for (c = 0; c < k; c++)
+      {
+         logpi[c] = log((nk[c] + pseudo) / (tot + pseudo * k));
+         for (j = 0; j < 65; j++)
+            gsum[j] = 0;
+         for (j = 0; j < dim; j++)
+            gsum[group[j]] += job.acc[(size_t)c * dim + j] + pseudo;
+         for (j = 0; j < dim; j++)
+            logtheta[(size_t)c * dim + j] =
+                log((job.acc[(size_t)c * dim + j] + pseudo) / gsum[group[j]]);
+      }
+   }
+
+   /* posteriors under the final parameters                             */
+   if (resp)
+   {
+      job.resp = resp;
+      em_estep(&job, nthreads);
+      *loglik = nk[k];
+   }
+
+   free(job.acc);
+   return status;
+}
+
+/****************** Posterior probabilities   *****************************/
+int em_posterior(long *ncod, long n, int k, int *cod, int dim, double *logpi,
+                 double *logtheta, double *resp, double *loglik, int nthreads)
+{
+   EM_JOB job;
+
+   if (em_job_init(&job, ncod, n, k, cod, dim, logpi, logtheta, resp, nthreads))
+      return 1;
+   em_estep(&job, nthreads);
+   *loglik = job.acc[(size_t)k * dim + k];
+
+   free(job.acc);
+   return 0;
+}
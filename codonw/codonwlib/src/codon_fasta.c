@@ -0,0 +1,78 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains a FASTA parser that packs the sequences of a buffer of
+whole records into the batch layout used in codon_batch.c.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "../include/codonW.h"
+
+/****************** Parse FASTA records       *****************************/
+/* buf holds whole FASTA records, anything before the first '>' is        */
+/* skipped. Sequences are copied into seq (at most len bytes are needed)  */
+/* without line breaks or white space and seq_off[0..n] delimits them.    */
+/* name_off[2i] and name_off[2i+1] delimit the title of record i in buf.  */
+/* Returns the number of records n, at most max_rec are parsed.           */
+/**************************************************************************/
+long fasta_parse(const char *buf, long len, char *seq, int64_t *seq_off, int64_t *name_off, long max_rec)
+{
+   long i = 0, n = 0, j = 0;
+   long end;
+   char c;
+
+   /* find the first record                                             */
+   while (i < len && !(buf[i] == '>' && (i == 0 || buf[i - 1] == '\n')))
+      i++;
+
+   seq_off[0] = 0;
+   while (i < len && n < max_rec)
+   {
+      /* title line, without the '>' or any trailing \r                 */
+      i++;
+      name_off[2 * n] = i;
+      while (i < len && buf[i] != '\n')
+         i++;
+      end = i;
+      if (end > name_off[2 * n] && buf[end - 1] == '\r')
+         end--;
+      name_off[2 * n + 1] = end;
+
+      /* sequence lines up to the next title                           */
+      while (i < len && !(buf[i] == '>' && buf[i - 1] == '\n'))
+      {
+         c = buf[i++];
+         if (c == '\n' || c == '\r' || c == ' ' || c == '\t')
+            continue;
+         seq[j++] = c;
+      }
+      seq_off[++n] = j;
+   }
+
+   return n;
+}
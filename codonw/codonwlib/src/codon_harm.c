@@ -0,0 +1,223 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains codon harmonisation: genes from a source organism are
+rewritten for expression in a host so that each codon is as common among
+its synonyms in the host as the original codon was in the source.
+
+The codons of each amino acid are ranked by RSCU in the source and in the
+host usage table; harm_init maps the codon of rank r in the source to the
+codon of rank r in the host, once, and harm_batch rewrites sequences with
+the map in one pass. Similarity is the Pearson correlation, over the
+codons of amino acids with synonyms, between the frequency of the codon
+among its synonyms in the source and that of the codon put in its place
+in the host: 1 when the usage profile of the gene carries over exactly.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "../include/codonW.h"
+
+typedef struct
+{
+   const char *seqs;
+   const int64_t *offsets;
+   HARM_STRUCT *ph;
+   char *out;
+   double *sim;
+   long *changed;
+} HARM_JOB;
+
+static const char harm_bases[] = "TCAG";
+
+/* RSCU of the codon usage table ncod, as rscu_usage for fractional counts */
+static void harm_rscu(const double ncod[65], double rscu[65], int *ds, GENETIC_CODE_STRUCT *pcu)
+{
+   double naa[22];
+   int x;
+
+   memset(naa, 0, sizeof(naa));
+   for (x = 1; x < 65; x++)
+      naa[pcu->ca[x]] += ncod[x];
+   rscu[0] = 0;
+   for (x = 1; x < 65; x++)
+      rscu[x] = naa[pcu->ca[x]] > 0 ? ncod[x] / naa[pcu->ca[x]] * ds[x] : 0.0;
+}
+
+/* codons of amino acid a in order of decreasing RSCU, ties by codon      */
+static int harm_rank(const double rscu[65], int a, int cod[64], GENETIC_CODE_STRUCT *pcu)
+{
+   int x, i, j, t, n = 0;
+
+   for (x = 1; x < 65; x++)
+      if (pcu->ca[x] == a)
+         cod[n++] = x;
+   for (i = 1; i < n; i++)
+      for (j = i; j > 0 && rscu[cod[j]] > rscu[cod[j - 1]]; j--)
+      {
+         t = cod[j];
+         cod[j] = cod[j - 1];
+         cod[j - 1] = t;
+      }
+   return n;
+}
+
+/****************** Rank mapping              *****************************/
+/* Fills ph from the source and host codon usage tables (65 counts, the   */
+/* untranslatable codons first, fractions allowed)                        */
+/**************************************************************************/
+int harm_init(HARM_STRUCT *ph, const double src[65], const double host[65],
+              GENETIC_CODE_STRUCT *pcu)
+{
+   double rsrc[65], rhost[65];
+   int csrc[64], chost[64];
+   int a, i, n, x;
+
+   how_synon(ph->ds, pcu);
+   harm_rscu(src, rsrc, ph->ds, pcu);
+   harm_rscu(host, rhost, ph->ds, pcu);
+
+   ph->map[0] = 0;
+   ph->fsrc[0] = ph->fhost[0] = 0;
+   for (x = 1; x < 65; x++)
+   {
+      ph->fsrc[x] = rsrc[x] / ph->ds[x];
+      ph->fhost[x] = rhost[x] / ph->ds[x];
+   }
+
+   for (a = 0; a < 22; a++)
+   {
+      n = harm_rank(rsrc, a, csrc, pcu);
+      harm_rank(rhost, a, chost, pcu);
+      for (i = 0; i < n; i++)
+         ph->map[csrc[i]] = chost[i];
+   }
+
+   return 0;
+}
+
+/* Pearson correlation from running sums, NaN without variance            */
+static double harm_corr(long n, double sx, double sy, double sxx, double syy, double sxy)
+{
+   double vx, vy;
+
+   if (n < 2)
+      return NAN;
+   vx = sxx - sx * sx / n;
+   vy = syy - sy * sy / n;
+   if (vx <= 1e-12 || vy <= 1e-12)
+      return NAN;
+   return (sxy - sx * sy / n) / sqrt(vx * vy);
+}
+
+static void harm_range(long start, long end, void *varg)
+{
+   HARM_JOB *job = (HARM_JOB *)varg;
+   HARM_STRUCT *ph = job->ph;
+   const unsigned char *s;
+   char *o;
+   double fx, fy, fn, sx, sy, sn, sxx, syy, snn, sxy, sxn;
+   long i, k, len, m, changed;
+   int b[3], c, x, y, rna;
+
+   for (i = start; i < end; i++)
+   {
+      s = (const unsigned char *)job->seqs + job->offsets[i];
+      o = job->out + job->offsets[i];
+      len = (long)(job->offsets[i + 1] - job->offsets[i]);
+      memcpy(o, s, len);
+
+      m = changed = 0;
+      sx = sy = sn = sxx = syy = snn = sxy = sxn = 0;
+      for (k = 0; k + 2 < len; k += 3)
+      {
+         b[0] = base_code[s[k]];
+         b[1] = base_code[s[k + 1]];
+         b[2] = base_code[s[k + 2]];
+         if (!(b[0] && b[1] && b[2]))
+            continue;          /* untranslatable codons are left as is   */
+         x = (b[0] - 1) * 16 + b[1] + (b[2] - 1) * 4;
+         y = ph->map[x];
+
+         if (y != x)
+         {
+            changed++;
+            rna = memchr(s + k, 'U', 3) || memchr(s + k, 'u', 3);
+            b[0] = (y - 1) / 16 + 1;
+            b[1] = (y - 1) % 4 + 1;
+            b[2] = (y - 1) / 4 % 4 + 1;
+            for (c = 0; c < 3; c++)
+            {
+               o[k + c] = b[c] == 1 && rna ? 'U' : harm_bases[b[c] - 1];
+               if (s[k + c] >= 'a')   /* keep soft-masking             */
+                  o[k + c] = (char)(o[k + c] + ('a' - 'A'));
+            }
+         }
+
+         if (ph->ds[x] < 2)
+            continue;
+         fx = ph->fsrc[x];
+         fy = ph->fhost[y];
+         fn = ph->fhost[x];
+         m++;
+         sx += fx;
+         sy += fy;
+         sn += fn;
+         sxx += fx * fx;
+         syy += fy * fy;
+         snn += fn * fn;
+         sxy += fx * fy;
+         sxn += fx * fn;
+      }
+
+      job->changed[i] = changed;
+      job->sim[2 * i] = harm_corr(m, sx, sy, sxx, syy, sxy);
+      job->sim[2 * i + 1] = harm_corr(m, sx, sn, sxx, snn, sxn);
+   }
+}
+
+/****************** Harmonise a batch         *****************************/
+/* Sequences seqs[offsets[i]..offsets[i + 1]] are rewritten to the same   */
+/* offsets of out. sim is n x 2: the similarity of the harmonised gene    */
+/* and that of the gene unchanged in the host, changed the codons altered */
+/**************************************************************************/
+int harm_batch(const char *seqs, const int64_t *offsets, long n, HARM_STRUCT *ph,
+               char *out, double *sim, long *changed, int nthreads)
+{
+   HARM_JOB job;
+
+   job.seqs = seqs;
+   job.offsets = offsets;
+   job.ph = ph;
+   job.out = out;
+   job.sim = sim;
+   job.changed = changed;
+   par_for(n, nthreads, harm_range, &job);
+
+   return 0;
+}
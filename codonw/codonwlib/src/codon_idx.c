@@ -118,15 +118,17 @@ int base_sil_us_out(FILE *foutput, long *nncod, long *nnaa, MENU_STRUCT *pm)
 int cai(long *nncod, double *sigma, int *ds, CAI_STRUCT *pcai, GENETIC_CODE_STRUCT *pcu)
 {
    long totaa = 0;
+   float w;
    int x;
    
    for (x = 1, *sigma = 0; x < 65; x++)
    {
       if (pcu->ca[x] == 11 || *(ds + x) == 1)
          continue;
-      if (pcai->cai_val[x] < 0.0001)     /* if value is effectively zero       */
-         pcai->cai_val[x] = 0.01F;       /* make it .01 */
-      *sigma += (double)*(nncod + x) * log((double)pcai->cai_val[x]);
+      w = pcai->cai_val[x];
+      if (w < 0.0001)                    /* if value is effectively zero       */
+         w = 0.01F;                      /* make it .01, pcai is left as is    */
+      *sigma += (double)*(nncod + x) * log((double)w);
       totaa += *(nncod + x);
    }
 
@@ -163,24 +165,19 @@ int cbi(long *nncod, long *nnaa, float *fcbi, int *ds, int *da, GENETIC_CODE_STR
    long opt = 0;
    float exp_cod = 0.0F;
    int x;
-   static char first_call_cbi = true;
-   static char has_opt_info[22];
+   /* amino acids with optimal codons, found on every call as they depend */
+   /* on the genetic code and reference given                             */
+   char has_opt_info[22];
 
-   if (first_call_cbi)
-   { /* have we been called already   */
-      /* initilise has_opt_info             */
-      for (x = 1; x < 22; x++)
-         has_opt_info[x] = 0;
+   for (x = 0; x < 22; x++)
+      has_opt_info[x] = 0;
 
-      for (x = 1; x < 65; x++)
-      {
-         if (pcu->ca[x] == 11 || *(ds + x) == 1)
-            continue;
-         if (pcbi->fop_cod[x] == 3)
-            has_opt_info[pcu->ca[x]]++;
-      }
-
-      first_call_cbi = false; /*      this won't be called again      */
+   for (x = 1; x < 65; x++)
+   {
+      if (pcu->ca[x] == 11 || *(ds + x) == 1)
+         continue;
+      if (pcbi->fop_cod[x] == 3)
+         has_opt_info[pcu->ca[x]]++;
    }
 
    for (x = 1; x < 65; x++)
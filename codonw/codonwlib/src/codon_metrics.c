@@ -0,0 +1,651 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains the single-value indices of codon_idx.c computed from
+codon counts alone, for many genes at once. Everything an index needs
+besides the counts (genetic code, synonym tables, CAI and Fop references)
+is prepared once in a METRIC_REF_STRUCT, which is only read afterwards and
+so can be shared between threads.
+
+Values are the same as those of the CodonSeq methods of the same name.
+
+Results are written either as one row of indices per gene or, by
+metric_columns, as one contiguous column per index.
+
+The _frac functions take fractional (double) counts, such as those of
+codon_usage_seq_frac, and give the same values as the others for whole
+counts, up to the rounding of the float intermediates of codon_idx.c.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "../include/codonW.h"
+
+const char *metric_names[NUM_METRICS] = {
+    "CAI", "Fop", "Nc", "GC3s", "GC", "L_sym", "L_aa", "Gravy", "Aromo", "CBI"};
+
+/****************** Prepare references        *****************************/
+int metric_init(METRIC_REF_STRUCT *ref, GENETIC_CODE_STRUCT *pcu, CAI_STRUCT *pcai, FOP_STRUCT *pfop)
+{
+   double w;
+   int x;
+
+   memset(ref, 0, sizeof(METRIC_REF_STRUCT));
+   ref->code = *pcu;
+   how_synon(ref->ds, pcu);
+   how_synon_aa(ref->da, pcu);
+   ref->fop = *pfop;
+   ref->prop = amino_prop;
+
+   /* log relative adaptiveness, near zero values as in cai()           */
+   for (x = 1; x < 65; x++)
+   {
+      w = (double)pcai->cai_val[x];
+      ref->cai_logw[x] = log(w < 0.0001 ? (double)0.01F : w);
+   }
+   metric_opt_info(ref);
+
+   return 0;
+}
+
+/****************** Optimal codon information *****************************/
+/* Marks the amino acids that have an optimal codon among their synonyms, */
+/* the codons fop() and cbi() count with factor_in_rare false, and checks */
+/* that the classes (1 to 3) of all their codons are valid. Needs the     */
+/* code, ds and fop of ref.                                               */
+/**************************************************************************/
+void metric_opt_info(METRIC_REF_STRUCT *ref)
+{
+   int x;
+
+   for (x = 0; x < 22; x++)
+      ref->has_opt[x] = false;
+   for (x = 1; x < 65; x++)
+      if (ref->code.ca[x] != 11 && ref->ds[x] != 1 && ref->fop.fop_cod[x] == 3)
+         ref->has_opt[ref->code.ca[x]] = true;
+
+   ref->opt_ok = true;
+   for (x = 1; x < 65; x++)
+      if (ref->has_opt[ref->code.ca[x]] && (ref->fop.fop_cod[x] < 1 || ref->fop.fop_cod[x] > 3))
+         ref->opt_ok = false;
+}
+
+/****************** Indices of one gene       *****************************/
+/* Writes the nwhich indices listed in which (METRIC_*) for the 65 codon  */
+/* counts ncod to out                                                     */
+/**************************************************************************/
+int metric_row(long *ncod, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out)
+{
+   GENETIC_CODE_STRUCT *pcu = &ref->code;
+   long naa[22];
+   long bases[5], base_tot[5], base_1[5], base_2[5], base_3[5];
+   long tot_s = 0, totalaa = 0, totaa;
+   double gc_metrics[18], sigma;
+   bool have_gc = false;
+   float f;
+   int i, x;
+
+   count_amino_acids(ncod, naa, pcu);
+
+   for (i = 0; i < nwhich; i++)
+   {
+      switch (which[i])
+      {
+      case METRIC_CAI:
+         for (x = 1, sigma = 0, totaa = 0; x < 65; x++)
+         {
+            if (pcu->ca[x] == 11 || ref->ds[x] == 1)
+               continue;
+            sigma += (double)ncod[x] * ref->cai_logw[x];
+            totaa += ncod[x];
+         }
+         out[i] = totaa ? exp(sigma / (double)totaa) : 0;
+         break;
+      case METRIC_FOP:
+         fop(ncod, &f, ref->ds, false, pcu, &ref->fop);
+         out[i] = f;
+         break;
+      case METRIC_ENC:
+         enc(ncod, naa, &f, ref->da, pcu);
+         out[i] = f;
+         break;
+      case METRIC_GC3S:
+      case METRIC_GC:
+      case METRIC_LEN_SYM:
+      case METRIC_LEN_AA:
+         if (!have_gc)
+         {
+            gc(ref->ds, ncod, bases, base_tot, base_1, base_2, base_3,
+               &tot_s, &totalaa, gc_metrics, pcu);
+            have_gc = true;
+         }
+         out[i] = which[i] == METRIC_GC     ? gc_metrics[0]
+                  : which[i] == METRIC_GC3S ? gc_metrics[1]
+                  : which[i] == METRIC_LEN_SYM ? (double)tot_s
+                                               : (double)totalaa;
+         break;
+      case METRIC_GRAVY:
+         hydro(naa, &f, ref->prop.hydro);
+         out[i] = f;
+         break;
+      case METRIC_AROMO:
+         aromo(naa, &f, ref->prop.aromo);
+         out[i] = f;
+         break;
+      case METRIC_CBI:
+         cbi(ncod, naa, &f, ref->ds, ref->da, pcu, &ref->fop);
+         out[i] = f;
+         break;
+      default:
+         fprintf(stderr, "No index %d\n", which[i]);
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+typedef struct
+{
+   long *ncod;
+   METRIC_REF_STRUCT *ref;
+   const int8_t *codes;  /* reference of each gene, NULL for ref[0] */
+   const int *which;
+   int nwhich;
+   double *out;
+} METRIC_BATCH_JOB;
+
+static void metric_batch_range(long start, long end, void *varg)
+{
+   METRIC_BATCH_JOB *job = (METRIC_BATCH_JOB *)varg;
+   long i;
+
+   for (i = start; i < end; i++)
+      metric_row(job->ncod + i * 65, job->codes ? job->ref + job->codes[i] : job->ref,
+                 job->which, job->nwhich, job->out + i * job->nwhich);
+}
+
+static int metric_check(const int *which, int nwhich)
+{
+   int i;
+
+   for (i = 0; i < nwhich; i++)
+      if (which[i] < 0 || which[i] >= NUM_METRICS)
+      {
+         fprintf(stderr, "No index %d\n", which[i]);
+         return 1;
+      }
+   return 0;
+}
+
+/****************** Indices of a batch        *****************************/
+/* out is an n x nwhich matrix, row i for row i of the n x 65 counts      */
+/**************************************************************************/
+int metric_batch(long *ncod, long n, METRIC_REF_STRUCT *ref, const int *which, int nwhich,
+                 double *out, int nthreads)
+{
+   METRIC_BATCH_JOB job;
+
+   if (metric_check(which, nwhich))
+      return 1;
+
+   job.ncod = ncod;
+   job.ref = ref;
+   job.codes = NULL;
+   job.which = which;
+   job.nwhich = nwhich;
+   job.out = out;
+
+   return par_for(n, nthreads, metric_batch_range, &job);
+}
+
+/****************** Indices of sequences      *****************************/
+/* Counts the codons of the n sequences of a batch (see codon_batch.c)    */
+/* into the n x 65 matrix ncod and writes their indices to out            */
+/**************************************************************************/
+int metric_seqs(const char *data, const int64_t *offsets, long n, long *ncod, METRIC_REF_STRUCT *ref,
+                const int *which, int nwhich, double *out, int nthreads)
+{
+   if (codon_usage_batch(data, offsets, n, ncod, nthreads))
+      return 1;
+   return metric_batch(ncod, n, ref, which, nwhich, out, nthreads);
+}
+
+/****************** Indices of soft-masked sequences ***********************/
+/* As metric_seqs, leaving out codons with a lowercase (masked) letter,   */
+/* which are tallied per sequence in masked                               */
+/**************************************************************************/
+int metric_seqs_mask(const char *data, const int64_t *offsets, long n, long *ncod, long *masked,
+                     METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out, int nthreads)
+{
+   if (codon_usage_batch_mask(data, offsets, n, ncod, masked, nthreads))
+      return 1;
+   return metric_batch(ncod, n, ref, which, nwhich, out, nthreads);
+}
+
+/****************** Indices with mixed codes  *****************************/
+/* As metric_seqs, but sequence i is scored against refs[codes[i]], one   */
+/* of nrefs references (e.g. one per genetic code), all in the same pass  */
+/**************************************************************************/
+int metric_seqs_codes(const char *data, const int64_t *offsets, long n, const int8_t *codes,
+                      long *ncod, METRIC_REF_STRUCT *refs, int nrefs, const int *which, int nwhich,
+                      double *out, int nthreads)
+{
+   METRIC_BATCH_JOB job;
+   long i;
+
+   if (metric_check(which, nwhich))
+      return 1;
+   for (i = 0; i < n; i++)
+      if (codes[i] < 0 || codes[i] >= nrefs)
+      {
+         fprintf(stderr, "No reference %d for sequence %ld\n", codes[i], i);
+         return 1;
+      }
+   if (codon_usage_batch(data, offsets, n, ncod, nthreads))
+      return 1;
+
+   job.ncod = ncod;
+   job.ref = refs;
+   job.codes = codes;
+   job.which = which;
+   job.nwhich = nwhich;
+   job.out = out;
+
+   return par_for(n, nthreads, metric_batch_range, &job);
+}
+
+/* metric_seqs as a pool task, on the worker's thread only                */
+void metric_task(void *arg)
+{
+   METRIC_TASK_STRUCT *t = (METRIC_TASK_STRUCT *)arg;
+
+   t->status = metric_seqs(t->data, t->offsets, t->n, t->ncod, t->ref, t->which, t->nwhich, t->out, 1);
+}
+
+typedef struct
+{
+   const char *data;
+   const int64_t *offsets;
+   long n;
+   METRIC_REF_STRUCT *ref;
+   const int *which;
+   int nwhich;
+   double **cols;
+   int64_t **counts;
+   int status;
+} METRIC_COL_JOB;
+
+static void metric_col_range(long start, long end, void *varg)
+{
+   METRIC_COL_JOB *job = (METRIC_COL_JOB *)varg;
+   double tile[METRIC_BLOCK * NUM_METRICS], row[NUM_METRICS];
+   int64_t *ctile = NULL;
+   long ncod[65], b, r, first, len;
+   int k, x;
+
+   if (job->counts && !(ctile = (int64_t *)malloc(sizeof(int64_t) * 64 * METRIC_BLOCK)))
+   {
+      job->status = 1;
+      return;
+   }
+
+   for (b = start; b < end; b++)
+   {
+      first = b * METRIC_BLOCK;
+      len = job->n - first < METRIC_BLOCK ? job->n - first : METRIC_BLOCK;
+
+      /* one block of genes into column-major tiles                      */
+      for (r = 0; r < len; r++)
+      {
+         memset(ncod, 0, sizeof(ncod));
+         codon_usage_seq(job->data + job->offsets[first + r],
+                         (long)(job->offsets[first + r + 1] - job->offsets[first + r]), ncod);
+         if (metric_row(ncod, job->ref, job->which, job->nwhich, row))
+            job->status = 1;
+         for (k = 0; k < job->nwhich; k++)
+            tile[k * METRIC_BLOCK + r] = row[k];
+         if (ctile)
+            for (x = 1; x < 65; x++)
+               ctile[(x - 1) * METRIC_BLOCK + r] = ncod[x];
+      }
+
+      /* then each column segment in one sequential write                */
+      for (k = 0; k < job->nwhich; k++)
+         memcpy(job->cols[k] + first, tile + k * METRIC_BLOCK, sizeof(double) * len);
+      if (ctile)
+         for (x = 0; x < 64; x++)
+            memcpy(job->counts[x] + first, ctile + x * METRIC_BLOCK, sizeof(int64_t) * len);
+   }
+   free(ctile);
+}
+
+/****************** Indices as columns        *****************************/
+/* As metric_seqs, but index which[k] of sequence i is written to         */
+/* cols[k][i]. If counts is not NULL counts[x - 1][i] also receives the   */
+/* count of codon x (1 to 64). Genes are taken METRIC_BLOCK at a time and */
+/* each column written a block at once.                                   */
+/**************************************************************************/
+int metric_columns(const char *data, const int64_t *offsets, long n, METRIC_REF_STRUCT *ref,
+                   const int *which, int nwhich, double **cols, int64_t **counts, int nthreads)
+{
+   METRIC_COL_JOB job = {data, offsets, n, ref, which, nwhich, cols, counts, 0};
+   int i;
+
+   if (nwhich > NUM_METRICS)
+   {
+      fprintf(stderr, "At most %d indices at once\n", NUM_METRICS);
+      return 1;
+   }
+   for (i = 0; i < nwhich; i++)
+      if (which[i] < 0 || which[i] >= NUM_METRICS)
+      {
+         fprintf(stderr, "No index %d\n", which[i]);
+         return 1;
+      }
+
+   par_for((n + METRIC_BLOCK - 1) / METRIC_BLOCK, nthreads, metric_col_range, &job);
+   if (job.status)
+      fprintf(stderr, "Could not compute indices\n");
+   return job.status;
+}
+
+/****************** Amino acids of fractional counts **********************/
+int count_amino_acids_frac(const double *ncod, double naa[], GENETIC_CODE_STRUCT *pcu)
+{
+   int x;
+
+   for (x = 0; x < 22; x++)
+      naa[x] = 0;
+   for (x = 0; x < 65; x++)
+      naa[pcu->ca[x]] += ncod[x];
+
+   return 0;
+}
+
+/****************** Base composition, fractional *************************/
+/* As gc() in codon_blk.c, gc_metrics receives the same 18 values         */
+/**************************************************************************/
+int gc_frac(const double *ncod, METRIC_REF_STRUCT *ref, double *tot_s, double *totalaa, double gc_metrics[])
+{
+   double bases[5], base_tot[5], base_1[5], base_2[5], base_3[5];
+   int id, x, y, z;
+
+   for (x = 0; x < 5; x++)
+      bases[x] = base_tot[x] = base_1[x] = base_2[x] = base_3[x] = 0;
+   *tot_s = *totalaa = 0;
+
+   for (x = 1; x < 5; x++)
+      for (y = 1; y < 5; y++)
+         for (z = 1; z < 5; z++)
+         {
+            id = (x - 1) * 16 + y + (z - 1) * 4;
+            if (ref->code.ca[id] == 11)
+               continue;
+            base_tot[x] += ncod[id];
+            base_1[x] += ncod[id];
+            base_tot[y] += ncod[id];
+            base_2[y] += ncod[id];
+            base_tot[z] += ncod[id];
+            base_3[z] += ncod[id];
+            *totalaa += ncod[id];
+            if (ref->ds[id] == 1)
+               continue;
+            bases[z] += ncod[id];
+            *tot_s += ncod[id];
+         }
+
+   gc_metrics[0] = (base_tot[2] + base_tot[4]) / (*totalaa * 3);
+   gc_metrics[1] = (bases[2] + bases[4]) / *tot_s;
+   gc_metrics[2] = (base_tot[2] + base_tot[4] - bases[2] - bases[4]) / (*totalaa * 3 - *tot_s);
+   gc_metrics[3] = (base_1[2] + base_1[4]) / *totalaa;
+   gc_metrics[4] = (base_2[2] + base_2[4]) / *totalaa;
+   gc_metrics[5] = (base_3[2] + base_3[4]) / *totalaa;
+   for (x = 1; x < 5; x++)
+   {
+      gc_metrics[3 + x * 3] = base_1[x] / *totalaa;
+      gc_metrics[4 + x * 3] = base_2[x] / *totalaa;
+      gc_metrics[5 + x * 3] = base_3[x] / *totalaa;
+   }
+
+   return 0;
+}
+
+/* fop() with factor_in_rare false                                        */
+static int fop_frac(const double *ncod, METRIC_REF_STRUCT *ref, double *ffop)
+{
+   double n[4] = {0, 0, 0, 0};
+   int x;
+
+   if (!ref->opt_ok)
+      return 1;
+   for (x = 1; x < 65; x++)
+      if (ref->has_opt[ref->code.ca[x]])
+         n[(int)ref->fop.fop_cod[x]] += ncod[x];
+   *ffop = n[1] + n[2] + n[3] ? n[3] / (n[1] + n[2] + n[3]) : 0;
+
+   return 0;
+}
+
+static int cbi_frac(const double *ncod, const double *naa, METRIC_REF_STRUCT *ref, double *fcbi)
+{
+   GENETIC_CODE_STRUCT *pcu = &ref->code;
+   double opt = 0, tot_cod = 0, exp_cod = 0;
+   int x;
+
+   if (!ref->opt_ok)
+      return 1;
+   for (x = 1; x < 65; x++)
+   {
+      if (!ref->has_opt[pcu->ca[x]])
+         continue;
+      tot_cod += ncod[x];
+      if (ref->fop.fop_cod[x] == 3)
+      {
+         opt += ncod[x];
+         exp_cod += naa[pcu->ca[x]] / (double)ref->da[pcu->ca[x]];
+      }
+   }
+   *fcbi = tot_cod - exp_cod ? (opt - exp_cod) / (tot_cod - exp_cod) : 0;
+
+   return 0;
+}
+
+/* enc() for fractional counts, returns 1 (with the partial sum in        */
+/* enc_tot, as enc) if some class of amino acids is missing               */
+static int enc_frac(const double *ncod, const double *naa, METRIC_REF_STRUCT *ref, double *enc_tot)
+{
+   int numaa[9], fold[9], i, x, z;
+   double totb[9], averb, bb, s2;
+
+   for (i = 0; i < 9; i++)
+   {
+      fold[i] = numaa[i] = 0;
+      totb[i] = 0;
+   }
+
+   for (i = 1; i < 22; i++)
+   {
+      if (i == 11)
+         continue;
+      if (naa[i] <= 1)
+         bb = 0;
+      else
+      {
+         for (x = 1, s2 = 0; x < 65; x++)
+            if (ref->code.ca[x] == i)
+               s2 += (ncod[x] / naa[i]) * (ncod[x] / naa[i]);
+         bb = (naa[i] * s2 - 1.0) / (naa[i] - 1.0); /* homozygosity       */
+      }
+      if (bb > 0.0000001)
+      {
+         totb[ref->da[i]] += bb;
+         numaa[ref->da[i]]++;
+      }
+      fold[ref->da[i]]++;
+   }
+
+   *enc_tot = fold[1];
+   for (z = 2; z <= 8; z++)
+   {
+      if (!fold[z])
+         continue;
+      if (numaa[z] && totb[z] > 0)
+         averb = totb[z] / numaa[z];
+      else if (z == 3 && numaa[2] && numaa[4] && fold[z] == 1)
+         averb = (totb[2] / numaa[2] + totb[4] / numaa[4]) * 0.5;
+      else
+         return 1;
+      *enc_tot += fold[z] / averb;
+      if (*enc_tot > 61)
+         *enc_tot = 61;
+   }
+
+   return 0;
+}
+
+/****************** Indices of fractional counts **************************/
+/* As metric_row for the 65 double counts ncod                            */
+/**************************************************************************/
+int metric_row_frac(const double *ncod, METRIC_REF_STRUCT *ref, const int *which, int nwhich, double *out)
+{
+   GENETIC_CODE_STRUCT *pcu = &ref->code;
+   double naa[22], gc_metrics[18], tot_s = 0, totalaa = 0, sigma, tot;
+   bool have_gc = false;
+   int i, x;
+
+   count_amino_acids_frac(ncod, naa, pcu);
+
+   for (i = 0; i < nwhich; i++)
+   {
+      switch (which[i])
+      {
+      case METRIC_CAI:
+         for (x = 1, sigma = 0, tot = 0; x < 65; x++)
+         {
+            if (pcu->ca[x] == 11 || ref->ds[x] == 1)
+               continue;
+            sigma += ncod[x] * ref->cai_logw[x];
+            tot += ncod[x];
+         }
+         out[i] = tot ? exp(sigma / tot) : 0;
+         break;
+      case METRIC_FOP:
+         if (fop_frac(ncod, ref, out + i))
+            return 1;
+         break;
+      case METRIC_ENC:
+         enc_frac(ncod, naa, ref, out + i);
+         break;
+      case METRIC_GC3S:
+      case METRIC_GC:
+      case METRIC_LEN_SYM:
+      case METRIC_LEN_AA:
+         if (!have_gc)
+         {
+            gc_frac(ncod, ref, &tot_s, &totalaa, gc_metrics);
+            have_gc = true;
+         }
+         out[i] = which[i] == METRIC_GC     ? gc_metrics[0]
+                  : which[i] == METRIC_GC3S ? gc_metrics[1]
+                  : which[i] == METRIC_LEN_SYM ? tot_s
+                                               : totalaa;
+         break;
+      case METRIC_GRAVY:
+      case METRIC_AROMO:
+         for (x = 1, sigma = 0, tot = 0; x < 22; x++)
+         {
+            if (x == 11)
+               continue;
+            sigma += naa[x] * (which[i] == METRIC_GRAVY ? (double)ref->prop.hydro[x]
+                                                        : (double)ref->prop.aromo[x]);
+            tot += naa[x];
+         }
+         out[i] = tot ? sigma / tot : 0;
+         break;
+      case METRIC_CBI:
+         if (cbi_frac(ncod, naa, ref, out + i))
+            return 1;
+         break;
+      default:
+         fprintf(stderr, "No index %d\n", which[i]);
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+typedef struct
+{
+   double *ncod;
+   METRIC_REF_STRUCT *ref;
+   const int *which;
+   int nwhich;
+   double *out;
+   int status;
+} METRIC_FRAC_JOB;
+
+static void metric_frac_range(long start, long end, void *varg)
+{
+   METRIC_FRAC_JOB *job = (METRIC_FRAC_JOB *)varg;
+   long i;
+
+   for (i = start; i < end; i++)
+      if (metric_row_frac(job->ncod + i * 65, job->ref, job->which, job->nwhich,
+                          job->out + i * job->nwhich))
+         job->status = 1;
+}
+
+/****************** Indices of a fractional batch *************************/
+/* As metric_batch for an n x 65 matrix of double counts                  */
+/**************************************************************************/
+int metric_batch_frac(double *ncod, long n, METRIC_REF_STRUCT *ref, const int *which, int nwhich,
+                      double *out, int nthreads)
+{
+   METRIC_FRAC_JOB job = {ncod, ref, which, nwhich, out, 0};
+
+   if (metric_check(which, nwhich))
+      return 1;
+
+   par_for(n, nthreads, metric_frac_range, &job);
+   if (job.status)
+      fprintf(stderr, "Illegal Fop or CBI reference values\n");
+   return job.status;
+}
+
+/****************** Indices of ambiguous sequences ************************/
+/* As metric_seqs with codon_usage_seq_frac counts, so that codons with   */
+/* IUPAC ambiguity codes count towards the indices in proportion          */
+/**************************************************************************/
+int metric_seqs_frac(const char *data, const int64_t *offsets, long n, double *ncod, METRIC_REF_STRUCT *ref,
+                     const int *which, int nwhich, double *out, int nthreads)
+{
+   if (codon_usage_batch_frac(data, offsets, n, ncod, nthreads))
+      return 1;
+   return metric_batch_frac(ncod, n, ref, which, nwhich, out, nthreads);
+}
@@ -0,0 +1,603 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains an approximate nearest neighbour index over RSCU
+profiles (an inverted file of k-means cells, "IVF-flat"). Each profile is
+the RSCU of a codon count vector restricted to the synonymous, non-stop
+codons of the genetic code (59 dimensions for the universal code).
+
+The index is held in one block whose layout is identical to the file
+written by nn_save, so a saved index is loaded by mapping the file
+read-only into memory.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../include/codonW.h"
+
+#define NN_MAGIC "CWNNIDX"
+#define NN_VERSION 1
+#define NN_HEADER_LEN 1024
+#define NN_ALIGN 64
+#define NN_TRAIN_PER_LIST 64
+
+typedef struct
+{
+   char magic[8];
+   int32_t version;
+   int32_t dim;
+   int32_t nlist;
+   int32_t reserved;
+   int64_t n;
+   int32_t cod[64];
+   int32_t ca[65];
+} NN_HEADER;
+
+static char nn_code_des[] = "RSCU index genetic code";
+static char nn_code_typ[] = "";
+
+static size_t nn_align(size_t x)
+{
+   return (x + NN_ALIGN - 1) & ~((size_t)NN_ALIGN - 1);
+}
+
+/* byte offsets of centroids, offsets, ids and vectors in the block      */
+static size_t nn_layout(int dim, int nlist, long n, size_t off[4])
+{
+   off[0] = NN_HEADER_LEN;
+   off[1] = nn_align(off[0] + sizeof(float) * (size_t)nlist * dim);
+   off[2] = nn_align(off[1] + sizeof(int64_t) * ((size_t)nlist + 1));
+   off[3] = nn_align(off[2] + sizeof(int64_t) * (size_t)n);
+   return nn_align(off[3] + sizeof(float) * (size_t)n * dim);
+}
+
+static void nn_point(NN_INDEX_STRUCT *idx)
+{
+   size_t off[4];
+   char *base = (char *)idx->map;
+
+   nn_layout(idx->dim, idx->nlist, idx->n, off);
+   idx->centroids = (float *)(base + off[0]);
+   idx->offsets = (int64_t *)(base + off[1]);
+   idx->ids = (int64_t *)(base + off[2]);
+   idx->vecs = (float *)(base + off[3]);
+}
+
+static float nn_dist(const float *a, const float *b, int dim)
+{
+   float d = 0.0F, t;
+   int x;
+
+   for (x = 0; x < dim; x++)
+   {
+      t = a[x] - b[x];
+      d += t * t;
+   }
+   return d;
+}
+
+static int nn_nearest(const float *vec, const float *centroids, int nlist, int dim)
+{
+   float best = FLT_MAX, d;
+   int c, which = 0;
+
+   for (c = 0; c < nlist; c++)
+   {
+      d = nn_dist(vec, centroids + (size_t)c * dim, dim);
+      if (d < best)
+      {
+         best = d;
+         which = c;
+      }
+   }
+   return which;
+}
+
+/* small deterministic generator so that builds are reproducible         */
+static unsigned long nn_rand(unsigned long *state)
+{
+   *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+   return *state >> 17;
+}
+
+/****************** Build helpers (run in parallel) ***********************/
+typedef struct
+{
+   long *ncod;
+   float *vecs;
+   int *cod;
+   int dim;
+   int *ds;
+   GENETIC_CODE_STRUCT *pcu;
+} NN_PROFILE_JOB;
+
+static void nn_profile_range(long start, long end, void *varg)
+{
+   NN_PROFILE_JOB *job = (NN_PROFILE_JOB *)varg;
+   long i;
+
+   for (i = start; i < end; i++)
+      rscu_profile(job->ncod + i * 65, job->vecs + (size_t)i * job->dim,
+                 job->cod, job->dim, job->ds, job->pcu);
+}
+
+typedef struct
+{
+   float *vecs;
+   long *rows; /* NULL to assign every row */
+   int *assign;
+   float *centroids;
+   int nlist;
+   int dim;
+} NN_ASSIGN_JOB;
+
+static void nn_assign_range(long start, long end, void *varg)
+{
+   NN_ASSIGN_JOB *job = (NN_ASSIGN_JOB *)varg;
+   long i, row;
+
+   for (i = start; i < end; i++)
+   {
+      row = job->rows ? job->rows[i] : i;
+      job->assign[i] = nn_nearest(job->vecs + (size_t)row * job->dim,
+                                  job->centroids, job->nlist, job->dim);
+   }
+}
+
+/****************** Build index               *****************************/
+/* ncod is an n x 65 row-major matrix of codon counts, ids the user id of */
+/* each row (or NULL for 0..n-1). Centroids are trained by k-means on at  */
+/* most NN_TRAIN_PER_LIST profiles per list.                              */
+/**************************************************************************/
+int nn_build(NN_INDEX_STRUCT *idx, long *ncod, int64_t *ids, long n, int nlist,
+             int niter, GENETIC_CODE_STRUCT *pcu, int nthreads)
+{
+   NN_PROFILE_JOB pjob;
+   NN_ASSIGN_JOB ajob;
+   NN_HEADER *head;
+   size_t off[4], total;
+   float *vecs = NULL;
+   long *rows = NULL, *cnt = NULL;
+   int64_t *fill = NULL;
+   int *assign = NULL;
+   double *sums = NULL;
+   unsigned long seed = 42;
+   long ntrain, i, j, row;
+   int ds[65], x, c, it, dim, status = 1;
+
+   memset(idx, 0, sizeof(NN_INDEX_STRUCT));
+   if (n < 1)
+   {
+      fprintf(stderr, "Cannot build an RSCU index from no profiles\n");
+      return 1;
+   }
+   if (nlist < 1)
+      nlist = 1;
+   if (nlist > n)
+      nlist = (int)n;
+
+   dim = syn_codons(idx->cod, pcu);
+   how_synon(ds, pcu);
+
+   total = nn_layout(dim, nlist, n, off);
+   idx->map = calloc(1, total);
+   vecs = (float *)malloc(sizeof(float) * (size_t)n * dim);
+   rows = (long *)malloc(sizeof(long) * n);
+   assign = (int *)malloc(sizeof(int) * n);
+   sums = (double *)malloc(sizeof(double) * (size_t)nlist * dim);
+   cnt = (long *)malloc(sizeof(long) * nlist);
+   fill = (int64_t *)malloc(sizeof(int64_t) * nlist);
+   if (!idx->map || !vecs || !rows || !assign || !sums || !cnt || !fill)
+   {
+      fprintf(stderr, "Out of memory building RSCU index\n");
+      goto done;
+   }
+
+   idx->dim = dim;
+   idx->nlist = nlist;
+   idx->n = n;
+   idx->map_len = total;
+   idx->mapped = false;
+   idx->code = *pcu;
+   idx->code.des = nn_code_des;
+   idx->code.typ = nn_code_typ;
+   nn_point(idx);
+
+   pjob.ncod = ncod;
+   pjob.vecs = vecs;
+   pjob.cod = idx->cod;
+   pjob.dim = dim;
+   pjob.ds = ds;
+   pjob.pcu = pcu;
+   par_for(n, nthreads, nn_profile_range, &pjob);
+
+   /* random training sample, its first nlist rows seed the centroids  */
+   for (i = 0; i < n; i++)
+      rows[i] = i;
+   ntrain = (long)nlist * NN_TRAIN_PER_LIST;
+   if (ntrain > n)
+      ntrain = n;
+   for (i = 0; i < ntrain; i++)
+   {
+      j = i + (long)(nn_rand(&seed) % (unsigned long)(n - i));
+      row = rows[i];
+      rows[i] = rows[j];
+      rows[j] = row;
+   }
+   for (c = 0; c < nlist; c++)
+      memcpy(idx->centroids + (size_t)c * dim, vecs + (size_t)rows[c] * dim,
+             sizeof(float) * dim);
+
+   ajob.vecs = vecs;
+   ajob.rows = rows;
+   ajob.assign = assign;
+   ajob.centroids = idx->centroids;
+   ajob.nlist = nlist;
+   ajob.dim = dim;
+
+   for (it = 0; it < niter && nlist > 1; it++)
+   {
+      par_for(ntrain, nthreads, nn_assign_range, &ajob);
+
+      memset(sums, 0, sizeof(double) * (size_t)nlist * dim);
+      memset(cnt, 0, sizeof(long) * nlist);
+      for (i = 0; i < ntrain; i++)
+      {
+         c = assign[i];
+         cnt[c]++;
+         for (x = 0; x < dim; x++)
+            sums[(size_t)c * dim + x] += vecs[(size_t)rows[i] * dim + x];
+      }
+      for (c = 0; c < nlist; c++)
+      {
+         if (cnt[c] == 0)
+         { /* empty cell, reseed it from a random training profile */
+            row = rows[nn_rand(&seed) % (unsigned long)ntrain];
+            memcpy(idx->centroids + (size_t)c * dim, vecs + (size_t)row * dim,
+                   sizeof(float) * dim);
+            continue;
+         }
+         for (x = 0; x < dim; x++)
+            idx->centroids[(size_t)c * dim + x] =
+                (float)(sums[(size_t)c * dim + x] / (double)cnt[c]);
+      }
+   }
+
+   /* place every profile in its nearest cell (counting sort by cell)  */
+   ajob.rows = NULL;
+   par_for(n, nthreads, nn_assign_range, &ajob);
+
+   memset(cnt, 0, sizeof(long) * nlist);
+   for (i = 0; i < n; i++)
+      cnt[assign[i]]++;
+   idx->offsets[0] = 0;
+   for (c = 0; c < nlist; c++)
+   {
+      idx->offsets[c + 1] = idx->offsets[c] + cnt[c];
+      fill[c] = idx->offsets[c];
+   }
+   for (i = 0; i < n; i++)
+   {
+      j = (long)fill[assign[i]]++;
+      idx->ids[j] = ids ? ids[i] : (int64_t)i;
+      memcpy(idx->vecs + (size_t)j * dim, vecs + (size_t)i * dim, sizeof(float) * dim);
+   }
+
+   head = (NN_HEADER *)idx->map;
+   memcpy(head->magic, NN_MAGIC, sizeof(NN_MAGIC));
+   head->version = NN_VERSION;
+   head->dim = dim;
+   head->nlist = nlist;
+   head->n = n;
+   for (x = 0; x < 64; x++)
+      head->cod[x] = x < dim ? idx->cod[x] : 0;
+   for (x = 0; x < 65; x++)
+      head->ca[x] = pcu->ca[x];
+
+   status = 0;
+
+done:
+   free(vecs);
+   free(rows);
+   free(assign);
+   free(sums);
+   free(cnt);
+   free(fill);
+   if (status)
+      nn_free(idx);
+   return status;
+}
+
+/* false if the codons or amino acids of a header are out of range, as  */
+/* rscu_profile indexes counts and totals by them                         */
+static bool nn_header_ok(const NN_HEADER *head)
+{
+   int x;
+
+   for (x = 0; x < head->dim; x++)
+      if (head->cod[x] < 1 || head->cod[x] > 64)
+         return false;
+   for (x = 0; x < 65; x++)
+      if (head->ca[x] < 0 || head->ca[x] > 21)
+         return false;
+   return true;
+}
+
+/* false unless the lists' offsets run from 0 to n without decreasing,  */
+/* as searches walk ids and vectors between them                          */
+static bool nn_offsets_ok(const int64_t *offsets, int nlist, int64_t n)
+{
+   int c;
+
+   if (offsets[0] != 0 || offsets[nlist] != n)
+      return false;
+   for (c = 0; c < nlist; c++)
+      if (offsets[c + 1] < offsets[c])
+         return false;
+   return true;
+}
+
+/****************** Save / load               *****************************/
+int nn_save(NN_INDEX_STRUCT *idx, char *filename)
+{
+   FILE *fout;
+   size_t written;
+
+   if ((fout = fopen(filename, "wb")) == NULL)
+   {
+      fprintf(stderr, "Could not open %s for writing\n", filename);
+      return 1;
+   }
+   written = fwrite(idx->map, 1, idx->map_len, fout);
+   if (fclose(fout) != 0 || written != idx->map_len)
+   {
+      fprintf(stderr, "Could not write RSCU index to %s\n", filename);
+      return 1;
+   }
+   return 0;
+}
+
+int nn_load(NN_INDEX_STRUCT *idx, char *filename)
+{
+   struct stat st;
+   NN_HEADER *head;
+   size_t off[4];
+   void *map;
+   int fd, x;
+
+   memset(idx, 0, sizeof(NN_INDEX_STRUCT));
+
+   if ((fd = open(filename, O_RDONLY)) < 0)
+   {
+      fprintf(stderr, "Could not open %s\n", filename);
+      return 1;
+   }
+   if (fstat(fd, &st) != 0 || (size_t)st.st_size < NN_HEADER_LEN)
+   {
+      fprintf(stderr, "%s is not an RSCU index\n", filename);
+      close(fd);
+      return 1;
+   }
+   map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (map == MAP_FAILED)
+   {
+      fprintf(stderr, "Could not map %s\n", filename);
+      return 1;
+   }
+
+   head = (NN_HEADER *)map;
+   if (memcmp(head->magic, NN_MAGIC, sizeof(NN_MAGIC)) != 0 ||
+       head->version != NN_VERSION || head->dim < 1 || head->dim > 64 ||
+       head->nlist < 1 || head->n < 1 || !nn_header_ok(head) ||
+       nn_layout(head->dim, head->nlist, head->n, off) != (size_t)st.st_size ||
+       !nn_offsets_ok((const int64_t *)((char *)map + off[1]), head->nlist, head->n))
+   {
+      fprintf(stderr, "%s is not a version %d RSCU index\n", filename, NN_VERSION);
+      munmap(map, (size_t)st.st_size);
+      return 1;
+   }
+
+   idx->map = map;
+   idx->map_len = (size_t)st.st_size;
+   idx->mapped = true;
+   idx->dim = head->dim;
+   idx->nlist = head->nlist;
+   idx->n = (long)head->n;
+   for (x = 0; x < 64; x++)
+      idx->cod[x] = head->cod[x];
+   idx->code.des = nn_code_des;
+   idx->code.typ = nn_code_typ;
+   for (x = 0; x < 65; x++)
+      idx->code.ca[x] = head->ca[x];
+   nn_point(idx);
+
+   return 0;
+}
+
+void nn_free(NN_INDEX_STRUCT *idx)
+{
+   if (idx->map)
+   {
+      if (idx->mapped)
+         munmap(idx->map, idx->map_len);
+      else
+         free(idx->map);
+   }
+   memset(idx, 0, sizeof(NN_INDEX_STRUCT));
+}
+
+/****************** k-NN search               *****************************/
+typedef struct
+{
+   NN_INDEX_STRUCT *idx;
+   long *ncod;
+   int k;
+   int nprobe;
+   int64_t *out_ids;
+   float *out_dist;
+   int ds[65];
+} NN_SEARCH_JOB;
+
+/* keep the k best (smallest) distances as a max-heap rooted at 0        */
+static void nn_sift(float *hd, int64_t *hi, int k)
+{
+   int i = 0, l, r, m;
+   float td;
+   int64_t ti;
+
+   for (;;)
+   {
+      l = 2 * i + 1;
+      r = l + 1;
+      m = i;
+      if (l < k && hd[l] > hd[m])
+         m = l;
+      if (r < k && hd[r] > hd[m])
+         m = r;
+      if (m == i)
+         break;
+      td = hd[i], hd[i] = hd[m], hd[m] = td;
+      ti = hi[i], hi[i] = hi[m], hi[m] = ti;
+      i = m;
+   }
+}
+
+static void nn_heap_push(float *hd, int64_t *hi, int k, float d, int64_t id)
+{
+   if (d >= hd[0])
+      return;
+   hd[0] = d;
+   hi[0] = id;
+   nn_sift(hd, hi, k);
+}
+
+static void nn_search_range(long start, long end, void *varg)
+{
+   NN_SEARCH_JOB *job = (NN_SEARCH_JOB *)varg;
+   NN_INDEX_STRUCT *idx = job->idx;
+   int dim = idx->dim, k = job->k, nprobe = job->nprobe;
+   float vec[64];
+   float *cdist = (float *)malloc(sizeof(float) * idx->nlist);
+   int *probe = (int *)malloc(sizeof(int) * nprobe);
+   float *hd;
+   int64_t *hi, j, tid;
+   long q;
+   int c, p, a, b;
+   float td;
+
+   if (!cdist || !probe)
+   { /* leave these queries empty rather than fail the whole batch */
+      for (q = start; q < end; q++)
+         for (a = 0; a < k; a++)
+         {
+            job->out_ids[q * k + a] = -1;
+            job->out_dist[q * k + a] = INFINITY;
+         }
+      free(cdist);
+      free(probe);
+      return;
+   }
+
+   for (q = start; q < end; q++)
+   {
+      hd = job->out_dist + q * k;
+      hi = job->out_ids + q * k;
+      for (a = 0; a < k; a++)
+      {
+         hd[a] = INFINITY;
+         hi[a] = -1;
+      }
+
+      rscu_profile(job->ncod + q * 65, vec, idx->cod, dim, job->ds, &idx->code);
+
+      /* the nprobe cells with the closest centroids, insertion ordered  */
+      for (c = 0, p = 0; c < idx->nlist; c++)
+      {
+         cdist[c] = nn_dist(vec, idx->centroids + (size_t)c * dim, dim);
+         if (p == nprobe && cdist[c] >= cdist[probe[p - 1]])
+            continue;
+         a = p < nprobe ? p++ : p - 1;
+         while (a > 0 && cdist[probe[a - 1]] > cdist[c])
+         {
+            probe[a] = probe[a - 1];
+            a--;
+         }
+         probe[a] = c;
+      }
+
+      for (a = 0; a < p; a++)
+      {
+         c = probe[a];
+         for (j = idx->offsets[c]; j < idx->offsets[c + 1]; j++)
+            nn_heap_push(hd, hi, k, nn_dist(vec, idx->vecs + (size_t)j * dim, dim),
+                         idx->ids[j]);
+      }
+
+      /* heap to ascending order */
+      for (b = k - 1; b > 0; b--)
+      {
+         td = hd[0], hd[0] = hd[b], hd[b] = td;
+         tid = hi[0], hi[0] = hi[b], hi[b] = tid;
+         nn_sift(hd, hi, b);
+      }
+   }
+
+   free(cdist);
+   free(probe);
+}
+
+/* ncod is an nq x 65 matrix of query counts, results are nq x k with    */
+/* squared euclidean distances ascending and id -1 for unfilled slots    */
+int nn_search(NN_INDEX_STRUCT *idx, long *ncod, long nq, int k, int nprobe,
+              int64_t *out_ids, float *out_dist, int nthreads)
+{
+   NN_SEARCH_JOB job;
+
+   if (k < 1)
+      return 0;
+   if (nprobe < 1)
+      nprobe = 1;
+   if (nprobe > idx->nlist)
+      nprobe = idx->nlist;
+
+   job.idx = idx;
+   job.ncod = ncod;
+   job.k = k;
+   job.nprobe = nprobe;
+   job.out_ids = out_ids;
+   job.out_dist = out_dist;
+   how_synon(job.ds, &idx->code);
+
+   return par_for(nq, nthreads, nn_search_range, &job);
+}
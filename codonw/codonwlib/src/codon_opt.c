@@ -0,0 +1,361 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains codon optimisation: the back-translation of protein
+sequences into the coding sequence with the highest CAI (the sum of log
+weights, with any table of codon weights such as tAI taken as the CAI
+weights) subject to
+
+   - the fraction of G+C in every window of a given length lying within
+     a range, and
+   - none of a list of forbidden motifs (IUPAC letters allowed, e.g.
+     restriction sites) occurring.
+
+The search is a beam search over synonymous codons, one amino acid at a
+time: the best par->beam partial sequences are kept at each position, so
+a beam of one is the greedy choice and an unconstrained search always
+finds the best codon of each amino acid. A candidate carries the last
+OPT_TAIL bases in a ring to test windows and motifs as bases are added.
+Constraints are counted rather than enforced: candidates are ranked by
+the number of violations first and then by score, so that a sequence is
+returned even where the constraints cannot all be met.
+
+Proteins are one letter codes as in amino_acids.aa1, with '*' for stop.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "../include/codonW.h"
+
+#define OPT_TAIL 256                /* a power of two                 */
+
+typedef struct
+{
+   double score;             /* sum of log weights                 */
+   long viol;                /* windows and motifs violated        */
+   int gcwin;                /* G+C among the last window bases    */
+   long len;                 /* bases so far                       */
+   unsigned char tail[OPT_TAIL]; /* ring of the last bases (base_code) */
+} OPT_ENTRY;
+
+typedef struct
+{
+   const char *prot;
+   const int64_t *offsets;
+   char *out;
+   long *violations;
+   OPT_PARAMS_STRUCT *par;
+   signed char aa_of[256];   /* amino acid of each letter, -1 none */
+   int ncand[22];            /* codons of each amino acid          */
+   int cand[22][64];
+   double logw[65];
+   int gc_lo, gc_hi;         /* G+C counts allowed in a window     */
+   int *motif_len;
+   int status;
+} OPT_JOB;
+
+static const char opt_bases[] = "TCAG";
+
+/* base_code values (T=1, C=2, A=3, G=4) of the three bases of codon x   */
+static void opt_codon_bases(int x, int b[3])
+{
+   b[0] = (x - 1) / 16 + 1;
+   b[1] = (x - 1) % 4 + 1;
+   b[2] = (x - 1) / 4 % 4 + 1;
+}
+
+typedef struct               /* an entry extended by one codon     */
+{
+   double score;
+   long viol;
+   int parent;               /* entry of the previous position     */
+   int codon;
+   int gcwin;
+} OPT_CAND;
+
+static int opt_cmp(const void *a, const void *b)
+{
+   const OPT_CAND *x = (const OPT_CAND *)a, *y = (const OPT_CAND *)b;
+
+   if (x->viol != y->viol)
+      return x->viol < y->viol ? -1 : 1;
+   if (x->score != y->score)
+      return x->score > y->score ? -1 : 1;
+   if (x->parent != y->parent)
+      return x->parent < y->parent ? -1 : 1;
+   return (x->codon > y->codon) - (x->codon < y->codon);
+}
+
+/* base q (from 0) of entry e followed by the three bases b              */
+#define OPT_BASE(e, b, q) \
+   ((q) >= (e)->len ? (b)[(q) - (e)->len] : (e)->tail[(q) & (OPT_TAIL - 1)])
+
+/* scores entry e extended by codon x (bases b) into c, without copying  */
+/* the ring: only the survivors are materialised by opt_push             */
+static void opt_eval(const OPT_ENTRY *e, int x, const int b[3], OPT_JOB *job,
+                     OPT_CAND *c)
+{
+   OPT_PARAMS_STRUCT *par = job->par;
+   const char *m;
+   long n, k;
+   int w = par->window, i, j, len, g = e->gcwin;
+
+   c->score = e->score + job->logw[x];
+   c->viol = e->viol;
+   c->codon = x;
+
+   for (j = 0; j < 3; j++)
+   {
+      n = e->len + j + 1;     /* bases once b[j] is added               */
+      if (w > 0)
+      {
+         g += b[j] == 2 || b[j] == 4;
+         if (n > w)
+         {
+            k = OPT_BASE(e, b, n - 1 - w);
+            g -= k == 2 || k == 4;
+         }
+         if (n >= w && (g < job->gc_lo || g > job->gc_hi))
+            c->viol++;
+      }
+
+      for (i = 0; i < par->nmotif; i++)
+      {
+         m = par->motifs[i];
+         len = job->motif_len[i];
+         if (len > n)
+            continue;
+         for (k = 0; k < len; k++)
+            if (!(iupac_code[(unsigned char)m[len - 1 - k]] &
+                  (1 << (OPT_BASE(e, b, n - 1 - k) - 1))))
+               break;
+         if (k == len)
+            c->viol++;
+      }
+   }
+   c->gcwin = g;
+}
+
+/* appends the three bases b of a surviving candidate to its entry e      */
+static void opt_push(OPT_ENTRY *e, const int b[3], const OPT_CAND *c)
+{
+   int j;
+
+   for (j = 0; j < 3; j++)
+      e->tail[(e->len + j) & (OPT_TAIL - 1)] = (unsigned char)b[j];
+   e->len += 3;
+   e->score = c->score;
+   e->viol = c->viol;
+   e->gcwin = c->gcwin;
+}
+
+static void opt_range(long start, long end, void *varg)
+{
+   OPT_JOB *job = (OPT_JOB *)varg;
+   int beam = job->par->beam;
+   OPT_ENTRY *cur = NULL, *next = NULL, *swap;
+   OPT_CAND *cand = NULL;
+   int *parent = NULL, *codon = NULL, b[3];
+   long i, p, len, cap = 0, viol;
+   int ncur, nnext, j, c, a, x, k;
+   char *dna;
+
+   cur = (OPT_ENTRY *)malloc(sizeof(OPT_ENTRY) * beam);
+   next = (OPT_ENTRY *)malloc(sizeof(OPT_ENTRY) * beam);
+   cand = (OPT_CAND *)malloc(sizeof(OPT_CAND) * beam * 64);
+   if (!cur || !next || !cand)
+   {
+      job->status = 1;
+      goto done;
+   }
+
+   for (i = start; i < end; i++)
+   {
+      len = (long)(job->offsets[i + 1] - job->offsets[i]);
+      dna = job->out + 3 * job->offsets[i];
+      if (len * beam > cap)
+      {
+         free(parent);
+         free(codon);
+         cap = len * beam;
+         parent = (int *)malloc(sizeof(int) * cap);
+         codon = (int *)malloc(sizeof(int) * cap);
+         if (!parent || !codon)
+         {
+            job->status = 1;
+            goto done;
+         }
+      }
+
+      memset(cur, 0, sizeof(OPT_ENTRY));
+      ncur = 1;
+      viol = 0;
+      for (p = 0; p < len; p++)
+      {
+         a = job->aa_of[(unsigned char)job->prot[job->offsets[i] + p]];
+         if (a < 0 || job->ncand[a] == 0)
+         {
+            viol = -1; /* not a letter this code can translate          */
+            break;
+         }
+
+         for (j = 0, nnext = 0; j < ncur; j++)
+            for (c = 0; c < job->ncand[a]; c++)
+            {
+               x = job->cand[a][c];
+               opt_codon_bases(x, b);
+               opt_eval(cur + j, x, b, job, cand + nnext);
+               cand[nnext++].parent = j;
+            }
+
+         if (nnext > 1)
+            qsort(cand, nnext, sizeof(OPT_CAND), opt_cmp);
+         nnext = nnext < beam ? nnext : beam;
+         for (j = 0; j < nnext; j++)
+         {
+            parent[p * beam + j] = cand[j].parent;
+            codon[p * beam + j] = x = cand[j].codon;
+            memcpy(next + j, cur + cand[j].parent, sizeof(OPT_ENTRY));
+            opt_codon_bases(x, b);
+            opt_push(next + j, b, cand + j);
+         }
+         swap = cur;
+         cur = next;
+         next = swap;
+         ncur = nnext;
+      }
+
+      if (viol < 0)
+      {
+         memset(dna, 'N', 3 * len);
+         job->violations[i] = -1;
+         continue;
+      }
+      job->violations[i] = len ? cur[0].viol : 0;
+
+      /* trace the best back to the first position                     */
+      for (p = len - 1, j = 0; p >= 0; p--)
+      {
+         x = codon[p * beam + j];
+         opt_codon_bases(x, b);
+         for (k = 0; k < 3; k++)
+            dna[3 * p + k] = opt_bases[b[k] - 1];
+         j = parent[p * beam + j];
+      }
+   }
+
+done:
+   free(cur);
+   free(next);
+   free(cand);
+   free(parent);
+   free(codon);
+}
+
+/****************** Optimise a batch          *****************************/
+/* Proteins prot[offsets[i]..offsets[i + 1]] become coding sequences at   */
+/* out[3 * offsets[i]..], with the number of constraints violated in      */
+/* violations[i] (-1 for a protein with a letter the code cannot encode)  */
+/**************************************************************************/
+int opt_batch(const char *prot, const int64_t *offsets, long n, GENETIC_CODE_STRUCT *pcu,
+              CAI_STRUCT *pcai, OPT_PARAMS_STRUCT *par, char *out, long *violations,
+              int nthreads)
+{
+   OPT_JOB job;
+   double w;
+   int *motif_len;
+   int x, a, i, j, t;
+
+   if (par->beam < 1 || (par->window == 0 && par->nmotif == 0))
+      par->beam = 1;          /* without constraints greedy is exact  */
+   if (par->window < 0 || par->window > OPT_TAIL - 4)
+   {
+      fprintf(stderr, "GC windows may be at most %d bases\n", OPT_TAIL - 4);
+      return 1;
+   }
+   for (i = 0; i < par->nmotif; i++)
+      if (strlen(par->motifs[i]) < 1 || strlen(par->motifs[i]) > OPT_TAIL - 4)
+      {
+         fprintf(stderr, "Forbidden motifs must be 1 to %d bases\n", OPT_TAIL - 4);
+         return 1;
+      }
+
+   memset(&job, 0, sizeof(job));
+   job.prot = prot;
+   job.offsets = offsets;
+   job.out = out;
+   job.violations = violations;
+   job.par = par;
+   job.gc_lo = (int)ceil(par->gc_min * par->window - 1e-9);
+   job.gc_hi = (int)floor(par->gc_max * par->window + 1e-9);
+
+   memset(job.aa_of, -1, sizeof(job.aa_of));
+   for (a = 0; a < 22; a++)
+   {
+      job.aa_of[(unsigned char)amino_acids.aa1[a][0]] = (signed char)a;
+      job.aa_of[(unsigned char)tolower(amino_acids.aa1[a][0])] = (signed char)a;
+   }
+   job.aa_of['X'] = job.aa_of['x'] = -1;
+
+   /* codons of each amino acid, highest weight first                  */
+   for (x = 1; x < 65; x++)
+   {
+      w = (double)pcai->cai_val[x];
+      job.logw[x] = log(w < 0.0001 ? (double)0.01F : w);
+      a = pcu->ca[x];
+      job.cand[a][job.ncand[a]++] = x;
+   }
+   for (a = 0; a < 22; a++)
+      for (i = 1; i < job.ncand[a]; i++)
+         for (j = i; j > 0 && job.logw[job.cand[a][j]] > job.logw[job.cand[a][j - 1]]; j--)
+         {
+            t = job.cand[a][j];
+            job.cand[a][j] = job.cand[a][j - 1];
+            job.cand[a][j - 1] = t;
+         }
+
+   motif_len = (int *)malloc(sizeof(int) * (par->nmotif + 1));
+   if (!motif_len)
+   {
+      fprintf(stderr, "Out of memory optimising codons\n");
+      return 1;
+   }
+   for (i = 0; i < par->nmotif; i++)
+      motif_len[i] = (int)strlen(par->motifs[i]);
+   job.motif_len = motif_len;
+
+   par_for(n, nthreads, opt_range, &job);
+   free(motif_len);
+   if (job.status)
+   {
+      fprintf(stderr, "Out of memory optimising codons\n");
+      return 1;
+   }
+   return 0;
+}
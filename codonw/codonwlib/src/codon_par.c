@@ -0,0 +1,121 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains a small parallel-for used by the functions that work
+on many genes at once. Work is handed out in chunks so that threads that
+finish early pick up more of the remaining genes. None of these functions
+touch Python objects and all may be called without holding the GIL.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../include/codonW.h"
+
+typedef struct
+{
+   PAR_FUNC fn;
+   void *arg;
+   long n;
+   long chunk;
+   long next; /* next unclaimed item, shared by all threads */
+} PAR_JOB;
+
+/****************** Number of threads          ****************************/
+/* A request for 0 (or fewer) threads means use every online processor    */
+/**************************************************************************/
+int par_threads(int nthreads)
+{
+   long ncpu;
+
+   if (nthreads > 0)
+      return nthreads < PAR_MAX_THREADS ? nthreads : PAR_MAX_THREADS;
+
+   ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+   if (ncpu < 1)
+      ncpu = 1;
+   return ncpu < PAR_MAX_THREADS ? (int)ncpu : PAR_MAX_THREADS;
+}
+
+static void *par_worker(void *varg)
+{
+   PAR_JOB *job = (PAR_JOB *)varg;
+   long start, end;
+
+   for (;;)
+   {
+      start = __atomic_fetch_add(&job->next, job->chunk, __ATOMIC_RELAXED);
+      if (start >= job->n)
+         break;
+      end = start + job->chunk;
+      if (end > job->n)
+         end = job->n;
+      job->fn(start, end, job->arg);
+   }
+   return NULL;
+}
+
+/****************** Parallel for               ****************************/
+/* Calls fn(start, end, arg) over disjoint ranges covering [0, n). The    */
+/* calling thread takes part in the work. If threads cannot be created    */
+/* the remaining work is simply done by the calling thread.               */
+/**************************************************************************/
+int par_for(long n, int nthreads, PAR_FUNC fn, void *arg)
+{
+   pthread_t tid[PAR_MAX_THREADS];
+   PAR_JOB job;
+   int i, started = 0;
+
+   if (n <= 0)
+      return 0;
+
+   nthreads = par_threads(nthreads);
+   if (nthreads > n)
+      nthreads = (int)n;
+
+   job.fn = fn;
+   job.arg = arg;
+   job.n = n;
+   job.next = 0;
+   /* several chunks per thread keeps the load balanced for uneven genes */
+   job.chunk = n / ((long)nthreads * 8);
+   if (job.chunk < 1)
+      job.chunk = 1;
+
+   for (i = 1; i < nthreads; i++)
+   {
+      if (pthread_create(&tid[started], NULL, par_worker, &job) != 0)
+         break;
+      started++;
+   }
+
+   par_worker(&job);
+
+   for (i = 0; i < started; i++)
+      pthread_join(tid[i], NULL);
+
+   return 0;
+}
@@ -0,0 +1,253 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains a pool of worker threads that run tasks in the
+background. Unlike par_for the caller does not wait: each finished task's
+id is queued and a file descriptor (an eventfd on Linux, otherwise a pipe)
+becomes readable, so that an event loop can wait for results alongside
+its other I/O and collect them with pool_done.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include "../include/codonW.h"
+
+typedef struct
+{
+   POOL_FUNC fn;
+   void *arg;
+   int64_t id;
+} POOL_TASK;
+
+struct pool_struct
+{
+   pthread_mutex_t lock;
+   pthread_cond_t wake;
+   pthread_t tid[PAR_MAX_THREADS];
+   int nthreads;
+   bool stop;
+
+   POOL_TASK *queue;     /* ring of waiting tasks           */
+   long qhead, qlen, qcap;
+   int64_t *done;        /* ids of finished tasks           */
+   long ndone, done_cap;
+   long nheld;           /* submitted, not yet collected    */
+
+   int fd[2];            /* read and write ends, equal for an eventfd */
+};
+
+/* make the notification descriptor readable                              */
+static void pool_notify(POOL_STRUCT *pool)
+{
+   uint64_t one = 1;
+   ssize_t r;
+
+   do
+      r = write(pool->fd[1], &one, pool->fd[0] == pool->fd[1] ? 8 : 1);
+   while (r < 0 && errno == EINTR);
+   /* a full pipe is already readable                                    */
+}
+
+static void *pool_worker(void *varg)
+{
+   POOL_STRUCT *pool = (POOL_STRUCT *)varg;
+   POOL_TASK task;
+
+   pthread_mutex_lock(&pool->lock);
+   for (;;)
+   {
+      while (!pool->qlen && !pool->stop)
+         pthread_cond_wait(&pool->wake, &pool->lock);
+      if (!pool->qlen)
+         break;
+      task = pool->queue[pool->qhead];
+      pool->qhead = (pool->qhead + 1) % pool->qcap;
+      pool->qlen--;
+      pthread_mutex_unlock(&pool->lock);
+
+      task.fn(task.arg);
+
+      pthread_mutex_lock(&pool->lock);
+      /* room was reserved by pool_submit                                 */
+      pool->done[pool->ndone++] = task.id;
+      pool_notify(pool);
+   }
+   pthread_mutex_unlock(&pool->lock);
+
+   return NULL;
+}
+
+/****************** Start a pool              *****************************/
+/* nthreads as for par_threads. Returns NULL on error.                    */
+/**************************************************************************/
+POOL_STRUCT *pool_open(int nthreads)
+{
+   POOL_STRUCT *pool;
+   int i;
+
+   if (!(pool = (POOL_STRUCT *)calloc(1, sizeof(POOL_STRUCT))))
+      return NULL;
+   pthread_mutex_init(&pool->lock, NULL);
+   pthread_cond_init(&pool->wake, NULL);
+
+#ifdef __linux__
+   pool->fd[0] = pool->fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if (pool->fd[0] < 0)
+#else
+   if (pipe(pool->fd) || fcntl(pool->fd[0], F_SETFL, O_NONBLOCK) ||
+       fcntl(pool->fd[1], F_SETFL, O_NONBLOCK))
+#endif
+   {
+      fprintf(stderr, "Could not create worker pool: %s\n", strerror(errno));
+      free(pool);
+      return NULL;
+   }
+
+   nthreads = par_threads(nthreads);
+   for (i = 0; i < nthreads; i++)
+      if (pthread_create(pool->tid + i, NULL, pool_worker, pool) != 0)
+         break;
+   pool->nthreads = i;
+   if (!i)
+   {
+      pool_close(pool);
+      return NULL;
+   }
+
+   return pool;
+}
+
+/* descriptor that becomes readable when tasks finish                     */
+int pool_fd(POOL_STRUCT *pool)
+{
+   return pool->fd[0];
+}
+
+/****************** Queue a task              *****************************/
+/* fn(arg) is run by a worker, after which id is returned by pool_done.   */
+/* Room for the id among the finished tasks is reserved here, so a task   */
+/* that is accepted is always reported.                                   */
+/**************************************************************************/
+int pool_submit(POOL_STRUCT *pool, POOL_FUNC fn, void *arg, int64_t id)
+{
+   POOL_TASK *queue;
+   int64_t *done;
+   long i, cap;
+
+   pthread_mutex_lock(&pool->lock);
+   if (pool->nheld == pool->done_cap)
+   {
+      cap = pool->done_cap * 2 + 64;
+      if (!(done = (int64_t *)realloc(pool->done, sizeof(int64_t) * cap)))
+      {
+         pthread_mutex_unlock(&pool->lock);
+         fprintf(stderr, "Out of memory in worker pool\n");
+         return 1;
+      }
+      pool->done = done;
+      pool->done_cap = cap;
+   }
+   if (pool->qlen == pool->qcap)
+   {
+      cap = pool->qcap * 2 + 16;
+      if (!(queue = (POOL_TASK *)malloc(sizeof(POOL_TASK) * cap)))
+      {
+         pthread_mutex_unlock(&pool->lock);
+         fprintf(stderr, "Out of memory in worker pool\n");
+         return 1;
+      }
+      for (i = 0; i < pool->qlen; i++)
+         queue[i] = pool->queue[(pool->qhead + i) % pool->qcap];
+      free(pool->queue);
+      pool->queue = queue;
+      pool->qhead = 0;
+      pool->qcap = cap;
+   }
+   pool->queue[(pool->qhead + pool->qlen) % pool->qcap] = (POOL_TASK){fn, arg, id};
+   pool->qlen++;
+   pool->nheld++;
+   pthread_cond_signal(&pool->wake);
+   pthread_mutex_unlock(&pool->lock);
+
+   return 0;
+}
+
+/****************** Collect finished tasks    *****************************/
+/* Clears the descriptor and writes up to max ids of finished tasks to    */
+/* ids, returning how many. If more are left the descriptor stays ready.  */
+/**************************************************************************/
+long pool_done(POOL_STRUCT *pool, int64_t *ids, long max)
+{
+   char buf[64];
+   long n;
+
+   while (read(pool->fd[0], buf, pool->fd[0] == pool->fd[1] ? 8 : sizeof(buf)) > 0)
+      ;
+
+   pthread_mutex_lock(&pool->lock);
+   n = pool->ndone < max ? pool->ndone : max;
+   memcpy(ids, pool->done, sizeof(int64_t) * n);
+   memmove(pool->done, pool->done + n, sizeof(int64_t) * (pool->ndone - n));
+   pool->ndone -= n;
+   pool->nheld -= n;
+   if (pool->ndone)
+      pool_notify(pool);
+   pthread_mutex_unlock(&pool->lock);
+
+   return n;
+}
+
+/****************** Stop a pool               *****************************/
+/* Waits for queued tasks to finish                                       */
+/**************************************************************************/
+void pool_close(POOL_STRUCT *pool)
+{
+   int i;
+
+   pthread_mutex_lock(&pool->lock);
+   pool->stop = true;
+   pthread_cond_broadcast(&pool->wake);
+   pthread_mutex_unlock(&pool->lock);
+   for (i = 0; i < pool->nthreads; i++)
+      pthread_join(pool->tid[i], NULL);
+
+   close(pool->fd[0]);
+   if (pool->fd[1] != pool->fd[0])
+      close(pool->fd[1]);
+   pthread_mutex_destroy(&pool->lock);
+   pthread_cond_destroy(&pool->wake);
+   free(pool->queue);
+   free(pool->done);
+   free(pool);
+}
@@ -0,0 +1,337 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains the scan of every single synonymous codon substitution
+of a gene (each sense codon replaced by each of its synonyms) for the
+change it makes to CAI, Fop, Nc and GC3s.
+
+The codon counts of a gene and the running totals of each index are kept
+in a SCAN_GENE_STRUCT, and a substitution only moves one count from codon
+x to codon y (scan_move), updating the two bins it touches:
+
+   CAI    the sum of log weights and the number of codons counted
+   Fop    the number of optimal codons and of codons counted
+   Nc     the count and sum of squared codon counts of each amino acid,
+          from which homozygosities and class averages are recomputed
+   GC3s   the G+C count at synonymous third positions
+
+so that the indices of a variant (scan_values) take no recount of the
+gene. Moves are not limited to synonyms, the VCF annotation of codon_vcf.c
+uses the same state for any single base change.
+
+Values are those of metric_row_frac (codon_metrics.c) for the gene and for
+each variant, a delta being NaN where either index is undefined.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "../include/codonW.h"
+
+typedef struct
+{
+   const char *data;
+   const int64_t *offsets;
+   SCAN_REF_STRUCT *sr;
+   int64_t *var_off;
+   int64_t *pos;
+   uint8_t *from;
+   uint8_t *to;
+   double *out;
+} SCAN_JOB;
+
+/* codon id of the three letters at s, 0 if any is not a base             */
+int scan_codon(const char *seq)
+{
+   const unsigned char *s = (const unsigned char *)seq;
+   int b1 = base_code[s[0]], b2 = base_code[s[1]], b3 = base_code[s[2]];
+
+   return b1 && b2 && b3 ? (b1 - 1) * 16 + b2 + (b3 - 1) * 4 : 0;
+}
+
+/* codons counted by CAI and GC3s: sense codons with synonyms             */
+static int scan_syn(METRIC_REF_STRUCT *ref, int x)
+{
+   return x && ref->code.ca[x] != 11 && ref->ds[x] > 1;
+}
+
+/****************** Prepare references        *****************************/
+int scan_ref_init(SCAN_REF_STRUCT *sr, METRIC_REF_STRUCT *ref)
+{
+   int a, x;
+
+   memset(sr, 0, sizeof(SCAN_REF_STRUCT));
+   sr->ref = ref;
+   for (x = 1; x < 65; x++)
+      sr->gc3[x] = (x - 1) / 4 % 4 + 1 == 2 || (x - 1) / 4 % 4 + 1 == 4;
+   for (a = 1; a < 22; a++)
+      if (a != 11)
+         sr->fold[ref->da[a]]++;
+
+   return 0;
+}
+
+/* adds d (1 or -1) counts of codon x to the totals of g                  */
+static void scan_add(SCAN_GENE_STRUCT *g, int x, long d, SCAN_REF_STRUCT *sr)
+{
+   METRIC_REF_STRUCT *ref = sr->ref;
+   int a = ref->code.ca[x];
+
+   /* (n + d)^2 - n^2 for d = +-1                                       */
+   g->q[a] += 2 * d * g->ncod[x] + 1;
+   g->ncod[x] += d;
+   g->naa[a] += d;
+   if (!scan_syn(ref, x))
+      return;
+   g->sigma += d * ref->cai_logw[x];
+   g->tot += d;
+   g->gc3 += d * sr->gc3[x];
+   if (ref->has_opt[a])
+   {
+      g->fop_tot += d;
+      g->fop_opt += ref->fop.fop_cod[x] == 3 ? d : 0;
+   }
+}
+
+/****************** Gene state                *****************************/
+/* Counts the codons of seq (len bases) into g                            */
+/**************************************************************************/
+int scan_gene_init(SCAN_GENE_STRUCT *g, const char *seq, long len, SCAN_REF_STRUCT *sr)
+{
+   METRIC_REF_STRUCT *ref = sr->ref;
+   long n;
+   int a, x;
+
+   memset(g, 0, sizeof(SCAN_GENE_STRUCT));
+   codon_usage_seq(seq, len, g->ncod);
+   for (x = 0; x < 65; x++)
+   {
+      n = g->ncod[x];
+      a = ref->code.ca[x];
+      g->naa[a] += n;
+      g->q[a] += n * n;
+      if (!scan_syn(ref, x))
+         continue;
+      g->sigma += n * ref->cai_logw[x];
+      g->tot += n;
+      g->gc3 += n * sr->gc3[x];
+      if (ref->has_opt[a])
+      {
+         g->fop_tot += n;
+         g->fop_opt += ref->fop.fop_cod[x] == 3 ? n : 0;
+      }
+   }
+
+   return 0;
+}
+
+/* moves one count of g from codon x to codon y                           */
+void scan_move(SCAN_GENE_STRUCT *g, int x, int y, SCAN_REF_STRUCT *sr)
+{
+   scan_add(g, x, -1, sr);
+   scan_add(g, y, 1, sr);
+}
+
+/****************** Indices of a gene state   *****************************/
+/* CAI, Fop, Nc and GC3s of g to out, as metric_row_frac (NaN for an Nc   */
+/* that cannot be computed, a Fop of invalid classes or a GC3s of no      */
+/* codons)                                                                */
+/**************************************************************************/
+void scan_values(const SCAN_GENE_STRUCT *g, SCAN_REF_STRUCT *sr, double out[SCAN_NMETRIC])
+{
+   METRIC_REF_STRUCT *ref = sr->ref;
+   double totb[9], averb, bb, enc_tot;
+   int numaa[9], a, z;
+
+   out[0] = g->tot ? exp(g->sigma / g->tot) : 0;
+   out[1] = !sr->ref->opt_ok ? NAN : g->fop_tot ? (double)g->fop_opt / g->fop_tot : 0;
+   out[3] = g->tot ? (double)g->gc3 / g->tot : NAN;
+
+   /* enc_frac from the counts and squared counts of each amino acid    */
+   memset(totb, 0, sizeof(totb));
+   memset(numaa, 0, sizeof(numaa));
+   for (a = 1; a < 22; a++)
+   {
+      if (a == 11 || g->naa[a] <= 1)
+         continue;
+      bb = ((double)g->q[a] / g->naa[a] - 1.0) / (double)(g->naa[a] - 1);
+      if (bb > 0.0000001)
+      {
+         totb[ref->da[a]] += bb;
+         numaa[ref->da[a]]++;
+      }
+   }
+   enc_tot = sr->fold[1];
+   for (z = 2; z <= 8 && !isnan(enc_tot); z++)
+   {
+      if (!sr->fold[z])
+         continue;
+      if (numaa[z] && totb[z] > 0)
+         averb = totb[z] / numaa[z];
+      else if (z == 3 && numaa[2] && numaa[4] && sr->fold[z] == 1)
+         averb = (totb[2] / numaa[2] + totb[4] / numaa[4]) * 0.5;
+      else
+      {
+         enc_tot = NAN;
+         break;
+      }
+      enc_tot += sr->fold[z] / averb;
+      if (enc_tot > 61)
+         enc_tot = 61;
+   }
+   out[2] = enc_tot;
+}
+
+/****************** Index changes of one move *****************************/
+/* out = indices after moving a count from x to y less those of g (base), */
+/* g is left as it was                                                    */
+/**************************************************************************/
+void scan_delta(SCAN_GENE_STRUCT *g, const double base[SCAN_NMETRIC], int x, int y,
+                SCAN_REF_STRUCT *sr, double out[SCAN_NMETRIC])
+{
+   double sigma = g->sigma;
+   int k;
+
+   scan_move(g, x, y, sr);
+   scan_values(g, sr, out);
+   scan_move(g, y, x, sr);
+   g->sigma = sigma;        /* exactly, whatever the rounding          */
+   for (k = 0; k < SCAN_NMETRIC; k++)
+      out[k] -= base[k];
+}
+
+static void scan_count_range(long start, long end, void *varg)
+{
+   SCAN_JOB *job = (SCAN_JOB *)varg;
+   const char *s;
+   long i, k, len, nvar;
+   int x;
+
+   for (i = start; i < end; i++)
+   {
+      s = job->data + job->offsets[i];
+      len = (long)(job->offsets[i + 1] - job->offsets[i]);
+      for (k = 0, nvar = 0; k + 2 < len; k += 3)
+      {
+         x = scan_codon(s + k);
+         if (scan_syn(job->sr->ref, x))
+            nvar += job->sr->ref->ds[x] - 1;
+      }
+      job->var_off[i + 1] = nvar;
+   }
+}
+
+/****************** Count variants            *****************************/
+/* Fills var_off (n + 1 entries) with the offsets of the variants of each */
+/* gene and returns their total                                           */
+/**************************************************************************/
+int64_t scan_count(const char *data, const int64_t *offsets, long n, METRIC_REF_STRUCT *ref,
+                   int64_t *var_off, int nthreads)
+{
+   SCAN_REF_STRUCT sr;
+   SCAN_JOB job;
+   long i;
+
+   scan_ref_init(&sr, ref);
+   memset(&job, 0, sizeof(job));
+   job.data = data;
+   job.offsets = offsets;
+   job.sr = &sr;
+   job.var_off = var_off;
+   par_for(n, nthreads, scan_count_range, &job);
+
+   var_off[0] = 0;
+   for (i = 0; i < n; i++)
+      var_off[i + 1] += var_off[i];
+   return var_off[n];
+}
+
+static void scan_range(long start, long end, void *varg)
+{
+   SCAN_JOB *job = (SCAN_JOB *)varg;
+   SCAN_REF_STRUCT *sr = job->sr;
+   GENETIC_CODE_STRUCT *pcu = &sr->ref->code;
+   SCAN_GENE_STRUCT g;
+   double base[SCAN_NMETRIC];
+   const char *s;
+   long i, k, len, v;
+   int a, x, y;
+
+   for (i = start; i < end; i++)
+   {
+      s = job->data + job->offsets[i];
+      len = (long)(job->offsets[i + 1] - job->offsets[i]);
+      scan_gene_init(&g, s, len, sr);
+      scan_values(&g, sr, base);
+
+      v = job->var_off[i];
+      for (k = 0; k + 2 < len; k += 3)
+      {
+         x = scan_codon(s + k);
+         if (!scan_syn(sr->ref, x))
+            continue;
+         a = pcu->ca[x];
+         for (y = 1; y < 65; y++)
+         {
+            if (y == x || pcu->ca[y] != a)
+               continue;
+            job->pos[v] = k;
+            job->from[v] = (uint8_t)x;
+            job->to[v] = (uint8_t)y;
+            scan_delta(&g, base, x, y, sr, job->out + v * SCAN_NMETRIC);
+            v++;
+         }
+      }
+   }
+}
+
+/****************** Scan synonymous variants  *****************************/
+/* For the variant offsets var_off of scan_count, writes the position of  */
+/* each variant's codon in its gene (in bases), the codons replaced and   */
+/* put in, and a row of SCAN_NMETRIC deltas: CAI, Fop, Nc and GC3s        */
+/**************************************************************************/
+int scan_batch(const char *data, const int64_t *offsets, long n, METRIC_REF_STRUCT *ref,
+               const int64_t *var_off, int64_t *pos, uint8_t *from, uint8_t *to, double *out,
+               int nthreads)
+{
+   SCAN_REF_STRUCT sr;
+   SCAN_JOB job;
+
+   scan_ref_init(&sr, ref);
+   memset(&job, 0, sizeof(job));
+   job.data = data;
+   job.offsets = offsets;
+   job.sr = &sr;
+   job.var_off = (int64_t *)var_off;
+   job.pos = pos;
+   job.from = from;
+   job.to = to;
+   job.out = out;
+   par_for(n, nthreads, scan_range, &job);
+
+   return 0;
+}
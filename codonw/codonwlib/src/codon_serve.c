@@ -0,0 +1,580 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains a resident server that computes indices for batches of
+sequences sent over a Unix domain socket, so that clients pay neither
+start up nor table set up per request. The references for every genetic
+code, CAI and Fop table are prepared when the server starts.
+
+All integers are in the byte order of the host (the socket is local).
+Each request is a 16 byte header followed by its payload:
+
+   u32 payload length    u32 request id
+   u8  kind              u8  genetic code  u8 cai_ref  u8 fop_ref
+   u32 indices wanted    (bit i for metric_names[i], 0 for all)
+
+   kind 1  FASTA text
+        2  u32 nseq, nseq u32 sequence lengths, the sequences end to end
+        3  statistics, the reply holds SERVE_NSTATS doubles
+        4  shut down the server
+
+Bits of indices wanted past the last of metric_names are an error.
+
+Each reply is a 16 byte header followed by its payload:
+
+   u32 payload length    u32 request id
+   u8  status (0 ok, 1 error with the message as payload)
+   u8  indices per sequence   u16 0
+   u32 nseq
+
+   then nseq rows of doubles, indices in increasing bit order.
+
+A request or reply, header included, is at most 1 GiB (SERVE_MAX_FRAME):
+a larger request closes the connection, and a batch whose reply would be
+larger gets an error reply.
+
+A client may send any number of requests before reading replies, which
+come back in the order the requests were sent on that connection. The
+latency recorded is from a request being received in full to its reply
+being queued.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "../include/codonW.h"
+
+#define SERVE_HEADER 16
+#define SERVE_MAX_FRAME (1U << 30) /* header and payload, either way */
+#define SERVE_MAX_PAYLOAD (SERVE_MAX_FRAME - SERVE_HEADER)
+#define SERVE_MAX_CLIENTS 1024
+#define SERVE_LAT_SAMPLES 65536
+#define SERVE_READ_CHUNK 65536
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define SERVE_FASTA 1
+#define SERVE_BINARY 2
+#define SERVE_STATS 3
+#define SERVE_SHUTDOWN 4
+
+typedef struct
+{
+   int fd;
+   char *in;        /* received, not yet handled       */
+   size_t in_len, in_cap;
+   char *out;       /* replies not yet sent            */
+   size_t out_pos, out_len, out_cap;
+   bool closing;
+} SERVE_CLIENT;
+
+struct serve_struct
+{
+   int fd;
+   char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+   int nthreads;
+   bool running;
+   METRIC_REF_STRUCT ref[NUM_GENETIC_CODES][NUM_CAI_SPECIES][NUM_FOP_SPECIES];
+
+   SERVE_CLIENT *clients;
+   int nclients;
+   struct pollfd *pfd;
+
+   long nrequests;       /* sequence requests answered      */
+   long nseq;
+   double lat[SERVE_LAT_SAMPLES]; /* last latencies, us      */
+   double lat_max, lat_sum;
+};
+
+static uint32_t get_u32(const char *p)
+{
+   uint32_t v;
+   memcpy(&v, p, 4);
+   return v;
+}
+
+static double serve_now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static int serve_reserve(char **buf, size_t *cap, size_t need)
+{
+   size_t n = *cap ? *cap : SERVE_READ_CHUNK;
+   char *p;
+
+   if (need <= *cap)
+      return 0;
+   while (n < need)
+      n *= 2;
+   if (!(p = (char *)realloc(*buf, n)))
+      return 1;
+   *buf = p;
+   *cap = n;
+   return 0;
+}
+
+/****************** Open the socket           *****************************/
+/* Binds path (replacing a stale socket there) and prepares references.   */
+/* Returns NULL on error.                                                 */
+/**************************************************************************/
+SERVE_STRUCT *serve_open(const char *path, int nthreads)
+{
+   SERVE_STRUCT *srv;
+   struct sockaddr_un addr;
+   struct stat st;
+   int c, a, f;
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   if (strlen(path) >= sizeof(addr.sun_path))
+   {
+      fprintf(stderr, "Socket path %s is too long\n", path);
+      return NULL;
+   }
+   strcpy(addr.sun_path, path);
+
+   if (!(srv = (SERVE_STRUCT *)calloc(1, sizeof(SERVE_STRUCT))))
+   {
+      fprintf(stderr, "Out of memory starting server\n");
+      return NULL;
+   }
+   strcpy(srv->path, path);
+   srv->nthreads = nthreads;
+   srv->running = true;
+
+   for (c = 0; c < NUM_GENETIC_CODES; c++)
+      for (a = 0; a < NUM_CAI_SPECIES; a++)
+         for (f = 0; f < NUM_FOP_SPECIES; f++)
+            metric_init(&srv->ref[c][a][f], cu_ref + c, cai_ref + a, fop_ref + f);
+
+   if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+      unlink(path);
+
+   srv->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (srv->fd < 0 || bind(srv->fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+       listen(srv->fd, 128) || fcntl(srv->fd, F_SETFL, O_NONBLOCK))
+   {
+      fprintf(stderr, "Could not listen on %s: %s\n", path, strerror(errno));
+      if (srv->fd >= 0)
+         close(srv->fd);
+      free(srv);
+      return NULL;
+   }
+
+   return srv;
+}
+
+/* queue a reply, false if out of memory                                  */
+static bool serve_reply(SERVE_CLIENT *c, uint32_t id, int status, int nind, uint32_t nseq,
+                        const void *payload, uint32_t len)
+{
+   char head[SERVE_HEADER];
+   uint16_t zero = 0;
+
+   if (c->out_pos == c->out_len)
+      c->out_pos = c->out_len = 0;
+   if (serve_reserve(&c->out, &c->out_cap, c->out_len + SERVE_HEADER + len))
+   {
+      c->closing = true;
+      return false;
+   }
+
+   memcpy(head, &len, 4);
+   memcpy(head + 4, &id, 4);
+   head[8] = (char)status;
+   head[9] = (char)nind;
+   memcpy(head + 10, &zero, 2);
+   memcpy(head + 12, &nseq, 4);
+   memcpy(c->out + c->out_len, head, SERVE_HEADER);
+   if (len)
+      memcpy(c->out + c->out_len + SERVE_HEADER, payload, len);
+   c->out_len += SERVE_HEADER + len;
+   return true;
+}
+
+static void serve_error(SERVE_CLIENT *c, uint32_t id, const char *msg)
+{
+   serve_reply(c, id, 1, 0, 0, msg, (uint32_t)strlen(msg));
+}
+
+/* sequences of a request in batch layout, data may point into payload   */
+static long serve_batch(int kind, const char *payload, uint32_t len, const char **data,
+                        int64_t **offsets, char **copy)
+{
+   int64_t *off, *names;
+   uint32_t nseq, i, l;
+   long n, max_rec = 1;
+
+   *copy = NULL;
+   if (kind == SERVE_BINARY)
+   {
+      if (len < 4)
+         return -1;
+      nseq = get_u32(payload);
+      if ((uint64_t)nseq * 4 > len - 4)
+         return -1;
+      if (!(off = (int64_t *)malloc(sizeof(int64_t) * ((size_t)nseq + 1))))
+         return -1;
+      for (i = 0, off[0] = 0; i < nseq; i++)
+      {
+         l = get_u32(payload + 4 + 4 * (size_t)i);
+         off[i + 1] = off[i] + l;
+      }
+      if (off[nseq] != (int64_t)len - 4 - 4 * (int64_t)nseq)
+      {
+         free(off);
+         return -1;
+      }
+      *data = payload + 4 + 4 * (size_t)nseq;
+      *offsets = off;
+      return (long)nseq;
+   }
+
+   for (i = 0; i < len; i++)
+      if (payload[i] == '>')
+         max_rec++;
+   off = (int64_t *)malloc(sizeof(int64_t) * (max_rec + 1));
+   names = (int64_t *)malloc(sizeof(int64_t) * 2 * max_rec);
+   *copy = (char *)malloc(len + 1);
+   if (!off || !names || !*copy)
+   {
+      free(off);
+      free(names);
+      free(*copy);
+      *copy = NULL;
+      return -1;
+   }
+   n = fasta_parse(payload, (long)len, *copy, off, names, max_rec);
+   free(names);
+   *data = *copy;
+   *offsets = off;
+   return n;
+}
+
+static void serve_request(SERVE_STRUCT *srv, SERVE_CLIENT *c, const char *frame)
+{
+   uint32_t len = get_u32(frame), id = get_u32(frame + 4), mask = get_u32(frame + 12);
+   int kind = (unsigned char)frame[8], code = (unsigned char)frame[9];
+   int ca = (unsigned char)frame[10], fo = (unsigned char)frame[11];
+   const char *payload = frame + SERVE_HEADER, *data = NULL;
+   int64_t *offsets = NULL;
+   char *copy = NULL;
+   long *ncod = NULL;
+   double *out = NULL, stats[SERVE_NSTATS], t0 = serve_now(), lat;
+   int which[NUM_METRICS], nwhich = 0, m;
+   long n;
+
+   switch (kind)
+   {
+   case SERVE_STATS:
+      serve_stats(srv, stats);
+      serve_reply(c, id, 0, SERVE_NSTATS, 1, stats, sizeof(stats));
+      return;
+   case SERVE_SHUTDOWN:
+      srv->running = false;
+      serve_reply(c, id, 0, 0, 0, NULL, 0);
+      return;
+   case SERVE_FASTA:
+   case SERVE_BINARY:
+      break;
+   default:
+      serve_error(c, id, "Unknown request");
+      return;
+   }
+
+   if (code >= NUM_GENETIC_CODES || ca >= NUM_CAI_SPECIES || fo >= NUM_FOP_SPECIES)
+   {
+      serve_error(c, id, "No such genetic code or reference");
+      return;
+   }
+   if (mask >> NUM_METRICS)
+   {
+      serve_error(c, id, "No such index");
+      return;
+   }
+   for (m = 0; m < NUM_METRICS; m++)
+      if (!mask || (mask >> m) & 1)
+         which[nwhich++] = m;
+
+   n = serve_batch(kind, payload, len, &data, &offsets, &copy);
+   if (n < 0)
+   {
+      serve_error(c, id, "Malformed sequence batch");
+      return;
+   }
+   if ((uint64_t)sizeof(double) * nwhich * n > SERVE_MAX_PAYLOAD)
+   { /* the length would not fit the reply header                      */
+      serve_error(c, id, "Reply too large, send fewer sequences per request");
+      free(offsets);
+      free(copy);
+      return;
+   }
+   ncod = (long *)malloc(sizeof(long) * 65 * (n ? n : 1));
+   out = (double *)malloc(sizeof(double) * nwhich * (n ? n : 1));
+   if (!ncod || !out)
+      serve_error(c, id, "Out of memory");
+   else
+   {
+      metric_seqs(data, offsets, n, ncod, &srv->ref[code][ca][fo], which, nwhich, out, srv->nthreads);
+      if (serve_reply(c, id, 0, nwhich, (uint32_t)n, out, (uint32_t)(sizeof(double) * nwhich * n)))
+      {
+         lat = serve_now() - t0;
+         srv->lat[srv->nrequests % SERVE_LAT_SAMPLES] = lat;
+         srv->lat_sum += lat;
+         if (lat > srv->lat_max)
+            srv->lat_max = lat;
+         srv->nrequests++;
+         srv->nseq += n;
+      }
+   }
+
+   free(offsets);
+   free(copy);
+   free(ncod);
+   free(out);
+}
+
+/* read what is available, up to a whole frame, and answer every          */
+/* complete request; the rest is left in the socket for the next poll     */
+static void serve_read(SERVE_STRUCT *srv, SERVE_CLIENT *c)
+{
+   ssize_t got;
+   size_t pos = 0, want;
+   uint32_t len;
+
+   while (!c->closing && c->in_len < SERVE_MAX_FRAME)
+   {
+      want = c->in_len + SERVE_READ_CHUNK < SERVE_MAX_FRAME ? c->in_len + SERVE_READ_CHUNK : SERVE_MAX_FRAME;
+      if (serve_reserve(&c->in, &c->in_cap, want))
+      {
+         c->closing = true;
+         break;
+      }
+      want = c->in_cap < SERVE_MAX_FRAME ? c->in_cap : SERVE_MAX_FRAME;
+      got = read(c->fd, c->in + c->in_len, want - c->in_len);
+      if (got > 0)
+         c->in_len += (size_t)got;
+      else if (got < 0 && errno == EINTR)
+         continue;
+      else
+      {
+         if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            c->closing = true;
+         break;
+      }
+   }
+
+   while (c->in_len - pos >= SERVE_HEADER)
+   {
+      len = get_u32(c->in + pos);
+      if (len > SERVE_MAX_PAYLOAD)
+      {
+         serve_error(c, get_u32(c->in + pos + 4), "Request too large");
+         c->closing = true;
+         pos = c->in_len;
+         break;
+      }
+      if (c->in_len - pos < SERVE_HEADER + (size_t)len)
+         break;
+      serve_request(srv, c, c->in + pos);
+      pos += SERVE_HEADER + len;
+   }
+   memmove(c->in, c->in + pos, c->in_len - pos);
+   c->in_len -= pos;
+}
+
+/* send queued replies, false if the connection is broken                 */
+static bool serve_write(SERVE_CLIENT *c)
+{
+   ssize_t put;
+
+   while (c->out_pos < c->out_len)
+   {
+      put = send(c->fd, c->out + c->out_pos, c->out_len - c->out_pos, MSG_NOSIGNAL);
+      if (put > 0)
+         c->out_pos += (size_t)put;
+      else if (put < 0 && errno == EINTR)
+         continue;
+      else if (put < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+         break;
+      else
+         return false;
+   }
+   return true;
+}
+
+static void serve_drop(SERVE_CLIENT *c)
+{
+   close(c->fd);
+   free(c->in);
+   free(c->out);
+}
+
+/****************** Handle socket events      *****************************/
+/* Waits up to timeout_ms for connections, requests or room to send       */
+/* replies, and handles them. Returns 1 on error.                         */
+/**************************************************************************/
+int serve_poll(SERVE_STRUCT *srv, int timeout_ms)
+{
+   SERVE_CLIENT *c;
+   struct pollfd *pfd;
+   int npoll = srv->nclients + 1, fd, i, j;
+
+   if (!(pfd = (struct pollfd *)realloc(srv->pfd, sizeof(struct pollfd) * npoll)))
+   {
+      fprintf(stderr, "Out of memory in server\n");
+      return 1;
+   }
+   srv->pfd = pfd;
+   pfd[0].fd = srv->fd;
+   pfd[0].events = POLLIN;
+   for (i = 0; i < srv->nclients; i++)
+   {
+      pfd[i + 1].fd = srv->clients[i].fd;
+      pfd[i + 1].events = POLLIN;
+      if (srv->clients[i].out_pos < srv->clients[i].out_len)
+         pfd[i + 1].events |= POLLOUT;
+   }
+
+   if (poll(pfd, npoll, timeout_ms) < 0)
+   {
+      if (errno == EINTR)
+         return 0;
+      fprintf(stderr, "Server poll failed: %s\n", strerror(errno));
+      return 1;
+   }
+
+   for (i = 0; i < srv->nclients; i++)
+   {
+      c = srv->clients + i;
+      if (pfd[i + 1].revents & (POLLIN | POLLHUP | POLLERR))
+         serve_read(srv, c);
+      if (!serve_write(c))
+      { /* nobody to reply to                                          */
+         c->closing = true;
+         c->out_pos = c->out_len;
+      }
+   }
+
+   /* drop closed connections once their replies are sent               */
+   for (i = j = 0; i < srv->nclients; i++)
+   {
+      if (srv->clients[i].closing && srv->clients[i].out_pos == srv->clients[i].out_len)
+         serve_drop(srv->clients + i);
+      else
+         srv->clients[j++] = srv->clients[i];
+   }
+   srv->nclients = j;
+
+   if (pfd[0].revents & POLLIN)
+      while ((fd = accept(srv->fd, NULL, NULL)) >= 0)
+      {
+         if (srv->nclients >= SERVE_MAX_CLIENTS || fcntl(fd, F_SETFL, O_NONBLOCK))
+         {
+            close(fd);
+            continue;
+         }
+         if (!(c = (SERVE_CLIENT *)realloc(srv->clients, sizeof(SERVE_CLIENT) * (srv->nclients + 1))))
+         {
+            close(fd);
+            break;
+         }
+         srv->clients = c;
+         c += srv->nclients++;
+         memset(c, 0, sizeof(SERVE_CLIENT));
+         c->fd = fd;
+      }
+
+   return 0;
+}
+
+/* false once a shut down request has been answered                      */
+bool serve_running(SERVE_STRUCT *srv)
+{
+   return srv->running;
+}
+
+static int serve_cmp(const void *a, const void *b)
+{
+   double x = *(const double *)a, y = *(const double *)b;
+   return x < y ? -1 : x > y;
+}
+
+/****************** Server statistics         *****************************/
+/* requests and sequences answered, then p50, p99, max and mean latency   */
+/* (us) of the last SERVE_LAT_SAMPLES requests                            */
+/**************************************************************************/
+int serve_stats(SERVE_STRUCT *srv, double stats[SERVE_NSTATS])
+{
+   double *sorted;
+   long m = srv->nrequests < SERVE_LAT_SAMPLES ? srv->nrequests : SERVE_LAT_SAMPLES;
+
+   stats[0] = (double)srv->nrequests;
+   stats[1] = (double)srv->nseq;
+   stats[2] = stats[3] = stats[4] = stats[5] = 0;
+   if (!m)
+      return 0;
+
+   if (!(sorted = (double *)malloc(sizeof(double) * m)))
+      return 1;
+   memcpy(sorted, srv->lat, sizeof(double) * m);
+   qsort(sorted, m, sizeof(double), serve_cmp);
+   stats[2] = sorted[(long)ceil(0.50 * m) - 1];
+   stats[3] = sorted[(long)ceil(0.99 * m) - 1];
+   stats[4] = srv->lat_max;
+   stats[5] = srv->lat_sum / (double)srv->nrequests;
+   free(sorted);
+
+   return 0;
+}
+
+/****************** Close the server          *****************************/
+void serve_close(SERVE_STRUCT *srv)
+{
+   int i;
+
+   for (i = 0; i < srv->nclients; i++)
+      serve_drop(srv->clients + i);
+   close(srv->fd);
+   unlink(srv->path);
+   free(srv->clients);
+   free(srv->pfd);
+   free(srv);
+}
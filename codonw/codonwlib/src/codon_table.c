@@ -0,0 +1,472 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains readers and writers of codon usage tables in the
+formats reference tables are usually distributed in:
+
+   CUT_GCG     GCG CodonFrequency (.cod) tables, one row per codon
+   CUT_KAZUSA  the Kazusa / CoCoPUTs text layout, "UUU 17.6(714298)"
+   CUT_CUTG    CUTG .spsum files, a title line and a line of 64 counts
+               per species in the CUTG codon order
+   CUT_CODONW  the machine readable layout of codon_usage_out
+   CUT_CUTAB   the table of cutab_out
+
+A buffer may hold any number of tables of one format (e.g. a whole CUTG
+release), which are read in a single pass into rows of 65 counts in the
+order of codon_usage_batch. Counts are doubles as GCG tables can hold
+fractional counts; column 0 is always 0.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "../include/codonW.h"
+
+/* codons of a CUTG .spsum line, in order                                 */
+static const char cutg_order[] =
+    "CGACGCCGGCGUAGAAGGCUACUCCUGCUUUUAUUGUCAUCCUCGUCUAGCAGUACAACCACGACU"
+    "CCACCCCCGCCUGCAGCCGCGGCUGGAGGCGGGGGUGUAGUCGUGGUUAAAAAGAACAAUCAACAG"
+    "CACCAUGAAGAGGACGAUUACUAUUGCUGUUUCUUUAUAAUCAUUAUGUGGUGAUAAUAG";
+
+/* codon id of the three letters at p (DNA or RNA, any case), 0 if none  */
+static int cut_id(const char *p)
+{
+   int b1, b2, b3;
+
+   b1 = base_code[(unsigned char)p[0]];
+   b2 = base_code[(unsigned char)p[1]];
+   b3 = base_code[(unsigned char)p[2]];
+
+   return b1 && b2 && b3 ? (b1 - 1) * 16 + b2 + (b3 - 1) * 4 : 0;
+}
+
+/* cut_id of a word of three letters at p, 0 if part of a longer word     */
+static int cut_codon(const char *buf, const char *p, const char *end)
+{
+   if (end - p < 3 || (p > buf && isalnum((unsigned char)p[-1])) ||
+       (p + 3 < end && isalnum((unsigned char)p[3])))
+      return 0;
+   return cut_id(p);
+}
+
+/* unsigned decimal number at *pp, which is moved past it; 0 if none      */
+static int cut_number(const char **pp, const char *end, double *v)
+{
+   const char *p = *pp;
+   double scale;
+
+   if (p >= end || !(isdigit((unsigned char)*p) || (*p == '.' && p + 1 < end && isdigit((unsigned char)p[1]))))
+      return 0;
+   for (*v = 0; p < end && isdigit((unsigned char)*p); p++)
+      *v = *v * 10 + (*p - '0');
+   if (p < end && *p == '.')
+      for (p++, scale = 0.1; p < end && isdigit((unsigned char)*p); p++, scale *= 0.1)
+         *v += (*p - '0') * scale;
+   *pp = p;
+
+   return 1;
+}
+
+/* Adds the codon, count pairs of the line [p, end) to ncod, the count of */
+/* a codon being the first number after it or, if paren, the number      */
+/* after the next '('. Returns how many codons were read.                 */
+static int cut_line(const char *buf, const char *p, const char *end, bool paren, double ncod[65])
+{
+   int n = 0, x;
+   double v;
+
+   while (p < end)
+   {
+      if (!(x = cut_codon(buf, p, end)))
+      {
+         p++;
+         continue;
+      }
+      for (p += 3; p < end && !(paren ? *p == '(' : isdigit((unsigned char)*p) || *p == '.'); p++)
+         if (!paren && isalpha((unsigned char)*p))
+            break;
+      if (paren && p < end && *p == '(')
+         for (p++; p < end && *p == ' '; p++)
+            ;
+      if (cut_number(&p, end, &v))
+      {
+         ncod[x] += v;
+         n++;
+      }
+   }
+
+   return n;
+}
+
+/* start and end of a line without surrounding white space               */
+static void cut_trim(const char **s, const char **e)
+{
+   while (*s < *e && isspace((unsigned char)**s))
+      (*s)++;
+   while (*e > *s && isspace((unsigned char)(*e)[-1]))
+      (*e)--;
+}
+
+/****************** Parse codon usage tables  *****************************/
+/* buf holds len bytes of tables in format (CUT_*). The counts of table i */
+/* are added to row i of ncod (n x 65, zeroed by the caller) and its      */
+/* title is buf[name_off[2i]] to buf[name_off[2i+1]]:                     */
+/*   CUT_GCG     the first line of the header                             */
+/*   CUT_KAZUSA  the first line of the text before the table              */
+/*   CUT_CUTG    the species line                                         */
+/*   CUT_CODONW  the title at the end of the fourth line                  */
+/*   CUT_CUTAB   the title of the closing "codons in" line                */
+/* Returns the number of tables n, at most max_rec are read, or -1 if the */
+/* format is unknown or a CUTG count line does not hold 64 counts.        */
+/**************************************************************************/
+long cut_parse(const char *buf, long len, int format, double *ncod, int64_t *name_off, long max_rec)
+{
+   const char *end = buf + len, *p, *nl, *s, *e, *q;
+   const char *cand = NULL, *cand_end = NULL;
+   int cutg_id[64], got = 0, line = 0, j;
+   bool open = false;
+   double v, *row;
+   long n = 0;
+
+   if (format < 0 || format >= NUM_CUT_FORMATS)
+   {
+      fprintf(stderr, "No codon usage table format %d\n", format);
+      return -1;
+   }
+   for (j = 0; j < 64; j++)
+      cutg_id[j] = cut_id(cutg_order + 3 * j);
+
+   for (p = buf; p < end && n < max_rec; p = nl + 1)
+   {
+      if (!(nl = (const char *)memchr(p, '\n', (size_t)(end - p))))
+         nl = end;
+      s = p;
+      e = nl;
+      cut_trim(&s, &e);
+      row = ncod + n * 65;
+
+      switch (format)
+      {
+      case CUT_GCG:
+         if (s == e)
+            break;
+         for (q = s; q + 1 < e && !(q[0] == '.' && q[1] == '.'); q++)
+            ;
+         if (q + 1 < e)
+         { /* ".." ends the header, the rows follow                    */
+            if (open && got)
+            {
+               n++;
+               if (n == max_rec)
+                  break;
+               row += 65;
+            }
+            if (!open || got)
+            { /* the header may be this line alone                     */
+               if (!cand)
+               {
+                  cand = s;
+                  cand_end = q;
+                  cut_trim(&cand, &cand_end);
+               }
+               name_off[2 * n] = cand - buf;
+               name_off[2 * n + 1] = cand_end - buf;
+               cand = NULL;
+            }
+            open = true;
+            got = 0;
+         }
+         else if (open && (j = cut_line(buf, s, e, false, row)))
+            got += j;
+         else
+         {
+            if (open && got)
+            {
+               n++;
+               open = false;
+            }
+            if (!open && !cand)
+            {
+               cand = s;
+               cand_end = e;
+            }
+         }
+         break;
+
+      case CUT_KAZUSA:
+         if ((j = cut_line(buf, s, e, true, row)))
+         {
+            if (!open)
+            {
+               name_off[2 * n] = (cand ? cand : s) - buf;
+               name_off[2 * n + 1] = (cand ? cand_end : s) - buf;
+               open = true;
+            }
+            got += j;
+            if (got >= 64)
+            {
+               n++;
+               open = false;
+               got = 0;
+               cand = NULL;
+            }
+         }
+         else if (s != e)
+         {
+            if (open)
+            { /* a short table                                          */
+               n++;
+               open = false;
+               got = 0;
+               cand = NULL;
+            }
+            if (!cand)
+            {
+               cand = s;
+               cand_end = e;
+            }
+         }
+         break;
+
+      case CUT_CUTG:
+         if (s == e)
+            break;
+         if (!open)
+         {
+            name_off[2 * n] = s - buf;
+            name_off[2 * n + 1] = e - buf;
+            open = true;
+            break;
+         }
+         for (q = s, j = 0; j < 64; j++)
+         {
+            while (q < e && isspace((unsigned char)*q))
+               q++;
+            if (!cut_number(&q, e, &v))
+               break;
+            row[cutg_id[j]] = v;
+         }
+         if (j < 64)
+         {
+            fprintf(stderr, "CUTG table %ld has %d counts\n", n + 1, j);
+            return -1;
+         }
+         n++;
+         open = false;
+         break;
+
+      case CUT_CODONW:
+         if (s == e)
+            break;
+         for (q = s, j = 0; j < 16; j++)
+         {
+            while (q < e && (*q == ',' || *q == ' ' || *q == '\t'))
+               q++;
+            if (!cut_number(&q, e, &v))
+               break;
+            row[line * 16 + j + 1] = v;
+         }
+         if (++line == 4)
+         {
+            while (q < e && (*q == ',' || *q == ' ' || *q == '\t'))
+               q++;
+            name_off[2 * n] = q - buf;
+            name_off[2 * n + 1] = e - buf;
+            n++;
+            line = 0;
+         }
+         break;
+
+      case CUT_CUTAB:
+         for (q = s; q < e && isdigit((unsigned char)*q); q++)
+            ;
+         if (q > s && e - q > 11 && !strncmp(q, " codons in ", 11))
+         { /* "%li codons in %16.16s (used %22.22s)"                  */
+            q += 11;
+            for (e = nl - 6; e > q && strncmp(e, " (used", 6); e--)
+               ;
+            if (e <= q)
+               e = nl;
+            cut_trim(&q, &e);
+            name_off[2 * n] = q - buf;
+            name_off[2 * n + 1] = e - buf;
+            n++;
+         }
+         else
+            cut_line(buf, s, e, false, row);
+         break;
+      }
+   }
+   if (open && got && n < max_rec && (format == CUT_GCG || format == CUT_KAZUSA))
+      n++;
+
+   return n;
+}
+
+/* one table in the GCG CodonFrequency layout                             */
+static void cut_write_gcg(FILE *f, const double *ncod, const char *name, GENETIC_CODE_STRUCT *pcu)
+{
+   double naa[22], tot = 0;
+   char cod[4];
+   int a, i, x;
+
+   count_amino_acids_frac(ncod, naa, pcu);
+   for (x = 1; x < 65; x++)
+      tot += ncod[x];
+
+   fprintf(f, "%s\n\nAmAcid  Codon      Number    /1000     Fraction   ..\n\n", name);
+   for (a = 1; a < 22; a++)
+   {
+      for (x = 1; x < 65; x++)
+      {
+         if (pcu->ca[x] != a)
+            continue;
+         for (i = 0; i < 4; i++) /* GCG tables are in DNA              */
+            cod[i] = amino_acids.cod[x][i] == 'U' ? 'T' : amino_acids.cod[x][i];
+         fprintf(f, "%-8s%-8s%9.2f %9.2f %12.2f\n", a == 11 ? "End" : amino_acids.aa3[a], cod,
+                 ncod[x], tot ? ncod[x] * 1000 / tot : 0, naa[a] ? ncod[x] / naa[a] : 0);
+      }
+      fprintf(f, "\n");
+   }
+}
+
+/* one table in the Kazusa layout, frequencies per thousand               */
+static void cut_write_kazusa(FILE *f, const double *ncod, const char *name)
+{
+   double tot = 0;
+   int x;
+
+   for (x = 1; x < 65; x++)
+      tot += ncod[x];
+
+   fprintf(f, "%s\n\n", name);
+   for (x = 1; x < 65; x++)
+   {
+      fprintf(f, "%s %4.1f(%6.0f)%s", amino_acids.cod[x], tot ? ncod[x] * 1000 / tot : 0, ncod[x],
+              x % 4 ? "  " : "\n");
+      if (!(x % 16))
+         fprintf(f, "\n");
+   }
+}
+
+/****************** Write codon usage tables  *****************************/
+/* Writes the n tables of 65 counts in ncod, with titles names (or none   */
+/* if names is NULL), to filename in format (CUT_*). The CUT_CODONW and   */
+/* CUT_CUTAB layouts are those of codon_usage_out and cutab_out, which    */
+/* write whole counts and cut titles to 20 and 16 characters.             */
+/**************************************************************************/
+int cut_save(const char *filename, int format, const double *ncod, long n, const char **names,
+             GENETIC_CODE_STRUCT *pcu)
+{
+   MENU_STRUCT menu = Z_menu;
+   long lcod[65], naa[22], i;
+   const double *row;
+   const char *name;
+   char title[MAX_FILENAME_LEN];
+   FILE *f;
+   int j, x;
+
+   if (format < 0 || format >= NUM_CUT_FORMATS)
+   {
+      fprintf(stderr, "No codon usage table format %d\n", format);
+      return 1;
+   }
+   if (!(f = fopen(filename, "w")))
+   {
+      fprintf(stderr, "Could not open %s\n", filename);
+      return 1;
+   }
+
+   /* settings for codon_usage_out and cutab_out                          */
+   menu.pcu = pcu;
+   menu.paa = &amino_acids;
+   how_synon(menu.dds, pcu);
+   menu.ds = menu.dds;
+   menu.separator = format == CUT_CODONW ? ',' : ' ';
+
+   for (i = 0; i < n; i++)
+   {
+      row = ncod + i * 65;
+      name = names ? names[i] : "";
+      switch (format)
+      {
+      case CUT_GCG:
+         cut_write_gcg(f, row, name, pcu);
+         break;
+      case CUT_KAZUSA:
+         cut_write_kazusa(f, row, name);
+         break;
+      case CUT_CUTG:
+         fprintf(f, "%s\n", name);
+         for (j = 0; j < 64; j++)
+         {
+            x = cut_id(cutg_order + 3 * j);
+            fprintf(f, "%.0f%c", row[x], j < 63 ? ' ' : '\n');
+         }
+         break;
+      default:
+         for (x = 0; x < 65; x++)
+            lcod[x] = lround(row[x]);
+         snprintf(title, sizeof(title), "%s", name);
+         if (format == CUT_CODONW)
+            codon_usage_out(f, lcod, title, &menu);
+         else
+         {
+            count_amino_acids(lcod, naa, pcu);
+            cutab_out(f, lcod, naa, title, &menu);
+         }
+      }
+   }
+
+   if (fclose(f))
+   {
+      fprintf(stderr, "Could not write %s\n", filename);
+      return 1;
+   }
+   return 0;
+}
+
+/****************** Weights of usage tables   *****************************/
+/* w (n x 65) receives the relative adaptiveness of each codon of each of */
+/* the n tables in ncod, as cai_fit derives CAI weights from counts       */
+/**************************************************************************/
+int cut_weights(const double *ncod, long n, GENETIC_CODE_STRUCT *pcu, double *w)
+{
+   CAI_STRUCT cai;
+   long i;
+   int x;
+
+   for (i = 0; i < n; i++)
+   {
+      cai_weights(ncod + i * 65, &cai, pcu);
+      for (x = 0; x < 65; x++)
+         w[i * 65 + x] = cai.cai_val[x];
+   }
+
+   return 0;
+}
@@ -0,0 +1,561 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains a database of codon (and optionally codon pair) counts
+pooled per taxon, in the manner of CUTG or CoCoPUTs.
+
+A builder takes batches of sequences with, for each sequence, the taxon
+ids it belongs to at a fixed number of ranks (e.g. species, genus and
+family). Sequences are counted in parallel as for codon_usage_batch and
+the counts added to the table of each of their taxa, with the taxa of a
+batch shared out between threads so that no table is written by two.
+
+The saved store holds the taxa sorted by id, so that once the file is
+mapped read-only into memory a taxon is found by binary search:
+
+   header           TDB_HEADER_LEN bytes
+   ids              int64 x n, increasing
+   ranks            int32 x n, column of the id in the batches
+   genes            int64 x n, sequences pooled
+   codons           int64 x n x 65, as codon_usage_batch
+   pairs            int64 x n x CSR_PAIR_BINS, when built with pairs
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../include/codonW.h"
+
+#define TDB_MAGIC "CWTAXDB"
+#define TDB_VERSION 1
+#define TDB_HEADER_LEN 1024
+#define TDB_ALIGN 64
+
+typedef struct
+{
+   char magic[8];
+   int32_t version;
+   int32_t pairs;
+   int32_t nrank;
+   int32_t reserved;
+   int64_t n;
+   char rank_names[TDB_MAX_RANKS][TDB_RANK_LEN];
+} TDB_HEADER;
+
+struct tdb_builder_struct
+{
+   bool pairs;
+   int nrank;
+   char rank_names[TDB_MAX_RANKS][TDB_RANK_LEN];
+
+   long n;                   /* taxa so far                       */
+   long cap;
+   int64_t *ids;
+   int32_t *ranks;
+   int64_t *genes;
+   int64_t *ncod;            /* cap x 65                          */
+   int64_t *npair;           /* cap x CSR_PAIR_BINS, or NULL      */
+
+   long *slot;               /* hash of ids to taxa, -1 if empty  */
+   long nslot;               /* a power of two, over twice n      */
+};
+
+static size_t tdb_align(size_t x)
+{
+   return (x + TDB_ALIGN - 1) & ~((size_t)TDB_ALIGN - 1);
+}
+
+/* byte offsets of ids, ranks, genes, codons and pairs in the file       */
+static size_t tdb_layout(long n, bool pairs, size_t off[5])
+{
+   off[0] = TDB_HEADER_LEN;
+   off[1] = tdb_align(off[0] + sizeof(int64_t) * (size_t)n);
+   off[2] = tdb_align(off[1] + sizeof(int32_t) * (size_t)n);
+   off[3] = tdb_align(off[2] + sizeof(int64_t) * (size_t)n);
+   off[4] = tdb_align(off[3] + sizeof(int64_t) * (size_t)n * 65);
+   if (!pairs)
+      return off[4];
+   return tdb_align(off[4] + sizeof(int64_t) * (size_t)n * CSR_PAIR_BINS);
+}
+
+static unsigned long tdb_hash(int64_t id)
+{
+   uint64_t h = (uint64_t)id * 0x9E3779B97F4A7C15ULL;
+   return (unsigned long)(h ^ (h >> 29));
+}
+
+/****************** Open a builder            *****************************/
+/* nrank ids per sequence, named by rank_names (may be NULL)              */
+/**************************************************************************/
+TDB_BUILDER_STRUCT *tdb_open(int nrank, const char **rank_names, bool pairs)
+{
+   TDB_BUILDER_STRUCT *tb;
+   int r;
+
+   if (nrank < 1 || nrank > TDB_MAX_RANKS)
+   {
+      fprintf(stderr, "A taxon database takes 1 to %d ranks\n", TDB_MAX_RANKS);
+      return NULL;
+   }
+   if (!(tb = (TDB_BUILDER_STRUCT *)calloc(1, sizeof(TDB_BUILDER_STRUCT))))
+      return NULL;
+   tb->pairs = pairs;
+   tb->nrank = nrank;
+   for (r = 0; r < nrank; r++)
+      if (rank_names && rank_names[r])
+         strncpy(tb->rank_names[r], rank_names[r], TDB_RANK_LEN - 1);
+   return tb;
+}
+
+/* room for at least want taxa, and a hash table to match               */
+static int tdb_grow(TDB_BUILDER_STRUCT *tb, long want)
+{
+   long cap = tb->cap ? tb->cap : 1024, i, s, mask;
+   long *slot;
+   void *p;
+
+   if (want <= tb->cap)
+      return 0;
+   while (cap < want)
+      cap *= 2;
+
+#define TDB_REALLOC(ptr, type, width)                                          \
+   if (!(p = realloc(ptr, sizeof(type) * (size_t)cap * (width))))              \
+      return 1;                                                              \
+   memset((type *)p + (size_t)tb->cap * (width), 0,                           \
+          sizeof(type) * (size_t)(cap - tb->cap) * (width));                  \
+   ptr = (type *)p;
+
+   TDB_REALLOC(tb->ids, int64_t, 1)
+   TDB_REALLOC(tb->ranks, int32_t, 1)
+   TDB_REALLOC(tb->genes, int64_t, 1)
+   TDB_REALLOC(tb->ncod, int64_t, 65)
+   if (tb->pairs)
+   {
+      TDB_REALLOC(tb->npair, int64_t, CSR_PAIR_BINS)
+   }
+#undef TDB_REALLOC
+   tb->cap = cap;
+
+   /* rehash into a table of twice the capacity                        */
+   if (!(slot = (long *)malloc(sizeof(long) * (size_t)cap * 2)))
+      return 1;
+   for (i = 0; i < cap * 2; i++)
+      slot[i] = -1;
+   mask = cap * 2 - 1;
+   for (i = 0; i < tb->n; i++)
+   {
+      s = (long)(tdb_hash(tb->ids[i]) & (unsigned long)mask);
+      while (slot[s] >= 0)
+         s = (s + 1) & mask;
+      slot[s] = i;
+   }
+   free(tb->slot);
+   tb->slot = slot;
+   tb->nslot = cap * 2;
+   return 0;
+}
+
+/* table of taxon id, added at rank if new; -1 if out of memory         */
+static long tdb_taxon(TDB_BUILDER_STRUCT *tb, int64_t id, int rank)
+{
+   long s, mask;
+
+   if (tb->n >= tb->cap && tdb_grow(tb, tb->n + 1))
+      return -1;
+   mask = tb->nslot - 1;
+   s = (long)(tdb_hash(id) & (unsigned long)mask);
+   while (tb->slot[s] >= 0)
+   {
+      if (tb->ids[tb->slot[s]] == id)
+         return tb->slot[s];
+      s = (s + 1) & mask;
+   }
+   tb->slot[s] = tb->n;
+   tb->ids[tb->n] = id;
+   tb->ranks[tb->n] = rank;
+   return tb->n++;
+}
+
+typedef struct
+{
+   TDB_BUILDER_STRUCT *tb;
+   const long *touched;      /* taxa of this batch                 */
+   const long *start;        /* their members are rows[start[j]..] */
+   const long *rows;
+   const long *ncod;         /* batch x 65                         */
+   const int64_t *indptr;    /* batch codon pairs in CSR form      */
+   const uint16_t *indices;
+   const uint32_t *values;
+} TDB_ADD_JOB;
+
+static void tdb_add_range(long start, long end, void *varg)
+{
+   TDB_ADD_JOB *job = (TDB_ADD_JOB *)varg;
+   TDB_BUILDER_STRUCT *tb = job->tb;
+   int64_t *tc, *tp, k;
+   const long *gc;
+   long j, m, row, t;
+   int x;
+
+   for (j = start; j < end; j++)
+   {
+      t = job->touched[j];
+      tc = tb->ncod + (size_t)t * 65;
+      tp = tb->pairs ? tb->npair + (size_t)t * CSR_PAIR_BINS : NULL;
+      for (m = job->start[j]; m < job->start[j + 1]; m++)
+      {
+         row = job->rows[m];
+         gc = job->ncod + (size_t)row * 65;
+         for (x = 0; x < 65; x++)
+            tc[x] += gc[x];
+         if (tp)
+            for (k = job->indptr[row]; k < job->indptr[row + 1]; k++)
+               tp[job->indices[k]] += job->values[k];
+      }
+      tb->genes[t] += job->start[j + 1] - job->start[j];
+   }
+}
+
+/****************** Add a batch               *****************************/
+/* Sequences as for codon_usage_batch, taxa an nseq x nrank row-major     */
+/* matrix of taxon ids with negative ids for ranks a sequence lacks       */
+/**************************************************************************/
+int tdb_add(TDB_BUILDER_STRUCT *tb, const char *data, const int64_t *offsets, long nseq,
+            const int64_t *taxa, int nthreads)
+{
+   TDB_ADD_JOB job;
+   long *ncod = NULL, *member = NULL, *rows = NULL, *start = NULL, *touched = NULL;
+   long *local = NULL;
+   int64_t *indptr = NULL;
+   uint16_t *indices = NULL;
+   uint32_t *values = NULL;
+   long nent = nseq * tb->nrank, i, t, ntouched = 0;
+   int status = 1;
+
+   if (nseq <= 0)
+      return 0;
+
+   ncod = (long *)calloc((size_t)nseq * 65, sizeof(long));
+   member = (long *)malloc(sizeof(long) * (size_t)nent);
+   rows = (long *)malloc(sizeof(long) * (size_t)nent);
+   if (!ncod || !member || !rows)
+      goto done;
+
+   /* the table of each (sequence, rank), -1 where there is none        */
+   for (i = 0; i < nent; i++)
+   {
+      member[i] = -1;
+      if (taxa[i] < 0)
+         continue;
+      if ((member[i] = tdb_taxon(tb, taxa[i], (int)(i % tb->nrank))) < 0)
+         goto done;
+   }
+
+   /* members grouped by taxon, taxa numbered in order of first use     */
+   local = (long *)malloc(sizeof(long) * (size_t)(tb->n + 1));
+   touched = (long *)malloc(sizeof(long) * (size_t)(tb->n + 1));
+   start = (long *)calloc((size_t)tb->n + 2, sizeof(long));
+   if (!local || !touched || !start)
+      goto done;
+   for (t = 0; t < tb->n; t++)
+      local[t] = -1;
+   for (i = 0; i < nent; i++)
+   {
+      if ((t = member[i]) < 0)
+         continue;
+      if (local[t] < 0)
+      {
+         local[t] = ntouched;
+         touched[ntouched++] = t;
+      }
+      start[local[t] + 1]++;
+   }
+   for (t = 0; t < ntouched; t++)
+      start[t + 1] += start[t];
+   for (i = 0; i < nent; i++)
+      if ((t = member[i]) >= 0)
+         rows[start[local[t]]++] = i / tb->nrank;
+   for (t = ntouched; t > 0; t--)
+      start[t] = start[t - 1];
+   start[0] = 0;
+
+   if (codon_usage_batch(data, offsets, nseq, ncod, nthreads))
+      goto done;
+   if (tb->pairs)
+   {
+      if (!(indptr = (int64_t *)malloc(sizeof(int64_t) * ((size_t)nseq + 1))))
+         goto done;
+      if (codon_csr_count(data, offsets, nseq, true, indptr, nthreads))
+         goto done;
+      indices = (uint16_t *)malloc(sizeof(uint16_t) * ((size_t)indptr[nseq] + 1));
+      values = (uint32_t *)malloc(sizeof(uint32_t) * ((size_t)indptr[nseq] + 1));
+      if (!indices || !values)
+         goto done;
+      if (codon_csr_fill(data, offsets, nseq, true, indptr, indices, values, nthreads))
+         goto done;
+   }
+
+   job.tb = tb;
+   job.touched = touched;
+   job.start = start;
+   job.rows = rows;
+   job.ncod = ncod;
+   job.indptr = indptr;
+   job.indices = indices;
+   job.values = values;
+   par_for(ntouched, nthreads, tdb_add_range, &job);
+   status = 0;
+
+done:
+   if (status)
+      fprintf(stderr, "Out of memory adding to taxon database\n");
+   free(ncod);
+   free(member);
+   free(rows);
+   free(local);
+   free(touched);
+   free(start);
+   free(indptr);
+   free(indices);
+   free(values);
+   return status;
+}
+
+long tdb_size(TDB_BUILDER_STRUCT *tb)
+{
+   return tb->n;
+}
+
+static int tdb_order_cmp(const void *a, const void *b)
+{
+   int64_t x = ((const int64_t *)a)[0], y = ((const int64_t *)b)[0];
+   return (x > y) - (x < y);
+}
+
+/* write len bytes, then zeros up to offset end                          */
+static int tdb_write(FILE *fout, const void *p, size_t len, size_t *pos, size_t end)
+{
+   static const char zeros[TDB_ALIGN] = {0};
+
+   if (len && fwrite(p, 1, len, fout) != len)
+      return 1;
+   *pos += len;
+   while (*pos < end)
+   {
+      len = end - *pos < TDB_ALIGN ? end - *pos : TDB_ALIGN;
+      if (fwrite(zeros, 1, len, fout) != len)
+         return 1;
+      *pos += len;
+   }
+   return 0;
+}
+
+/****************** Save the store            *****************************/
+int tdb_save(TDB_BUILDER_STRUCT *tb, const char *filename)
+{
+   TDB_HEADER head;
+   FILE *fout;
+   int64_t *order;
+   size_t off[5], total, pos = 0;
+   long i, t;
+   int r, err = 0;
+
+   if (!(order = (int64_t *)malloc(sizeof(int64_t) * 2 * ((size_t)tb->n + 1))))
+   {
+      fprintf(stderr, "Out of memory saving taxon database\n");
+      return 1;
+   }
+   for (i = 0; i < tb->n; i++)
+   {
+      order[2 * i] = tb->ids[i];
+      order[2 * i + 1] = i;
+   }
+   qsort(order, tb->n, 2 * sizeof(int64_t), tdb_order_cmp);
+
+   if ((fout = fopen(filename, "wb")) == NULL)
+   {
+      fprintf(stderr, "Could not open %s for writing\n", filename);
+      free(order);
+      return 1;
+   }
+
+   total = tdb_layout(tb->n, tb->pairs, off);
+   memset(&head, 0, sizeof(head));
+   memcpy(head.magic, TDB_MAGIC, sizeof(TDB_MAGIC));
+   head.version = TDB_VERSION;
+   head.pairs = tb->pairs;
+   head.nrank = tb->nrank;
+   head.n = tb->n;
+   for (r = 0; r < tb->nrank; r++)
+      memcpy(head.rank_names[r], tb->rank_names[r], TDB_RANK_LEN);
+   err |= tdb_write(fout, &head, sizeof(head), &pos, off[0]);
+
+   for (i = 0; i < tb->n; i++)
+      err |= tdb_write(fout, &order[2 * i], sizeof(int64_t), &pos, 0);
+   err |= tdb_write(fout, NULL, 0, &pos, off[1]);
+   for (i = 0; i < tb->n; i++)
+      err |= tdb_write(fout, &tb->ranks[order[2 * i + 1]], sizeof(int32_t), &pos, 0);
+   err |= tdb_write(fout, NULL, 0, &pos, off[2]);
+   for (i = 0; i < tb->n; i++)
+      err |= tdb_write(fout, &tb->genes[order[2 * i + 1]], sizeof(int64_t), &pos, 0);
+   err |= tdb_write(fout, NULL, 0, &pos, off[3]);
+   for (i = 0; i < tb->n; i++)
+   {
+      t = (long)order[2 * i + 1];
+      err |= tdb_write(fout, tb->ncod + (size_t)t * 65, sizeof(int64_t) * 65, &pos, 0);
+   }
+   err |= tdb_write(fout, NULL, 0, &pos, off[4]);
+   if (tb->pairs)
+   {
+      for (i = 0; i < tb->n; i++)
+      {
+         t = (long)order[2 * i + 1];
+         err |= tdb_write(fout, tb->npair + (size_t)t * CSR_PAIR_BINS,
+                          sizeof(int64_t) * CSR_PAIR_BINS, &pos, 0);
+      }
+      err |= tdb_write(fout, NULL, 0, &pos, total);
+   }
+
+   free(order);
+   if (fclose(fout) != 0 || err || pos != total)
+   {
+      fprintf(stderr, "Could not write taxon database to %s\n", filename);
+      return 1;
+   }
+   return 0;
+}
+
+void tdb_close(TDB_BUILDER_STRUCT *tb)
+{
+   free(tb->ids);
+   free(tb->ranks);
+   free(tb->genes);
+   free(tb->ncod);
+   free(tb->npair);
+   free(tb->slot);
+   free(tb);
+}
+
+/****************** Load a saved store        *****************************/
+int tdb_load(TAXON_DB_STRUCT *db, const char *filename)
+{
+   struct stat st;
+   TDB_HEADER *head;
+   size_t off[5];
+   char *map;
+   int fd, r;
+
+   memset(db, 0, sizeof(TAXON_DB_STRUCT));
+
+   if ((fd = open(filename, O_RDONLY)) < 0)
+   {
+      fprintf(stderr, "Could not open %s\n", filename);
+      return 1;
+   }
+   if (fstat(fd, &st) != 0 || (size_t)st.st_size < TDB_HEADER_LEN)
+   {
+      fprintf(stderr, "%s is not a taxon database\n", filename);
+      close(fd);
+      return 1;
+   }
+   map = (char *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (map == MAP_FAILED)
+   {
+      fprintf(stderr, "Could not map %s\n", filename);
+      return 1;
+   }
+
+   head = (TDB_HEADER *)map;
+   if (memcmp(head->magic, TDB_MAGIC, sizeof(TDB_MAGIC)) != 0 ||
+       head->version != TDB_VERSION || head->n < 0 ||
+       head->nrank < 1 || head->nrank > TDB_MAX_RANKS ||
+       tdb_layout((long)head->n, head->pairs != 0, off) != (size_t)st.st_size)
+   {
+      fprintf(stderr, "%s is not a version %d taxon database\n", filename, TDB_VERSION);
+      munmap(map, (size_t)st.st_size);
+      return 1;
+   }
+
+   db->map = map;
+   db->map_len = (size_t)st.st_size;
+   db->n = (long)head->n;
+   db->pairs = head->pairs != 0;
+   db->nrank = head->nrank;
+   for (r = 0; r < head->nrank; r++)
+   {
+      memcpy(db->rank_names[r], head->rank_names[r], TDB_RANK_LEN);
+      db->rank_names[r][TDB_RANK_LEN - 1] = '\0';
+   }
+   db->ids = (int64_t *)(map + off[0]);
+   db->ranks = (int32_t *)(map + off[1]);
+   db->genes = (int64_t *)(map + off[2]);
+   db->ncod = (int64_t *)(map + off[3]);
+   db->npair = db->pairs ? (int64_t *)(map + off[4]) : NULL;
+
+   return 0;
+}
+
+void tdb_free(TAXON_DB_STRUCT *db)
+{
+   if (db->map)
+      munmap(db->map, db->map_len);
+   memset(db, 0, sizeof(TAXON_DB_STRUCT));
+}
+
+/****************** Find taxa                 *****************************/
+/* row of a taxon id in the store by binary search, -1 if it is not held  */
+/**************************************************************************/
+long tdb_find(TAXON_DB_STRUCT *db, int64_t id)
+{
+   long lo = 0, hi = db->n, mid;
+
+   while (lo < hi)
+   {
+      mid = lo + (hi - lo) / 2;
+      if (db->ids[mid] < id)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   return lo < db->n && db->ids[lo] == id ? lo : -1;
+}
+
+/* rows of n ids, returns how many were found                           */
+long tdb_lookup(TAXON_DB_STRUCT *db, const int64_t *ids, long n, int64_t *rows)
+{
+   long i, found = 0;
+
+   for (i = 0; i < n; i++)
+      if ((rows[i] = tdb_find(db, ids[i])) >= 0)
+         found++;
+   return found;
+}
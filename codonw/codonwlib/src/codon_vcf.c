@@ -0,0 +1,652 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains the annotation of the single nucleotide variants of a
+VCF with their effect on the codon usage indices of the genes they fall
+in (CAI, Fop, Nc and GC3s, as codon_scan.c).
+
+A VCF_MODEL_STRUCT gives the coding sequence of each gene and its exons
+on the genome. The VCF is read once, in blocks of whole lines given to
+vcf_feed as they are read (or decompressed), so that it never needs to
+be held in memory: each ALT allele of one base of a record whose REF is
+one base is placed on the CDS of every exon holding it, which gives the
+codon before and after the change (complemented for genes on the minus
+strand). Other records and alleles (indels, symbolic alleles) are passed
+over.
+
+The changes are then worked out in parallel over genes, each gene's
+codon counts being taken once into a SCAN_GENE_STRUCT:
+
+   - for each variant, the indices after moving one count from the old
+     codon to the new one, less those of the gene, and
+   - with model->samples, for each haplotype of each sample that carries
+     alternative alleles in the gene (the GT field of the samples, taken
+     in the order written, so that unphased calls are assigned to
+     haplotypes as they come), the same for all of its variants at once:
+     variants in the same codon are combined into one codon change.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "../include/codonW.h"
+
+#define VCF_MAX_PLOIDY 8
+
+typedef struct
+{
+   int32_t gene;
+   int32_t sample;
+   int8_t hap;
+   int64_t pos;              /* CDS offset of the variant          */
+   long hit;
+} VCF_CARRIER;
+
+typedef struct
+{
+   VCF_MODEL_STRUCT *model;
+   SCAN_REF_STRUCT *sr;
+   VCF_RESULT_STRUCT *res;
+   const uint8_t *alt;       /* base put in, in the CDS strand     */
+   const long *order;        /* hits by gene                       */
+   const long *gene_hit;     /* ngene + 1 offsets into order       */
+   const VCF_CARRIER *car;   /* carriers by gene, sample, haplotype */
+   const long *group;        /* nhap + 1 offsets into car          */
+   const long *gene_group;   /* ngene + 1 offsets into group       */
+   long max_group;
+   int status;
+} VCF_JOB;
+
+/* base_code of the complementary base                                   */
+static const int vcf_comp[5] = {0, 3, 4, 1, 2};
+
+/* codon x with base b (base_code) at position j                          */
+static int vcf_codon_with(int x, int j, int b)
+{
+   int c[3];
+
+   c[0] = (x - 1) / 16 + 1;
+   c[1] = (x - 1) % 4 + 1;
+   c[2] = (x - 1) / 4 % 4 + 1;
+   c[j] = b;
+   return (c[0] - 1) * 16 + c[1] + (c[2] - 1) * 4;
+}
+
+/* index of the chromosome named s (len bytes), -1 if not in the model    */
+static long vcf_chrom(VCF_MODEL_STRUCT *m, const char *s, long len)
+{
+   long lo = 0, hi = m->nchrom - 1, mid, l;
+   int c;
+
+   while (lo <= hi)
+   {
+      mid = (lo + hi) / 2;
+      l = (long)(m->chrom_off[mid + 1] - m->chrom_off[mid]);
+      c = memcmp(m->chroms + m->chrom_off[mid], s, (size_t)(l < len ? l : len));
+      if (!c)
+         c = (l > len) - (l < len);
+      if (!c)
+         return mid;
+      if (c < 0)
+         lo = mid + 1;
+      else
+         hi = mid - 1;
+   }
+   return -1;
+}
+
+/* last exon starting at or before pos on chrom, -1 if none              */
+static long vcf_exon(VCF_MODEL_STRUCT *m, long chrom, int64_t pos)
+{
+   long lo = 0, hi = m->nexon - 1, mid, best = -1;
+
+   while (lo <= hi)
+   {
+      mid = (lo + hi) / 2;
+      if (m->exon_chrom[mid] < chrom || (m->exon_chrom[mid] == chrom && m->exon_start[mid] <= pos))
+      {
+         best = mid;
+         lo = mid + 1;
+      }
+      else
+         hi = mid - 1;
+   }
+   return best;
+}
+
+struct vcf_parse_struct
+{
+   VCF_MODEL_STRUCT *model;
+   VCF_RESULT_STRUCT *res;
+   long cap_hit, cap_car, ncar;
+   uint8_t *alt;
+   VCF_CARRIER *car;
+};
+
+typedef VCF_PARSE_STRUCT VCF_PARSE;
+
+/* room for at least want hits                                           */
+static int vcf_grow_hits(VCF_PARSE *ps, long want)
+{
+   VCF_RESULT_STRUCT *r = ps->res;
+   long cap = ps->cap_hit ? ps->cap_hit : 1024;
+   void *p;
+
+   while (cap < want)
+      cap *= 2;
+
+#define VCF_REALLOC(ptr, type)                                                 \
+   if (!(p = realloc(ptr, sizeof(type) * (size_t)cap)))                       \
+      return 1;                                                              \
+   ptr = (type *)p;
+
+   VCF_REALLOC(r->rec, int64_t)
+   VCF_REALLOC(r->vcf_pos, int64_t)
+   VCF_REALLOC(r->chrom, int32_t)
+   VCF_REALLOC(r->allele, int32_t)
+   VCF_REALLOC(r->gene, int32_t)
+   VCF_REALLOC(r->pos, int64_t)
+   VCF_REALLOC(r->from, uint8_t)
+   VCF_REALLOC(r->to, uint8_t)
+   VCF_REALLOC(r->status, int8_t)
+   VCF_REALLOC(ps->alt, uint8_t)
+#undef VCF_REALLOC
+   ps->cap_hit = cap;
+   return 0;
+}
+
+/* room for one more carrier                                             */
+static int vcf_grow_carriers(VCF_PARSE *ps)
+{
+   long cap = ps->cap_car ? ps->cap_car * 2 : 1024;
+   void *p;
+
+   if (ps->ncar < ps->cap_car)
+      return 0;
+   if (!(p = realloc(ps->car, sizeof(VCF_CARRIER) * (size_t)cap)))
+      return 1;
+   ps->car = (VCF_CARRIER *)p;
+   ps->cap_car = cap;
+   return 0;
+}
+
+/* end of the field starting at s, before e                              */
+static const char *vcf_field_end(const char *s, const char *e)
+{
+   const char *t = memchr(s, '\t', (size_t)(e - s));
+
+   return t ? t : e;
+}
+
+/* position of GT among the FORMAT keys f..e, -1 if absent               */
+static int vcf_gt_index(const char *f, const char *e)
+{
+   int k = 0;
+
+   while (f < e)
+   {
+      if (e - f >= 2 && f[0] == 'G' && f[1] == 'T' && (f + 2 == e || f[2] == ':'))
+         return k;
+      while (f < e && *f != ':')
+         f++;
+      f++;
+      k++;
+   }
+   return -1;
+}
+
+/* places allele a of record rec at chrom:pos (0-based, the bases ref_b   */
+/* and alt_b in base_code) on the CDS of every exon holding it            */
+static int vcf_place(VCF_MODEL_STRUCT *m, VCF_PARSE *ps, long rec, int a, long chrom,
+                     int64_t pos, int ref_b, int alt_b)
+{
+   VCF_RESULT_STRUCT *r = ps->res;
+   long e = vcf_exon(m, chrom, pos), h;
+   int64_t off, cds_len, start;
+   const char *cds;
+   int rb, ab, x;
+
+   for (; e >= 0 && m->exon_chrom[e] == chrom && m->exon_start[e] + m->max_exon > pos; e--)
+   {
+      if (pos >= m->exon_end[e])
+         continue;
+      h = r->nhit;
+      if (h >= ps->cap_hit && vcf_grow_hits(ps, h + 1))
+         return 1;
+
+      if (m->exon_strand[e] < 0)
+      {
+         off = m->exon_cds[e] + (m->exon_end[e] - 1 - pos);
+         rb = vcf_comp[ref_b];
+         ab = vcf_comp[alt_b];
+      }
+      else
+      {
+         off = m->exon_cds[e] + (pos - m->exon_start[e]);
+         rb = ref_b;
+         ab = alt_b;
+      }
+      cds = m->cds + m->cds_off[m->exon_gene[e]];
+      cds_len = m->cds_off[m->exon_gene[e] + 1] - m->cds_off[m->exon_gene[e]];
+      start = off - off % 3;
+
+      r->rec[h] = rec;
+      r->vcf_pos[h] = pos + 1;
+      r->chrom[h] = (int32_t)chrom;
+      r->allele[h] = a;
+      r->gene[h] = m->exon_gene[e];
+      r->pos[h] = off;
+      ps->alt[h] = (uint8_t)ab;
+      x = off < cds_len && start + 3 <= cds_len ? scan_codon(cds + start) : 0;
+      r->from[h] = (uint8_t)x;
+      r->to[h] = x ? (uint8_t)vcf_codon_with(x, (int)(off % 3), ab) : 0;
+      if (!x)
+         r->status[h] = VCF_NO_CODON;
+      else if (base_code[(unsigned char)cds[off]] != rb)
+         r->status[h] = VCF_REF_MISMATCH;
+      else
+         r->status[h] = VCF_OK;
+      r->nhit++;
+   }
+   return 0;
+}
+
+/* adds the carriers among the samples (fields s..e) of the hits          */
+/* [first, nhit) of one record, GT being key gt of each sample            */
+static int vcf_samples(VCF_PARSE *ps, const char *s, const char *e, int gt, long first)
+{
+   VCF_RESULT_STRUCT *r = ps->res;
+   const char *f, *fe;
+   long sample = 0, h;
+   int k, hap, a;
+
+   while (s < e)
+   {
+      fe = vcf_field_end(s, e);
+      /* the GT subfield of this sample                                 */
+      for (f = s, k = 0; k < gt && f < fe; f++)
+         if (*f == ':')
+            k++;
+      for (hap = 0; f < fe && *f != ':' && hap < VCF_MAX_PLOIDY; hap++)
+      {
+         if (*f >= '0' && *f <= '9')
+         {
+            for (a = 0; f < fe && *f >= '0' && *f <= '9'; f++)
+               a = a * 10 + (*f - '0');
+            for (h = first; a > 0 && h < r->nhit; h++)
+            {
+               if (r->allele[h] != a || r->status[h] != VCF_OK)
+                  continue;
+               if (vcf_grow_carriers(ps))
+                  return 1;
+               ps->car[ps->ncar].gene = r->gene[h];
+               ps->car[ps->ncar].sample = (int32_t)sample;
+               ps->car[ps->ncar].hap = (int8_t)hap;
+               ps->car[ps->ncar].pos = r->pos[h];
+               ps->car[ps->ncar].hit = h;
+               ps->ncar++;
+            }
+         }
+         else
+            f++;              /* '.' for a missing allele                 */
+         if (f < fe && (*f == '|' || *f == '/'))
+            f++;
+      }
+      sample++;
+      s = fe + 1;
+   }
+   if (sample > r->nsample)
+      r->nsample = sample;
+   return 0;
+}
+
+/* reads the VCF records of buf, filling the hits of res and carriers     */
+static int vcf_read(const char *buf, long len, VCF_MODEL_STRUCT *m, VCF_PARSE *ps)
+{
+   VCF_RESULT_STRUCT *r = ps->res;
+   const char *line = buf, *end = buf + len, *le, *f[9], *fe, *alt, *ae;
+   long chrom, first, i, rec = r->nrec;
+   int64_t pos;
+   int a, k, gt, rb;
+
+   for (; line < end; line = le + 1)
+   {
+      le = memchr(line, '\n', (size_t)(end - line));
+      if (!le)
+         le = end;
+      if (line == le || *line == '#')
+         continue;
+      if (le[-1] == '\r')
+         le--;
+
+      /* the first nine fields                                          */
+      f[8] = le;
+      for (k = 0, f[0] = line; k < 8 && f[k] < le; k++)
+         f[k + 1] = vcf_field_end(f[k], le) + 1;
+      rec++;
+      if (k < 5)
+         continue;
+      if ((chrom = vcf_chrom(m, f[0], (long)(f[1] - 1 - f[0]))) < 0)
+         continue;
+      for (pos = 0, fe = f[1]; fe < f[2] - 1 && *fe >= '0' && *fe <= '9'; fe++)
+         pos = pos * 10 + (*fe - '0');
+      if (f[4] - 1 - f[3] != 1 || !(rb = base_code[(unsigned char)*f[3]]) || pos < 1)
+         continue;
+
+      /* every one base ALT allele                                      */
+      first = r->nhit;
+      fe = vcf_field_end(f[4], le);
+      for (alt = f[4], a = 1; alt < fe; alt = ae + 1, a++)
+      {
+         for (ae = alt; ae < fe && *ae != ','; ae++)
+            ;
+         if (ae - alt == 1 && base_code[(unsigned char)*alt])
+            if (vcf_place(m, ps, rec - 1, a, chrom, pos - 1, rb,
+                          base_code[(unsigned char)*alt]))
+               return 1;
+      }
+
+      if (!m->samples || r->nhit == first || k < 8 || f[8] >= le)
+         continue;
+      for (i = first; i < r->nhit && r->status[i] != VCF_OK; i++)
+         ;
+      if (i == r->nhit)
+         continue;
+      if ((gt = vcf_gt_index(f[8], vcf_field_end(f[8], le))) < 0)
+         continue;
+      fe = vcf_field_end(f[8], le);
+      if (fe < le && vcf_samples(ps, fe + 1, le, gt, first))
+         return 1;
+   }
+   r->nrec = rec;
+   return 0;
+}
+
+static int vcf_car_cmp(const void *a, const void *b)
+{
+   const VCF_CARRIER *x = (const VCF_CARRIER *)a, *y = (const VCF_CARRIER *)b;
+
+   if (x->gene != y->gene)
+      return x->gene < y->gene ? -1 : 1;
+   if (x->sample != y->sample)
+      return x->sample < y->sample ? -1 : 1;
+   if (x->hap != y->hap)
+      return x->hap < y->hap ? -1 : 1;
+   if (x->pos != y->pos)
+      return x->pos < y->pos ? -1 : 1;
+   return (x->hit > y->hit) - (x->hit < y->hit);
+}
+
+static void vcf_range(long start, long end, void *varg)
+{
+   VCF_JOB *job = (VCF_JOB *)varg;
+   VCF_MODEL_STRUCT *m = job->model;
+   VCF_RESULT_STRUCT *r = job->res;
+   SCAN_REF_STRUCT *sr = job->sr;
+   SCAN_GENE_STRUCT g;
+   const VCF_CARRIER *c;
+   double base[SCAN_NMETRIC], sigma;
+   int *moves = NULL, nmove, x, y, k;
+   long gene, i, h, grp, cstart;
+
+   if (job->max_group && !(moves = (int *)malloc(sizeof(int) * 2 * job->max_group)))
+   {
+      job->status = 1;
+      return;
+   }
+
+   for (gene = start; gene < end; gene++)
+   {
+      if (job->gene_hit[gene] == job->gene_hit[gene + 1])
+         continue;
+      scan_gene_init(&g, m->cds + m->cds_off[gene],
+                     (long)(m->cds_off[gene + 1] - m->cds_off[gene]), sr);
+      scan_values(&g, sr, base);
+
+      for (i = job->gene_hit[gene]; i < job->gene_hit[gene + 1]; i++)
+      {
+         h = job->order[i];
+         if (r->status[h] != VCF_OK)
+            for (k = 0; k < SCAN_NMETRIC; k++)
+               r->delta[h * SCAN_NMETRIC + k] = NAN;
+         else
+            scan_delta(&g, base, r->from[h], r->to[h], sr, r->delta + h * SCAN_NMETRIC);
+      }
+
+      /* each haplotype: the codons it changes, moved together           */
+      for (grp = job->gene_group[gene]; grp < job->gene_group[gene + 1]; grp++)
+      {
+         sigma = g.sigma;
+         nmove = 0;
+         x = y = 0;
+         cstart = -1;
+         for (i = job->group[grp]; i <= job->group[grp + 1]; i++)
+         {
+            c = i < job->group[grp + 1] ? job->car + i : NULL;
+            if (!c || c->pos - c->pos % 3 != cstart)
+            {
+               if (cstart >= 0 && y != x)
+               {
+                  scan_move(&g, x, y, sr);
+                  moves[2 * nmove] = x;
+                  moves[2 * nmove + 1] = y;
+                  nmove++;
+               }
+               if (!c)
+                  break;
+               cstart = c->pos - c->pos % 3;
+               x = y = r->from[c->hit];
+            }
+            y = vcf_codon_with(y, (int)(c->pos % 3), job->alt[c->hit]);
+         }
+
+         c = job->car + job->group[grp];
+         r->hap_sample[grp] = c->sample;
+         r->hap[grp] = c->hap;
+         r->hap_gene[grp] = c->gene;
+         r->hap_nvar[grp] = (int32_t)(job->group[grp + 1] - job->group[grp]);
+         scan_values(&g, sr, r->hap_delta + grp * SCAN_NMETRIC);
+         for (k = 0; k < SCAN_NMETRIC; k++)
+            r->hap_delta[grp * SCAN_NMETRIC + k] -= base[k];
+         while (nmove--)
+            scan_move(&g, moves[2 * nmove + 1], moves[2 * nmove], sr);
+         g.sigma = sigma;
+      }
+   }
+   free(moves);
+}
+
+/****************** Start reading a VCF       *****************************/
+/* Returns the state of a VCF annotated on the genes of model into res    */
+/* (to be released by vcf_free), NULL if out of memory                    */
+/**************************************************************************/
+VCF_PARSE_STRUCT *vcf_open(VCF_MODEL_STRUCT *model, VCF_RESULT_STRUCT *res)
+{
+   VCF_PARSE *ps;
+   long i;
+
+   memset(res, 0, sizeof(VCF_RESULT_STRUCT));
+   if (!(ps = (VCF_PARSE *)calloc(1, sizeof(VCF_PARSE))))
+      return NULL;
+   ps->model = model;
+   ps->res = res;
+
+   model->max_exon = 0;
+   for (i = 0; i < model->nexon; i++)
+      if (model->exon_end[i] - model->exon_start[i] > model->max_exon)
+         model->max_exon = model->exon_end[i] - model->exon_start[i];
+   return ps;
+}
+
+/****************** Read VCF lines            *****************************/
+/* Places the variants of the len bytes of whole VCF lines at buf, record */
+/* numbers following on from earlier blocks                               */
+/**************************************************************************/
+int vcf_feed(VCF_PARSE_STRUCT *ps, const char *buf, long len)
+{
+   if (vcf_read(buf, len, ps->model, ps))
+   {
+      fprintf(stderr, "Out of memory reading variants\n");
+      return 1;
+   }
+   return 0;
+}
+
+/****************** Annotate the variants read ****************************/
+/* Fills res with the index changes of the variants fed to ps and, with   */
+/* model->samples, those of each haplotype                                */
+/**************************************************************************/
+int vcf_finish(VCF_PARSE_STRUCT *ps, METRIC_REF_STRUCT *ref, int nthreads)
+{
+   VCF_MODEL_STRUCT *model = ps->model;
+   VCF_RESULT_STRUCT *res = ps->res;
+   SCAN_REF_STRUCT sr;
+   VCF_JOB job;
+   long *order = NULL, *gene_hit = NULL, *group = NULL, *gene_group = NULL, *fill = NULL;
+   long i, ngroup, ng = model->ngene;
+   int ret = 1;
+
+   memset(&job, 0, sizeof(job));
+
+   /* hits by gene, a counting sort that keeps the VCF order            */
+   if (!(order = (long *)malloc(sizeof(long) * (res->nhit + 1))) ||
+       !(gene_hit = (long *)calloc(ng + 1, sizeof(long))) ||
+       !(fill = (long *)malloc(sizeof(long) * (ng + 1))) ||
+       !(res->delta = (double *)malloc(sizeof(double) * SCAN_NMETRIC * (res->nhit + 1))))
+      goto done;
+   for (i = 0; i < res->nhit; i++)
+      gene_hit[res->gene[i] + 1]++;
+   for (i = 0; i < ng; i++)
+      gene_hit[i + 1] += gene_hit[i];
+   memcpy(fill, gene_hit, sizeof(long) * (ng + 1));
+   for (i = 0; i < res->nhit; i++)
+      order[fill[res->gene[i]]++] = i;
+
+   /* carriers by gene, sample and haplotype: one group per haplotype   */
+   if (ps->ncar)
+      qsort(ps->car, ps->ncar, sizeof(VCF_CARRIER), vcf_car_cmp);
+   if (!(group = (long *)malloc(sizeof(long) * (ps->ncar + 1))) ||
+       !(gene_group = (long *)calloc(ng + 1, sizeof(long))))
+      goto done;
+   for (i = 0, ngroup = 0; i < ps->ncar; i++)
+      if (!i || ps->car[i].gene != ps->car[i - 1].gene ||
+          ps->car[i].sample != ps->car[i - 1].sample || ps->car[i].hap != ps->car[i - 1].hap)
+      {
+         if (ngroup && i - group[ngroup - 1] > job.max_group)
+            job.max_group = i - group[ngroup - 1];
+         group[ngroup++] = i;
+         gene_group[ps->car[i].gene + 1]++;
+      }
+   group[ngroup] = ps->ncar;
+   if (ngroup && ps->ncar - group[ngroup - 1] > job.max_group)
+      job.max_group = ps->ncar - group[ngroup - 1];
+   for (i = 0; i < ng; i++)
+      gene_group[i + 1] += gene_group[i];
+
+   res->nhap = ngroup;
+   if (!(res->hap_sample = (int32_t *)malloc(sizeof(int32_t) * (ngroup + 1))) ||
+       !(res->hap = (int8_t *)malloc(sizeof(int8_t) * (ngroup + 1))) ||
+       !(res->hap_gene = (int32_t *)malloc(sizeof(int32_t) * (ngroup + 1))) ||
+       !(res->hap_nvar = (int32_t *)malloc(sizeof(int32_t) * (ngroup + 1))) ||
+       !(res->hap_delta = (double *)malloc(sizeof(double) * SCAN_NMETRIC * (ngroup + 1))))
+      goto done;
+
+   scan_ref_init(&sr, ref);
+   job.model = model;
+   job.sr = &sr;
+   job.res = res;
+   job.alt = ps->alt;
+   job.order = order;
+   job.gene_hit = gene_hit;
+   job.car = ps->car;
+   job.group = group;
+   job.gene_group = gene_group;
+   par_for(ng, nthreads, vcf_range, &job);
+   ret = job.status;
+
+done:
+   if (ret)
+      fprintf(stderr, "Out of memory annotating variants\n");
+   free(order);
+   free(gene_hit);
+   free(fill);
+   free(group);
+   free(gene_group);
+   return ret;
+}
+
+/****************** Stop reading a VCF        *****************************/
+/* Releases ps (not its result)                                           */
+/**************************************************************************/
+void vcf_close(VCF_PARSE_STRUCT *ps)
+{
+   if (!ps)
+      return;
+   free(ps->alt);
+   free(ps->car);
+   free(ps);
+}
+
+/****************** Annotate a VCF            *****************************/
+/* vcf_open, vcf_feed and vcf_finish for the len bytes of VCF text at buf */
+/**************************************************************************/
+int vcf_annotate(const char *buf, long len, VCF_MODEL_STRUCT *model, METRIC_REF_STRUCT *ref,
+                 VCF_RESULT_STRUCT *res, int nthreads)
+{
+   VCF_PARSE_STRUCT *ps = vcf_open(model, res);
+   int ret;
+
+   if (!ps)
+   {
+      fprintf(stderr, "Out of memory reading variants\n");
+      return 1;
+   }
+   ret = vcf_feed(ps, buf, len) || vcf_finish(ps, ref, nthreads);
+   vcf_close(ps);
+   return ret;
+}
+
+/****************** Release a result          *****************************/
+void vcf_free(VCF_RESULT_STRUCT *res)
+{
+   free(res->rec);
+   free(res->vcf_pos);
+   free(res->chrom);
+   free(res->allele);
+   free(res->gene);
+   free(res->pos);
+   free(res->from);
+   free(res->to);
+   free(res->status);
+   free(res->delta);
+   free(res->hap_sample);
+   free(res->hap);
+   free(res->hap_gene);
+   free(res->hap_nvar);
+   free(res->hap_delta);
+   memset(res, 0, sizeof(VCF_RESULT_STRUCT));
+}
@@ -0,0 +1,171 @@
+/*************************************************************************
+
+CodonW codon usage analysis package
+
+    Copyright (C) 2005            John F. Peden
+    Copyright (C) 2020            Shyam Saladi
+
+This program is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; version 2 of the License.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+675 Mass Ave, Cambridge, MA 02139, USA.
+
+*************************************************************************
+
+This file contains the codon usage of whole transcriptomes: the codon
+counts of n genes (an n x 65 matrix, as codon_usage_tot counts them)
+weighted by the expression of each gene in each of s samples (an n x s
+matrix of e.g. TPM or ribosome densities), which is the product
+W' C of the two matrices.
+
+The product is taken in blocks as a matrix multiplication would be,
+WUSAGE_GENES rows of counts being used by every block of WUSAGE_SAMPLES
+samples a thread owns while they are in cache, and the 65 sums of each
+sample in a block staying in L1. Sums are in double precision whatever
+the counts. Amino acid usage, RSCU and the indices of metric_row_frac
+(codon_metrics.c) are then taken from each sample's table.
+
+************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "../include/codonW.h"
+
+typedef struct
+{
+   const double *ncod;
+   long n;
+   const double *w;
+   long nsample;
+   METRIC_REF_STRUCT *ref;
+   const int *which;
+   int nwhich;
+   double *usage;
+   double *naa;
+   double *rscu;
+   double *out;
+   int status;
+} WUSAGE_JOB;
+
+/* adds the weighted counts of genes [g0, g1) to samples [s0, s1), four   */
+/* genes at a time so that each sum is loaded and stored once for them    */
+static void wusage_block(WUSAGE_JOB *job, long g0, long g1, long s0, long s1)
+{
+   const double *c0, *c1, *c2, *c3, *w;
+   const long ns = job->nsample;
+   double *u, w0, w1, w2, w3;
+   long i, j;
+   int x;
+
+   for (i = g0; i + 3 < g1; i += 4)
+   {
+      c0 = job->ncod + i * 65;
+      c1 = c0 + 65;
+      c2 = c1 + 65;
+      c3 = c2 + 65;
+      w = job->w + i * ns;
+      for (j = s0; j < s1; j++)
+      {
+         w0 = w[j];
+         w1 = w[ns + j];
+         w2 = w[2 * ns + j];
+         w3 = w[3 * ns + j];
+         if (w0 == 0 && w1 == 0 && w2 == 0 && w3 == 0)
+            continue;
+         u = job->usage + j * 65;
+         for (x = 0; x < 65; x++)
+            u[x] += w0 * c0[x] + w1 * c1[x] + w2 * c2[x] + w3 * c3[x];
+      }
+   }
+   for (; i < g1; i++)
+   {
+      c0 = job->ncod + i * 65;
+      w = job->w + i * ns;
+      for (j = s0; j < s1; j++)
+      {
+         if ((w0 = w[j]) == 0)
+            continue;
+         u = job->usage + j * 65;
+         for (x = 0; x < 65; x++)
+            u[x] += w0 * c0[x];
+      }
+   }
+}
+
+/* amino acid usage, RSCU and indices of the table of sample j           */
+static int wusage_derive(WUSAGE_JOB *job, long j)
+{
+   METRIC_REF_STRUCT *ref = job->ref;
+   const double *u = job->usage + j * 65;
+   double *naa = job->naa + j * 22, *rscu = job->rscu + j * 65, v;
+   int x;
+
+   count_amino_acids_frac(u, naa, &ref->code);
+   rscu[0] = 0;
+   for (x = 1; x < 65; x++)
+   {
+      v = naa[ref->code.ca[x]];
+      rscu[x] = v != 0 ? u[x] / v * ref->ds[x] : 0;
+   }
+   return metric_row_frac(u, ref, job->which, job->nwhich, job->out + j * job->nwhich);
+}
+
+static void wusage_range(long start, long end, void *varg)
+{
+   WUSAGE_JOB *job = (WUSAGE_JOB *)varg;
+   long s0 = start * WUSAGE_SAMPLES;
+   long s1 = end * WUSAGE_SAMPLES < job->nsample ? end * WUSAGE_SAMPLES : job->nsample;
+   long g, b, j;
+
+   memset(job->usage + s0 * 65, 0, sizeof(double) * 65 * (s1 - s0));
+   for (g = 0; g < job->n; g += WUSAGE_GENES)
+      for (b = s0; b < s1; b += WUSAGE_SAMPLES)
+         wusage_block(job, g, g + WUSAGE_GENES < job->n ? g + WUSAGE_GENES : job->n,
+                      b, b + WUSAGE_SAMPLES < s1 ? b + WUSAGE_SAMPLES : s1);
+
+   for (j = s0; j < s1; j++)
+      if (wusage_derive(job, j))
+         job->status = 1;
+}
+
+/****************** Expression weighted usage *****************************/
+/* For n x 65 codon counts ncod and n x nsample weights w (both row       */
+/* major), writes the weighted codon usage (nsample x 65), amino acid     */
+/* usage (nsample x 22), RSCU (nsample x 65, 0 for untranslatable codons) */
+/* and nwhich indices (METRIC_*) of each sample                           */
+/**************************************************************************/
+int wusage_batch(const double *ncod, long n, const double *w, long nsample, METRIC_REF_STRUCT *ref,
+                 const int *which, int nwhich, double *usage, double *naa, double *rscu, double *out,
+                 int nthreads)
+{
+   WUSAGE_JOB job;
+
+   memset(&job, 0, sizeof(job));
+   job.ncod = ncod;
+   job.n = n;
+   job.w = w;
+   job.nsample = nsample;
+   job.ref = ref;
+   job.which = which;
+   job.nwhich = nwhich;
+   job.usage = usage;
+   job.naa = naa;
+   job.rscu = rscu;
+   job.out = out;
+   par_for((nsample + WUSAGE_SAMPLES - 1) / WUSAGE_SAMPLES, nthreads, wusage_range, &job);
+
+   if (job.status)
+      fprintf(stderr, "Illegal Fop or CBI reference values\n");
+   return job.status;
+}
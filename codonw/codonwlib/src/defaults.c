@@ -307,7 +307,7 @@ AMINO_PROP_STRUCT amino_prop = {
     }
 };
 
-MENU_STRUCT Z_menu = {
+const MENU_STRUCT Z_menu = {
     'X',   /*This default is set in proc_commline to CU        */
     false, /*totals                                            */
     true,  /*warnings about sequence data are to be displayed  */
@@ -349,7 +349,13 @@ MENU_STRUCT Z_menu = {
     NULL,
     NULL,
     NULL,
-    NULL
+
+    {0}, /* dds, filled in by initialize_point               */
+    {0}, /* dda                                              */
+    false, /* raau header written                            */
+    false, /* aa header                                      */
+    false, /* gc header                                      */
+    false  /* dinuc header                                   */
 };
 
 REF_STRUCT Z_ref = {
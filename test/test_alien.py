@@ -0,0 +1,69 @@
+"""
+
+codonw-slim tests of gene vs genome codon usage differences
+
+"""
+
+import numpy as np
+
+import codonw
+
+from test_regression import seq_fn, test_seqs
+
+
+def reference_scores(counts, leave_one_out, pseudo=0.5, ridge=1e-3):
+    code = codonw.CodonSeq("ATG").genetic_code.values
+    sense = np.where(code != '*')[0]
+    sense = sense[sense > 0]
+    aas = code[sense]
+    genes = counts[:, sense].astype(float)
+    freqs = genes / genes.sum(axis=1, keepdims=True)
+    n = len(genes)
+    var = np.mean(np.diag(np.cov(freqs, rowvar=False)))
+    if leave_one_out:
+        var *= (n - 1) / (n - 2)
+
+    scores = []
+    for i, g in enumerate(genes):
+        back = genes.sum(axis=0) - (g if leave_one_out else 0)
+        b = 0
+        for aa in set(aas):
+            m = aas == aa
+            if g[m].sum() > 0:
+                fb = back[m] / back[m].sum() if back[m].sum() else 0
+                b += g[m].sum() / g.sum() * np.abs(g[m] / g[m].sum() - fb).sum()
+        f = g / g.sum()
+        fb = (back + pseudo) / (back.sum() + pseudo * len(back))
+        kl = np.sum(f[f > 0] * np.log(f[f > 0] / fb[f > 0]))
+
+        # the ridge is always relative to the variance of all genes
+        others = np.delete(freqs, i, axis=0) if leave_one_out else freqs
+        cov = np.cov(others, rowvar=False)
+        cov += np.eye(len(cov)) * ridge * var
+        d = freqs[i] - others.mean(axis=0)
+        scores.append([b, kl, np.sqrt(d @ np.linalg.solve(cov, d))])
+    return np.array(scores)
+
+
+def test_gene_vs_genome():
+    counts = codonw.count_codons(test_seqs)
+
+    bg = codonw.GenomeBackground()
+    bg.add(counts[:50])
+    bg.add(counts[50:])
+    assert bg.n_genes == len(test_seqs)
+    assert bg.codon_usage().sum() == counts[:, 1:].sum()
+
+    for loo in [False, True]:
+        ref = reference_scores(counts, loo)
+        np.testing.assert_allclose(bg.score(counts, leave_one_out=loo).values, ref,
+                                   rtol=1e-6)
+
+
+def test_alien_scores_from_fasta():
+    scores = codonw.alien_scores(seq_fn)
+    assert scores.shape == (len(test_seqs), 3)
+    assert list(scores.index.str.split(' ').str[0]) == list(test_seqs.index)
+
+    ref = reference_scores(codonw.count_codons(test_seqs), True)
+    np.testing.assert_allclose(scores.values, ref, rtol=1e-6)
@@ -0,0 +1,48 @@
+"""
+
+codonw-slim arena allocator tests
+
+"""
+
+import numpy as np
+import pandas as pd
+import pytest
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def test_arena_arrays():
+    arena = codonw.Arena(1 << 20)
+    a = arena.array([3, 5], np.int32)
+    b = arena.array(7, np.float64, zero=False)
+    assert a.shape == (3, 5) and not a.any()
+    assert a.ctypes.data % 64 == 0 and b.ctypes.data % 64 == 0
+    assert b.ctypes.data - a.ctypes.data == 64
+    a[:] = 1
+    assert arena.used == 64 + 7 * 8
+
+    with pytest.raises(BufferError):
+        arena.reset()
+    del a, b
+    arena.reset()
+    assert arena.used == 0
+
+    with pytest.raises(MemoryError):
+        arena.array(1 << 20, np.float64)
+
+
+def test_arena_batches():
+    arena = codonw.Arena()
+    for _ in range(3):
+        arena.reset()
+        counts = codonw.count_codons(test_seqs, arena=arena)
+        np.testing.assert_array_equal(counts, codonw.count_codons(test_seqs))
+        res = codonw.compute_metrics(test_seqs, nthreads=2, arena=arena)
+        pd.testing.assert_frame_equal(res, codonw.compute_metrics(test_seqs))
+        # the results are views of the arena, not copies
+        with pytest.raises(BufferError):
+            arena.reset()
+        assert arena.used >= res.values.nbytes + counts.nbytes
+        del counts, res
@@ -0,0 +1,64 @@
+"""
+
+codonw-slim Arrow partition tests
+
+"""
+
+import numpy as np
+import pandas as pd
+import pytest
+
+import codonw
+
+from test_regression import test_seqs
+
+pa = pytest.importorskip("pyarrow")
+
+metrics = ["CAI", "Fop", "Nc", "GC3s"]
+
+
+def test_arrow_metrics():
+    ref = codonw.compute_metrics(test_seqs, metrics=metrics)
+
+    arr = pa.array(list(test_seqs))
+    res = codonw.arrow_metrics(arr, metrics=metrics)
+    assert res.column_names == metrics
+    np.testing.assert_allclose(res.to_pandas().values, ref.values)
+
+    # large offsets, slices, chunks and tables give the same rows
+    res = codonw.arrow_metrics(arr.cast(pa.large_string())[3:], metrics=metrics)
+    np.testing.assert_allclose(res.to_pandas().values, ref.values[3:])
+    chunked = pa.chunked_array([arr[:5], arr[5:]])
+    res = codonw.arrow_metrics(pa.table({"cds": chunked}), column="cds", metrics=metrics)
+    np.testing.assert_allclose(res.to_pandas().values, ref.values)
+
+    # optimal codons as a list, as compute_metrics takes them
+    optimal = ["CUG", "AAA", "GAA", "CGU", "ACC", "GGU", "UUC", "CAG", "GAU", "AAC"]
+    res = codonw.arrow_metrics(arr, metrics=["Fop", "CBI"], fop_ref=optimal)
+    ref = codonw.compute_metrics(test_seqs, metrics=["Fop", "CBI"], fop_ref=optimal)
+    np.testing.assert_allclose(res.to_pandas().values, ref.values)
+
+
+def test_arrow_nulls():
+    arr = pa.array([test_seqs.iloc[0], None, test_seqs.iloc[1]])
+    res = codonw.arrow_metrics(arr, metrics="CAI").column("CAI")
+    assert res.null_count == 1 and res[1].as_py() is None
+    np.testing.assert_allclose([res[0].as_py(), res[2].as_py()],
+                               [codonw.CodonSeq(s).cai() for s in test_seqs.iloc[:2]])
+
+
+def test_partition_metrics():
+    df = pd.DataFrame({"seq": pd.array(list(test_seqs), dtype="string[pyarrow]")},
+                      index=test_seqs.index)
+    res = codonw.partition_metrics(df, metrics=metrics)
+    pd.testing.assert_frame_equal(res, codonw.compute_metrics(test_seqs, metrics=metrics),
+                                  check_names=False)
+
+
+def test_polars_metrics():
+    pl = pytest.importorskip("polars")
+    df = pl.DataFrame({"seq": list(test_seqs)})
+    res = df.select(codonw.polars_metrics("seq", metrics).alias("idx")).unnest("idx")
+    assert res.columns == metrics
+    np.testing.assert_allclose(res.to_numpy(),
+                               codonw.compute_metrics(test_seqs, metrics=metrics).values)
@@ -0,0 +1,87 @@
+"""
+
+codonw-slim asyncio streaming tests
+
+"""
+
+import asyncio
+import time
+
+import numpy as np
+import pandas as pd
+
+import codonw
+
+from test_regression import seq_fn, test_seqs
+from test_serve import expected
+
+
+def test_compute_metrics():
+    res = codonw.compute_metrics(test_seqs, nthreads=2)
+    assert list(res.columns) == codonw.ref_metrics
+    assert (res.index == test_seqs.index).all()
+    np.testing.assert_allclose(res.values, expected(test_seqs), rtol=1e-6)
+
+
+def test_astream():
+    async def run(source, **kwargs):
+        return [df async for df in codonw.astream(source, **kwargs)]
+
+    ref = codonw.compute_metrics(test_seqs, metrics=["CAI", "Nc", "GC3s"])
+
+    res = asyncio.run(run(test_seqs, metrics=["CAI", "Nc", "GC3s"], batch_size=6))
+    assert [len(df) for df in res[:-1]] == [6] * (len(res) - 1)
+    pd.testing.assert_frame_equal(pd.concat(res), ref)
+
+    res = asyncio.run(run(seq_fn, metrics=["CAI", "Nc", "GC3s"]))
+    np.testing.assert_allclose(pd.concat(res).values, ref.values)
+
+    res = asyncio.run(run(test_seqs, metrics="Fop", fop_ref=["CUG", "AAA"]))
+    pd.testing.assert_frame_equal(pd.concat(res),
+                                  codonw.compute_metrics(test_seqs, "Fop", fop_ref=["CUG", "AAA"]))
+
+
+def test_astream_backpressure():
+    pulled = []
+
+    async def source():
+        for name, seq in test_seqs.items():
+            pulled.append(name)
+            yield name, seq
+
+    async def run():
+        ahead = []
+        async for df in codonw.astream(source(), metrics="CAI", batch_size=4, max_pending=2):
+            ahead.append(len(pulled))
+            await asyncio.sleep(0)
+        return ahead
+
+    ahead = asyncio.run(run())
+    # no more than max_pending batches are read before the first is used
+    assert ahead[0] <= 4 * 2
+    assert len(pulled) == len(test_seqs)
+
+
+def test_astream_after_abandoned_stream():
+    async def first():
+        async for df in codonw.astream(list(test_seqs) * 1600, metrics="CAI", batch_size=20000,
+                                       max_pending=8):
+            break
+
+    async def source():
+        for i, item in enumerate(test_seqs.items()):
+            if i == 20:
+                # blocks the loop, so that its next poll collects batches of both runs
+                time.sleep(0.2)
+            yield item
+
+    async def second():
+        return [df async for df in codonw.astream(source(), metrics="CAI", batch_size=20,
+                                                  max_pending=2)]
+
+    # the loop of the first run closes with batches still in the pool, which
+    # finish before the second run starts
+    asyncio.run(first())
+    time.sleep(2)
+    res = asyncio.run(asyncio.wait_for(second(), 10))
+    pd.testing.assert_frame_equal(pd.concat(res), codonw.compute_metrics(test_seqs, "CAI"))
@@ -0,0 +1,53 @@
+"""
+
+codonw-slim tests of functions working on many sequences at once
+
+"""
+
+import io
+
+import numpy as np
+import pandas as pd
+import pytest
+
+import codonw
+
+from test_regression import seq_fn, test_seqs
+
+
+def test_count_codons():
+    counts = codonw.count_codons(test_seqs, nthreads=3)
+    ref = np.vstack([np.asarray(codonw.CodonSeq(s).ncod) for s in test_seqs])
+    np.testing.assert_array_equal(counts, ref)
+
+    # short and partial sequences
+    counts = codonw.count_codons(["", "A", "ATGA", "atgNNN"])
+    assert counts.sum(axis=1).tolist() == [0, 1, 2, 2]
+    assert counts[3, 0] == 1 and counts[3, 1:].sum() == 1
+
+
+def test_read_fasta():
+    batches = list(codonw.read_fasta(seq_fn, batch_bytes=4096))
+    assert len(batches) > 1
+    seqs = pd.concat([b.to_series() for b in batches])
+    seqs.index = seqs.index.str.split(' ').str[0]
+    pd.testing.assert_series_equal(seqs, test_seqs, check_names=False)
+
+    fh = io.BytesIO(b"junk\n>a x\r\nAC G\r\nT\n>b\n\n>c\nGG")
+    batch = next(codonw.read_fasta(fh))
+    assert batch.names == ["a x", "b", "c"]
+    assert list(batch) == ["ACGT", "", "GG"]
+
+
+def test_compute_metrics_mixed_codes():
+    codes = np.arange(len(test_seqs)) % 8
+    res = codonw.compute_metrics(test_seqs, genetic_code=codes, cai_ref=1, fop_ref=2, nthreads=2)
+    for code in range(8):
+        sel = codes == code
+        ref = codonw.compute_metrics(test_seqs[sel], genetic_code=code, cai_ref=1, fop_ref=2)
+        pd.testing.assert_frame_equal(res[sel], ref)
+
+    with pytest.raises(ValueError):
+        codonw.compute_metrics(test_seqs, genetic_code=codes[1:])
+    with pytest.raises(ValueError):
+        codonw.compute_metrics(test_seqs, genetic_code=codes + 8)
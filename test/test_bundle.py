@@ -0,0 +1,86 @@
+"""
+
+codonw-slim memory-mapped reference bundles
+
+"""
+
+import numpy as np
+import pandas as pd
+import pytest
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def test_builtin_bundle(tmp_path):
+    path = tmp_path / "refs.bundle"
+    codonw.write_ref_bundle(path, version=3)
+    bundle = codonw.RefBundle(path)
+
+    assert bundle.version == 3
+    assert len(bundle.names("genetic_code")) == 8
+    assert bundle.names("cai")[0] == "Escherichia coli"
+    assert bundle.names("aa_properties") == ["codonW"]
+
+    expected = codonw.compute_metrics(test_seqs, genetic_code=1, cai_ref=2, fop_ref=3)
+    df = codonw.compute_metrics(test_seqs, bundle=bundle, genetic_code=1,
+                                cai_ref=bundle.names("cai")[2], fop_ref=3)
+    pd.testing.assert_frame_equal(df, expected)
+
+    pd.testing.assert_series_equal(bundle.genetic_code(4), codonw.get_reference_code(4),
+                                   check_names=False)
+    with pytest.raises(KeyError):
+        bundle.cai_weights("no such species")
+    with pytest.raises(ValueError):
+        codonw.compute_metrics(test_seqs, bundle=bundle, genetic_code=[0] * len(test_seqs))
+
+
+def test_custom_tables_and_reload(tmp_path):
+    counts = codonw.count_codons(test_seqs)
+    weights = codonw.usage_weights(counts.sum(axis=0))
+    path = tmp_path / "refs.bundle"
+    codonw.write_ref_bundle(
+        path, cai_refs={"genome": weights}, fop_refs={"ecoli": 0, "two": ["GCU", "GGC"]},
+        aa_properties={"flat": {"hydro": pd.Series(1.0, index=codonw.ref_aa3[1:])}},
+        genetic_codes={"bact": "FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG"},
+        builtins=False)
+    bundle = codonw.RefBundle(path)
+    assert bundle.names("fop") == ["ecoli", "two"]
+    assert bundle.codon_classes("two")["GCU"] == 3
+
+    df = codonw.compute_metrics(test_seqs, bundle=bundle, genetic_code="bact",
+                                cai_ref="genome", fop_ref="ecoli", aa_properties="flat")
+    expected = codonw.compute_metrics(test_seqs, cai_ref=weights)
+    np.testing.assert_allclose(df["CAI"], expected["CAI"], rtol=1e-6)
+    np.testing.assert_allclose(df["Fop"], expected["Fop"])
+    np.testing.assert_allclose(df["Gravy"], 1, rtol=1e-6)
+    np.testing.assert_array_equal(df["Aromo"], expected["Aromo"])
+
+    # a new file swapped in under the same names
+    codonw.write_ref_bundle(tmp_path / "new.bundle", version=2, cai_refs={"genome": 0},
+                            builtins=True)
+    bundle.reload(tmp_path / "new.bundle")
+    assert bundle.version == 2
+    df = codonw.compute_metrics(test_seqs, bundle=bundle, cai_ref="genome")
+    np.testing.assert_array_equal(df["CAI"], codonw.compute_metrics(test_seqs)["CAI"])
+
+
+def test_not_a_bundle(tmp_path):
+    path = tmp_path / "junk"
+    path.write_bytes(b"x" * 4096)
+    with pytest.raises(IOError):
+        codonw.RefBundle(path)
+
+
+def test_corrupt_records(tmp_path):
+    path = tmp_path / "refs.bundle"
+    codonw.write_ref_bundle(path)
+    good = path.read_bytes()
+    # first genetic code record: 256 byte header, 64 byte name, then ca[65]
+    for offset, value in [(256 + 64 + 4, 99), (256 + 64 + 4, 2), (256 + 63, ord("x"))]:
+        data = bytearray(good)
+        data[offset] = value
+        path.write_bytes(bytes(data))
+        with pytest.raises(IOError):
+            codonw.RefBundle(path)
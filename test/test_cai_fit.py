@@ -0,0 +1,56 @@
+"""
+
+codonw-slim reference-free CAI tests
+
+"""
+
+import numpy as np
+import pandas as pd
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def weights(pool, aa):
+    most = pd.Series(pool).groupby(aa).transform("max").values
+    return np.divide(pool, most, out=np.zeros(64), where=most > 0)
+
+
+def numpy_cai(counts, w, used):
+    logw = np.log(np.where(w < 0.0001, 0.01, w.astype(np.float32)))
+    n = counts[:, used]
+    tot = n.sum(axis=1)
+    return np.exp((n * logw[used]).sum(axis=1) / np.maximum(tot, 1)) * (tot > 0)
+
+
+def test_fit_cai_weights():
+    counts = codonw.count_codons(test_seqs)[:, 1:]
+    code = codonw.CodonSeq("ATG").genetic_code[1:]
+    aa = code.values
+    used = np.array([code[c] != '*' and (code == code[c]).sum() > 1 for c in code.index])
+
+    w = codonw.fit_cai_weights(counts, top=0.1)
+
+    # the same rounds in numpy
+    nref = int(0.1 * len(counts))
+    ref_w, ref_set = weights(counts.sum(axis=0), aa), None
+    for _ in range(50):
+        cai = numpy_cai(counts, ref_w, used)
+        top = np.sort(np.lexsort((np.arange(len(cai)), -cai))[:nref])
+        if ref_set is not None and (top == ref_set).all():
+            break
+        ref_set = top
+        ref_w = weights(counts[top].sum(axis=0), aa)
+
+    assert w.attrs["converged"]
+    np.testing.assert_array_equal(w.attrs["reference"], ref_set)
+    np.testing.assert_allclose(w.values, ref_w, rtol=1e-6)
+    np.testing.assert_allclose(w.attrs["cai"], cai, rtol=1e-6)
+
+    # the weights are usable by CodonSeq.cai
+    for i in [0, 5, 17]:
+        seq = codonw.CodonSeq(test_seqs.iloc[i])
+        np.testing.assert_allclose(seq.cai(w), w.attrs["cai"][i], rtol=1e-6)
+        np.testing.assert_allclose(seq.cai(w.values), w.attrs["cai"][i], rtol=1e-6)
+    assert seq.cai(0) == seq.cai()
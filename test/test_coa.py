@@ -0,0 +1,59 @@
+"""
+
+codonw-slim streaming correspondence analysis tests
+
+"""
+
+import numpy as np
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def syn_columns():
+    code = codonw.CodonSeq("ATG").genetic_code
+    return [i for i, c in enumerate(code.index)
+            if i > 0 and code[c] != '*' and (code[1:] == code[c]).sum() > 1]
+
+
+def assert_same_axes(a, b, rtol=1e-6):
+    # axes are only defined up to sign
+    signs = np.sign(a[0]) * np.sign(b[0])
+    np.testing.assert_allclose(a, b * signs, rtol=rtol, atol=1e-8)
+
+
+def test_correspondence_analysis():
+    counts = codonw.count_codons(test_seqs)
+
+    coa = codonw.CodonCOA()
+    for i in range(0, len(counts), 17):
+        coa.partial_fit(counts[i:i + 17], nthreads=2)
+    coords = coa.transform(counts, naxes=3)
+
+    # CA by SVD of the standardised residuals
+    n = counts[:, syn_columns()].astype(float)
+    p = n / n.sum()
+    r, c = p.sum(axis=1), p.sum(axis=0)
+    s = (p - np.outer(r, c)) / np.sqrt(np.outer(r, c))
+    u, d, vt = np.linalg.svd(s, full_matrices=False)
+    ref = (u * d / np.sqrt(r)[:, None])[:, :3]
+
+    assert coa.n_genes == len(counts)
+    np.testing.assert_allclose(coa.inertia[:10], d[:10] ** 2, rtol=1e-6)
+    assert_same_axes(coords, ref)
+    assert_same_axes(coa.codon_coordinates(3).values, (vt.T * d / np.sqrt(c)[:, None])[:, :3])
+
+
+def test_rscu_pca():
+    counts = codonw.count_codons(test_seqs)
+    coa = codonw.CodonCOA("pca").partial_fit(counts[:60]).partial_fit(counts[60:])
+    coords = coa.transform(counts, naxes=2)
+
+    rscu = np.vstack([codonw.CodonSeq(s)._rscu() for s in test_seqs])[:, syn_columns()]
+    w, v = np.linalg.eigh(np.cov(rscu, rowvar=False))
+    w, v = w[::-1], v[:, ::-1]
+
+    np.testing.assert_allclose(coa.inertia[:5], w[:5], rtol=1e-5)
+    assert_same_axes(coords, (rscu - rscu.mean(axis=0)) @ v[:, :2], rtol=1e-4)
+    assert coa.axes(2).index.tolist() == coa.codons
@@ -0,0 +1,52 @@
+"""
+
+codonw-slim custom genetic code tests
+
+"""
+
+import pandas as pd
+import pytest
+
+import codonw
+
+from test_regression import test_seqs
+
+# NCBI translation tables 1 and 2
+standard = "FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG"
+vert_mito = "FFLLSSSSYY**CCWWLLLLPPPPHHQQRRRRIIMMTTTTNNKKSS**VVVVAAAADDEEGGGG"
+
+
+def test_ncbi_string():
+    for aas, code in [(standard, 0), (vert_mito, 1)]:
+        pd.testing.assert_series_equal(codonw.CodonSeq("ATG", aas).genetic_code,
+                                       codonw.CodonSeq("ATG", code).genetic_code,
+                                       check_names=False)
+        seq = test_seqs.iloc[0]
+        a, b = codonw.CodonSeq(seq, aas.lower()), codonw.CodonSeq(seq, code)
+        assert (a.enc(), a.cai(), a.fop()) == (b.enc(), b.cai(), b.fop())
+        pd.testing.assert_series_equal(a.aa_usage(), b.aa_usage())
+
+
+def test_dict_and_setter():
+    as_dict = {c.replace("T", "U"): aa for c, aa in zip(codonw.ncbi_codons, vert_mito)}
+    cs = codonw.CodonSeq(test_seqs.iloc[1])
+    cs.genetic_code = as_dict
+    ref = codonw.CodonSeq(test_seqs.iloc[1], 1)
+    assert cs.enc() == ref.enc()
+    pd.testing.assert_series_equal(cs.rscu(), ref.rscu())
+    pd.testing.assert_series_equal(cs.aa_usage(), ref.aa_usage())
+
+    cs.genetic_code = ref.genetic_code
+    assert cs.enc() == ref.enc()
+
+    res = codonw.compute_metrics(test_seqs, genetic_code=vert_mito)
+    pd.testing.assert_frame_equal(res, codonw.compute_metrics(test_seqs, genetic_code=1))
+
+
+def test_invalid_code():
+    with pytest.raises(ValueError):
+        codonw.CodonSeq("ATG", standard[:-1])
+    with pytest.raises(ValueError):
+        codonw.CodonSeq("ATG", standard[:-1] + "B")
+    with pytest.raises(ValueError):
+        codonw.CodonSeq("ATG", {"ATG": "M"})
@@ -0,0 +1,64 @@
+"""
+
+codonw-slim codon harmonisation
+
+"""
+
+import numpy as np
+import pandas as pd
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def translate(seq):
+    code = codonw.get_reference_code(0)
+    return "".join(code[seq[i:i + 3].upper().replace("T", "U")] for i in range(0, len(seq) - 2, 3))
+
+
+def reversed_usage(usage):
+    """usage with the ranks of codons reversed within each amino acid"""
+    code = codonw.get_reference_code(0)
+    host = usage.copy()
+    for aa, cods in pd.Series(code.index[1:], index=code.index[1:]).groupby(code.iloc[1:].values):
+        ranked = usage[cods].sort_values(kind="stable").index
+        host[list(ranked)] = usage[list(ranked[::-1])].values
+    return host
+
+
+def test_same_tables():
+    usage = pd.Series(codonw.count_codons(list(test_seqs)).sum(axis=0)[1:], index=codonw.ref_codons[1:])
+    harm = codonw.CodonHarmoniser(usage, usage)
+    assert (harm.mapping == harm.mapping.index).all()
+
+    df = harm.harmonise(test_seqs.iloc[:10])
+    assert list(df["seq"]) == list(test_seqs.iloc[:10])
+    assert (df["Changed"] == 0).all()
+    np.testing.assert_allclose(df["Similarity"], 1)
+    np.testing.assert_allclose(df["Similarity"], df["Native"])
+
+
+def test_reversed_ranks():
+    usage = pd.Series(codonw.count_codons(list(test_seqs)).sum(axis=0)[1:], index=codonw.ref_codons[1:])
+    host = reversed_usage(usage)
+    harm = codonw.CodonHarmoniser(usage, host)
+    code = codonw.get_reference_code(0)
+    # the most used codon of each amino acid becomes the host's favourite
+    for aa in "LSRV":
+        cods = code.index[code == aa]
+        assert harm.mapping[usage[cods].idxmax()] == host[cods].idxmax()
+
+    seqs = list(test_seqs.iloc[:10])
+    df = harm.harmonise(seqs, nthreads=2)
+    assert [translate(s) for s in df["seq"]] == [translate(s) for s in seqs]
+    assert (df["Changed"] > 0).all()
+    np.testing.assert_allclose(df["Similarity"], 1)
+    assert (df["Native"] < 0.9).all()
+
+    # untranslatable codons and case are kept
+    out = harm.harmonise(["ctgNNNCTG", "AT"])
+    assert out["seq"][0] == harm.mapping["CUG"].replace("U", "T").lower() + "NNN" + \
+        harm.mapping["CUG"].replace("U", "T")
+    assert out["seq"][1] == "AT"
+    assert np.isnan(out["Similarity"][1])
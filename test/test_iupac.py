@@ -0,0 +1,56 @@
+"""
+
+codonw-slim fractional counting of ambiguous codons
+
+"""
+
+import numpy as np
+import pytest
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def test_fractional_counts():
+    counts = codonw.count_codons(["ATGACNAAR--AT", "nnn", "ATGAAA"], ambiguous=True)
+    assert counts.dtype == np.float64
+    idx = codonw.ref_codons.index
+
+    assert counts[0, idx("AUG")] == 1
+    for c in ["ACU", "ACC", "ACA", "ACG"]:
+        assert counts[0, idx(c)] == 0.25
+    assert counts[0, idx("AAA")] == counts[0, idx("AAG")] == 0.5
+    assert counts[0, 0] == 2  # gap codon and trailing partial codon
+    assert counts[0].sum() == 5
+
+    np.testing.assert_allclose(counts[1, 1:], 1 / 64)
+    np.testing.assert_array_equal(counts[2], codonw.count_codons(["ATGAAA"])[0])
+
+
+def test_unambiguous_metrics_match():
+    exact = codonw.compute_metrics(test_seqs)
+    frac = codonw.compute_metrics(test_seqs, ambiguous=True)
+    np.testing.assert_allclose(frac.values, exact.values, rtol=1e-5, atol=1e-6, equal_nan=True)
+
+    counts = codonw.count_codons(test_seqs)
+    fcounts = codonw.count_codons(test_seqs, ambiguous=True)
+    np.testing.assert_array_equal(fcounts, counts)
+    for f in ["cai", "fop", "cbi", "enc"]:
+        ufunc = getattr(codonw.ufuncs, f)
+        np.testing.assert_allclose(ufunc(fcounts), ufunc(counts), rtol=1e-5, atol=1e-6)
+    np.testing.assert_allclose(codonw.ufuncs.gc(fcounts), codonw.ufuncs.gc(counts),
+                               rtol=1e-12, equal_nan=True)
+
+
+def test_ambiguous_metrics():
+    seq = test_seqs.iloc[0]
+    masked = "".join("N" if i % 50 == 2 else b for i, b in enumerate(seq))
+    frac = codonw.compute_metrics([masked], ambiguous=True)
+    exact = codonw.compute_metrics([masked])
+    # the masked codons still count towards lengths, shared between codons
+    assert frac["L_aa"].iloc[0] > exact["L_aa"].iloc[0]
+    assert abs(frac["CAI"].iloc[0] - codonw.compute_metrics([seq])["CAI"].iloc[0]) < 0.05
+
+    with pytest.raises(ValueError):
+        codonw.compute_metrics([masked], genetic_code=[0], ambiguous=True)
@@ -0,0 +1,62 @@
+"""
+
+codonw-slim codon usage mixture model tests
+
+"""
+
+import numpy as np
+import pytest
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def numpy_em(x, group, logpi, logtheta, n_iter, pseudo):
+    for _ in range(n_iter):
+        l = logpi[None, :] + x @ logtheta.T
+        resp = np.exp(l - l.max(axis=1, keepdims=True))
+        resp /= resp.sum(axis=1, keepdims=True)
+        nk = resp.sum(axis=0)
+        logpi = np.log((nk + pseudo) / (nk.sum() + pseudo * len(nk)))
+        e = resp.T @ x + pseudo
+        sums = np.zeros((len(nk), 65))
+        for j, g in enumerate(group):
+            sums[:, g] += e[:, j]
+        logtheta = np.log(e / sums[:, group])
+    return logpi, logtheta
+
+
+def test_mixture_matches_numpy():
+    counts = codonw.count_codons(test_seqs)
+    for synonymous in [True, False]:
+        mix = codonw.CodonMixture(3, init=[("cai", 0), ("fop", 0)],
+                                  synonymous=synonymous, max_iter=25, tol=0)
+        start = mix._start(counts)
+        mix.fit(counts, nthreads=2)
+        assert mix.n_iter == 25 and not mix.converged
+
+        logpi, logtheta = numpy_em(counts[:, mix._cod].astype(float), mix._group,
+                                   np.full(3, -np.log(3)), start, 25, mix.pseudocount)
+        np.testing.assert_allclose(mix.weights, np.exp(logpi), rtol=1e-8)
+        np.testing.assert_allclose(mix.profiles.values, np.exp(logtheta), rtol=1e-8)
+
+        # class probabilities sum to one within each amino acid, or overall
+        sums = mix.profiles.T.groupby(mix._group).sum()
+        np.testing.assert_allclose(sums.values, 1)
+
+
+def test_mixture_posterior():
+    counts = codonw.count_codons(test_seqs)
+    mix = codonw.CodonMixture(2, init=[("cai", 0)]).fit(counts)
+    assert mix.converged
+    np.testing.assert_allclose(mix.posterior.sum(axis=1), 1)
+    np.testing.assert_allclose(mix.predict_proba(counts, nthreads=3), mix.posterior)
+    assert list(mix.profiles.columns) == mix.codons
+
+
+def test_mixture_bad_start():
+    counts = codonw.count_codons(test_seqs)
+    for init in ([("cai", 7)], [("fop", -1)], [("fop", 99)]):
+        with pytest.raises(ValueError):
+            codonw.CodonMixture(2, init=init).fit(counts)
@@ -0,0 +1,60 @@
+"""
+
+codonw-slim codon optimisation
+
+"""
+
+import numpy as np
+import pytest
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def translate(seq):
+    code = codonw.get_reference_code(0)
+    return "".join(code[seq[i:i + 3].upper().replace("T", "U")] for i in range(0, len(seq) - 2, 3))
+
+
+@pytest.fixture
+def proteins():
+    return [translate(s) for s in test_seqs.iloc[:20]]
+
+
+def test_unconstrained_is_best_codons(proteins):
+    df = codonw.optimise_codons(proteins, beam=1)
+    assert (df["Violations"] == 0).all()
+    assert [translate(s) for s in df["seq"]] == proteins
+    # the greedy choice already maximises CAI, so a wide beam cannot improve on it
+    wide = codonw.optimise_codons(proteins, beam=8)
+    np.testing.assert_allclose(wide["CAI"], df["CAI"])
+    assert (df["CAI"] > codonw.compute_metrics(list(test_seqs.iloc[:20]))["CAI"]).all()
+    assert list(df.columns) == ["seq", "CAI", "GC", "Nc", "Violations"]
+
+
+def test_constraints(proteins):
+    free = codonw.optimise_codons(proteins)
+    df = codonw.optimise_codons(proteins, gc_window=30, gc_range=(0.3, 0.6),
+                                forbidden=["GAATTC", "GGTNACC", "CTGCTG"], nthreads=3)
+    assert [translate(s) for s in df["seq"]] == proteins
+    assert (df["CAI"] <= free["CAI"] + 1e-9).all()
+    for seq, v in zip(df["seq"], df["Violations"]):
+        gc = [sum(b in "GC" for b in seq[i:i + 30]) / 30 for i in range(len(seq) - 29)]
+        bad = sum(not 0.3 - 1e-9 <= g <= 0.6 + 1e-9 for g in gc)
+        bad += sum(seq[i:i + 6] in ("GAATTC", "CTGCTG", "CAGCAG") for i in range(len(seq) - 5))
+        bad += sum(seq[i:i + 3] == "GGT" and seq[i + 4:i + 7] == "ACC" for i in range(len(seq) - 6))
+        assert bad == v
+    # the beam avoids violations a greedy choice under the same constraints makes
+    greedy = codonw.optimise_codons(proteins, beam=1, gc_window=30, gc_range=(0.3, 0.6),
+                                    forbidden=["GAATTC", "GGTNACC", "CTGCTG"])
+    assert (df["Violations"] <= greedy["Violations"]).all()
+    assert df["Violations"].sum() < greedy["Violations"].sum()
+
+
+def test_bad_letters_and_custom_weights():
+    w = codonw.usage_weights(codonw.count_codons(test_seqs).sum(axis=0))
+    df = codonw.optimise_codons(["MKV*", "MZK", ""], cai_ref=w)
+    assert df["Violations"].tolist() == [0, -1, 0]
+    assert df["seq"].iloc[1] == "" and np.isnan(df["CAI"].iloc[1])
+    assert translate(df["seq"].iloc[0]) == "MKV*"
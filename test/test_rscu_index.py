@@ -0,0 +1,87 @@
+"""
+
+codonw-slim RSCU nearest neighbour index tests
+
+"""
+
+import numpy as np
+import pytest
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def seq_counts():
+    return np.vstack([np.asarray(codonw.CodonSeq(s).ncod) for s in test_seqs])
+
+
+def test_exhaustive_search_matches_brute_force():
+    counts = seq_counts()
+    rscu = np.vstack([codonw.CodonSeq(s).rscu().values for s in test_seqs])
+    code = codonw.CodonSeq("ATG").genetic_code[1:]
+    dims = [i for i, c in enumerate(code.index)
+            if code[c] != '*' and (code == code[c]).sum() > 1]
+    rscu = rscu[:, dims]
+
+    index = codonw.RSCUIndex.build(counts, nlist=8)
+    assert len(index) == counts.shape[0]
+    assert index.dim == 59
+
+    # probing every cell is an exact search
+    ids, dist = index.query(counts[:10], k=5, nprobe=index.nlist)
+    for q in range(10):
+        d = ((rscu - rscu[q]) ** 2).sum(axis=1)
+        np.testing.assert_allclose(np.sort(d)[:5], dist[q], rtol=1e-4, atol=1e-4)
+        # ties are possible, test_seqs has repeated genes
+        np.testing.assert_allclose(rscu[ids[q, 0]], rscu[q])
+
+
+def test_save_and_load(tmp_path):
+    counts = seq_counts()
+    ids = np.arange(counts.shape[0]) * 10 + 7
+    index = codonw.RSCUIndex.build(counts, ids=ids, nlist=4)
+    fn = tmp_path / "genomes.idx"
+    index.save(fn)
+
+    loaded = codonw.RSCUIndex.load(fn)
+    assert loaded.mapped and not index.mapped
+    assert (len(loaded), loaded.dim, loaded.nlist) == (len(index), index.dim, index.nlist)
+
+    a = index.query(counts, k=3, nprobe=2, nthreads=1)
+    b = loaded.query(counts, k=3, nprobe=2, nthreads=4)
+    np.testing.assert_array_equal(a[0], b[0])
+    np.testing.assert_array_equal(a[1], b[1])
+    assert set(a[0][:, 0]) <= set(ids)
+
+
+def test_load_rejects_bad_codes(tmp_path):
+    fn = tmp_path / "genomes.idx"
+    codonw.RSCUIndex.build(seq_counts(), nlist=4).save(fn)
+    good = fn.read_bytes()
+
+    # the codon of the first dimension and the amino acid of codon 1
+    for offset, value in [(32, 0), (32, 65), (288 + 4, -1), (288 + 4, 22)]:
+        bad = bytearray(good)
+        bad[offset:offset + 4] = np.int32(value).tobytes()
+        fn.write_bytes(bytes(bad))
+        with pytest.raises(IOError):
+            codonw.RSCUIndex.load(fn)
+
+
+def test_load_rejects_bad_offsets(tmp_path):
+    fn = tmp_path / "genomes.idx"
+    counts = seq_counts()
+    codonw.RSCUIndex.build(counts, nlist=4).save(fn)
+    good = fn.read_bytes()
+    # the list offsets follow the header and the 4 x 59 float centroids
+    at = (1024 + 4 * 4 * 59 + 63) // 64 * 64
+    offsets = np.frombuffer(good[at:at + 5 * 8], dtype=np.int64).copy()
+    assert offsets[0] == 0 and offsets[4] == len(counts)
+
+    for list_, value in [(0, 1), (1, 1 << 40), (2, -1), (4, len(counts) + 1)]:
+        bad = offsets.copy()
+        bad[list_] = value
+        fn.write_bytes(good[:at] + bad.tobytes() + good[at + 5 * 8:])
+        with pytest.raises(IOError):
+            codonw.RSCUIndex.load(fn)
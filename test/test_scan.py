@@ -0,0 +1,47 @@
+"""
+
+codonw-slim synonymous variant scan
+
+"""
+
+import numpy as np
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def test_scan_matches_recount():
+    seqs = list(test_seqs.iloc[:3])
+    df = codonw.scan_synonymous(seqs, nthreads=2)
+    code = codonw.get_reference_code(0)
+    syn = code.iloc[1:].map(code.iloc[1:].value_counts())
+
+    for g, seq in enumerate(seqs):
+        rows = df[df["gene"] == g]
+        codons = [seq[k:k + 3].upper().replace("T", "U") for k in range(0, len(seq) - 2, 3)]
+        expected = sum(syn[c] - 1 for c in codons if c in syn.index and code[c] != "*")
+        assert len(rows) == expected
+
+        # every variant keeps the protein and changes one codon
+        sample = rows.iloc[::37]
+        variants = [seq[:p] + alt + seq[p + 3:] for p, alt in zip(sample["pos"], sample["alt"])]
+        for p, ref, alt in zip(sample["pos"], sample["ref"], sample["alt"]):
+            assert seq[p:p + 3].upper() == ref
+            assert code[ref.replace("T", "U")] == code[alt.replace("T", "U")]
+
+        metrics = ["CAI", "Fop", "Nc", "GC3s"]
+        base = codonw.compute_metrics([seq], metrics)
+        recount = codonw.compute_metrics(variants, metrics)
+        delta = recount.values - base.values
+        np.testing.assert_allclose(sample[["dCAI", "dFop", "dNc", "dGC3s"]].values, delta,
+                                   atol=1e-4)
+
+
+def test_scan_edge_cases():
+    df = codonw.scan_synonymous(codonw.SeqBatch(["ATGTGGTAA", "", "CTGNNN"], names=["a", "b", "c"]))
+    # Met, Trp and stop codons have no synonymous variants
+    assert list(df["gene"]) == ["c"] * 5
+    assert set(df["alt"]) == {"TTA", "TTG", "CTT", "CTC", "CTA"}
+    np.testing.assert_allclose(df["dGC3s"], [-1, 0, -1, 0, -1])
+    assert len(codonw.scan_synonymous([])) == 0
@@ -0,0 +1,102 @@
+"""
+
+codonw-slim resident server tests
+
+"""
+
+import struct
+import threading
+
+import numpy as np
+import pytest
+
+import codonw
+
+from test_regression import seq_fn, test_seqs
+
+
+def expected(seqs, fop_ref=0):
+    rows = []
+    for s in seqs:
+        cs = codonw.CodonSeq(s)
+        gc = cs.bases2()
+        rows.append([cs.cai(), cs.fop(fop_ref=fop_ref), cs.enc(), gc["GC3s"], gc["GC"],
+                     gc["Len_sym"], gc["Len_aa"], cs.hydropathy(), cs.aromaticity(),
+                     cs.cbi(fop_ref)])
+    return np.array(rows)
+
+
+def test_server(tmp_path):
+    path = str(tmp_path / "codonw.sock")
+    server = codonw.Server(path, nthreads=2)
+    thread = threading.Thread(target=server.serve_forever, args=(0.05,))
+    thread.start()
+    try:
+        with codonw.ServeClient(path) as client:
+            # pipelined requests, answered in order
+            batches = [test_seqs.iloc[i:i + 7] for i in range(0, 35, 7)]
+            ids = [client.submit(b) for b in batches]
+            fasta = client.submit(open(seq_fn).read(), metrics=["Nc", "CAI"],
+                                  fasta=True, fop_ref=3)
+            fop3 = client.submit(batches[0], metrics=["Fop"], fop_ref=3)
+
+            for rid, b in zip(ids, batches):
+                res = client.result(rid)
+                assert list(res.columns) == codonw.ref_metrics
+                assert (res.index == b.index).all()
+                np.testing.assert_allclose(res.values, expected(b), rtol=1e-6)
+
+            res = client.result(fasta)
+            assert list(res.columns) == ["CAI", "Nc"]
+            np.testing.assert_allclose(res.values, expected(test_seqs)[:, [0, 2]], rtol=1e-6)
+            np.testing.assert_allclose(client.result(fop3)["Fop"],
+                                       expected(batches[0], fop_ref=3)[:, 1], rtol=1e-6)
+
+            stats = client.stats()
+            assert stats["requests"] == 7
+            assert stats["sequences"] == 35 + 7 + len(test_seqs)
+            assert 0 < stats["p50_us"] <= stats["p99_us"] <= stats["max_us"]
+
+            with pytest.raises(ValueError):
+                client.query(["ATG"], genetic_code=100)
+            with pytest.raises(ValueError, match="No such index"):
+                client._wait(client._send(2, struct.pack("=II", 1, 3) + b"ATG", mask=1 << 20))
+
+            # a reply of more than 1 GiB is refused (80 bytes per sequence)
+            nseq = (1 << 30) // 80 + 1
+            rid = client._send(2, np.array([nseq] + [0] * nseq, dtype=np.uint32).tobytes())
+            with pytest.raises(ValueError, match="Reply too large"):
+                client._wait(rid)
+
+            client.shutdown()
+    finally:
+        thread.join(10)
+        server.close()
+    assert not thread.is_alive()
+
+
+def test_limits_and_close(tmp_path):
+    path = str(tmp_path / "codonw.sock")
+    server = codonw.Server(path)
+    thread = threading.Thread(target=server.serve_forever, args=(0.05,))
+    thread.start()
+    try:
+        with codonw.ServeClient(path) as client:
+            # a frame over the limit is answered and the connection closed
+            client.sock.sendall(client._header.pack(1 << 30, 9, 2, 0, 0, 0, 0))
+            with pytest.raises(ValueError, match="Request too large"):
+                client._wait(9)
+            with pytest.raises(ConnectionError):
+                client._wait(10)
+
+        with pytest.raises(RuntimeError):
+            server.serve_forever()
+        # closing from another thread stops serve_forever after its poll
+        server.close()
+        thread.join(10)
+        assert not thread.is_alive()
+        with pytest.raises(OSError):
+            codonw.ServeClient(path)
+    finally:
+        server.close()
+        thread.join(10)
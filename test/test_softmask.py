@@ -0,0 +1,49 @@
+"""
+
+codonw-slim soft-masked counting tests
+
+"""
+
+import numpy as np
+import pytest
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def test_masked_codons():
+    seqs = ["ATGaaaAAAtTT", "atgaaa", "ATGAAANNN", "ATGAa", ""]
+    counts, masked = codonw.count_codons(seqs, soft_mask=True)
+    idx = codonw.ref_codons.index
+
+    np.testing.assert_array_equal(masked, [2, 2, 0, 1, 0])
+    assert counts[0, idx("AUG")] == counts[0, idx("AAA")] == 1
+    assert counts[0].sum() == 2
+    assert counts[1].sum() == 0
+    np.testing.assert_array_equal(counts[2], codonw.count_codons(["ATGAAANNN"])[0])
+
+    # without the mask case does not matter
+    np.testing.assert_array_equal(codonw.count_codons(["atgaaa"]),
+                                  codonw.count_codons(["ATGAAA"]))
+
+
+def test_masked_metrics():
+    upper = list(test_seqs)
+    seqs = [s[:60].lower() + s[60:] for s in upper]
+    df = codonw.compute_metrics(seqs, soft_mask=True)
+    expected = codonw.compute_metrics([s[60:] for s in upper])
+
+    np.testing.assert_array_equal(df["Masked"], 20)
+    np.testing.assert_allclose(df[expected.columns].values, expected.values, equal_nan=True)
+
+    with pytest.raises(ValueError):
+        codonw.compute_metrics(seqs, soft_mask=True, ambiguous=True)
+
+
+def test_masked_dinuc():
+    cseq = codonw.CodonSeq("ATGCaaaaGCAT")
+    din = cseq.dinuc(pct=False, soft_mask=True)
+    assert din.loc["all"].sum() == 6
+    assert din.loc["all", "AA"] == 0
+    assert cseq.dinuc(pct=False).loc["all", "AA"] == 3
@@ -0,0 +1,60 @@
+"""
+
+codonw-slim sparse codon count tests
+
+"""
+
+import numpy as np
+import pandas as pd
+import pytest
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def test_count_codons_sparse():
+    sp = codonw.count_codons_sparse(test_seqs, nthreads=2)
+    assert sp.shape == (len(test_seqs), 65)
+    assert sp.indices.dtype == np.uint16 and sp.data.dtype == np.uint32
+    assert (sp.data > 0).all()
+    np.testing.assert_array_equal(sp.toarray(), codonw.count_codons(test_seqs))
+
+
+def test_codon_pairs():
+    seqs = ["ATGAAAATGAAANNNATGAAA", "", "ATGTG", "AAAAAAAAA"]
+    sp = codonw.count_codons_sparse(seqs, pairs=True)
+    assert sp.shape == (4, 4096)
+
+    def pair(a, b):
+        return (codonw.ref_codons.index(a) - 1) * 64 + codonw.ref_codons.index(b) - 1
+
+    dense = sp.toarray()
+    expected = np.zeros_like(dense)
+    expected[0, pair("AUG", "AAA")] = 3
+    expected[0, pair("AAA", "AUG")] = 1
+    expected[3, pair("AAA", "AAA")] = 2
+    np.testing.assert_array_equal(dense, expected)
+
+
+def test_sparse_metrics():
+    sp = codonw.count_codons_sparse(test_seqs)
+    for kwargs in [{}, dict(cai_ref=2, fop_ref=3, genetic_code=1), dict(fop_ref=["CUG", "AAA"])]:
+        res = sp.metrics(**kwargs)
+        ref = codonw.compute_metrics(test_seqs, **kwargs)
+        pd.testing.assert_frame_equal(res, ref)
+
+
+def test_sparse_rscu():
+    sp = codonw.count_codons_sparse(test_seqs)
+    dense = np.zeros(sp.shape, dtype=np.float32)
+    rows = np.repeat(np.arange(len(sp)), np.diff(sp.indptr))
+    dense[rows, sp.indices] = sp.rscu()
+    for i, s in enumerate(test_seqs):
+        np.testing.assert_array_equal(dense[i, 1:], codonw.CodonSeq(s).rscu().values)
+
+
+def test_bad_indptr():
+    for indptr in ([0, 100000000, 3], [1, 2, 3], [0, 2, 4]):
+        with pytest.raises(ValueError):
+            codonw.SparseCounts(indptr, [1, 2, 3], [1, 1, 1])
@@ -0,0 +1,49 @@
+"""
+
+codonw-slim column result table tests
+
+"""
+
+import numpy as np
+import pandas as pd
+import pytest
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def test_metric_table():
+    seqs = pd.concat([test_seqs] * 40)  # more than one block of genes
+    table = codonw.metric_table(seqs, counts=True, nthreads=2)
+    assert len(table) == len(seqs)
+    assert table.columns == codonw.ref_metrics + codonw.ref_codons[1:]
+    for c in table.columns:
+        assert table[c].flags.c_contiguous and table[c].ctypes.data % 64 == 0
+
+    ref = codonw.compute_metrics(seqs)
+    pd.testing.assert_frame_equal(table.to_pandas()[codonw.ref_metrics], ref)
+    np.testing.assert_array_equal(table.to_pandas()[codonw.ref_codons[1:]].values,
+                                  codonw.count_codons(seqs)[:, 1:])
+
+
+def test_metric_table_subset():
+    arena = codonw.Arena(1 << 20)
+    table = codonw.metric_table(test_seqs, metrics=["GC3s", "CAI"], arena=arena)
+    assert table.columns == ["GC3s", "CAI"]
+    np.testing.assert_array_equal(
+        table["CAI"], codonw.compute_metrics(test_seqs, metrics="CAI")["CAI"].values)
+    table = codonw.metric_table(test_seqs, metrics="Fop", fop_ref=["CUG", "AAA"])
+    ref = codonw.compute_metrics(test_seqs, metrics="Fop", fop_ref=["CUG", "AAA"])
+    np.testing.assert_array_equal(table["Fop"], ref["Fop"].values)
+    assert len(codonw.metric_table([]).columns) == len(codonw.ref_metrics)
+
+
+def test_metric_table_arrow():
+    pa = pytest.importorskip("pyarrow")
+    table = codonw.metric_table(test_seqs, metrics=["CAI", "Nc"])
+    at = table.to_arrow()
+    assert at.column_names == ["name", "CAI", "Nc"]
+    assert at.column("name").to_pylist() == list(test_seqs.index)
+    # columns are shared, not copied
+    assert at.column("CAI").chunk(0).buffers()[1].address == table["CAI"].ctypes.data
@@ -0,0 +1,76 @@
+"""
+
+codonw-slim per-taxon codon usage database
+
+"""
+
+import numpy as np
+import pandas as pd
+import pytest
+
+import codonw
+
+from test_regression import test_seqs
+
+
+@pytest.fixture
+def lineage():
+    # species 1..4 in genera 10, 10, 20, 20 of family 100, one gene unplaced
+    names = ["g{}".format(i) for i in range(len(test_seqs))]
+    species = [1 + i % 4 for i in range(len(names))]
+    df = pd.DataFrame({"species": species,
+                       "genus": [10 if s < 3 else 20 for s in species],
+                       "family": 100}, index=names)
+    df.iloc[-1] = -1
+    return df
+
+
+def fasta(names):
+    return "".join(">{} some description\n{}\n".format(n, s)
+                   for n, s in zip(names, test_seqs)).encode()
+
+
+def test_build_and_lookup(tmp_path, lineage):
+    import io
+    path = tmp_path / "cu.tdb"
+    db = codonw.TaxonDB.build(io.BytesIO(fasta(lineage.index)), lineage, path,
+                              pairs=True, batch_bytes=2000, nthreads=3)
+    counts = codonw.count_codons(test_seqs)
+    placed = lineage["species"].values >= 0
+
+    assert db.ranks == ("species", "genus", "family")
+    np.testing.assert_array_equal(db.ids, [1, 2, 3, 4, 10, 20, 100])
+    assert len(db) == 7 and 10 in db and 5 not in db
+    assert db.rank(20) == "genus" and db.rank(3) == "species"
+
+    for taxid, col in [(2, "species"), (10, "genus"), (100, "family")]:
+        rows = (lineage[col].values == taxid) & placed
+        np.testing.assert_array_equal(db.codon_usage(taxid), counts[rows].sum(axis=0))
+        assert db.n_genes(taxid) == rows.sum()
+
+    pairs = codonw.count_codons_sparse(test_seqs, pairs=True).toarray()
+    np.testing.assert_array_equal(db.pair_usage([100, 1])[0], pairs[placed].sum(axis=0))
+    assert db.codon_usage([4, 1, 4]).shape == (3, 65)
+
+    with pytest.raises(KeyError):
+        db.codon_usage([1, 5])
+
+    # same tables from the builder fed directly in other batches
+    builder = codonw.TaxonDBBuilder(["species", "genus", "family"])
+    ids = lineage.values
+    for start in range(0, len(test_seqs), 7):
+        builder.add(list(test_seqs.iloc[start:start + 7]), ids[start:start + 7], nthreads=2)
+    builder.save(tmp_path / "b.tdb")
+    other = codonw.TaxonDB.load(tmp_path / "b.tdb")
+    assert not other.pairs
+    np.testing.assert_array_equal(other.codon_usage(other.ids), db.codon_usage(db.ids))
+
+    w = codonw.usage_weights(db.codon_usage(100))
+    assert w.max() == 1
+
+
+def test_not_a_store(tmp_path):
+    path = tmp_path / "junk"
+    path.write_bytes(b"x" * 2048)
+    with pytest.raises(IOError):
+        codonw.TaxonDB.load(path)
@@ -0,0 +1,92 @@
+"""
+
+codonw-slim multithreaded stress tests, most useful on a free-threaded
+(no-GIL) interpreter where the threads really run at once
+
+"""
+
+import asyncio
+import sys
+import sysconfig
+from concurrent.futures import ThreadPoolExecutor
+
+import numpy as np
+import pandas as pd
+import pytest
+
+import codonw
+
+from test_regression import test_seqs
+
+nthreads = 8
+
+
+def seq_indices(seq, cai_ref):
+    cs = codonw.CodonSeq(seq)
+    return [cs.cai(cai_ref), cs.fop(), cs.cbi(), cs.enc(), *cs.silent_base_usage().values, *cs.bases2().values,
+            cs.hydropathy(), cs.aromaticity(),
+            *cs.rscu().values, *cs.aa_usage().values, *cs.dinuc(pct=False).values.ravel()]
+
+
+@pytest.mark.skipif(not sysconfig.get_config_var("Py_GIL_DISABLED"), reason="needs a free-threaded build")
+def test_module_is_freethreading_compatible():
+    # importing a module that is not declared compatible turns the GIL on
+    assert not sys._is_gil_enabled()
+
+
+def test_codonseq_threads():
+    # a CAI reference with zero weights, which must not be changed by use
+    w = codonw.fit_cai_weights(codonw.count_codons(test_seqs.iloc[:3]))
+    w_before = w.copy()
+    jobs = [(s, ref) for _ in range(4) for s in test_seqs for ref in (0, 2, w)]
+    serial = [seq_indices(*j) for j in jobs]
+
+    with ThreadPoolExecutor(nthreads) as ex:
+        threaded = list(ex.map(lambda j: seq_indices(*j), jobs))
+
+    np.testing.assert_array_equal(np.array(threaded, dtype=float),
+                                  np.array(serial, dtype=float))
+    pd.testing.assert_series_equal(w, w_before)
+
+
+def test_batch_threads():
+    ref = codonw.compute_metrics(test_seqs, nthreads=1)
+
+    def run(i):
+        if i % 3 == 0:
+            return codonw.compute_metrics(test_seqs, nthreads=2)
+        if i % 3 == 1:
+            return codonw.index_ufuncs(i % 2).cai(codonw.count_codons(test_seqs))
+
+        async def stream():
+            return pd.concat([df async for df in codonw.astream(test_seqs, batch_size=5)])
+        return asyncio.run(stream())
+
+    with ThreadPoolExecutor(nthreads) as ex:
+        res = list(ex.map(run, range(6 * nthreads)))
+
+    for i, r in enumerate(res):
+        if i % 3 == 1:
+            assert r.shape == (len(test_seqs),)
+        else:
+            pd.testing.assert_frame_equal(r, ref)
+
+
+def test_shared_accumulators():
+    counts = codonw.count_codons(test_seqs)
+    bg = codonw.GenomeBackground()
+    coa = codonw.CodonCOA()
+
+    def add(i):
+        bg.add(counts[i::nthreads])
+        coa.partial_fit(counts[i::nthreads], nthreads=1)
+        return coa.transform(counts[:5], nthreads=1).shape
+
+    with ThreadPoolExecutor(nthreads) as ex:
+        assert set(ex.map(add, range(nthreads))) == {(5, 4)}
+
+    serial = codonw.GenomeBackground()
+    serial.add(counts)
+    assert bg.n_genes == serial.n_genes
+    pd.testing.assert_series_equal(bg.codon_usage(), serial.codon_usage())
+    assert coa.n_genes == codonw.CodonCOA().partial_fit(counts).n_genes
@@ -0,0 +1,43 @@
+"""
+
+codonw-slim index ufunc tests
+
+"""
+
+import gc
+
+import numpy as np
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def test_index_ufuncs():
+    counts = codonw.count_codons(test_seqs)
+    seqs = [codonw.CodonSeq(s) for s in test_seqs]
+
+    for dtype in [np.int32, np.int64]:
+        c = counts.astype(dtype)
+        np.testing.assert_allclose(codonw.ufuncs.cai(c), [s.cai() for s in seqs])
+        np.testing.assert_allclose(codonw.ufuncs.cbi(c), [s.cbi() for s in seqs], rtol=1e-6)
+        np.testing.assert_allclose(codonw.ufuncs.fop(c), [s.fop() for s in seqs], rtol=1e-6)
+        np.testing.assert_allclose(codonw.ufuncs.enc(c), [s.enc() for s in seqs], rtol=1e-6)
+
+        naa = codonw.ufuncs.aa_usage(c)
+        np.testing.assert_array_equal(naa, [np.asarray(s.naa) for s in seqs])
+        np.testing.assert_allclose(codonw.ufuncs.rscu_usage(c, naa.astype(dtype)),
+                                   [s.rscu().values for s in seqs], rtol=1e-6)
+        np.testing.assert_allclose(codonw.ufuncs.gc(c), [s.bases2().values for s in seqs])
+
+    # broadcasting over leading dimensions, other references
+    stacked = counts[:30].reshape(5, 6, 65)
+    assert codonw.ufuncs.enc(stacked).shape == (5, 6)
+    fop3 = codonw.index_ufuncs(fop_ref=3).fop(stacked)
+    np.testing.assert_allclose(fop3.ravel(), [s.fop(fop_ref=3) for s in seqs[:30]], rtol=1e-6)
+    assert codonw.index_ufuncs(fop_ref=3) is codonw.index_ufuncs(fop_ref=3)
+
+    # a ufunc outlives the IndexUfuncs that made it
+    fop1 = codonw.IndexUfuncs(fop_ref=1).fop
+    gc.collect()
+    np.testing.assert_allclose(fop1(counts[:30]), [s.fop(fop_ref=1) for s in seqs[:30]], rtol=1e-6)
@@ -0,0 +1,115 @@
+"""
+
+codonw-slim codon usage table reader and writer tests
+
+"""
+
+import numpy as np
+import pandas as pd
+import pytest
+
+import codonw
+
+from test_regression import test_seqs
+
+
+KAZUSA = b"""Escherichia coli K12 [gbbct]: 5 CDS's (1000 codons)
+
+fields: [triplet] [frequency: per thousand] ([number])
+
+UUU 22.1(   22)  UCU  8.4(    8)  UAU 16.2(   16)  UGU  5.2(    5)
+UUC 16.0(   16)  UCC  8.6(    9)  UAC 12.2(   12)  UGC  6.5(    6)
+UUA 13.9(   14)  UCA  7.2(    7)  UAA  2.0(    2)  UGA  1.0(    1)
+UUG 13.7(   14)  UCG  8.9(    9)  UAG  0.2(    0)  UGG 15.2(   15)
+
+CUU 11.0(   11)  CCU  7.0(    7)  CAU 12.9(   13)  CGU 20.9(   21)
+CUC 11.0(   11)  CCC  5.5(    5)  CAC  9.7(   10)  CGC 22.0(   22)
+CUA  3.9(    4)  CCA  8.4(    8)  CAA 15.4(   15)  CGA  3.6(    4)
+CUG 52.6(   53)  CCG 23.2(   23)  CAG 28.8(   29)  CGG  5.4(    5)
+
+AUU 30.3(   30)  ACU  8.9(    9)  AAU 17.7(   18)  AGU  8.7(    9)
+AUC 25.1(   25)  ACC 23.4(   23)  AAC 21.7(   22)  AGC 16.0(   16)
+AUA  4.4(    4)  ACA  7.1(    7)  AAA 33.6(   34)  AGA  2.1(    2)
+AUG 27.8(   28)  ACG 14.4(   14)  AAG 10.3(   10)  AGG  1.2(    1)
+
+GUU 18.3(   18)  GCU 15.3(   15)  GAU 32.1(   32)  GGU 24.7(   25)
+GUC 15.3(   15)  GCC 25.6(   26)  GAC 19.1(   19)  GGC 29.6(   30)
+GUA 10.9(   11)  GCA 20.3(   20)  GAA 39.4(   39)  GGA  8.0(    8)
+GUG 26.3(   26)  GCG 33.7(   34)  GAG 17.8(   18)  GGG 11.1(   11)
+"""
+
+
+def test_read_kazusa():
+    df = codonw.read_usage_tables(KAZUSA, "kazusa")
+    assert df.shape == (1, 64)
+    assert df.index[0].startswith("Escherichia coli K12")
+    assert df.loc[df.index[0], "UUU"] == 22
+    assert df.loc[df.index[0], "GGG"] == 11
+    counts = [int(x.split(")")[0]) for x in KAZUSA.decode().split("(")[3:]]
+    assert len(counts) == 64 and df.values.sum() == sum(counts)
+
+
+GCG = b"""  ecoli.cod  Length: 1000  May 1, 1990 11:10  Check: 1234  ..
+
+AmAcid  Codon     Number    /1000     Fraction   ..
+
+Gly     GGG     17.00     11.48      0.22
+Gly     GGA      7.50      4.73      0.09
+End     TAA      3.00      1.00      1.00
+"""
+
+
+def test_read_gcg():
+    df = codonw.read_usage_tables(GCG + b"\n" + GCG.replace(b"ecoli", b"bsubt"), "gcg")
+    assert df.index.tolist() == ["ecoli.cod  Length: 1000  May 1, 1990 11:10  Check: 1234",
+                                 "bsubt.cod  Length: 1000  May 1, 1990 11:10  Check: 1234"]
+    assert df[["GGG", "GGA", "UAA"]].values.tolist() == [[17, 7.5, 3]] * 2
+    assert df.values.sum() == 27.5 * 2
+
+
+@pytest.mark.parametrize("fmt", codonw.usage_formats)
+def test_round_trip(tmp_path, fmt):
+    counts = codonw.count_codons(test_seqs[:20])[:, 1:]
+    names = ["gene{}".format(i) for i in range(20)]
+    path = tmp_path / "tables.txt"
+
+    codonw.write_usage_tables(path, counts, fmt, names=names)
+    df = codonw.read_usage_tables(path, fmt)
+    assert list(df.index) == names
+    np.testing.assert_array_equal(df.values, counts)
+
+    again = tmp_path / "again.txt"
+    codonw.write_usage_tables(again, df, fmt)
+    assert again.read_bytes() == path.read_bytes()
+
+
+def test_cutg_order():
+    order = ("CGA CGC CGG CGU AGA AGG CUA CUC CUG CUU UUA UUG UCA UCC UCG UCU "
+             "AGC AGU ACA ACC ACG ACU CCA CCC CCG CCU GCA GCC GCG GCU GGA GGC "
+             "GGG GGU GUA GUC GUG GUU AAA AAG AAC AAU CAA CAG CAC CAU GAA GAG "
+             "GAC GAU UAC UAU UGC UGU UUC UUU AUA AUC AUU AUG UGG UGA UAA UAG").split()
+    text = "".join("{}:Species {}: 10\n{}\n".format(i, i, " ".join(str(i * 100 + j) for j in range(64)))
+                   for i in range(1000)).encode()
+    df = codonw.read_usage_tables(text, "cutg")
+    assert df.shape == (1000, 64)
+    assert df.index[7] == "7:Species 7: 10"
+    assert df.loc[df.index[7], order].tolist() == [700 + j for j in range(64)]
+
+
+def test_usage_weights():
+    counts = codonw.count_codons(test_seqs)[:, 1:].sum(axis=0)
+    w = codonw.usage_weights(counts)
+    assert isinstance(w, pd.Series) and w.max() == 1
+    assert w["AUG"] == 1 and w["UGG"] == 1
+    cseq = codonw.CodonSeq(test_seqs.iloc[0])
+    assert 0 < cseq.cai(cai_ref=w) < 1
+
+    tables = codonw.usage_weights(np.vstack([counts, counts * 2]))
+    np.testing.assert_allclose(tables[0], tables[1])
+
+
+def test_no_tables(tmp_path):
+    path = tmp_path / "none.txt"
+    codonw.write_usage_tables(path, np.zeros([0, 64]), "kazusa")
+    assert path.read_bytes() == b""
+    assert codonw.usage_weights(np.zeros([0, 64])).shape == (0, 64)
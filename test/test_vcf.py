@@ -0,0 +1,126 @@
+"""
+
+codonw-slim VCF variant annotation
+
+"""
+
+import gzip
+import io
+import random
+
+import numpy as np
+import pandas as pd
+import pytest
+
+import codonw
+
+COMP = str.maketrans("ACGT", "TGCA")
+METRICS = ["CAI", "Fop", "Nc", "GC3s"]
+DELTAS = ["dCAI", "dFop", "dNc", "dGC3s"]
+
+
+@pytest.fixture
+def model():
+    rng = random.Random(7)
+    genome = {"chr1": "".join(rng.choice("ACGT") for _ in range(600)),
+              "chr2": "".join(rng.choice("ACGT") for _ in range(300))}
+    cds = pd.DataFrame({"gene": ["gA", "gA", "gB", "gB", "gC"],
+                        "chrom": ["chr1", "chr1", "chr1", "chr1", "chr2"],
+                        "start": [201, 101, 301, 421, 11],
+                        "end": [290, 160, 390, 480, 100],
+                        "strand": ["+", "+", "-", "-", "+"]})
+    # genomic position (1-based) of each CDS base, in the gene's direction
+    where = {"gA": [("chr1", p) for p in list(range(101, 161)) + list(range(201, 291))],
+             "gB": [("chr1", p) for p in list(range(480, 420, -1)) + list(range(390, 300, -1))],
+             "gC": [("chr2", p) for p in range(11, 101)]}
+    strand = {"gA": 1, "gB": -1, "gC": 1}
+    seqs = {}
+    for g, places in where.items():
+        bases = "".join(genome[c][p - 1] for c, p in places)
+        seqs[g] = bases if strand[g] > 0 else bases.translate(COMP)
+    return genome, cds, where, strand, seqs
+
+
+def mutate(seq, changes):
+    seq = list(seq)
+    for off, base in changes:
+        seq[off] = base
+    return "".join(seq)
+
+
+def make_vcf(genome, records):
+    lines = ["##fileformat=VCFv4.2",
+             "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\ts1\ts2"]
+    for chrom, pos, ref, alt, gts in records:
+        lines.append("\t".join([chrom, str(pos), ".", ref, alt, ".", "PASS", ".", "GT:DP"] +
+                               [gt + ":10" for gt in gts]))
+    return "\n".join(lines) + "\n"
+
+
+def test_variants(model):
+    genome, cds, where, strand, seqs = model
+    other = {b: [c for c in "ACGT" if c != b] for b in "ACGT"}
+    records = []
+    for p in (101, 105, 159, 203, 288, 305, 333, 479):
+        ref = genome["chr1"][p - 1]
+        records.append(("chr1", p, ref, ",".join(other[ref][:2]), ["0|1", "2|0"]))
+    ref = genome["chr2"][49]
+    records.append(("chr2", 50, ref, other[ref][0], ["1|1", "0/1"]))
+    records.append(("chr2", 51, "AC", "A", ["0|1", "0|0"]))              # indel
+    records.append(("chr1", 20, genome["chr1"][19], "T", ["1|1", "1|1"]))  # not coding
+    records.append(("chrX", 20, "A", "T", ["1|1", "1|1"]))                # no such chromosome
+    bad = other[genome["chr1"][109]][0]
+    records.append(("chr1", 110, bad, genome["chr1"][109], ["1|0", "0|0"]))  # REF mismatch
+
+    df = codonw.annotate_vcf(io.StringIO(make_vcf(genome, records)), cds, genome, nthreads=2)
+    assert len(df) == 8 * 2 + 1 + 1
+    assert list(df.columns[:11]) == ["chrom", "pos", "record", "allele", "gene", "cds_pos",
+                                     "ref", "alt", "ref_aa", "alt_aa", "status"]
+    assert (df["status"] == "ok").sum() == 17
+    bad_row = df[df["status"] == "ref_mismatch"]
+    assert list(bad_row["record"]) == [12] and bad_row[DELTAS].isna().all(axis=None)
+
+    ok = df[df["status"] == "ok"]
+    for row in ok.itertuples():
+        g = row.gene
+        assert where[g][row.cds_pos] == (row.chrom, row.pos)
+        alt = records[row.record][3].split(",")[row.allele - 1]
+        alt = alt if strand[g] > 0 else alt.translate(COMP)
+        variant = mutate(seqs[g], [(row.cds_pos, alt)])
+        start = row.cds_pos - row.cds_pos % 3
+        assert row.ref == seqs[g][start:start + 3] and row.alt == variant[start:start + 3]
+        expected = (codonw.compute_metrics([variant], METRICS).values -
+                    codonw.compute_metrics([seqs[g]], METRICS).values)[0]
+        np.testing.assert_allclose([getattr(row, d) for d in DELTAS], expected, atol=1e-4)
+
+
+def test_haplotypes(model):
+    genome, cds, where, strand, seqs = model
+    base = {p: genome["chr1"][p - 1] for p in (202, 203, 110, 400)}
+    other = {p: "ACGT".replace(b, "") for p, b in base.items()}
+    # two changes in one codon of gA and one in another, on haplotype 0 of s1
+    records = [("chr1", 202, base[202], other[202][0], ["1|0", "0|1"]),
+               ("chr1", 203, base[203], other[203][1], ["1|0", "0|0"]),
+               ("chr1", 110, base[110], other[110][0] + "," + other[110][1], ["2|1", "./."]),
+               ("chr1", 400, base[400], other[400][0], ["1|1", "1|1"])]  # between exons
+    # gzip compressed, read in blocks of a few lines
+    vcf = io.BytesIO(gzip.compress(make_vcf(genome, records).encode()))
+    variants, haps = codonw.annotate_vcf(vcf, cds, genome, haplotypes=True, block_bytes=64)
+
+    assert list(haps.columns) == ["sample", "haplotype", "gene", "variants"] + DELTAS
+    assert len(haps) == 3
+    for row in haps.itertuples():
+        changes = []
+        for i, (chrom, pos, ref, alt, gts) in enumerate(records):
+            gt = gts[["s1", "s2"].index(row.sample)].replace("/", "|").split("|")[row.haplotype]
+            if gt in (".", "0"):
+                continue
+            hit = variants[(variants["record"] == i) & (variants["allele"] == int(gt)) &
+                           (variants["gene"] == row.gene)]
+            for h in hit.itertuples():
+                b = alt.split(",")[h.allele - 1]
+                changes.append((h.cds_pos, b if strand[row.gene] > 0 else b.translate(COMP)))
+        assert row.variants == len(changes) > 0
+        expected = (codonw.compute_metrics([mutate(seqs[row.gene], changes)], METRICS).values -
+                    codonw.compute_metrics([seqs[row.gene]], METRICS).values)[0]
+        np.testing.assert_allclose([getattr(row, d) for d in DELTAS], expected, atol=1e-4)
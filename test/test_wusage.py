@@ -0,0 +1,64 @@
+"""
+
+codonw-slim expression weighted codon usage
+
+"""
+
+import numpy as np
+import pandas as pd
+
+import codonw
+
+from test_regression import test_seqs
+
+
+def test_weighted_tables():
+    rng = np.random.default_rng(3)
+    counts = rng.integers(0, 40, size=(600, 65))
+    weights = rng.gamma(0.5, 100, size=(600, 21))
+    weights[rng.random(weights.shape) < 0.3] = 0
+
+    usage, aa, rscu, metrics = codonw.weighted_usage(counts, weights, nthreads=2)
+    table = weights.T @ counts
+    assert usage.shape == (21, 64) and list(usage.columns) == list(codonw.ref_codons[1:])
+    np.testing.assert_allclose(usage.values, table[:, 1:], rtol=1e-12)
+    np.testing.assert_allclose(aa.values, codonw.ufuncs.aa_usage(table), rtol=1e-12)
+    np.testing.assert_allclose(rscu.values, codonw.ufuncs.rscu_usage(table, codonw.ufuncs.aa_usage(table)),
+                               rtol=1e-12)
+    assert list(metrics.columns) == ["Nc", "GC3s"]
+    np.testing.assert_allclose(metrics["Nc"], codonw.ufuncs.enc(table), rtol=1e-12)
+    np.testing.assert_allclose(metrics["GC3s"], codonw.ufuncs.gc(table)[:, 3], rtol=1e-12)
+
+
+def test_expression_frames():
+    seqs = test_seqs.iloc[:30]
+    counts = pd.DataFrame(codonw.count_codons(list(seqs))[:, 1:], index=seqs.index,
+                          columns=codonw.ref_codons[1:])
+    tpm = pd.DataFrame({"liver": np.linspace(1, 30, 30), "brain": np.zeros(30)}, index=seqs.index)
+    tpm.loc[seqs.index[4], "brain"] = 1.0
+
+    # rows of the weights are taken by gene name
+    usage, aa, rscu, metrics = codonw.weighted_usage(counts, tpm.iloc[::-1], metrics=["CAI", "Nc", "GC3s"])
+    assert list(usage.index) == ["liver", "brain"]
+    np.testing.assert_allclose(usage.loc["brain"], counts.iloc[4])
+    np.testing.assert_allclose(usage.loc["liver"], tpm["liver"] @ counts)
+    np.testing.assert_allclose(aa.loc["brain"], codonw.CodonSeq(seqs.iloc[4]).aa_usage())
+    # a sample of one gene at weight 1 has that gene's indices
+    np.testing.assert_allclose(metrics.loc["brain"],
+                               codonw.compute_metrics([seqs.iloc[4]], ["CAI", "Nc", "GC3s"]).values[0],
+                               atol=1e-4)
+    np.testing.assert_allclose(rscu.loc["brain"], codonw.CodonSeq(seqs.iloc[4]).rscu(), atol=1e-5)
+
+    one = codonw.weighted_usage(counts, tpm["liver"].values)
+    np.testing.assert_allclose(one[0].values[0], usage.loc["liver"])
+
+
+def test_optimal_codon_list():
+    seqs = list(test_seqs.iloc[:40])
+    optimal = ["CUG", "AAA", "GAA", "CGU", "ACC", "GGU", "UUC", "CAG", "GAU", "AAC"]
+
+    # a sample per gene, weight 1, with the optimal codons as a list
+    _, _, _, metrics = codonw.weighted_usage(codonw.count_codons(seqs), np.eye(40)[:, :3],
+                                             metrics=["Fop", "CBI"], fop_ref=optimal)
+    expected = codonw.compute_metrics(seqs[:3], ["Fop", "CBI"], fop_ref=optimal)
+    np.testing.assert_allclose(metrics.values, expected.values, atol=1e-6)